@@ -10,6 +10,8 @@
 #include "user_config.h"
 #include "../drivers/UART_APP.h"
 #include "MQTT_Wrapper.h"
+#include "OTA_Jobs.h"
+#include "OTA_Manager.h"
 
 //----------------------------------------------------------------------------------------------------------------------
 // Local macros
@@ -31,9 +33,19 @@ static void ICACHE_FLASH_ATTR MQTT_ConnectedCallback(uint32* args);
 static void ICACHE_FLASH_ATTR MQTT_DisconnectedCallback(uint32* args);
 static void ICACHE_FLASH_ATTR MQTT_PublishCallback(uint32* args);
 static void ICACHE_FLASH_ATTR MQTT_DataCallback(uint32* args, const char* topic, uint32 topic_len, const char* data, uint32 data_len);
+static void ICACHE_FLASH_ATTR MQTT_SubscribeGroups(MQTT_Client* client);
+static void ICACHE_FLASH_ATTR MQTT_ExecuteCommand(const char* command, const char* data, uint32 data_len);
+static void ICACHE_FLASH_ATTR MQTT_PublishBootTelemetry(void);
 
 static MQTT_Client Client;
 
+// Unique client ID and topic namespace of this device, derived from the chip ID
+static char ClientID[24];
+static char DeviceTopic[MAX_TOPIC_LENGTH];
+
+// the boot telemetry goes out on the first connection only
+static bool IsBootPublished;
+
 MQTT_Client* Get_MQTTClient(void)
 {
     return &Client;
@@ -57,12 +69,94 @@ void ICACHE_FLASH_ATTR MQTT_WiFiConnectCallback(uint8 status)
 static void ICACHE_FLASH_ATTR MQTT_ConnectedCallback(uint32* args)
 {
     MQTT_Client* client = (MQTT_Client*) args;
+    char topic[MAX_TOPIC_LENGTH];
+    bool isRevert;
 
     WriteLine("MQTT: Connected, subscribing and publishing\r\n");
 
+    // Broadcast commands
     MQTT_Subscribe(client, UpdateTopic, 2);
 
     MQTT_Subscribe(client, RevertTopic, 2);
+
+    // Commands addressed to this device only
+    os_sprintf(topic, "%s/+", DeviceTopic);
+
+    MQTT_Subscribe(client, topic, 2);
+
+    // Commands addressed to the groups of this device
+    MQTT_SubscribeGroups(client);
+
+    // Reaching the broker proves the software on trial works
+    isRevert = IsRevertBoot();
+
+    if ((true == ConfirmOTA()) && (true == isRevert))
+    {
+        MQTT_PublishStatus("revertdone", "Revert is completed", 19);
+    }
+
+    // Let the server know which update jobs are done already
+    PublishOTAJobState();
+
+    SetBootPhase(BOOT_PHASE_MQTT);
+
+    MQTT_PublishBootTelemetry();
+}
+
+// Publish how this boot went and how the run before ended, once per boot
+static void ICACHE_FLASH_ATTR MQTT_PublishBootTelemetry(void)
+{
+    BootTelemetry telemetry;
+    char message[TELEMETRY_REPORT_LENGTH];
+
+    if (true == IsBootPublished)
+    {
+        return;
+    }
+
+    IsBootPublished = true;
+
+    GetBootTelemetry(&telemetry, false);
+    FormatBootTelemetry(&telemetry, message);
+    MQTT_PublishStatus("boot", message, os_strlen(message));
+
+    if (true == GetBootTelemetry(&telemetry, true))
+    {
+        FormatBootTelemetry(&telemetry, message);
+        MQTT_PublishStatus("lastboot", message, os_strlen(message));
+    }
+}
+
+static void ICACHE_FLASH_ATTR MQTT_SubscribeGroups(MQTT_Client* client)
+{
+    char topic[MAX_TOPIC_LENGTH];
+    char group[MAX_TOPIC_LENGTH];
+    const char* tag = DeviceGroups;
+    uint32 length;
+
+    while ('\0' != *tag)
+    {
+        for (length = 0; ('\0' != tag[length]) && (',' != tag[length]); length++)
+        {
+        }
+
+        if ((0 != length) && (length < (MAX_TOPIC_LENGTH - sizeof(GroupTopicRoot "//+"))))
+        {
+            os_memcpy(group, tag, length);
+            group[length] = '\0';
+
+            os_sprintf(topic, "%s/%s/+", GroupTopicRoot, group);
+
+            MQTT_Subscribe(client, topic, 2);
+        }
+
+        tag += length;
+
+        if (',' == *tag)
+        {
+            tag++;
+        }
+    }
 }
 
 static void ICACHE_FLASH_ATTR MQTT_DisconnectedCallback(uint32* args)
@@ -85,6 +179,8 @@ static void ICACHE_FLASH_ATTR MQTT_DataCallback(uint32* args, const char* topic,
 
     MQTT_Client* client = (MQTT_Client*) args;
 
+    const char* command;
+
     os_memcpy(topicBuf, topic, topic_len);
 
     topicBuf[topic_len] = 0;
@@ -93,19 +189,79 @@ static void ICACHE_FLASH_ATTR MQTT_DataCallback(uint32* args, const char* topic,
 
     dataBuf[data_len] = 0;
 
-    if (0 == strcmp(topicBuf, UpdateTopic))
+    // Only topics addressed to this device are subscribed, the command is the last topic level
+    command = strrchr(topicBuf, '/');
+
+    MQTT_ExecuteCommand((NULL != command) ? command + 1 : topicBuf, dataBuf, data_len);
+
+    os_free(topicBuf);
+
+    os_free(dataBuf);
+}
+
+static void ICACHE_FLASH_ATTR MQTT_ExecuteCommand(const char* command, const char* data, uint32 data_len)
+{
+    char line[MAX_COMMAND_LENGTH];
+
+    if ((0 == strcmp(command, UpdateCommand)) && (NULL != os_strstr(data, ";"))
+            && (data_len < (sizeof(line) - sizeof("job "))))
     {
-        ParseCommand("fota");
+        os_sprintf(line, "job %s", data);
+        ParseCommand(line);
     }
+    else if (0 == strcmp(command, UpdateCommand))
+    {
+        // an optional payload lists the mirrors to fetch the image from
+        if ((0 != data_len) && (data_len < (sizeof(line) - sizeof("mirrors "))))
+        {
+            os_sprintf(line, "mirrors %s", data);
+            ParseCommand(line);
+        }
 
-    if (0 == strcmp(topicBuf, RevertTopic))
+        ParseCommand("fota");
+    }
+    else if (0 == strcmp(command, RevertCommand))
     {
         ParseCommand("revert");
     }
-
-    os_free(topicBuf);
-
-    os_free(dataBuf);
+    else if (0 == strcmp(command, PrepareCommand))
+    {
+        ParseCommand("warmup");
+    }
+    else if ((0 == strcmp(command, StageCommand)) && (NULL != os_strstr(data, ";"))
+            && (data_len < (sizeof(line) - sizeof("jobbg "))))
+    {
+        os_sprintf(line, "jobbg %s", data);
+        ParseCommand(line);
+    }
+    else if (0 == strcmp(command, StageCommand))
+    {
+        ParseCommand("fotabg");
+    }
+    else if (0 == strcmp(command, BenchCommand))
+    {
+        ParseCommand("fota-bench");
+    }
+    else if (0 == strcmp(command, ScrubCommand))
+    {
+        ParseCommand("scrub");
+    }
+    else if ((0 == strcmp(command, ActivateCommand)) && (data_len < (sizeof(line) - sizeof("activate "))))
+    {
+        // an optional payload schedules the activation, see the activate command
+        os_sprintf(line, "activate %s", data);
+        ParseCommand(line);
+    }
+    else if ((0 == strcmp(command, RateCommand)) && (data_len < (sizeof(line) - sizeof("rate "))))
+    {
+        os_sprintf(line, "rate %s", data);
+        ParseCommand(line);
+    }
+    else if ((0 == strcmp(command, RootCommand)) && (data_len < (sizeof(line) - sizeof("root "))))
+    {
+        os_sprintf(line, "root %s", data);
+        ParseCommand(line);
+    }
 }
 
 void MQTT_PublishTopic(const char* topic, const char* data, int data_length)
@@ -113,11 +269,38 @@ void MQTT_PublishTopic(const char* topic, const char* data, int data_length)
     MQTT_Publish(&Client, topic, data, data_length, 0, 0);
 }
 
+void ICACHE_FLASH_ATTR MQTT_PublishStatus(const char* name, const char* data, int data_length)
+{
+    char topic[MAX_TOPIC_LENGTH];
+
+    os_sprintf(topic, "%s/" StatusTopic "/%s", DeviceTopic, name);
+
+    MQTT_Publish(&Client, topic, data, data_length, 0, 0);
+}
+
+void ICACHE_FLASH_ATTR MQTT_PublishRetainedStatus(const char* name, const char* data, int data_length)
+{
+    char topic[MAX_TOPIC_LENGTH];
+
+    os_sprintf(topic, "%s/" StatusTopic "/%s", DeviceTopic, name);
+
+    MQTT_Publish(&Client, topic, data, data_length, 1, 1);
+}
+
 void ICACHE_FLASH_ATTR MQTT_Init(void)
 {
+    uint32 chipID = system_get_chip_id();
+    char willTopic[MAX_TOPIC_LENGTH];
+
+    os_sprintf(ClientID, "%s-%08x", MQTT_CLIENT_ID, chipID);
+
+    os_sprintf(DeviceTopic, "%s/%08x", TopicRoot, chipID);
+
     MQTT_InitConnection(&Client, MQTT_HOST, MQTT_PORT, DEFAULT_SECURITY);
 
-    MQTT_InitLWT(&Client, "/lwt", "offline", 0, 0);
+    os_sprintf(willTopic, "%s/" StatusTopic "/lwt", DeviceTopic);
+
+    MQTT_InitLWT(&Client, willTopic, "offline", 0, 0);
 
     MQTT_OnConnected(&Client, MQTT_ConnectedCallback);
 
@@ -127,6 +310,6 @@ void ICACHE_FLASH_ATTR MQTT_Init(void)
 
     MQTT_OnData(&Client, MQTT_DataCallback);
 
-    MQTT_InitClient(&Client, MQTT_CLIENT_ID, MQTT_USER, MQTT_PASS, MQTT_KEEPALIVE, MQTT_CLEAN_SESSION);
+    MQTT_InitClient(&Client, ClientID, MQTT_USER, MQTT_PASS, MQTT_KEEPALIVE, MQTT_CLEAN_SESSION);
 }
 
@@ -4,4 +4,16 @@
 
 MQTT_Client* Get_MQTTClient(void);
 
+void ICACHE_FLASH_ATTR MQTT_Init(void);
+
+void ICACHE_FLASH_ATTR MQTT_WiFiConnectCallback(uint8 status);
+
+void MQTT_PublishTopic(const char* topic, const char* data, int data_length);
+
+// Publish to <device topic>/status/<name>
+void ICACHE_FLASH_ATTR MQTT_PublishStatus(const char* name, const char* data, int data_length);
+
+// Publish to <device topic>/status/<name>, retained and at least once
+void ICACHE_FLASH_ATTR MQTT_PublishRetainedStatus(const char* name, const char* data, int data_length);
+
 #endif
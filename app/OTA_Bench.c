@@ -0,0 +1,385 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+#include <mem.h>
+#include <osapi.h>
+#include "OTA_Manager.h"
+#include "OTA_Bench.h"
+#include "MQTT_Wrapper.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define debug
+
+#ifdef debug
+#define WriteLine UART0_Send
+#else
+#define WriteLine
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR OnNetworkPassFinished(bool result, uint8 ROM);
+
+static void ICACHE_FLASH_ATTR StartFlashPass(void);
+
+static void ICACHE_FLASH_ATTR OnFlashStep(void);
+
+static void ICACHE_FLASH_ATTR FinishBench(const char* message);
+
+static void ICACHE_FLASH_ATTR Report(const char* message);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static BenchStatistics* Statistics;
+
+static uint8 Digest[SHA256_SIZE];
+
+static WriteStatus FlashStatus;
+
+static uint8* FlashChunk;
+
+static uint32 FlashLeft;
+
+static os_timer_t FlashTimer;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Clear the statistics for a new pass.
+//
+// PARAMETERS:          BenchStatistics* statistics
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR BenchReset(BenchStatistics* statistics)
+{
+    os_memset(statistics, 0, sizeof(BenchStatistics));
+
+    statistics->Stride = 1;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Account one operation of the pass. Once the samples are full every other one is dropped and
+//                      only every 2nd operation is sampled from then on, so the samples cover the whole pass.
+//
+// PARAMETERS:          BenchStatistics* statistics
+//                      uint32 bytes - bytes transferred by the operation
+//                      uint32 latency - duration of the operation (in us)
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR BenchRecord(BenchStatistics* statistics, uint32 bytes, uint32 latency)
+{
+    uint16 index;
+
+    statistics->Operations++;
+    statistics->Bytes += bytes;
+    statistics->Time += latency;
+
+    if (latency > statistics->MaxLatency)
+    {
+        statistics->MaxLatency = latency;
+    }
+
+    if (++statistics->Skipped < statistics->Stride)
+    {
+        return;
+    }
+
+    statistics->Skipped = 0;
+
+    if (OTA_BENCH_MAX_SAMPLES == statistics->Count)
+    {
+        for (index = 0; index < (OTA_BENCH_MAX_SAMPLES / 2); index++)
+        {
+            statistics->Samples[index] = statistics->Samples[2 * index];
+        }
+
+        statistics->Count = OTA_BENCH_MAX_SAMPLES / 2;
+        statistics->Stride *= 2;
+    }
+
+    statistics->Samples[statistics->Count++] = latency;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Latency percentile of the pass. Sorts the samples, call it once the pass is over.
+//
+// PARAMETERS:          BenchStatistics* statistics
+//                      uint8 percentile - 0 to 100
+//
+// RETURN VALUE:        uint32 - latency (in us), 0 without samples
+//
+//======================================================================================================================
+uint32 ICACHE_FLASH_ATTR BenchPercentile(BenchStatistics* statistics, uint8 percentile)
+{
+    uint16 index;
+    uint16 position;
+    uint32 sample;
+
+    if (0 == statistics->Count)
+    {
+        return 0;
+    }
+
+    // insertion sort, cheap for the few samples and a no-op once sorted
+    for (index = 1; index < statistics->Count; index++)
+    {
+        sample = statistics->Samples[index];
+
+        for (position = index; (0 != position) && (statistics->Samples[position - 1] > sample); position--)
+        {
+            statistics->Samples[position] = statistics->Samples[position - 1];
+        }
+
+        statistics->Samples[position] = sample;
+    }
+
+    return statistics->Samples[((uint32) percentile * (statistics->Count - 1)) / 100];
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Report line of a pass.
+//
+// PARAMETERS:          BenchStatistics* statistics
+//                      const char* name - name of the pass
+//                      char* buffer - at least OTA_BENCH_REPORT_LENGTH characters
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR BenchFormat(BenchStatistics* statistics, const char* name, char* buffer)
+{
+    uint32 rate = 0;
+
+    if (0 != statistics->Time)
+    {
+        rate = (uint32) (((uint64) statistics->Bytes * 1000000) / statistics->Time);
+    }
+
+    os_sprintf(buffer, "%s: %u B/s, %u B in %u ms, latency p50 %u p90 %u p99 %u max %u us", name, rate,
+            statistics->Bytes, statistics->Time / 1000, BenchPercentile(statistics, 50),
+            BenchPercentile(statistics, 90), BenchPercentile(statistics, 99), statistics->MaxLatency);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Measure network and flash throughput of an update separately. The image is downloaded and
+//                      hashed but discarded, then the inactive ROM slot is erased and programmed with a synthetic
+//                      pattern. Results go to UART and <device topic>/status/bench.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if an update or a benchmark is running
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR RunOTABench(void)
+{
+    if (NULL != Statistics)
+    {
+        WriteLine("Benchmark is running\r\n");
+        return false;
+    }
+
+    Statistics = (BenchStatistics*) os_malloc(sizeof(BenchStatistics));
+    if (NULL == Statistics)
+    {
+        WriteLine("No ram!\r\n");
+        return false;
+    }
+
+    BenchReset(Statistics);
+
+    if (false == BenchmarkOTA(Statistics, Digest, (Callback) OnNetworkPassFinished))
+    {
+        os_free(Statistics);
+        Statistics = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         The image is downloaded, report the network pass and go on with the flash pass.
+//
+// PARAMETERS:          bool result - true if the whole image was received
+//                      uint8 ROM - not used
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnNetworkPassFinished(bool result, uint8 ROM)
+{
+    char message[OTA_BENCH_REPORT_LENGTH + (2 * SHA256_SIZE) + 8];
+    uint8 index;
+
+    if (true == result)
+    {
+        BenchFormat(Statistics, "network", message);
+
+        os_strcat(message, ", sha256 ");
+
+        for (index = 0; index < SHA256_SIZE; index++)
+        {
+            os_sprintf(message + os_strlen(message), "%02x", Digest[index]);
+        }
+
+        Report(message);
+    }
+    else
+    {
+        Report("network: download failed");
+    }
+
+    StartFlashPass();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start the synthetic erase and program pass over the inactive ROM slot.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR StartFlashPass(void)
+{
+    uint8 rom = GetUpdateSlot();
+    uint16 index;
+
+    // the staged image is kept
+    if (NO_STAGED_ROM != GetStagedROM(NULL))
+    {
+        FinishBench("flash: skipped, an image is staged");
+        return;
+    }
+
+    if (NO_ROM == rom)
+    {
+        FinishBench("flash: skipped, no ROM slot to update");
+        return;
+    }
+
+    FlashChunk = (uint8*) os_malloc(OTA_BENCH_FLASH_CHUNK);
+    if (NULL == FlashChunk)
+    {
+        FinishBench("flash: no ram");
+        return;
+    }
+
+    for (index = 0; index < OTA_BENCH_FLASH_CHUNK; index++)
+    {
+        FlashChunk[index] = (uint8) index;
+    }
+
+    BenchReset(Statistics);
+
+    // keeps updates off the slot until the pass is over
+    system_upgrade_flag_set(UPGRADE_FLAG_START);
+
+    // the image of the slot is overwritten
+    SetSlotState(rom, SLOT_EMPTY);
+
+    FlashStatus = WriteStatusInit(GetROMAddress(rom));
+    FlashLeft = OTA_BENCH_FLASH_LENGTH;
+
+    os_timer_disarm(&FlashTimer);
+    os_timer_setfn(&FlashTimer, (os_timer_func_t *) OnFlashStep, 0);
+    os_timer_arm(&FlashTimer, OTA_BENCH_STEP_DELAY, 0);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Program the next chunk of the flash pass, through the same path as a downloaded image.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnFlashStep(void)
+{
+    char message[OTA_BENCH_REPORT_LENGTH];
+    uint32 length = (FlashLeft < OTA_BENCH_FLASH_CHUNK) ? FlashLeft : OTA_BENCH_FLASH_CHUNK;
+    uint32 start = system_get_time();
+    bool isOK;
+
+    isOK = WriteFlash(&FlashStatus, FlashChunk, length);
+
+    FlashLeft -= length;
+
+    if ((true == isOK) && (0 == FlashLeft))
+    {
+        isOK = WriteRemainingBytes(&FlashStatus);
+    }
+
+    BenchRecord(Statistics, length, system_get_time() - start);
+
+    if (false == isOK)
+    {
+        FinishBench("flash: write failed");
+        return;
+    }
+
+    if (0 != FlashLeft)
+    {
+        os_timer_arm(&FlashTimer, OTA_BENCH_STEP_DELAY, 0);
+        return;
+    }
+
+    BenchFormat(Statistics, "flash", message);
+    FinishBench(message);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Report the last result and release the benchmark.
+//
+// PARAMETERS:          const char* message
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR FinishBench(const char* message)
+{
+    Report(message);
+
+    if (NULL != FlashChunk)
+    {
+        system_upgrade_flag_set(UPGRADE_FLAG_IDLE);
+
+        os_free(FlashChunk);
+        FlashChunk = NULL;
+    }
+
+    os_free(Statistics);
+    Statistics = NULL;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Send a result to UART and MQTT.
+//
+// PARAMETERS:          const char* message
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR Report(const char* message)
+{
+    WriteLine(message);
+    WriteLine("\r\n");
+
+    MQTT_PublishStatus("bench", message, os_strlen(message));
+}
@@ -0,0 +1,51 @@
+#ifndef __OTA_BENCH_H__
+#define __OTA_BENCH_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include "SHA256.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// latency samples kept per pass, a longer pass keeps every 2nd, 4th, ... sample
+#define OTA_BENCH_MAX_SAMPLES  128
+
+// synthetic flash pass over the inactive ROM slot, programmed in chunks of a received TCP segment
+#define OTA_BENCH_FLASH_LENGTH  0x40000
+#define OTA_BENCH_FLASH_CHUNK   1460
+
+// longest report line, see BenchFormat
+#define OTA_BENCH_REPORT_LENGTH  128
+
+// pause between the flash chunks, keeps WiFi and the watchdog serviced (in ms)
+#define OTA_BENCH_STEP_DELAY  1
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Throughput and latency of one pass, throughput is the transferred bytes over the sum of the latencies
+typedef struct
+{
+    uint32 Samples[OTA_BENCH_MAX_SAMPLES];  // latency of each operation (in us)
+    uint16 Count;
+    uint16 Stride;      // operations per kept sample
+    uint16 Skipped;     // operations since the last kept sample
+    uint32 Operations;
+    uint32 Bytes;
+    uint32 Time;        // sum of the latencies (in us)
+    uint32 MaxLatency;
+} BenchStatistics;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void ICACHE_FLASH_ATTR BenchReset(BenchStatistics* statistics);
+void ICACHE_FLASH_ATTR BenchRecord(BenchStatistics* statistics, uint32 bytes, uint32 latency);
+uint32 ICACHE_FLASH_ATTR BenchPercentile(BenchStatistics* statistics, uint8 percentile);
+void ICACHE_FLASH_ATTR BenchFormat(BenchStatistics* statistics, const char* name, char* buffer);
+bool ICACHE_FLASH_ATTR RunOTABench(void);
+
+#endif
@@ -0,0 +1,317 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <osapi.h>
+#include "OTA_Bundle.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR ParseHeader(BundleStatus* bundle);
+
+static bool ICACHE_FLASH_ATTR StartPart(BundleStatus* bundle);
+
+static bool ICACHE_FLASH_ATTR FinishPart(BundleStatus* bundle);
+
+static bool ICACHE_FLASH_ATTR GetRegion(uint8 type, uint8 index, uint32* address, uint32* size);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Prepare the reception of a bundle.
+//
+// PARAMETERS:          BundleStatus* bundle
+//                      uint32 romAddress - slot the firmware part is written to
+//                      uint8 activeParts - BootConfiguration.ActiveParts, the other regions are written
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR BundleInit(BundleStatus* bundle, uint32 romAddress, uint8 activeParts)
+{
+    os_memset(bundle, 0, sizeof(BundleStatus));
+
+    bundle->ROMAddress = romAddress;
+    bundle->ActiveParts = activeParts;
+    bundle->StagedParts = activeParts;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Program the next chunk of a bundle into the regions of its parts.
+//
+// PARAMETERS:          BundleStatus* bundle
+//                      uint8* data - received chunk
+//                      uint16 length - chunk length
+//
+// RETURN VALUE:        bool - false on a malformed bundle, a part failing verification or a flash error
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR WriteBundle(BundleStatus* bundle, uint8* data, uint16 length)
+{
+    uint16 chunk;
+    uint8 needed;
+    bool isOK;
+
+    while (0 != length)
+    {
+        // inside a part, program it
+        if (0 != bundle->PartLeft)
+        {
+            chunk = (bundle->PartLeft < length) ? bundle->PartLeft : length;
+
+            SHA256Update(&bundle->Hash, data, chunk);
+
+            isOK = (0 != (bundle->Part.Flags & BUNDLE_FLAG_SPARSE)) ?
+                    WriteSparse(&bundle->Sparse, &bundle->Write, data, chunk) : WriteFlash(&bundle->Write, data, chunk);
+
+            if (false == isOK)
+            {
+                return false;
+            }
+
+            data += chunk;
+            length -= chunk;
+            bundle->PartLeft -= chunk;
+
+            if ((0 == bundle->PartLeft) && (false == FinishPart(bundle)))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        // data after the last part
+        if ((true == bundle->IsHeaderParsed) && (0 == bundle->PartsLeft))
+        {
+            return false;
+        }
+
+        // collect the next header
+        needed = (true == bundle->IsHeaderParsed) ? sizeof(BundlePart) : sizeof(BundleHeader);
+        chunk = needed - bundle->RecordCount;
+        chunk = (chunk < length) ? chunk : length;
+
+        os_memcpy(bundle->Record + bundle->RecordCount, data, chunk);
+
+        data += chunk;
+        length -= chunk;
+        bundle->RecordCount += chunk;
+
+        if (needed == bundle->RecordCount)
+        {
+            bundle->RecordCount = 0;
+
+            if (false == ((true == bundle->IsHeaderParsed) ? StartPart(bundle) : ParseHeader(bundle)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check every part of the bundle arrived and was verified.
+//
+// PARAMETERS:          BundleStatus* bundle
+//
+// RETURN VALUE:        bool - true if the bundle is complete
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR FinishBundle(BundleStatus* bundle)
+{
+    return ((true == bundle->IsHeaderParsed) && (0 == bundle->PartsLeft) && (0 == bundle->PartLeft)
+            && (0 == bundle->RecordCount));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check if the bundle carried a part.
+//
+// PARAMETERS:          const BundleStatus* bundle
+//                      uint8 type - BUNDLE_PART_...
+//
+// RETURN VALUE:        bool - true if the part was received and verified
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR HasBundlePart(const BundleStatus* bundle, uint8 type)
+{
+    return (0 != (bundle->ReceivedParts & (1 << type)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Flash address of the part in use, e.g. to read the certificates from. Software on trial
+//                      uses the staged parts.
+//
+// PARAMETERS:          uint8 type - BUNDLE_PART_...
+//
+// RETURN VALUE:        uint32 - flash address, 0 for an unknown part
+//
+//======================================================================================================================
+uint32 ICACHE_FLASH_ATTR GetBundlePartAddress(uint8 type)
+{
+    uint32 address = 0;
+    uint32 size;
+
+    if (BUNDLE_PART_FIRMWARE == type)
+    {
+        return GetROMAddress(GetRunningROM());
+    }
+
+    GetRegion(type, (GetBootParts() >> type) & 1, &address, &size);
+
+    return address;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Check the bundle header collected in the record.
+//
+// PARAMETERS:          BundleStatus* bundle
+//
+// RETURN VALUE:        bool - true for a supported bundle
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ParseHeader(BundleStatus* bundle)
+{
+    BundleHeader header;
+
+    os_memcpy(&header, bundle->Record, sizeof(BundleHeader));
+
+    if ((BUNDLE_MAGIC != header.MagicNumber) || (BUNDLE_VERSION != header.Version) || (0 == header.PartCount)
+            || (BUNDLE_MAX_PARTS < header.PartCount))
+    {
+        return false;
+    }
+
+    bundle->IsHeaderParsed = true;
+    bundle->PartsLeft = header.PartCount;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start writing the part whose header is collected in the record. The firmware goes to the
+//                      ROM slot being updated, the other parts to their region not in use.
+//
+// PARAMETERS:          BundleStatus* bundle
+//
+// RETURN VALUE:        bool - false for an unknown, repeated or oversized part
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR StartPart(BundleStatus* bundle)
+{
+    uint32 address = bundle->ROMAddress;
+    uint32 size = 0;
+
+    os_memcpy(&bundle->Part, bundle->Record, sizeof(BundlePart));
+
+    if ((BUNDLE_MAX_PARTS <= bundle->Part.Type) || (true == HasBundlePart(bundle, bundle->Part.Type)))
+    {
+        return false;
+    }
+
+    if (BUNDLE_PART_FIRMWARE != bundle->Part.Type)
+    {
+        GetRegion(bundle->Part.Type, ((bundle->ActiveParts >> bundle->Part.Type) & 1) ^ 1, &address, &size);
+
+        // sparse parts would need the expanded length to be checked
+        if ((0 != (bundle->Part.Flags & BUNDLE_FLAG_SPARSE)) || (bundle->Part.Length > size))
+        {
+            return false;
+        }
+    }
+
+    bundle->Write = WriteStatusInit(address);
+    os_memset(&bundle->Sparse, 0, sizeof(SparseStatus));
+    SHA256Init(&bundle->Hash);
+
+    bundle->PartLeft = bundle->Part.Length;
+    bundle->PartsLeft--;
+
+    if (0 == bundle->PartLeft)
+    {
+        return FinishPart(bundle);
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         All data of the part is written, verify it.
+//
+// PARAMETERS:          BundleStatus* bundle
+//
+// RETURN VALUE:        bool - false if the part does not match its hash
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR FinishPart(BundleStatus* bundle)
+{
+    uint8 hash[SHA256_SIZE];
+    bool isOK;
+
+    SHA256Final(&bundle->Hash, hash);
+
+    if (0 != os_memcmp(hash, bundle->Part.Hash, SHA256_SIZE))
+    {
+        return false;
+    }
+
+    isOK = (0 != (bundle->Part.Flags & BUNDLE_FLAG_SPARSE)) ?
+            FinishSparse(&bundle->Sparse, &bundle->Write) : WriteRemainingBytes(&bundle->Write);
+
+    if (false == isOK)
+    {
+        return false;
+    }
+
+    bundle->ReceivedParts |= (1 << bundle->Part.Type);
+
+    // the written region takes over on activation
+    if (BUNDLE_PART_FIRMWARE != bundle->Part.Type)
+    {
+        bundle->StagedParts ^= (1 << bundle->Part.Type);
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Flash region of a part.
+//
+// PARAMETERS:          uint8 type - BUNDLE_PART_CERTIFICATES or BUNDLE_PART_CONFIGURATION
+//                      uint8 index - 0 or 1
+//                      uint32* address
+//                      uint32* size
+//
+// RETURN VALUE:        bool - false for a part without regions
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR GetRegion(uint8 type, uint8 index, uint32* address, uint32* size)
+{
+    switch (type)
+    {
+        case BUNDLE_PART_CERTIFICATES:
+        {
+            *size = BUNDLE_CERTIFICATES_SIZE;
+            *address = BUNDLE_CERTIFICATES_REGION + (index * BUNDLE_CERTIFICATES_SIZE);
+            return true;
+        }
+        case BUNDLE_PART_CONFIGURATION:
+        {
+            *size = BUNDLE_CONFIGURATION_SIZE;
+            *address = BUNDLE_CONFIGURATION_REGION + (index * BUNDLE_CONFIGURATION_SIZE);
+            return true;
+        }
+        default:
+        {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef __OTA_BUNDLE_H__
+#define __OTA_BUNDLE_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include "../drivers/Bootloader.h"
+#include "OTA_Sparse.h"
+#include "SHA256.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// "ESPB", bundles are produced by tools/bundle.py
+#define BUNDLE_MAGIC  0x42505345
+
+#define BUNDLE_VERSION  1
+
+#define BUNDLE_PART_FIRMWARE        0
+#define BUNDLE_PART_CERTIFICATES    1
+#define BUNDLE_PART_CONFIGURATION   2
+#define BUNDLE_MAX_PARTS            3
+
+// part data is a sparse image, see OTA_Sparse.h
+#define BUNDLE_FLAG_SPARSE  0x01
+
+// Flash regions of the parts next to the firmware. Each part has two regions, the bit of the part in
+// BootConfiguration.ActiveParts selects the one in use, an update writes the other one.
+#define BUNDLE_CERTIFICATES_REGION   0x200000
+#define BUNDLE_CERTIFICATES_SIZE     0x8000
+#define BUNDLE_CONFIGURATION_REGION  0x210000
+#define BUNDLE_CONFIGURATION_SIZE    0x1000
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Bundle layout, all fields little endian:
+//   BundleHeader, then for each part a BundlePart followed by Length bytes of data.
+// Each part type appears at most once, Hash is the SHA256 of the part data as transferred.
+typedef struct
+{
+    uint32 MagicNumber;
+    uint16 Version;
+    uint16 PartCount;
+} BundleHeader;
+
+typedef struct
+{
+    uint8 Type;
+    uint8 Flags;
+    uint16 Reserved;
+    uint32 Length;
+    uint8 Hash[SHA256_SIZE];
+} BundlePart;
+
+// Position in a bundle, kept between the received chunks
+typedef struct
+{
+    uint8 Record[sizeof(BundlePart)];   // header or part header split between chunks
+    uint8 RecordCount;
+    bool IsHeaderParsed;
+    uint16 PartsLeft;
+    BundlePart Part;        // part being received
+    uint32 PartLeft;        // data bytes left in the part, 0 between parts
+    SHA256Context Hash;
+    WriteStatus Write;      // flash position of the part
+    SparseStatus Sparse;
+    uint32 ROMAddress;      // slot of the firmware part
+    uint8 ActiveParts;      // region selection before the update
+    uint8 StagedParts;      // region selection once activated
+    uint8 ReceivedParts;    // bit per received part type
+} BundleStatus;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void ICACHE_FLASH_ATTR BundleInit(BundleStatus* bundle, uint32 romAddress, uint8 activeParts);
+bool ICACHE_FLASH_ATTR WriteBundle(BundleStatus* bundle, uint8* data, uint16 length);
+bool ICACHE_FLASH_ATTR FinishBundle(BundleStatus* bundle);
+bool ICACHE_FLASH_ATTR HasBundlePart(const BundleStatus* bundle, uint8 type);
+uint32 ICACHE_FLASH_ATTR GetBundlePartAddress(uint8 type);
+
+#endif
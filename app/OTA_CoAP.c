@@ -0,0 +1,659 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+#include <espconn.h>
+#include <osapi.h>
+#include "OTA_CoAP.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define debug
+
+#ifdef debug
+#define WriteLine UART0_Send
+#else
+#define WriteLine
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local types
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct espconn ESPConnection;
+
+// Block-wise GET of one resource, the device sends one confirmable request per block
+typedef struct
+{
+    ESPConnection* Connection;
+    const char* Path;
+    uint32 Offset;          // image offset of the next byte wanted
+    uint8 SZX;              // block size exponent of the next request
+    uint16 MessageID;
+    uint16 Token;
+    uint8 Request[OTA_COAP_MAX_REQUEST];    // kept for retransmissions
+    uint16 RequestLength;
+    uint8 Retransmits;
+    uint32 Timeout;         // current retransmission timeout (in ms)
+    uint32 Generation;      // changes when the transfer stops, a handler may restart it
+    bool IsActive;
+    bool IsHeld;
+    CoAPBlockHandler OnBlock;
+    CoAPErrorHandler OnError;
+} CoAPTransfer;
+
+// Response fields of interest
+typedef struct
+{
+    uint8 Type;
+    uint8 Code;
+    uint16 MessageID;
+    uint8 TokenLength;
+    uint16 Token;
+    bool HasBlock;
+    uint32 Block;           // NUM << 4 | M << 3 | SZX
+    uint32 Size;            // Size2, 0 if absent
+    uint8* Payload;
+    uint16 PayloadLength;
+} CoAPResponse;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR RequestBlock(void);
+
+static void ICACHE_FLASH_ATTR SendRequest(void);
+
+static void ICACHE_FLASH_ATTR OnRetransmitTimeOut(void);
+
+static void ICACHE_FLASH_ATTR OnReceived(void* arg, char* data, unsigned short length);
+
+static void ICACHE_FLASH_ATTR ProcessResponse(CoAPResponse* response);
+
+static bool ICACHE_FLASH_ATTR ParseResponse(uint8* data, uint16 length, CoAPResponse* response);
+
+static void ICACHE_FLASH_ATTR SendEmptyACK(uint16 messageID);
+
+static uint16 ICACHE_FLASH_ATTR WriteOption(uint8* buffer, uint16 delta, const uint8* value, uint16 length);
+
+static uint8 ICACHE_FLASH_ATTR EncodeUInt(uint32 value, uint8* buffer);
+
+static bool ICACHE_FLASH_ATTR ReadExtended(uint8** data, uint8* end, uint16* value);
+
+static void ICACHE_FLASH_ATTR Fail(const char* message);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static CoAPTransfer Transfer;
+
+static os_timer_t RetransmitTimer;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Start fetching a resource block by block (RFC 7959), from any offset. Each block is requested
+//                      once the previous one is handled, lost requests and responses are retransmitted by the
+//                      device, the server keeps no state.
+//
+// PARAMETERS:          struct espconn* connection - allocated with proto.udp, owned by the caller
+//                      ip_addr_t* IP - server address
+//                      uint16 port - server port
+//                      const char* path - resource path, must stay valid during the transfer
+//                      uint32 offset - first byte wanted
+//                      CoAPBlockHandler onBlock
+//                      CoAPErrorHandler onError
+//
+// RETURN VALUE:        bool - false if the UDP connection cannot be created
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR StartCoAPTransfer(struct espconn* connection, ip_addr_t* IP, uint16 port, const char* path,
+        uint32 offset, CoAPBlockHandler onBlock, CoAPErrorHandler onError)
+{
+    StopCoAPTransfer();
+
+    connection->type = ESPCONN_UDP;
+    connection->state = ESPCONN_NONE;
+    connection->proto.udp->local_port = espconn_port();
+    connection->proto.udp->remote_port = port;
+    *(ip_addr_t*) connection->proto.udp->remote_ip = *IP;
+
+    espconn_regist_recvcb(connection, OnReceived);
+
+    if (ESPCONN_OK != espconn_create(connection))
+    {
+        WriteLine("Cannot create the CoAP connection\r\n");
+        return false;
+    }
+
+    Transfer.Connection = connection;
+    Transfer.Path = path;
+    Transfer.Offset = offset;
+    Transfer.SZX = OTA_COAP_BLOCK_SZX;
+    Transfer.IsActive = true;
+    Transfer.IsHeld = false;
+    Transfer.OnBlock = onBlock;
+    Transfer.OnError = onError;
+
+    // start the message IDs at a random point, so requests of an earlier boot are not taken for retransmissions
+    if (0 == Transfer.MessageID)
+    {
+        Transfer.MessageID = (uint16) os_random();
+    }
+
+    RequestBlock();
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Stop the transfer and release the UDP connection, late responses are dropped.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR StopCoAPTransfer(void)
+{
+    os_timer_disarm(&RetransmitTimer);
+
+    if (true == Transfer.IsActive)
+    {
+        espconn_delete(Transfer.Connection);
+    }
+
+    Transfer.IsActive = false;
+    Transfer.Connection = NULL;
+    Transfer.Generation++;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Do not request the next block until ResumeCoAPTransfer, e.g. to rate limit the transfer.
+//                      Call it from the block handler.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR HoldCoAPTransfer(void)
+{
+    Transfer.IsHeld = true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Request the next block of a held transfer.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR ResumeCoAPTransfer(void)
+{
+    if ((true == Transfer.IsActive) && (true == Transfer.IsHeld))
+    {
+        Transfer.IsHeld = false;
+        RequestBlock();
+    }
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Build and send the confirmable GET for the block holding Transfer.Offset.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR RequestBlock(void)
+{
+    uint8 value[4];
+    uint8* request = Transfer.Request;
+    uint16 position = 0;
+    uint16 option = 0;
+    const char* segment = Transfer.Path;
+    const char* separator;
+    uint16 length;
+
+    Transfer.MessageID++;
+    Transfer.Token++;
+
+    request[position++] = (COAP_VERSION << 6) | (COAP_TYPE_CON << 4) | COAP_TOKEN_LENGTH;
+    request[position++] = COAP_CODE_GET;
+    request[position++] = (uint8) (Transfer.MessageID >> 8);
+    request[position++] = (uint8) Transfer.MessageID;
+    request[position++] = (uint8) (Transfer.Token >> 8);
+    request[position++] = (uint8) Transfer.Token;
+
+    // one Uri-Path option per path segment
+    while ('\0' != *segment)
+    {
+        separator = (const char*) os_strchr(segment, '/');
+        length = (NULL != separator) ? (separator - segment) : os_strlen(segment);
+
+        if (0 != length)
+        {
+            position += WriteOption(request + position, COAP_OPTION_URI_PATH - option, (const uint8*) segment,
+                    length);
+            option = COAP_OPTION_URI_PATH;
+        }
+
+        segment += length + ((NULL != separator) ? 1 : 0);
+    }
+
+    // NUM, M = 0 and the wanted size
+    length = EncodeUInt(((Transfer.Offset >> (Transfer.SZX + 4)) << 4) | Transfer.SZX, value);
+    position += WriteOption(request + position, COAP_OPTION_BLOCK2 - option, value, length);
+
+    // ask for the image size with the first block
+    if (0 == Transfer.Offset)
+    {
+        position += WriteOption(request + position, COAP_OPTION_SIZE2 - COAP_OPTION_BLOCK2, value, 0);
+    }
+
+    Transfer.RequestLength = position;
+    Transfer.Retransmits = 0;
+
+    // randomised between ACK_TIMEOUT and 1.5 * ACK_TIMEOUT
+    Transfer.Timeout = OTA_COAP_ACK_TIMEOUT + (os_random() % ((OTA_COAP_ACK_TIMEOUT / 2) + 1));
+
+    SendRequest();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Send the current request and wait for its acknowledgement.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR SendRequest(void)
+{
+    espconn_send(Transfer.Connection, Transfer.Request, Transfer.RequestLength);
+
+    os_timer_disarm(&RetransmitTimer);
+    os_timer_setfn(&RetransmitTimer, (os_timer_func_t *) OnRetransmitTimeOut, 0);
+    os_timer_arm(&RetransmitTimer, Transfer.Timeout, 0);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         No answer in time, retransmit with a doubled timeout or give up.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnRetransmitTimeOut(void)
+{
+    if (OTA_COAP_MAX_RETRANSMIT <= Transfer.Retransmits)
+    {
+        Fail("CoAP server does not answer\r\n");
+        return;
+    }
+
+    Transfer.Retransmits++;
+    Transfer.Timeout *= 2;
+
+    SendRequest();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Datagram from the server.
+//
+// PARAMETERS:          void* arg - connection
+//                      char* data
+//                      unsigned short length
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnReceived(void* arg, char* data, unsigned short length)
+{
+    CoAPResponse response;
+
+    if ((false == Transfer.IsActive) || (false == ParseResponse((uint8*) data, length, &response)))
+    {
+        return;
+    }
+
+    // a separate response has to be acknowledged, duplicates as well
+    if (COAP_TYPE_CON == response.Type)
+    {
+        SendEmptyACK(response.MessageID);
+    }
+
+    if ((COAP_TYPE_ACK == response.Type) || (COAP_TYPE_RST == response.Type))
+    {
+        if (response.MessageID != Transfer.MessageID)
+        {
+            return;
+        }
+
+        if (COAP_TYPE_RST == response.Type)
+        {
+            Fail("CoAP request rejected\r\n");
+            return;
+        }
+
+        // acknowledged, the response follows separately, the request is sent again if it does not
+        if (COAP_CODE_EMPTY == response.Code)
+        {
+            os_timer_disarm(&RetransmitTimer);
+            os_timer_arm(&RetransmitTimer, OTA_COAP_RESPONSE_TIMEOUT, 0);
+            return;
+        }
+    }
+
+    if ((COAP_TOKEN_LENGTH != response.TokenLength) || (response.Token != Transfer.Token))
+    {
+        return;
+    }
+
+    ProcessResponse(&response);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Hand the block to the caller and request the next one.
+//
+// PARAMETERS:          CoAPResponse* response - response to the current request
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ProcessResponse(CoAPResponse* response)
+{
+    uint32 generation = Transfer.Generation;
+    uint32 blockStart = 0;
+    uint32 skip;
+    uint8 SZX = Transfer.SZX;
+    bool isLast = true;
+
+    os_timer_disarm(&RetransmitTimer);
+
+    if (COAP_CODE_CONTENT != response->Code)
+    {
+        Fail("CoAP request failed\r\n");
+        return;
+    }
+
+    // a resource fitting one message comes without Block2
+    if (true == response->HasBlock)
+    {
+        SZX = response->Block & 0x07;
+        isLast = (0 == (response->Block & 0x08));
+        blockStart = (response->Block >> 4) << (SZX + 4);
+    }
+
+    if ((7 == SZX) || (blockStart > Transfer.Offset) || ((blockStart + response->PayloadLength) < Transfer.Offset))
+    {
+        Fail("Unexpected CoAP block\r\n");
+        return;
+    }
+
+    // the first block of a resumed transfer starts before the wanted offset
+    skip = Transfer.Offset - blockStart;
+
+    Transfer.Offset += response->PayloadLength - skip;
+
+    // the server may only lower the block size
+    Transfer.SZX = (SZX < Transfer.SZX) ? SZX : Transfer.SZX;
+
+    Transfer.OnBlock(response->Payload + skip, response->PayloadLength - skip, response->Size, isLast);
+
+    // stopped or restarted by the handler
+    if ((generation != Transfer.Generation) || (true == isLast) || (true == Transfer.IsHeld))
+    {
+        return;
+    }
+
+    RequestBlock();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Decode a message, only the fields a block-wise GET needs.
+//
+// PARAMETERS:          uint8* data
+//                      uint16 length
+//                      CoAPResponse* response
+//
+// RETURN VALUE:        bool - false if the message is malformed
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ParseResponse(uint8* data, uint16 length, CoAPResponse* response)
+{
+    uint8* end = data + length;
+    uint16 option = 0;
+    uint16 delta;
+    uint16 optionLength;
+    uint32 value;
+    uint8 index;
+
+    os_memset(response, 0, sizeof(CoAPResponse));
+
+    if ((4 > length) || (COAP_VERSION != (data[0] >> 6)) || (8 < (data[0] & 0x0F)))
+    {
+        return false;
+    }
+
+    response->Type = (data[0] >> 4) & 0x03;
+    response->TokenLength = data[0] & 0x0F;
+    response->Code = data[1];
+    response->MessageID = (data[2] << 8) | data[3];
+
+    data += 4;
+
+    if ((end - data) < response->TokenLength)
+    {
+        return false;
+    }
+
+    if (COAP_TOKEN_LENGTH == response->TokenLength)
+    {
+        response->Token = (data[0] << 8) | data[1];
+    }
+
+    data += response->TokenLength;
+
+    while ((data < end) && (COAP_PAYLOAD_MARKER != *data))
+    {
+        delta = *data >> 4;
+        optionLength = *data & 0x0F;
+        data++;
+
+        if ((false == ReadExtended(&data, end, &delta)) || (false == ReadExtended(&data, end, &optionLength))
+                || ((end - data) < optionLength))
+        {
+            return false;
+        }
+
+        option += delta;
+
+        value = 0;
+        for (index = 0; (index < optionLength) && (index < 4); index++)
+        {
+            value = (value << 8) | data[index];
+        }
+
+        if (COAP_OPTION_BLOCK2 == option)
+        {
+            response->HasBlock = true;
+            response->Block = value;
+        }
+        else if (COAP_OPTION_SIZE2 == option)
+        {
+            response->Size = value;
+        }
+
+        data += optionLength;
+    }
+
+    if (data < end)
+    {
+        // marker without payload
+        if (1 == (end - data))
+        {
+            return false;
+        }
+
+        response->Payload = data + 1;
+        response->PayloadLength = end - data - 1;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Acknowledge a confirmable message of the server.
+//
+// PARAMETERS:          uint16 messageID
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR SendEmptyACK(uint16 messageID)
+{
+    uint8 message[4];
+
+    message[0] = (COAP_VERSION << 6) | (COAP_TYPE_ACK << 4);
+    message[1] = COAP_CODE_EMPTY;
+    message[2] = (uint8) (messageID >> 8);
+    message[3] = (uint8) messageID;
+
+    espconn_send(Transfer.Connection, message, sizeof(message));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Encode an option after the previous one.
+//
+// PARAMETERS:          uint8* buffer
+//                      uint16 delta - option number minus the previous option number
+//                      const uint8* value
+//                      uint16 length - value length
+//
+// RETURN VALUE:        uint16 - encoded length
+//
+//======================================================================================================================
+static uint16 ICACHE_FLASH_ATTR WriteOption(uint8* buffer, uint16 delta, const uint8* value, uint16 length)
+{
+    uint16 position = 1;
+
+    // values up to 12 fit the nibble, up to 268 take one more byte
+    if (13 > delta)
+    {
+        buffer[0] = delta << 4;
+    }
+    else
+    {
+        buffer[0] = 13 << 4;
+        buffer[position++] = delta - 13;
+    }
+
+    if (13 > length)
+    {
+        buffer[0] |= length;
+    }
+    else
+    {
+        buffer[0] |= 13;
+        buffer[position++] = length - 13;
+    }
+
+    os_memcpy(buffer + position, value, length);
+
+    return position + length;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Encode an option value as a minimal big endian unsigned integer.
+//
+// PARAMETERS:          uint32 value
+//                      uint8* buffer - 4 bytes
+//
+// RETURN VALUE:        uint8 - encoded length, 0 for the value 0
+//
+//======================================================================================================================
+static uint8 ICACHE_FLASH_ATTR EncodeUInt(uint32 value, uint8* buffer)
+{
+    uint8 length = 0;
+    uint8 index;
+
+    while ((length < 4) && (0 != (value >> (8 * length))))
+    {
+        length++;
+    }
+
+    for (index = 0; index < length; index++)
+    {
+        buffer[index] = (uint8) (value >> (8 * (length - index - 1)));
+    }
+
+    return length;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the extended option delta or length following the option header.
+//
+// PARAMETERS:          uint8** data - position, moved past the extension
+//                      uint8* end
+//                      uint16* value - nibble of the option header, replaced by the full value
+//
+// RETURN VALUE:        bool - false if the field is truncated or reserved
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ReadExtended(uint8** data, uint8* end, uint16* value)
+{
+    if (13 == *value)
+    {
+        if (1 > (end - *data))
+        {
+            return false;
+        }
+
+        *value = 13 + **data;
+        (*data)++;
+    }
+    else if (14 == *value)
+    {
+        if (2 > (end - *data))
+        {
+            return false;
+        }
+
+        *value = 269 + (((*data)[0] << 8) | (*data)[1]);
+        (*data) += 2;
+    }
+    else if (15 == *value)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Give up the transfer and tell the caller.
+//
+// PARAMETERS:          const char* message
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR Fail(const char* message)
+{
+    os_timer_disarm(&RetransmitTimer);
+
+    WriteLine(message);
+
+    Transfer.OnError();
+}
@@ -0,0 +1,65 @@
+#ifndef __OTA_COAP_H__
+#define __OTA_COAP_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <espconn.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// Block2 size exponent, blocks are 16 << SZX bytes. 6 (1024 bytes) fills 4 blocks per flash sector and
+// stays below the UDP payload of a single frame. The server may answer with smaller blocks.
+#define OTA_COAP_BLOCK_SZX  6
+
+// confirmable request retransmission, RFC 7252 defaults: the first timeout is ACK_TIMEOUT to
+// 1.5 * ACK_TIMEOUT, doubled on each of the MAX_RETRANSMIT retransmissions (in ms)
+#define OTA_COAP_ACK_TIMEOUT     2000
+#define OTA_COAP_MAX_RETRANSMIT  4
+
+// wait for a separate response once the request is acknowledged, then retransmit (in ms)
+#define OTA_COAP_RESPONSE_TIMEOUT  10000
+
+// request header, token, options and the longest image path
+#define OTA_COAP_MAX_REQUEST  96
+
+#define COAP_VERSION  1
+
+#define COAP_TYPE_CON  0
+#define COAP_TYPE_NON  1
+#define COAP_TYPE_ACK  2
+#define COAP_TYPE_RST  3
+
+#define COAP_CODE_EMPTY    0x00
+#define COAP_CODE_GET      0x01
+#define COAP_CODE_CONTENT  0x45
+
+#define COAP_OPTION_URI_PATH  11
+#define COAP_OPTION_BLOCK2    23
+#define COAP_OPTION_SIZE2     28
+
+#define COAP_PAYLOAD_MARKER  0xFF
+
+#define COAP_TOKEN_LENGTH  2
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// receives the image from the requested offset on, size is the image size if the server sent Size2, 0 otherwise
+typedef void (*CoAPBlockHandler)(uint8* data, uint16 length, uint32 size, bool isLast);
+
+// the server did not answer all retransmissions or refused the request
+typedef void (*CoAPErrorHandler)(void);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR StartCoAPTransfer(struct espconn* connection, ip_addr_t* IP, uint16 port, const char* path,
+        uint32 offset, CoAPBlockHandler onBlock, CoAPErrorHandler onError);
+void ICACHE_FLASH_ATTR StopCoAPTransfer(void);
+void ICACHE_FLASH_ATTR HoldCoAPTransfer(void);
+void ICACHE_FLASH_ATTR ResumeCoAPTransfer(void);
+
+#endif
@@ -0,0 +1,375 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <mem.h>
+#include <osapi.h>
+#include "OTA_HashTree.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static TreeResult ICACHE_FLASH_ATTR CompleteUnit(TreeStatus* tree, TreeWriter writer);
+
+static TreeResult ICACHE_FLASH_ATTR ParseHeader(TreeStatus* tree);
+
+static TreeResult ICACHE_FLASH_ATTR VerifyNode(TreeStatus* tree);
+
+static TreeResult ICACHE_FLASH_ATTR VerifyChunk(TreeStatus* tree, TreeWriter writer);
+
+static void ICACHE_FLASH_ATTR PushNode(TreeStatus* tree, const uint8* hash, uint32 chunks);
+
+static void ICACHE_FLASH_ATTR HashUnit(uint8 prefix, const uint8* data, uint32 length, uint8* hash);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Prepare the verification of a hash tree image.
+//
+// PARAMETERS:          TreeStatus* tree
+//                      const uint8* imageRoot - published image root, NULL to trust the root in the header
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR TreeInit(TreeStatus* tree, const uint8* imageRoot)
+{
+    os_memset(tree, 0, sizeof(TreeStatus));
+
+    tree->UnitLength = sizeof(TreeHeader);
+
+    if (NULL != imageRoot)
+    {
+        os_memcpy(tree->ImageRoot, imageRoot, SHA256_SIZE);
+        tree->HasImageRoot = true;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Verify the next downloaded chunk of the image. Chunks are held back until they match the
+//                      tree, then passed to the writer.
+//
+// PARAMETERS:          TreeStatus* tree
+//                      uint8* data - received chunk
+//                      uint16 length - chunk length
+//                      TreeWriter writer - receives the verified payload
+//
+// RETURN VALUE:        TreeResult - TREE_RETRY if the rest of the data has to be downloaded again from
+//                      tree->Position, the remaining bytes of this chunk are dropped
+//
+//======================================================================================================================
+TreeResult ICACHE_FLASH_ATTR TreeWrite(TreeStatus* tree, uint8* data, uint16 length, TreeWriter writer)
+{
+    TreeResult result;
+    uint8* buffer;
+    uint32 chunk;
+
+    while (0 != length)
+    {
+        // data after the last chunk
+        if ((true == tree->IsHeaderParsed) && (0 == tree->Depth))
+        {
+            return TREE_ERROR;
+        }
+
+        buffer = ((true == tree->IsHeaderParsed) && (1 == tree->Stack[tree->Depth - 1].Chunks)) ?
+                tree->Chunk : tree->Record;
+
+        chunk = tree->UnitLength - tree->UnitCount;
+        chunk = (chunk < length) ? chunk : length;
+
+        os_memcpy(buffer + tree->UnitCount, data, chunk);
+
+        data += chunk;
+        length -= chunk;
+        tree->UnitCount += chunk;
+        tree->Position += chunk;
+
+        if (tree->UnitCount == tree->UnitLength)
+        {
+            result = CompleteUnit(tree, writer);
+
+            if (TREE_OK != result)
+            {
+                return result;
+            }
+        }
+    }
+
+    return TREE_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the whole tree was verified.
+//
+// PARAMETERS:          TreeStatus* tree
+//
+// RETURN VALUE:        bool - true if every chunk was verified and written
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR TreeFinish(TreeStatus* tree)
+{
+    return ((true == tree->IsHeaderParsed) && (0 == tree->Depth) && (tree->PayloadWritten == tree->PayloadLength));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Release the chunk buffer.
+//
+// PARAMETERS:          TreeStatus* tree
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR TreeFree(TreeStatus* tree)
+{
+    if (NULL != tree->Chunk)
+    {
+        os_free(tree->Chunk);
+        tree->Chunk = NULL;
+    }
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         A header, node or chunk is complete, verify it and work out the next one.
+//
+// PARAMETERS:          TreeStatus* tree
+//                      TreeWriter writer
+//
+// RETURN VALUE:        TreeResult
+//
+//======================================================================================================================
+static TreeResult ICACHE_FLASH_ATTR CompleteUnit(TreeStatus* tree, TreeWriter writer)
+{
+    TreeResult result;
+    TreeNode* next;
+
+    if (false == tree->IsHeaderParsed)
+    {
+        result = ParseHeader(tree);
+    }
+    else if (1 == tree->Stack[tree->Depth - 1].Chunks)
+    {
+        result = VerifyChunk(tree, writer);
+    }
+    else
+    {
+        result = VerifyNode(tree);
+    }
+
+    if (TREE_RETRY == result)
+    {
+        // start the unit again
+        tree->Position -= tree->UnitCount;
+        tree->UnitCount = 0;
+        tree->Retries++;
+        return result;
+    }
+
+    if (TREE_OK != result)
+    {
+        return result;
+    }
+
+    tree->UnitCount = 0;
+    tree->Retries = 0;
+
+    if (0 == tree->Depth)
+    {
+        tree->UnitLength = 0;
+        return TREE_OK;
+    }
+
+    next = &tree->Stack[tree->Depth - 1];
+
+    if (1 == next->Chunks)
+    {
+        tree->UnitLength = tree->PayloadLength - tree->PayloadWritten;
+        tree->UnitLength = (tree->UnitLength < tree->ChunkSize) ? tree->UnitLength : tree->ChunkSize;
+    }
+    else
+    {
+        tree->UnitLength = 2 * SHA256_SIZE;
+    }
+
+    return TREE_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the header against the published root and start with the tree root.
+//
+// PARAMETERS:          TreeStatus* tree
+//
+// RETURN VALUE:        TreeResult - TREE_RETRY if the header does not match the published root
+//
+//======================================================================================================================
+static TreeResult ICACHE_FLASH_ATTR ParseHeader(TreeStatus* tree)
+{
+    TreeHeader header;
+    SHA256Context context;
+    uint8 prefix = TREE_ROOT_PREFIX;
+    uint8 hash[SHA256_SIZE];
+    uint32 chunks;
+
+    os_memcpy(&header, tree->Record, sizeof(TreeHeader));
+
+    if (true == tree->HasImageRoot)
+    {
+        SHA256Init(&context);
+        SHA256Update(&context, &prefix, 1);
+        SHA256Update(&context, tree->Record, sizeof(TreeHeader));
+        SHA256Final(&context, hash);
+
+        if (0 != os_memcmp(hash, tree->ImageRoot, SHA256_SIZE))
+        {
+            return TREE_RETRY;
+        }
+    }
+
+    if ((TREE_MAGIC != header.MagicNumber) || (TREE_VERSION != header.Version) || (0 == header.ChunkSize)
+            || (TREE_MAX_CHUNK_SIZE < header.ChunkSize))
+    {
+        return TREE_ERROR;
+    }
+
+    chunks = (header.PayloadLength + header.ChunkSize - 1) / header.ChunkSize;
+
+    if (chunks > (1 << (TREE_MAX_DEPTH - 1)))
+    {
+        return TREE_ERROR;
+    }
+
+    tree->Chunk = (uint8*) os_malloc(header.ChunkSize);
+    if (NULL == tree->Chunk)
+    {
+        return TREE_ERROR;
+    }
+
+    tree->ChunkSize = header.ChunkSize;
+    tree->PayloadLength = header.PayloadLength;
+    tree->IsHeaderParsed = true;
+
+    if (0 != chunks)
+    {
+        PushNode(tree, header.TreeRoot, chunks);
+    }
+
+    return TREE_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the child hashes of the next inner node, both children are then waiting for
+//                      verification, the left one first.
+//
+// PARAMETERS:          TreeStatus* tree
+//
+// RETURN VALUE:        TreeResult - TREE_RETRY if the children do not match the node
+//
+//======================================================================================================================
+static TreeResult ICACHE_FLASH_ATTR VerifyNode(TreeStatus* tree)
+{
+    uint8 hash[SHA256_SIZE];
+    uint32 chunks = tree->Stack[tree->Depth - 1].Chunks;
+    uint32 left = 1;
+
+    HashUnit(TREE_NODE_PREFIX, tree->Record, 2 * SHA256_SIZE, hash);
+
+    if (0 != os_memcmp(hash, tree->Stack[tree->Depth - 1].Hash, SHA256_SIZE))
+    {
+        return TREE_RETRY;
+    }
+
+    // largest power of 2 below the chunk count
+    while ((left << 1) < chunks)
+    {
+        left <<= 1;
+    }
+
+    tree->Depth--;
+
+    PushNode(tree, tree->Record + SHA256_SIZE, chunks - left);
+
+    PushNode(tree, tree->Record, left);
+
+    return TREE_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the next chunk of the payload and pass it on.
+//
+// PARAMETERS:          TreeStatus* tree
+//                      TreeWriter writer
+//
+// RETURN VALUE:        TreeResult - TREE_RETRY if the chunk does not match its leaf
+//
+//======================================================================================================================
+static TreeResult ICACHE_FLASH_ATTR VerifyChunk(TreeStatus* tree, TreeWriter writer)
+{
+    uint8 hash[SHA256_SIZE];
+
+    HashUnit(TREE_LEAF_PREFIX, tree->Chunk, tree->UnitLength, hash);
+
+    if (0 != os_memcmp(hash, tree->Stack[tree->Depth - 1].Hash, SHA256_SIZE))
+    {
+        return TREE_RETRY;
+    }
+
+    tree->Depth--;
+
+    if (false == writer(tree->Chunk, tree->UnitLength))
+    {
+        return TREE_ERROR;
+    }
+
+    tree->PayloadWritten += tree->UnitLength;
+
+    return TREE_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Add a subtree waiting for verification.
+//
+// PARAMETERS:          TreeStatus* tree
+//                      const uint8* hash - subtree hash
+//                      uint32 chunks - chunks in the subtree
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR PushNode(TreeStatus* tree, const uint8* hash, uint32 chunks)
+{
+    os_memcpy(tree->Stack[tree->Depth].Hash, hash, SHA256_SIZE);
+
+    tree->Stack[tree->Depth].Chunks = chunks;
+
+    tree->Depth++;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Hash a leaf or an inner node with its domain prefix.
+//
+// PARAMETERS:          uint8 prefix - TREE_LEAF_PREFIX or TREE_NODE_PREFIX
+//                      const uint8* data
+//                      uint32 length
+//                      uint8* hash - SHA256_SIZE bytes
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR HashUnit(uint8 prefix, const uint8* data, uint32 length, uint8* hash)
+{
+    SHA256Context context;
+
+    SHA256Init(&context);
+
+    SHA256Update(&context, &prefix, 1);
+
+    SHA256Update(&context, data, length);
+
+    SHA256Final(&context, hash);
+}
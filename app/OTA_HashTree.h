@@ -0,0 +1,91 @@
+#ifndef __OTA_HASH_TREE_H__
+#define __OTA_HASH_TREE_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include "SHA256.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// "ESPT", hash tree images are produced by tools/hash_tree.py
+#define TREE_MAGIC  0x54505345
+
+#define TREE_VERSION  1
+
+#define TREE_MAX_CHUNK_SIZE  4096
+
+// subtrees waiting for verification, enough for 2^(TREE_MAX_DEPTH - 1) chunks
+#define TREE_MAX_DEPTH  10
+
+// hash domains, a chunk can never pass for a node
+#define TREE_LEAF_PREFIX  0x00
+#define TREE_NODE_PREFIX  0x01
+#define TREE_ROOT_PREFIX  0x02
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Hash tree image layout, all fields little endian:
+//   TreeHeader, then the tree in pre-order: an inner node is its two child hashes (left, right),
+//   a leaf is the chunk itself. Chunks are ChunkSize bytes of the payload, the last one may be shorter.
+//   leaf = SHA256(0x00 | chunk), node = SHA256(0x01 | left | right), a node over n chunks has
+//   the largest power of 2 below n in its left subtree.
+// The image root SHA256(0x02 | header) covers the tree root and the layout, it is what gets published.
+typedef struct
+{
+    uint32 MagicNumber;
+    uint16 Version;
+    uint16 Reserved;
+    uint32 ChunkSize;
+    uint32 PayloadLength;
+    uint8 TreeRoot[SHA256_SIZE];
+} TreeHeader;
+
+typedef enum
+{
+    TREE_OK,
+    TREE_RETRY,     // a chunk or node failed verification, download again from TreeStatus.Position
+    TREE_ERROR
+} TreeResult;
+
+// receives the verified payload
+typedef bool (*TreeWriter)(uint8* data, uint16 length);
+
+// subtree whose hash is known but whose content is not verified yet
+typedef struct
+{
+    uint8 Hash[SHA256_SIZE];
+    uint32 Chunks;
+} TreeNode;
+
+// Verification state, kept between the received chunks
+typedef struct
+{
+    TreeNode Stack[TREE_MAX_DEPTH];
+    uint8 Depth;
+    uint8 Record[sizeof(TreeHeader) + SHA256_SIZE]; // header or inner node being received
+    uint8* Chunk;           // chunk being received, held back until verified
+    uint32 UnitLength;      // length of the header, node or chunk being received
+    uint32 UnitCount;
+    uint32 Position;        // image offset of the next byte
+    uint32 ChunkSize;
+    uint32 PayloadLength;
+    uint32 PayloadWritten;
+    bool IsHeaderParsed;
+    bool HasImageRoot;
+    uint8 ImageRoot[SHA256_SIZE];   // published root the header must match
+    uint8 Retries;          // failed attempts on the current unit
+} TreeStatus;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void ICACHE_FLASH_ATTR TreeInit(TreeStatus* tree, const uint8* imageRoot);
+TreeResult ICACHE_FLASH_ATTR TreeWrite(TreeStatus* tree, uint8* data, uint16 length, TreeWriter writer);
+bool ICACHE_FLASH_ATTR TreeFinish(TreeStatus* tree);
+void ICACHE_FLASH_ATTR TreeFree(TreeStatus* tree);
+
+#endif
@@ -0,0 +1,405 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <osapi.h>
+#include "user_config.h"
+#include "OTA_Manager.h"
+#include "OTA_Mirrors.h"
+#include "OTA_Jobs.h"
+#include "MQTT_Wrapper.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define debug
+
+#ifdef debug
+#define WriteLine UART0_Send
+#else
+#define WriteLine
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local types
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32 ID;
+    uint32 Version;
+    bool IsBackground;  // staged only, otherwise activated as soon as it is downloaded
+    bool IsActive;
+} UpdateJob;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR ParseJob(const char* request, UpdateJob* job, const char** mirrors);
+
+static bool ICACHE_FLASH_ATTR MergeJob(UpdateJob* job, const char* mirrors);
+
+static bool ICACHE_FLASH_ATTR StartJob(UpdateJob* job, const char* mirrors);
+
+static void ICACHE_FLASH_ATTR OnJobFinished(bool result, uint8 ROM);
+
+static void ICACHE_FLASH_ATTR ActivateLater(void);
+
+static void ICACHE_FLASH_ATTR OnRebootDelay(void);
+
+static const char* ICACHE_FLASH_ATTR GetCompletedState(uint32 version);
+
+static void ICACHE_FLASH_ATTR PublishJob(const UpdateJob* job, const char* state);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static UpdateJob Running;
+
+// latest request for another version than the running job
+static UpdateJob Pending;
+
+static char PendingMirrors[OTA_MAX_MIRRORS * (OTA_MAX_HOST_LENGTH + 7)];
+
+static os_timer_t RebootTimer;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Handle an update job request. A job that is done, running or replaced by a later one is not
+//                      started again, a later job for the running version takes the running download over.
+//
+// PARAMETERS:          const char* request - "job;version[;mirrors]"
+//                      bool isBackground - stage the image only, otherwise it is activated once downloaded
+//
+// RETURN VALUE:        bool - false if the request is malformed or the update could not start
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SubmitOTAJob(const char* request, bool isBackground)
+{
+    UpdateJob job;
+    const char* mirrors;
+    uint32 lastVersion;
+    uint32 lastID;
+
+    if (false == ParseJob(request, &job, &mirrors))
+    {
+        WriteLine("Malformed update job\r\n");
+        return false;
+    }
+
+    job.IsBackground = isBackground;
+    job.IsActive = true;
+
+    lastID = GetLastJob(&lastVersion);
+
+    // redelivered, retained or outdated request
+    if ((NO_JOB != lastID) && (job.ID <= lastID))
+    {
+        PublishJob(&job, (job.ID == lastID) ? GetCompletedState(lastVersion) : JOB_STATE_SUPERSEDED);
+        return true;
+    }
+
+    if (true == Running.IsActive)
+    {
+        return MergeJob(&job, mirrors);
+    }
+
+    return StartJob(&job, mirrors);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Publish the state of the running or the last completed job, e.g. after (re)connecting.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR PublishOTAJobState(void)
+{
+    UpdateJob job;
+
+    if (true == Running.IsActive)
+    {
+        PublishJob(&Running, JOB_STATE_RUNNING);
+        return;
+    }
+
+    job.ID = GetLastJob(&job.Version);
+
+    if (NO_JOB != job.ID)
+    {
+        PublishJob(&job, GetCompletedState(job.Version));
+    }
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Split the job request.
+//
+// PARAMETERS:          const char* request - "job;version[;mirrors]"
+//                      UpdateJob* job - receives ID and version
+//                      const char** mirrors - receives the mirror list, NULL if there is none
+//
+// RETURN VALUE:        bool - false if the request is malformed
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ParseJob(const char* request, UpdateJob* job, const char** mirrors)
+{
+    const char* separator = (const char*) os_strstr(request, ";");
+
+    if ((NULL == separator) || ('\0' == separator[1]))
+    {
+        return false;
+    }
+
+    job->ID = atoi(request);
+    job->Version = atoi(separator + 1);
+
+    *mirrors = (const char*) os_strstr(separator + 1, ";");
+
+    if (NULL != *mirrors)
+    {
+        (*mirrors)++;
+    }
+
+    return (NO_JOB != job->ID);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A job arrived while another one is running, merge it instead of restarting the download.
+//
+// PARAMETERS:          UpdateJob* job
+//                      const char* mirrors - mirror list of the job, may be NULL
+//
+// RETURN VALUE:        bool - true
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR MergeJob(UpdateJob* job, const char* mirrors)
+{
+    if (job->ID <= Running.ID)
+    {
+        PublishJob(job, (job->ID == Running.ID) ? JOB_STATE_RUNNING : JOB_STATE_SUPERSEDED);
+        return true;
+    }
+
+    // a later job for the same version takes the running download over
+    if (job->Version == Running.Version)
+    {
+        PublishJob(&Running, JOB_STATE_SUPERSEDED);
+
+        Running.ID = job->ID;
+        Running.IsBackground = (Running.IsBackground && job->IsBackground);
+
+        PublishJob(&Running, JOB_STATE_RUNNING);
+        return true;
+    }
+
+    // another version waits for the running job, only the latest request is kept
+    if (true == Pending.IsActive)
+    {
+        if (job->ID <= Pending.ID)
+        {
+            PublishJob(job, (job->ID == Pending.ID) ? JOB_STATE_QUEUED : JOB_STATE_SUPERSEDED);
+            return true;
+        }
+
+        PublishJob(&Pending, JOB_STATE_SUPERSEDED);
+    }
+
+    Pending = *job;
+
+    PendingMirrors[0] = '\0';
+
+    if ((NULL != mirrors) && (os_strlen(mirrors) < sizeof(PendingMirrors)))
+    {
+        os_strcpy(PendingMirrors, mirrors);
+    }
+
+    PublishJob(&Pending, JOB_STATE_QUEUED);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start downloading the image of the job, unless the device has it already.
+//
+// PARAMETERS:          UpdateJob* job
+//                      const char* mirrors - mirror list of the job, NULL or empty to keep the current mirrors
+//
+// RETURN VALUE:        bool - false if the update could not start
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR StartJob(UpdateJob* job, const char* mirrors)
+{
+    uint32 lastVersion;
+    bool isStarted;
+
+    // running this version already
+    if (FIRMWARE_VERSION == job->Version)
+    {
+        SetLastJob(job->ID, job->Version);
+        PublishJob(job, JOB_STATE_DONE);
+        return true;
+    }
+
+    // staged by an earlier job
+    if ((NO_JOB != GetLastJob(&lastVersion)) && (lastVersion == job->Version) && (NO_STAGED_ROM != GetStagedROM(NULL)))
+    {
+        SetLastJob(job->ID, job->Version);
+        PublishJob(job, JOB_STATE_STAGED);
+
+        if (false == job->IsBackground)
+        {
+            ActivateLater();
+        }
+        return true;
+    }
+
+    if ((NULL != mirrors) && ('\0' != *mirrors) && (false == SetOTAMirrors(mirrors)))
+    {
+        PublishJob(job, JOB_STATE_FAILED);
+        return false;
+    }
+
+    Running = *job;
+
+    isStarted = (true == job->IsBackground) ?
+            ActivateBackgroundOTA((Callback) OnJobFinished) : ActivateOTA((Callback) OnJobFinished);
+
+    if (false == isStarted)
+    {
+        Running.IsActive = false;
+        PublishJob(job, JOB_STATE_FAILED);
+        return false;
+    }
+
+    PublishJob(&Running, JOB_STATE_RUNNING);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Download of the running job has finished, record it and go on with the queued job.
+//
+// PARAMETERS:          bool result - true if the image was staged
+//                      uint8 ROM - slot holding the new image
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnJobFinished(bool result, uint8 ROM)
+{
+    UpdateJob job = Running;
+    UpdateJob next;
+    SlotMetadata metadata;
+
+    Running.IsActive = false;
+
+    if (true == result)
+    {
+        SetLastJob(job.ID, job.Version);
+
+        // the slot metadata of a new image knows its version from the job
+        if ((true == GetSlotMetadata(ROM, &metadata)) && (SLOT_STAGED == metadata.State))
+        {
+            metadata.Version = job.Version;
+            SetSlotMetadata(ROM, &metadata);
+        }
+    }
+
+    PublishJob(&job, (true == result) ? JOB_STATE_STAGED : JOB_STATE_FAILED);
+
+    // a later job replaces the staged image
+    if (true == Pending.IsActive)
+    {
+        next = Pending;
+        Pending.IsActive = false;
+
+        StartJob(&next, PendingMirrors);
+        return;
+    }
+
+    if ((true == result) && (false == job.IsBackground))
+    {
+        ActivateLater();
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Activate the staged image once the job state went out.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ActivateLater(void)
+{
+    os_timer_disarm(&RebootTimer);
+    os_timer_setfn(&RebootTimer, (os_timer_func_t *) OnRebootDelay, 0);
+    os_timer_arm(&RebootTimer, JOB_REBOOT_DELAY, 0);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Time to reboot into the new version.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnRebootDelay(void)
+{
+    ScheduleOTAActivation(0);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         State of a completed job, depending on what the device runs now.
+//
+// PARAMETERS:          uint32 version - version installed by the job
+//
+// RETURN VALUE:        const char* - job state
+//
+//======================================================================================================================
+static const char* ICACHE_FLASH_ATTR GetCompletedState(uint32 version)
+{
+    if (FIRMWARE_VERSION == version)
+    {
+        return JOB_STATE_DONE;
+    }
+
+    if (NO_STAGED_ROM != GetStagedROM(NULL))
+    {
+        return JOB_STATE_STAGED;
+    }
+
+    return JOB_STATE_REVERTED;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Publish the job state, retained so the server finds it after a reconnect.
+//
+// PARAMETERS:          const UpdateJob* job
+//                      const char* state
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR PublishJob(const UpdateJob* job, const char* state)
+{
+    char message[50];
+
+    os_sprintf(message, "%u,%s,%u", job->ID, state, job->Version);
+
+    WriteLine("Job ");
+    WriteLine(message);
+    WriteLine("\r\n");
+
+    MQTT_PublishRetainedStatus("job", message, os_strlen(message));
+}
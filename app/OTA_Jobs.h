@@ -0,0 +1,32 @@
+#ifndef __OTA_JOBS_H__
+#define __OTA_JOBS_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// An update job request is "job;version[;mirrors]". Job IDs are assigned by the server in increasing order,
+// version is the FIRMWARE_VERSION the job installs. The state of a job is published, retained, to
+// <device topic>/status/job as "job,state,version".
+#define JOB_STATE_RUNNING     "running"
+#define JOB_STATE_QUEUED      "queued"      // waits for the running job of another version
+#define JOB_STATE_STAGED      "staged"      // downloaded, waits for activation
+#define JOB_STATE_DONE        "done"        // running the version of the job
+#define JOB_STATE_SUPERSEDED  "superseded"  // a later job replaced it
+#define JOB_STATE_FAILED      "failed"
+#define JOB_STATE_REVERTED    "reverted"    // completed, but the device runs another version since
+
+// time for the job state to go out before the reboot into the new version (in ms)
+#define JOB_REBOOT_DELAY  1000
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SubmitOTAJob(const char* request, bool isBackground);
+void ICACHE_FLASH_ATTR PublishOTAJobState(void);
+
+#endif
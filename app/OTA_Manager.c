@@ -6,7 +6,17 @@
 #include <espconn.h>
 #include <mem.h>
 #include <osapi.h>
+#include <sntp.h>
+#include <spi_flash.h>
+#include "user_config.h"
 #include "OTA_Manager.h"
+#include "OTA_Mirrors.h"
+#include "OTA_Sparse.h"
+#include "OTA_HashTree.h"
+#include "OTA_Bundle.h"
+#include "OTA_CoAP.h"
+#include "OTA_Scrub.h"
+#include "../drivers/BootImage.h"
 
 //----------------------------------------------------------------------------------------------------------------------
 // Local macros
@@ -19,15 +29,6 @@
 #define WriteLine
 #endif
 
-//----------------------------------------------------------------------------------------------------------------------
-// Constant data
-//----------------------------------------------------------------------------------------------------------------------
-#define UPGRADE_FLAG_IDLE       0x00
-
-#define UPGRADE_FLAG_START      0x01
-
-#define UPGRADE_FLAG_FINISH     0x02
-
 //----------------------------------------------------------------------------------------------------------------------
 // Local types
 //----------------------------------------------------------------------------------------------------------------------
@@ -43,17 +44,58 @@ typedef struct
     ESPConnection* Connection;
     IPAddress IPAddress;
     WriteStatus WriteStatus;
+    SparseStatus Sparse;    // position in a sparse image
+    TreeStatus Tree;        // verification of a hash tree image
+    BundleStatus Bundle;    // position in a bundle
     uint8 ROMSlot;   // rom slot to update, or FLASH_BY_ADDR
     uint32 Length;
     uint32 ContentLength;
+    bool IsStarted;     // false while the connection is only pre-warmed
+    bool IsConnected;
+    bool IsThrottled;   // background download, receive and flash programming are rate limited
+    bool IsHeaderParsed;
+    uint8 Mirror;       // mirror the image is downloaded from
+    uint8 MirrorSwitches;
+    uint32 WindowLength; // downloaded length at the start of the throughput window
+    BenchStatistics* Benchmark; // dry run, the image is hashed and discarded, NULL for an update
+    SHA256Context BenchmarkHash;
+    uint8* BenchmarkDigest;
+    uint32 LastReceiveTime;     // system time of the request or the last received chunk (in us)
+    bool IsKeepAlive;   // the server keeps the connection open after the response
+    uint32 DrainLength; // rest of a given up response to read before the next request
 } UpgradeStatus;
 
+typedef struct
+{
+    uint32 Rate;        // bytes per second, 0 is unlimited
+    sint32 Tokens;      // negative while in debt
+    uint32 LastRefill;  // system time of the last refill (in us)
+} TokenBucket;
+
+// Resolved server address kept in the RTC data area across soft resets
+typedef struct
+{
+    uint32 MagicNumber;
+    uint32 HostHash;
+    uint32 Address;
+    uint32 RTCTime;     // RTC counter when the address was resolved
+    uint32 CheckSum;
+} DNSCacheEntry;
+
 //----------------------------------------------------------------------------------------------------------------------
 // Local function prototypes
 //----------------------------------------------------------------------------------------------------------------------
 
 static void ICACHE_FLASH_ATTR OnDataReceived(void *arg, char *pusrdata, unsigned short length);
 
+#ifdef OTA_COAP
+static void ICACHE_FLASH_ATTR OnCoAPBlock(uint8* data, uint16 length, uint32 size, bool isLast);
+#endif
+
+static void ICACHE_FLASH_ATTR ProcessChunk(uint8* data, uint16 length);
+
+static void ICACHE_FLASH_ATTR CloseConnection(ESPConnection* connection);
+
 static void ICACHE_FLASH_ATTR OnDisconnect(void *arg);
 
 static void ICACHE_FLASH_ATTR OnConnectionReceived(void *arg);
@@ -64,6 +106,80 @@ static void ICACHE_FLASH_ATTR OnConnectionLost(void *arg, ErrorType errorMessage
 
 static void ICACHE_FLASH_ATTR OnDNSFound(const char *name, IPAddress* IP, void *arg);
 
+static bool ICACHE_FLASH_ATTR CreateUpgrade(Callback callback);
+
+static bool ICACHE_FLASH_ATTR CreateConnection(void);
+
+static bool ICACHE_FLASH_ATTR LocateServer(void);
+
+static void ICACHE_FLASH_ATTR OnProbeFinished(uint8 mirror);
+
+static void ICACHE_FLASH_ATTR OnThroughputWindow(void);
+
+static void ICACHE_FLASH_ATTR OnNetworkTimeOut(void);
+
+static void ICACHE_FLASH_ATTR SwitchMirror(void);
+
+static void ICACHE_FLASH_ATTR RetryChunk(void);
+
+static void ICACHE_FLASH_ATTR Reconnect(uint8 mirror);
+
+static void ICACHE_FLASH_ATTR RequestAgain(uint32 drainLength);
+
+static void ICACHE_FLASH_ATTR ParkConnection(ESPConnection* connection, uint8 mirror);
+
+static void ICACHE_FLASH_ATTR TakeIdleConnection(void);
+
+static void ICACHE_FLASH_ATTR CloseIdleConnection(void);
+
+static void ICACHE_FLASH_ATTR OnIdleDisconnect(void* arg);
+
+static void ICACHE_FLASH_ATTR OnIdleConnectionLost(void* arg, ErrorType errorMessage);
+
+static const char* ICACHE_FLASH_ATTR GetImageName(void);
+
+static TreeResult ICACHE_FLASH_ATTR WriteImage(uint8* data, uint16 length);
+
+static bool ICACHE_FLASH_ATTR WritePayload(uint8* data, uint16 length);
+
+static bool ICACHE_FLASH_ATTR FinishImage(void);
+
+static bool ICACHE_FLASH_ATTR RecordStagedImage(void);
+
+static void ICACHE_FLASH_ATTR RecordRunningImage(void);
+
+static bool ICACHE_FLASH_ATTR ReadImageFlash(uint32 address, void* data, uint32 length);
+
+static bool ICACHE_FLASH_ATTR VerifyImage(uint8 rom, SlotMetadata* metadata);
+
+static WriteStatus* ICACHE_FLASH_ATTR GetWriteStatus(void);
+
+static void ICACHE_FLASH_ATTR FreeUpgrade(void);
+
+static bool ICACHE_FLASH_ATTR ResolveHost(void);
+
+static void ICACHE_FLASH_ATTR ConnectToServer(IPAddress* IP);
+
+static void ICACHE_FLASH_ATTR SendRequest(void);
+
+static bool ICACHE_FLASH_ATTR GetCachedAddress(const char* host, IPAddress* address);
+
+static void ICACHE_FLASH_ATTR SetCachedAddress(const char* host, const IPAddress* address);
+
+static uint32 ICACHE_FLASH_ATTR GetHostHash(const char* host);
+
+static void ICACHE_FLASH_ATTR InitBucket(TokenBucket* bucket, uint32 rate);
+
+static uint32 ICACHE_FLASH_ATTR ConsumeTokens(TokenBucket* bucket, uint32 amount);
+
+static void ICACHE_FLASH_ATTR OnThrottleElapsed(void);
+
+static void ICACHE_FLASH_ATTR OnActivationCheck(void);
+
+static void ICACHE_FLASH_ATTR ActivateStagedImage(void);
+
+static void ICACHE_FLASH_ATTR OnTrialExpired(void);
+
 static const char* ICACHE_FLASH_ATTR GetErrorMessage(const ErrorType errorMessage);
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -73,6 +189,26 @@ static UpgradeStatus* Upgrade;
 
 static os_timer_t Timer;
 
+static os_timer_t ThroughputTimer;
+
+static os_timer_t ActivationTimer;
+
+static os_timer_t IdleTimer;
+
+static os_timer_t TrialTimer;
+
+static ESPConnection* IdleConnection;   // kept open after the last download, NULL if none
+
+static uint8 IdleMirror;
+
+static TokenBucket NetworkBucket = { OTA_BACKGROUND_NETWORK_RATE };
+
+static TokenBucket FlashBucket = { OTA_BACKGROUND_FLASH_RATE };
+
+static uint8 ImageRoot[SHA256_SIZE];
+
+static bool HasImageRoot;
+
 //======================================================================================================================
 // EXPORTED FUNCTIONS
 //======================================================================================================================
@@ -87,9 +223,6 @@ static os_timer_t Timer;
 //======================================================================================================================
 bool ICACHE_FLASH_ATTR ActivateOTA(Callback callback)
 {
-    BootConfiguration bootconf;
-    ErrorType errorMessage;
-
     // Check if there is an ongoing update
     if (UPGRADE_FLAG_START == system_upgrade_flag_check())
     {
@@ -97,76 +230,1351 @@ bool ICACHE_FLASH_ATTR ActivateOTA(Callback callback)
         return false;
     }
 
-    // Create upgrade status structure
-    Upgrade = (UpgradeStatus*) os_zalloc(sizeof(UpgradeStatus));
-    if (NULL == Upgrade)
+    // the running software is the staged image, the current ROM is the fallback
+    if (true == IsTrialBoot())
     {
-        WriteLine("No ram!\r\n");
+        WriteLine("Confirm the software on trial first\r\n");
         return false;
     }
 
-    // Store the callback
-    Upgrade->UserCallback = callback;
+    // the staged image is about to be overwritten
+    if (NO_STAGED_ROM != GetStagedROM(NULL))
+    {
+        os_timer_disarm(&ActivationTimer);
+        SetStagedROM(NO_STAGED_ROM, 0);
+    }
 
-    // Get the bootloader configuration
-    bootconf = GetConfiguration();
+    // Take over a pre-warmed connection
+    if (NULL != Upgrade)
+    {
+        Upgrade->UserCallback = callback;
+        Upgrade->IsStarted = true;
 
-    // Get details of rom slot to update
-    Upgrade->ROMSlot = (bootconf.CurrentROM == 0 ? 1 : 0);
+        // the image of the slot is overwritten from now on
+        SetSlotState(Upgrade->ROMSlot, SLOT_EMPTY);
 
-    // Initialize the flash write to the desired ROM
-    Upgrade->WriteStatus = WriteStatusInit(bootconf.ROMS[Upgrade->ROMSlot]);
+        system_upgrade_flag_set(UPGRADE_FLAG_START);
+
+        SetOTAPhase(OTA_PHASE_DOWNLOAD);
+
+        // Otherwise the request is sent as soon as the connection is established
+        if (true == Upgrade->IsConnected)
+        {
+            SendRequest();
+        }
+
+        return true;
+    }
+
+    if (false == CreateUpgrade(callback))
+    {
+        return false;
+    }
+
+    Upgrade->IsStarted = true;
+
+    SetSlotState(Upgrade->ROMSlot, SLOT_EMPTY);
+
+    // Set update flag
+    system_upgrade_flag_set(UPGRADE_FLAG_START);
+
+    if (false == LocateServer())
+    {
+        system_upgrade_flag_set(UPGRADE_FLAG_IDLE);
+        FreeUpgrade();
+        return false;
+    }
+
+    SetOTAPhase(OTA_PHASE_DOWNLOAD);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Download the image to the inactive ROM slot in the background. Network receive and flash
+//                      programming are rate limited, see SetOTARateLimit.
+//
+// PARAMETERS:          Callback callback
+//
+// RETURN VALUE:        bool - true if the download has started
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR ActivateBackgroundOTA(Callback callback)
+{
+    if (false == ActivateOTA(callback))
+    {
+        return false;
+    }
+
+    InitBucket(&NetworkBucket, NetworkBucket.Rate);
+
+    InitBucket(&FlashBucket, FlashBucket.Rate);
+
+    Upgrade->IsThrottled = true;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Download the image without writing it, to measure the network alone. The image is hashed and
+//                      each received chunk is accounted with the time since the previous one. The staged image and
+//                      the inactive ROM slot are left alone.
+//
+// PARAMETERS:          BenchStatistics* statistics - receives the network pass
+//                      uint8* digest - receives the SHA256 of the image, SHA256_SIZE bytes
+//                      Callback callback - result is true if the whole image was received
+//
+// RETURN VALUE:        bool - true if the download has started
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR BenchmarkOTA(BenchStatistics* statistics, uint8* digest, Callback callback)
+{
+    if ((UPGRADE_FLAG_START == system_upgrade_flag_check()) || (NULL != Upgrade))
+    {
+        WriteLine("Ongoing update\r\n");
+        return false;
+    }
+
+    if (false == CreateUpgrade(callback))
+    {
+        return false;
+    }
+
+    Upgrade->IsStarted = true;
+    Upgrade->Benchmark = statistics;
+    Upgrade->BenchmarkDigest = digest;
+
+    SHA256Init(&Upgrade->BenchmarkHash);
+
+    system_upgrade_flag_set(UPGRADE_FLAG_START);
+
+    if (false == LocateServer())
+    {
+        system_upgrade_flag_set(UPGRADE_FLAG_IDLE);
+        FreeUpgrade();
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Change the rate limits of background downloads, takes effect immediately.
+//
+// PARAMETERS:          uint32 networkRate - receive rate in bytes per second, 0 is unlimited
+//                      uint32 flashRate - flash programming rate in bytes per second, 0 is unlimited
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SetOTARateLimit(uint32 networkRate, uint32 flashRate)
+{
+    NetworkBucket.Rate = networkRate;
+
+    FlashBucket.Rate = flashRate;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Set the mirrors serving the update images. With more than one mirror the fastest is probed
+//                      before each download, a slow or stalled download resumes on the next mirror.
+//
+// PARAMETERS:          const char* list - "host[:port][,host[:port]]..."
+//
+// RETURN VALUE:        bool - false during an update or if the list is malformed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetOTAMirrors(const char* list)
+{
+    if (NULL != Upgrade)
+    {
+        WriteLine("Ongoing update\r\n");
+        return false;
+    }
+
+    // the idle connection may lead to a mirror no longer listed
+    CloseIdleConnection();
+
+    return SetMirrors(list);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Set the published root of the hash tree images, the header of the next image must match it.
+//                      Without a root the tree root in the image header is trusted.
+//
+// PARAMETERS:          const char* root - 64 hex digits, empty to forget the root
+//
+// RETURN VALUE:        bool - false during an update or if the root is malformed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetOTARoot(const char* root)
+{
+    uint8 loopIndex;
+    uint8 digit;
+    char character;
+
+    if (NULL != Upgrade)
+    {
+        WriteLine("Ongoing update\r\n");
+        return false;
+    }
+
+    HasImageRoot = false;
+
+    if (0 == os_strlen(root))
+    {
+        return true;
+    }
+
+    if ((2 * SHA256_SIZE) != os_strlen(root))
+    {
+        return false;
+    }
+
+    for (loopIndex = 0; loopIndex < (2 * SHA256_SIZE); loopIndex++)
+    {
+        character = root[loopIndex];
+
+        if ((character >= '0') && (character <= '9'))
+        {
+            digit = character - '0';
+        }
+        else if ((character >= 'a') && (character <= 'f'))
+        {
+            digit = character - 'a' + 10;
+        }
+        else if ((character >= 'A') && (character <= 'F'))
+        {
+            digit = character - 'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+
+        ImageRoot[loopIndex / 2] = (0 == (loopIndex % 2)) ? (digit << 4) : (ImageRoot[loopIndex / 2] | digit);
+    }
+
+    HasImageRoot = true;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start the clock of scheduled activations and pick up a ROM staged before the last reboot.
+//                      Go on with the trial of an activated ROM.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR InitOTAActivation(void)
+{
+    BootConfiguration configuration;
+    char message[60];
+    uint32 activationTime = 0;
+    uint8 stagedROM = GetStagedROM(&activationTime);
+
+    sntp_setservername(0, OTA_SNTP_SERVER);
+    sntp_init();
+
+    switch (CheckTrialBoot(OTA_TRIAL_BOOTS))
+    {
+        case TRIAL_RUNNING:
+        {
+            WriteLine("Software on trial, waiting for confirmation\r\n");
+
+            SetOTAPhase(OTA_PHASE_TRIAL);
+
+            os_timer_disarm(&TrialTimer);
+            os_timer_setfn(&TrialTimer, (os_timer_func_t *) OnTrialExpired, 0);
+            os_timer_arm(&TrialTimer, OTA_TRIAL_DEADLINE, 0);
+            return;
+        }
+        case TRIAL_RETRY:
+        {
+            WriteLine("Trial boot failed, trying again\r\n");
+
+            ActivateStagedImage();
+            return;
+        }
+        case TRIAL_ROLLBACK:
+        {
+            WriteLine("Trial boots failed, staged software dropped\r\n");
+
+            SetOTAPhase(OTA_PHASE_ROLLBACK);
+
+            stagedROM = NO_STAGED_ROM;
+            break;
+        }
+        case TRIAL_REVERT_FAILED:
+        {
+            WriteLine("Reverted software not confirmed, current software kept\r\n");
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    // the current ROM runs, e.g. for the first time after it was flashed or the configuration was migrated
+    RecordRunningImage();
+
+    if (NO_STAGED_ROM == stagedROM)
+    {
+        return;
+    }
+
+    configuration = GetConfiguration();
+
+    // activated by other means, e.g. the revert command
+    if ((stagedROM == configuration.CurrentROM) && (configuration.StagedParts == configuration.ActiveParts))
+    {
+        SetStagedROM(NO_STAGED_ROM, 0);
+        return;
+    }
+
+    os_sprintf(message, "ROM %d staged, activation at %d\r\n", stagedROM, activationTime);
+    WriteLine(message);
+
+    if (0 != activationTime)
+    {
+        os_timer_disarm(&ActivationTimer);
+        os_timer_setfn(&ActivationTimer, (os_timer_func_t *) OnActivationCheck, 0);
+        os_timer_arm(&ActivationTimer, OTA_ACTIVATION_CHECK_INTERVAL, 1);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Switch to the staged ROM and reboot, now or at a maintenance window. The schedule is kept
+//                      in the boot configuration, so it survives a reboot.
+//
+// PARAMETERS:          uint32 activationTime - Unix time to activate at, 0 activates now
+//
+// RETURN VALUE:        bool - false if there is no staged ROM
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR ScheduleOTAActivation(uint32 activationTime)
+{
+    uint8 stagedROM = GetStagedROM(NULL);
+
+    if (NO_STAGED_ROM == stagedROM)
+    {
+        WriteLine("No staged software!\r\n");
+        return false;
+    }
+
+    // returns only if the switch failed
+    if (0 == activationTime)
+    {
+        ActivateStagedImage();
+        return false;
+    }
+
+    if (false == SetActivationTime(activationTime))
+    {
+        return false;
+    }
+
+    os_timer_disarm(&ActivationTimer);
+    os_timer_setfn(&ActivationTimer, (os_timer_func_t *) OnActivationCheck, 0);
+    os_timer_arm(&ActivationTimer, OTA_ACTIVATION_CHECK_INTERVAL, 1);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The software on trial works, keep it as the current ROM.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if no software is on trial or the switch failed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR ConfirmOTA(void)
+{
+    if (false == IsTrialBoot())
+    {
+        return false;
+    }
+
+    os_timer_disarm(&TrialTimer);
+
+    if (false == ConfirmTrialBoot())
+    {
+        WriteLine("Unable to switch ROM...\r\n");
+        return false;
+    }
+
+    WriteLine("Software on trial confirmed\r\n");
+
+    SetBootPhase(BOOT_PHASE_CONFIRMED);
+    SetOTAPhase(OTA_PHASE_CONFIRMED);
+
+    RecordRunningImage();
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Current time of the activation clock.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32 - Unix time, 0 until the clock is synchronised
+//
+//======================================================================================================================
+uint32 ICACHE_FLASH_ATTR GetOTATime(void)
+{
+    return sntp_get_current_timestamp();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Resolve and connect to the update server ahead of the update request, so DNS lookup and
+//                      connection setup are already done when ActivateOTA is called.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true if the connection is being established
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR WarmUpOTA(void)
+{
+    if ((UPGRADE_FLAG_START == system_upgrade_flag_check()) || (NULL != Upgrade))
+    {
+        WriteLine("Ongoing update\r\n");
+        return false;
+    }
+
+    if (false == CreateUpgrade(NULL))
+    {
+        return false;
+    }
+
+    if (false == LocateServer())
+    {
+        FreeUpgrade();
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Allocate the upgrade status and the connection to the update server.
+//
+// PARAMETERS:          Callback callback - user callback, NULL for a pre-warmed connection
+//
+// RETURN VALUE:        bool - true if there was enough RAM
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR CreateUpgrade(Callback callback)
+{
+    BootConfiguration bootconf;
+
+    // Create upgrade status structure
+    Upgrade = (UpgradeStatus*) os_zalloc(sizeof(UpgradeStatus));
+    if (NULL == Upgrade)
+    {
+        WriteLine("No ram!\r\n");
+        return false;
+    }
+
+    // Store the callback
+    Upgrade->UserCallback = callback;
+
+    // Get the bootloader configuration
+    bootconf = GetConfiguration();
+
+    // Get details of rom slot to update, chosen by the slot metadata
+    Upgrade->ROMSlot = GetUpdateSlot();
+
+    if (NO_ROM == Upgrade->ROMSlot)
+    {
+        WriteLine("No ROM slot to update\r\n");
+        os_free(Upgrade);
+        Upgrade = NULL;
+        return false;
+    }
+
+    // Initialize the flash write to the desired ROM
+    Upgrade->WriteStatus = WriteStatusInit(bootconf.ROMS[Upgrade->ROMSlot]);
+
+    TreeInit(&Upgrade->Tree, (true == HasImageRoot) ? ImageRoot : NULL);
+
+    BundleInit(&Upgrade->Bundle, bootconf.ROMS[Upgrade->ROMSlot], bootconf.ActiveParts);
+
+    // continue on the connection of the last download
+    if (NULL != IdleConnection)
+    {
+        TakeIdleConnection();
+    }
+    else if (false == CreateConnection())
+    {
+        os_free(Upgrade);
+        Upgrade = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Allocate the connection to the update server.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true if there was enough RAM
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR CreateConnection(void)
+{
+    // create connection
+    Upgrade->Connection = (ESPConnection*) os_zalloc(sizeof(ESPConnection));
+    if (NULL == Upgrade->Connection)
+    {
+        WriteLine("No ram!\r\n");
+        return false;
+    }
+
+    Upgrade->Connection->proto.tcp = (esp_tcp *) os_zalloc(sizeof(esp_tcp));
+    if (NULL == Upgrade->Connection->proto.tcp)
+    {
+        WriteLine("No ram!\r\n");
+        os_free(Upgrade->Connection);
+        Upgrade->Connection = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Find the update server, probing the mirrors if there is more than one. An open connection
+//                      is used as it is.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if the server cannot be looked up
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR LocateServer(void)
+{
+    // the connection of the last download is still open
+    if (true == Upgrade->IsConnected)
+    {
+        OnConnectionReceived(Upgrade->Connection);
+        return true;
+    }
+
+    // the probes are HTTP requests, CoAP takes the mirrors in order
+#ifndef OTA_COAP
+    if (1 < GetMirrorCount())
+    {
+        return ProbeMirrors(GetImageName(), OnProbeFinished);
+    }
+#endif
+
+    Upgrade->Mirror = 0;
+    return ResolveHost();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Mirror probing is over, download from the fastest mirror.
+//
+// PARAMETERS:          uint8 mirror - fastest mirror, NO_MIRROR if none answered
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeFinished(uint8 mirror)
+{
+    if (NULL == Upgrade)
+    {
+        return;
+    }
+
+    if (NO_MIRROR == mirror)
+    {
+        OnDisconnect(Upgrade->Connection);
+        return;
+    }
+
+    Upgrade->Mirror = mirror;
+
+    ConnectToServer(&GetMirror(mirror)->IPAddress);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the download throughput, move to the next mirror if it is too low.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnThroughputWindow(void)
+{
+    uint32 throughput = ((Upgrade->Length - Upgrade->WindowLength) * 1000) / OTA_THROUGHPUT_WINDOW;
+
+    Upgrade->WindowLength = Upgrade->Length;
+
+    // background downloads are slow on purpose
+    if ((false == Upgrade->IsThrottled) && (throughput < OTA_MIN_THROUGHPUT))
+    {
+        WriteLine("Download too slow\r\n");
+        SwitchMirror();
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         No data from the server in time.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnNetworkTimeOut(void)
+{
+    WriteLine("Download stalled\r\n");
+
+    SwitchMirror();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Continue the download from the next mirror, where the current one has stopped.
+//                      The update fails if there is no other mirror.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR SwitchMirror(void)
+{
+    uint8 next = GetNextMirror(Upgrade->Mirror);
+
+    if ((NO_MIRROR == next) || (OTA_MAX_MIRROR_SWITCHES <= Upgrade->MirrorSwitches))
+    {
+        DeactivateOTA();
+        return;
+    }
+
+    Upgrade->MirrorSwitches++;
+
+    Reconnect(next);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A chunk of the image failed verification, download again from its start, on the same
+//                      connection if the end of the response is near. After OTA_MAX_CHUNK_RETRIES attempts the
+//                      download moves to the next mirror.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR RetryChunk(void)
+{
+    char message[40];
+    uint32 responseLeft = Upgrade->ContentLength - Upgrade->Length;
+
+    Upgrade->Length = Upgrade->Tree.Position;
+
+    os_sprintf(message, "Corrupted chunk at %d\r\n", Upgrade->Length);
+    WriteLine(message);
+
+    if (OTA_MAX_CHUNK_RETRIES < Upgrade->Tree.Retries)
+    {
+        Upgrade->Tree.Retries = 0;
+        SwitchMirror();
+    }
+    else if ((true == Upgrade->IsKeepAlive) && (responseLeft <= OTA_KEEP_ALIVE_MAX_DRAIN))
+    {
+        RequestAgain(responseLeft);
+    }
+    else
+    {
+        Reconnect(Upgrade->Mirror);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Drop the current connection and continue the download from the mirror at Upgrade->Length.
+//
+// PARAMETERS:          uint8 mirror - mirror to continue from
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR Reconnect(uint8 mirror)
+{
+    char message[60];
+    ESPConnection* connection = Upgrade->Connection;
+
+    os_timer_disarm(&Timer);
+
+    os_timer_disarm(&ThroughputTimer);
+
+    // the disconnect callback only frees a connection which is not the current one
+    Upgrade->Connection = NULL;
+
+    if (NULL != connection)
+    {
+        CloseConnection(connection);
+    }
+
+    Upgrade->Mirror = mirror;
+    Upgrade->IsConnected = false;
+    Upgrade->IsHeaderParsed = false;
+    Upgrade->IsKeepAlive = false;
+    Upgrade->DrainLength = 0;
+
+    os_sprintf(message, "Resuming from %s at %d\r\n", GetMirror(mirror)->Host, Upgrade->Length);
+    WriteLine(message);
+
+    if ((false == CreateConnection()) || (false == ResolveHost()))
+    {
+        DeactivateOTA();
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Request the download again from Upgrade->Length on the current connection, as soon as the
+//                      rest of the current response is read.
+//
+// PARAMETERS:          uint32 drainLength - bytes left in the current response
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR RequestAgain(uint32 drainLength)
+{
+    os_timer_disarm(&Timer);
+
+    os_timer_disarm(&ThroughputTimer);
+
+    Upgrade->IsHeaderParsed = false;
+    Upgrade->DrainLength = drainLength;
+
+    if (0 == drainLength)
+    {
+        SendRequest();
+        return;
+    }
+
+    os_timer_setfn(&Timer, (os_timer_func_t *) OnNetworkTimeOut, 0);
+    os_timer_arm(&Timer, OTA_NETWORK_TIMEOUT, 0);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Keep the connection of a finished download open for the next one, until the server closes
+//                      it or OTA_KEEP_ALIVE_TIMEOUT passes.
+//
+// PARAMETERS:          ESPConnection* connection - no longer Upgrade->Connection
+//                      uint8 mirror - mirror it is connected to
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ParkConnection(ESPConnection* connection, uint8 mirror)
+{
+    CloseIdleConnection();
+
+    IdleConnection = connection;
+    IdleMirror = mirror;
+
+    // nothing is requested, anything received is dropped
+    espconn_regist_recvcb(connection, NULL);
+
+    espconn_regist_disconcb(connection, OnIdleDisconnect);
+
+    espconn_regist_reconcb(connection, OnIdleConnectionLost);
+
+    os_timer_disarm(&IdleTimer);
+
+    os_timer_setfn(&IdleTimer, (os_timer_func_t *) CloseIdleConnection, 0);
+
+    os_timer_arm(&IdleTimer, OTA_KEEP_ALIVE_TIMEOUT, 0);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Hand the idle connection to a new upgrade, LocateServer then continues on it.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR TakeIdleConnection(void)
+{
+    os_timer_disarm(&IdleTimer);
+
+    Upgrade->Connection = IdleConnection;
+    Upgrade->Mirror = IdleMirror;
+    Upgrade->IsConnected = true;
+    Upgrade->IsKeepAlive = true;
+
+    IdleConnection = NULL;
+
+    espconn_regist_reconcb(Upgrade->Connection, OnConnectionLost);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Close the idle connection, it is freed by OnIdleDisconnect.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR CloseIdleConnection(void)
+{
+    os_timer_disarm(&IdleTimer);
+
+    if (NULL != IdleConnection)
+    {
+        espconn_disconnect(IdleConnection);
+        IdleConnection = NULL;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Idle connection closed, by the server or by us.
+//
+// PARAMETERS:          void* arg - the connection
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnIdleDisconnect(void* arg)
+{
+    ESPConnection* connection = (ESPConnection*) arg;
+
+    if (connection == IdleConnection)
+    {
+        os_timer_disarm(&IdleTimer);
+        IdleConnection = NULL;
+    }
+
+    os_free(connection->proto.tcp);
+    os_free(connection);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Idle connection aborted, it is closed already.
+//
+// PARAMETERS:          void* arg - the connection
+//                      sint8 errorMessage - not used
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnIdleConnectionLost(void* arg, sint8 errorMessage)
+{
+    OnIdleDisconnect(arg);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Name of the image for the ROM slot to update, the same for every slot with SINGLE_IMAGE.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        const char* - image name
+//
+//======================================================================================================================
+static const char* ICACHE_FLASH_ATTR GetImageName(void)
+{
+#ifdef SINGLE_IMAGE
+    return OTA_ROM OTA_IMAGE_EXTENSION;
+#else
+    return (((GetROMAddress(Upgrade->ROMSlot) % OTA_ROM_BLOCK_SIZE) < OTA_ROM1_OFFSET) ?
+            OTA_ROM0 OTA_IMAGE_EXTENSION : OTA_ROM1 OTA_IMAGE_EXTENSION);
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Process the next downloaded chunk of the image.
+//
+// PARAMETERS:          uint8* data - received chunk
+//                      uint16 length - chunk length
+//
+// RETURN VALUE:        TreeResult - TREE_RETRY if a chunk of the hash tree image failed verification
+//
+//======================================================================================================================
+static TreeResult ICACHE_FLASH_ATTR WriteImage(uint8* data, uint16 length)
+{
+    uint32 now;
+
+    if (NULL != Upgrade->Benchmark)
+    {
+        now = system_get_time();
+
+        SHA256Update(&Upgrade->BenchmarkHash, data, length);
+
+        BenchRecord(Upgrade->Benchmark, length, now - Upgrade->LastReceiveTime);
+
+        Upgrade->LastReceiveTime = now;
+
+        return TREE_OK;
+    }
+
+#ifdef OTA_HASH_TREE
+    return TreeWrite(&Upgrade->Tree, data, length, WritePayload);
+#else
+    return (true == WritePayload(data, length)) ? TREE_OK : TREE_ERROR;
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Program the next chunk of the payload.
+//
+// PARAMETERS:          uint8* data - received chunk
+//                      uint16 length - chunk length
+//
+// RETURN VALUE:        bool - false on a flash error, a malformed sparse image or bundle
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR WritePayload(uint8* data, uint16 length)
+{
+#if defined(OTA_BUNDLE)
+    return WriteBundle(&Upgrade->Bundle, data, length);
+#elif defined(OTA_SPARSE_IMAGE)
+    return WriteSparse(&Upgrade->Sparse, &Upgrade->WriteStatus, data, length);
+#else
+    return WriteFlash(&Upgrade->WriteStatus, data, length);
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The whole image is downloaded, complete the flash write and stage the new software. A bundle
+//                      is staged as a whole, its parts only take over together when the ROM is activated.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true if the image is complete and staged
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR FinishImage(void)
+{
+    if (NULL != Upgrade->Benchmark)
+    {
+        SHA256Final(&Upgrade->BenchmarkHash, Upgrade->BenchmarkDigest);
+        return true;
+    }
+
+    SetOTAPhase(OTA_PHASE_VERIFY);
+
+#ifdef OTA_HASH_TREE
+    if (false == TreeFinish(&Upgrade->Tree))
+    {
+        return false;
+    }
+#endif
+
+#if defined(OTA_BUNDLE)
+    if (false == FinishBundle(&Upgrade->Bundle))
+    {
+        return false;
+    }
+
+    if (false == HasBundlePart(&Upgrade->Bundle, BUNDLE_PART_FIRMWARE))
+    {
+        // the current ROM runs on with the new parts once activated
+        return SetStagedBundle(GetCurrentROM(), Upgrade->Bundle.StagedParts);
+    }
+
+    // keep running the current ROM until the new one is activated
+    return ((true == RecordStagedImage()) && (true == SetStagedBundle(Upgrade->ROMSlot, Upgrade->Bundle.StagedParts)));
+#else
+#ifdef OTA_SPARSE_IMAGE
+    char message[60];
+
+    if (false == FinishSparse(&Upgrade->Sparse, &Upgrade->WriteStatus))
+    {
+        return false;
+    }
+
+    os_sprintf(message, "Sparse image: %d bytes of %d erased only\r\n", Upgrade->Sparse.SkippedLength,
+            Upgrade->Sparse.ImageLength);
+    WriteLine(message);
+#endif
+
+    if (false == WriteRemainingBytes(&Upgrade->WriteStatus))
+    {
+        return false;
+    }
+
+    // keep running the current ROM until the new one is activated
+    return ((true == RecordStagedImage()) && (true == SetStagedROM(Upgrade->ROMSlot, 0)));
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Record the downloaded image in the metadata of its slot, its version is known once it runs or
+//                      from the update job. The image is checked once here, the bootloader then boots it without
+//                      reading it whole.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true if the image is intact and the metadata was written
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR RecordStagedImage(void)
+{
+    SlotMetadata metadata;
+
+    os_memset(&metadata, 0, sizeof(SlotMetadata));
+
+    if (false == VerifyImage(Upgrade->ROMSlot, &metadata))
+    {
+        WriteLine("Image checksum mismatch\r\n");
+        return false;
+    }
+
+    metadata.State = SLOT_STAGED;
+
+    return SetSlotMetadata(Upgrade->ROMSlot, &metadata);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Record the version and build of the running software in the metadata of the current ROM, it
+//                      booted and is confirmed. An image flashed by a tool is checked the first time, one verified
+//                      without a digest gets it from the scrub. Written only if the metadata differs.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR RecordRunningImage(void)
+{
+    SlotMetadata metadata;
+    uint8 rom = GetCurrentROM();
+
+    if ((false == GetSlotMetadata(rom, &metadata)) || ((SLOT_CONFIRMED == metadata.State)
+            && (FIRMWARE_VERSION == metadata.Version) && (BUILD_ID == metadata.BuildID)
+            && (0 != (metadata.Flags & SLOT_FLAG_VERIFIED)) && (0 != (metadata.Flags & SLOT_FLAG_DIGEST))))
+    {
+        return;
+    }
+
+    if (0 == (metadata.Flags & SLOT_FLAG_VERIFIED))
+    {
+        VerifyImage(rom, &metadata);
+    }
+    else if (0 == (metadata.Flags & SLOT_FLAG_DIGEST))
+    {
+        RequestOTADigest(rom);
+    }
+
+    metadata.Version = FIRMWARE_VERSION;
+    metadata.BuildID = BUILD_ID;
+    metadata.State = SLOT_CONFIRMED;
+
+    SetSlotMetadata(rom, &metadata);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the flash for CheckImage, see FlashReader. A whole image is read at once, the watchdog is
+//                      fed on the way.
+//
+// PARAMETERS:          uint32 address - 4 byte aligned
+//                      void* data - 4 byte aligned
+//                      uint32 length
+//
+// RETURN VALUE:        bool - false on a flash error
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ReadImageFlash(uint32 address, void* data, uint32 length)
+{
+    system_soft_wdt_feed();
+
+    return (SPI_FLASH_RESULT_OK == spi_flash_read(address, (uint32*) data, length));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the image of a slot against its checksum and record it in the metadata, see IsFastBoot in
+//                      boot/BootSelect.c. Its digest is taken right after by the scrub of app/OTA_Scrub.c, in slices
+//                      that leave MQTT and Wi-Fi alone, and later passes compare the slot with it.
+//
+// PARAMETERS:          uint8 rom
+//                      SlotMetadata* metadata - Size, CheckSum and Flags are set, the caller writes it
+//
+// RETURN VALUE:        bool - true if the image is intact
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR VerifyImage(uint8 rom, SlotMetadata* metadata)
+{
+    ImageInfo info;
+
+    // the digest, if any, is of the image as it was before
+    metadata->Flags &= ~(SLOT_FLAG_VERIFIED | SLOT_FLAG_DIGEST);
+
+    if (false == CheckImage(GetROMAddress(rom), ReadImageFlash, &info))
+    {
+        return false;
+    }
+
+    metadata->Size = info.Length;
+    metadata->CheckSum = info.CheckSum;
+    metadata->Flags |= SLOT_FLAG_VERIFIED;
+
+    RequestOTADigest(rom);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Flash position of the download, e.g. to charge the erased sectors to the rate limit.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        WriteStatus* - write status of the image or of the bundle part being received
+//
+//======================================================================================================================
+static WriteStatus* ICACHE_FLASH_ATTR GetWriteStatus(void)
+{
+#ifdef OTA_BUNDLE
+    return &Upgrade->Bundle.Write;
+#else
+    return &Upgrade->WriteStatus;
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Close a connection, it is freed by OnDisconnect.
+//
+// PARAMETERS:          ESPConnection* connection - no longer Upgrade->Connection
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR CloseConnection(ESPConnection* connection)
+{
+#ifdef OTA_COAP
+    // connectionless, nothing to wait for
+    StopCoAPTransfer();
+
+    OnDisconnect(connection);
+#else
+    espconn_disconnect(connection);
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Free an upgrade whose connection was never established.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR FreeUpgrade(void)
+{
+    os_free(Upgrade->Connection->proto.tcp);
+    os_free(Upgrade->Connection);
+    os_free(Upgrade);
+    Upgrade = NULL;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the server address from the DNS cache or start a DNS lookup.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false on DNS error
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ResolveHost(void)
+{
+    ErrorType errorMessage;
+    Mirror* mirror = GetMirror(Upgrade->Mirror);
+
+    // already resolved while probing
+    if (0 != mirror->IPAddress.addr)
+    {
+        ConnectToServer(&mirror->IPAddress);
+        return true;
+    }
+
+    if (true == GetCachedAddress(mirror->Host, &Upgrade->IPAddress))
+    {
+        WriteLine("Using cached server address\r\n");
+        ConnectToServer(&Upgrade->IPAddress);
+        return true;
+    }
+
+    // DNS lookup
+    errorMessage = espconn_gethostbyname(Upgrade->Connection, mirror->Host, &Upgrade->IPAddress, OnDNSFound);
+    if (ESPCONN_OK == errorMessage)
+    {
+        WriteLine("ESPCONN_OK\r\n");
+        // Hostname is a valid IP address string or the host name is already in the local names table.
+        OnDNSFound(0, &Upgrade->IPAddress, Upgrade->Connection);
+    }
+    else if (ESPCONN_INPROGRESS == errorMessage)
+    {
+        // Enqueue a request to be sent to the DNS server for resolution if no errors are present.
+    }
+    else
+    {
+        // DNS client not initialized or invalid hostname
+        WriteLine("DNS error!\r\n");
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the cached server address from the RTC data area.
+//                      The RTC counter wraps after a few hours, OTA_DNS_CACHE_TTL must stay well below that.
+//
+// PARAMETERS:          const char* host - host name
+//                      IPAddress* address - populated with the cached address
+//
+// RETURN VALUE:        bool - true if a valid, not expired address was found
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR GetCachedAddress(const char* host, IPAddress* address)
+{
+    DNSCacheEntry entry;
+    uint64 elapsed;
+
+    if (!system_rtc_mem_read(OTA_DNS_CACHE_RTC_ADDRESS, &entry, sizeof(DNSCacheEntry)))
+    {
+        return false;
+    }
+
+    // RTC memory content is random after power up
+    if ((OTA_DNS_CACHE_MAGIC != entry.MagicNumber) || (GetHostHash(host) != entry.HostHash)
+            || ((entry.MagicNumber ^ entry.HostHash ^ entry.Address ^ entry.RTCTime) != entry.CheckSum))
+    {
+        return false;
+    }
+
+    // RTC clock calibration is in microseconds per tick, fixed point with 12 fractional bits
+    elapsed = ((uint64) (system_get_rtc_time() - entry.RTCTime) * system_rtc_clock_cali_proc()) >> 12;
+    if (elapsed > ((uint64) OTA_DNS_CACHE_TTL * 1000000))
+    {
+        return false;
+    }
+
+    address->addr = entry.Address;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Store a resolved server address in the RTC data area.
+//
+// PARAMETERS:          const char* host - host name
+//                      const IPAddress* address - resolved address
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR SetCachedAddress(const char* host, const IPAddress* address)
+{
+    DNSCacheEntry entry;
+
+    entry.MagicNumber = OTA_DNS_CACHE_MAGIC;
+    entry.HostHash = GetHostHash(host);
+    entry.Address = address->addr;
+    entry.RTCTime = system_get_rtc_time();
+    entry.CheckSum = entry.MagicNumber ^ entry.HostHash ^ entry.Address ^ entry.RTCTime;
+
+    system_rtc_mem_write(OTA_DNS_CACHE_RTC_ADDRESS, &entry, sizeof(DNSCacheEntry));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Hash of the host name, so the cached address is only used for the same host.
+//
+// PARAMETERS:          const char* host - host name
+//
+// RETURN VALUE:        uint32 - hash
+//
+//======================================================================================================================
+static uint32 ICACHE_FLASH_ATTR GetHostHash(const char* host)
+{
+    uint32 hash = 5381;
+
+    while ('\0' != *host)
+    {
+        hash = (hash * 33) ^ (uint8) *host;
+        host++;
+    }
+
+    return hash;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Fill the token bucket for a full second burst.
+//
+// PARAMETERS:          TokenBucket* bucket
+//                      uint32 rate - bytes per second, 0 is unlimited
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR InitBucket(TokenBucket* bucket, uint32 rate)
+{
+    bucket->Rate = rate;
+    bucket->Tokens = rate;
+    bucket->LastRefill = system_get_time();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Take tokens from the bucket, going into debt if there are not enough.
+//
+// PARAMETERS:          TokenBucket* bucket
+//                      uint32 amount - number of bytes
+//
+// RETURN VALUE:        uint32 - time until the debt is paid back (in ms), 0 if there is no debt
+//
+//======================================================================================================================
+static uint32 ICACHE_FLASH_ATTR ConsumeTokens(TokenBucket* bucket, uint32 amount)
+{
+    uint32 now = system_get_time();
+    uint32 refill;
 
-    // create connection
-    Upgrade->Connection = (ESPConnection*) os_zalloc(sizeof(ESPConnection));
-    if (NULL == Upgrade->Connection)
+    if (0 == bucket->Rate)
     {
-        WriteLine("No ram!\r\n");
-        os_free(Upgrade);
-        return false;
+        return 0;
     }
 
-    Upgrade->Connection->proto.tcp = (esp_tcp *) os_zalloc(sizeof(esp_tcp));
-    if (NULL == Upgrade->Connection->proto.tcp)
+    // only advance the refill time by whole tokens, so slow rates do not lose the fractions
+    refill = ((uint64) (now - bucket->LastRefill) * bucket->Rate) / 1000000;
+    if (0 != refill)
     {
-        WriteLine("No ram!\r\n");
-        os_free(Upgrade->Connection);
-        os_free(Upgrade);
-        return false;
+        bucket->LastRefill += ((uint64) refill * 1000000) / bucket->Rate;
+        bucket->Tokens += refill;
     }
 
-    // Set update flag
-    system_upgrade_flag_set(UPGRADE_FLAG_START);
-
-    // DNS lookup
-    errorMessage = espconn_gethostbyname(Upgrade->Connection, OTA_HOST, &Upgrade->IPAddress, OnDNSFound);
-    if (ESPCONN_OK == errorMessage)
-    {
-        WriteLine("ESPCONN_OK\r\n");
-        // Hostname is a valid IP address string or the host name is already in the local names table.
-        OnDNSFound(0, &Upgrade->IPAddress, Upgrade->Connection);
-    }
-    else if (ESPCONN_INPROGRESS == errorMessage)
+    // burst is limited to one second worth of tokens
+    if (bucket->Tokens > (sint32) bucket->Rate)
     {
-        // Enqueue a request to be sent to the DNS server for resolution if no errors are present.
+        bucket->Tokens = bucket->Rate;
     }
-    else
+
+    bucket->Tokens -= amount;
+
+    if (bucket->Tokens >= 0)
     {
-        // DNS client not initialized or invalid hostname
-        WriteLine("DNS error!\r\n");
-        os_free(Upgrade->Connection->proto.tcp);
-        os_free(Upgrade->Connection);
-        os_free(Upgrade);
-        return false;
+        return 0;
     }
 
-    return true;
+    return (((uint64) (-bucket->Tokens) * 1000) / bucket->Rate) + 1;
 }
 
-//======================================================================================================================
-// LOCAL FUNCTIONS
-//======================================================================================================================
-
 //======================================================================================================================
 // DESCRIPTION:         Calling the user callback to indicate completion. Clean up at the end of the update.
 //
@@ -178,12 +1586,17 @@ bool ICACHE_FLASH_ATTR ActivateOTA(Callback callback)
 void ICACHE_FLASH_ATTR DeactivateOTA(void)
 {
     bool result;
+    bool isBenchmark;
     uint8 romSlot;
+    bool isIdle;
+    uint8 mirror;
     Callback callback;
     ESPConnection* connection;
 
     os_timer_disarm(&Timer);
 
+    os_timer_disarm(&ThroughputTimer);
+
     // save only remaining bits of interest from upgrade struct
     // then we can clean it up early, so disconnect callback
     // can distinguish between us calling it after update finished
@@ -191,19 +1604,32 @@ void ICACHE_FLASH_ATTR DeactivateOTA(void)
     connection = Upgrade->Connection;
     romSlot = Upgrade->ROMSlot;
     callback = Upgrade->UserCallback;
+    isBenchmark = (NULL != Upgrade->Benchmark);
+    mirror = Upgrade->Mirror;
+
+    // the whole response is read, the next download may continue on the connection
+    isIdle = ((0 != OTA_KEEP_ALIVE_TIMEOUT) && (true == Upgrade->IsKeepAlive) && (true == Upgrade->IsHeaderParsed)
+            && (Upgrade->Length == Upgrade->ContentLength));
+
+    TreeFree(&Upgrade->Tree);
 
     os_free(Upgrade);
     Upgrade = NULL;
 
     // If we have a connection, disconnect and clean up connection.
-    if (NULL != connection)
+    if ((NULL != connection) && (true == isIdle))
+    {
+        ParkConnection(connection, mirror);
+    }
+    else if (NULL != connection)
     {
-        espconn_disconnect(connection);
+        CloseConnection(connection);
     }
 
-    // Check if upgrade is completed.
+    // Check if upgrade is completed, it is staged already
     if (UPGRADE_FLAG_FINISH == system_upgrade_flag_check())
     {
+        romSlot = (true == isBenchmark) ? romSlot : GetStagedROM(NULL);
         result = true;
     }
     else
@@ -212,6 +1638,11 @@ void ICACHE_FLASH_ATTR DeactivateOTA(void)
         result = false;
     }
 
+    if (false == isBenchmark)
+    {
+        SetOTAPhase((true == result) ? OTA_PHASE_STAGED : OTA_PHASE_FAILED);
+    }
+
     // Invoke the user callback function
     if (NULL != callback)
     {
@@ -233,70 +1664,207 @@ static void ICACHE_FLASH_ATTR OnDataReceived(void *arg, char *pusrdata, unsigned
     char* ptrData;
     char* ptrLen;
     char* ptr;
+    const char* status;
 
     // disarm the timer
     os_timer_disarm(&Timer);
 
+    // rest of a response given up on, the next request goes out once it is read
+    if (0 != Upgrade->DrainLength)
+    {
+        Upgrade->DrainLength -= (length < Upgrade->DrainLength) ? length : Upgrade->DrainLength;
+
+        if (0 == Upgrade->DrainLength)
+        {
+            SendRequest();
+        }
+        else
+        {
+            os_timer_setfn(&Timer, (os_timer_func_t *) OnNetworkTimeOut, 0);
+            os_timer_arm(&Timer, OTA_NETWORK_TIMEOUT, 0);
+        }
+        return;
+    }
+
     // first reply?
-    if (0 == Upgrade->ContentLength)
+    if (false == Upgrade->IsHeaderParsed)
     {
+        // a download resumed on another mirror must get the requested range
+        status = (0 == Upgrade->Length) ? "200" : "206";
+
         // valid http response?
         if ((ptrLen = (char*) os_strstr(pusrdata, "Content-Length: ")) && (ptrData = (char*) os_strstr(ptrLen, "\r\n\r\n"))
-                && (os_strncmp(pusrdata + 9, "200", 3) == 0))
+                && (os_strncmp(pusrdata + 9, status, 3) == 0))
         {
 
+            // HTTP/1.1 keeps the connection open unless the server says otherwise
+            *(ptrData + 2) = '\0'; // destructive
+            Upgrade->IsKeepAlive = ((0 == os_strncmp(pusrdata, "HTTP/1.1", 8))
+                    && (NULL == os_strstr(pusrdata, "Connection: close")));
             // end of header/start of data
             ptrData += 4;
             // length of data after header in this chunk
             length -= (ptrData - pusrdata);
-            // running total of download length
-            Upgrade->Length += length;
-            // process current chunk
-            if (!WriteFlash(&Upgrade->WriteStatus, (uint8*) ptrData, length))
-            {
-                // write error
-                DeactivateOTA();
-                return;
-            }
-            // work out total download size
+            // work out total download size, a range only holds the rest of the image
             ptrLen += 16;
             ptr = (char *) os_strstr(ptrLen, "\r\n");
             *ptr = '\0'; // destructive
-            Upgrade->ContentLength = atoi(ptrLen);
+            Upgrade->ContentLength = Upgrade->Length + atoi(ptrLen);
+            Upgrade->IsHeaderParsed = true;
+            // process current chunk
+            ProcessChunk((uint8*) ptrData, length);
         }
         else
         {
             // Invalid http header
             DeactivateOTA();
-            return;
         }
     }
     else
     {
         // not the first chunk, process it
-        Upgrade->Length += length;
-        if (false == WriteFlash(&Upgrade->WriteStatus, (uint8*) pusrdata, length))
-        {
-            DeactivateOTA();
-            return;
-        }
+        ProcessChunk((uint8*) pusrdata, length);
+    }
+}
+
+#ifdef OTA_COAP
+//======================================================================================================================
+// DESCRIPTION:         Called with the next block of a CoAP transfer
+//
+// PARAMETERS:          uint8* data - image data from Upgrade->Length on
+//                      uint16 length
+//                      uint32 size - image size, 0 if the server did not send it
+//                      bool isLast - last block of the image
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnCoAPBlock(uint8* data, uint16 length, uint32 size, bool isLast)
+{
+    if (true == isLast)
+    {
+        Upgrade->ContentLength = Upgrade->Length + length;
+    }
+    else if (false == Upgrade->IsHeaderParsed)
+    {
+        // without Size2 the last block tells the end
+        Upgrade->ContentLength = (0 != size) ? size : 0xFFFFFFFF;
+    }
+
+    Upgrade->IsHeaderParsed = true;
+
+    ProcessChunk(data, length);
+}
+#endif
+
+//======================================================================================================================
+// DESCRIPTION:         Process the received image data, then let the next data in as the rate limits allow.
+//
+// PARAMETERS:          uint8* data - image data from Upgrade->Length on
+//                      uint16 length
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ProcessChunk(uint8* data, uint16 length)
+{
+    TreeResult result;
+    sint32 lastErasedSector = GetWriteStatus()->LastErasedSector;
+    sint32 erasedSectors;
+    uint32 networkDelay;
+    uint32 flashDelay;
+
+    // running total of download length
+    Upgrade->Length += length;
+
+    result = WriteImage(data, length);
+
+    if (TREE_RETRY == result)
+    {
+        RetryChunk();
+        return;
+    }
+    else if (TREE_OK != result)
+    {
+        // write error
+        DeactivateOTA();
+        return;
     }
 
     // check if we are finished
     if (Upgrade->Length == Upgrade->ContentLength)
     {
-        system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
+        if (true == FinishImage())
+        {
+            system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
+        }
         DeactivateOTA();
+        return;
     }
-    else if (ESPCONN_READ != Upgrade->Connection->state)
+
+#ifndef OTA_COAP
+    if (ESPCONN_READ != Upgrade->Connection->state)
     {
         DeactivateOTA();
+        return;
+    }
+#endif
+
+    networkDelay = 0;
+    flashDelay = 0;
+
+    if (true == Upgrade->IsThrottled)
+    {
+        networkDelay = ConsumeTokens(&NetworkBucket, length);
+
+        // a new bundle part starts in another region
+        erasedSectors = GetWriteStatus()->LastErasedSector - lastErasedSector;
+        erasedSectors = (erasedSectors < 0) ? 0 : erasedSectors;
+
+        flashDelay = ConsumeTokens(&FlashBucket, length + (erasedSectors * SECTOR_SIZE));
     }
+
+    if ((0 != networkDelay) || (0 != flashDelay))
+    {
+        // close the receive window until the rate limits allow more data
+#ifdef OTA_COAP
+        HoldCoAPTransfer();
+#else
+        espconn_recv_hold(Upgrade->Connection);
+#endif
+
+        os_timer_setfn(&Timer, (os_timer_func_t *) OnThrottleElapsed, 0);
+        os_timer_arm(&Timer, (networkDelay > flashDelay) ? networkDelay : flashDelay, 0);
+    }
+#ifndef OTA_COAP
     else
     {
-        os_timer_setfn(&Timer, (os_timer_func_t *) DeactivateOTA, 0);
+        // CoAP retransmits on its own and reports a stalled server
+        os_timer_setfn(&Timer, (os_timer_func_t *) OnNetworkTimeOut, 0);
         os_timer_arm(&Timer, OTA_NETWORK_TIMEOUT, 0);
     }
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Rate limited download may continue, reopen the receive window
+//
+// PARAMETERS:          void
+//
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnThrottleElapsed(void)
+{
+#ifdef OTA_COAP
+    ResumeCoAPTransfer();
+#else
+    espconn_recv_unhold(Upgrade->Connection);
+
+    os_timer_setfn(&Timer, (os_timer_func_t *) OnNetworkTimeOut, 0);
+    os_timer_arm(&Timer, OTA_NETWORK_TIMEOUT, 0);
+#endif
 }
 
 //======================================================================================================================
@@ -333,7 +1901,20 @@ static void ICACHE_FLASH_ATTR OnDisconnect(void* arg)
     {
         Upgrade->Connection = NULL;
 
-        DeactivateOTA();
+        // the server closed a kept alive connection between two responses, open a new one
+        if ((true == Upgrade->IsKeepAlive) && (false == Upgrade->IsHeaderParsed))
+        {
+            Reconnect(Upgrade->Mirror);
+        }
+        // an update in progress tries the next mirror
+        else if (true == Upgrade->IsStarted)
+        {
+            SwitchMirror();
+        }
+        else
+        {
+            DeactivateOTA();
+        }
     }
 }
 
@@ -348,8 +1929,6 @@ static void ICACHE_FLASH_ATTR OnDisconnect(void* arg)
 //======================================================================================================================
 static void ICACHE_FLASH_ATTR OnConnectionReceived(void* arg)
 {
-    uint8* request;
-
     // disable the timeout
     os_timer_disarm(&Timer);
 
@@ -358,6 +1937,48 @@ static void ICACHE_FLASH_ATTR OnConnectionReceived(void* arg)
 
     espconn_regist_recvcb(Upgrade->Connection, OnDataReceived);
 
+    Upgrade->IsConnected = true;
+
+    if (true == Upgrade->IsStarted)
+    {
+        SendRequest();
+    }
+    else
+    {
+        // pre-warmed, drop the connection if the update request does not come
+        os_timer_setfn(&Timer, (os_timer_func_t *) DeactivateOTA, 0);
+
+        os_timer_arm(&Timer, OTA_WARM_TIMEOUT, 0);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Send the http request for the ROM image
+//
+// PARAMETERS:          void
+//
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR SendRequest(void)
+{
+#ifndef OTA_COAP
+    uint8* request;
+#endif
+
+    os_timer_disarm(&Timer);
+
+#ifdef OTA_COAP
+    // the block requests start at Upgrade->Length, so a resumed download needs no range
+    if (false == StartCoAPTransfer(Upgrade->Connection, &Upgrade->IPAddress, GetMirror(Upgrade->Mirror)->Port,
+            GetImageName(), Upgrade->Length, OnCoAPBlock, OnNetworkTimeOut))
+    {
+        DeactivateOTA();
+
+        return;
+    }
+#else
     // http request string
     request = (uint8*) os_malloc(512);
     if (NULL == request)
@@ -369,17 +1990,41 @@ static void ICACHE_FLASH_ATTR OnConnectionReceived(void* arg)
         return;
     }
 
-    os_sprintf((char*) request, "GET /%s HTTP/1.1\r\nHost: " OTA_HOST "\r\n" HTTP_HEADER, (Upgrade->ROMSlot == 0 ? OTA_ROM0 : OTA_ROM1));
+    os_sprintf((char*) request, "GET /%s HTTP/1.1\r\nHost: %s\r\n", GetImageName(), GetMirror(Upgrade->Mirror)->Host);
+
+    // continue a download started on another mirror
+    if (0 != Upgrade->Length)
+    {
+        os_sprintf((char*) request + os_strlen((char*) request), "Range: bytes=%d-\r\n", Upgrade->Length);
+    }
+
+    os_strcpy((char*) request + os_strlen((char*) request), HTTP_HEADER);
     WriteLine(request);
 
     // send the http request, with timeout for reply
-    os_timer_setfn(&Timer, (os_timer_func_t *) DeactivateOTA, 0);
+    os_timer_setfn(&Timer, (os_timer_func_t *) OnNetworkTimeOut, 0);
 
     os_timer_arm(&Timer, OTA_NETWORK_TIMEOUT, 0);
+#endif
+
+    // the first chunk of a benchmark accounts the time to the first byte
+    Upgrade->LastReceiveTime = system_get_time();
+
+    // watch the throughput if there is a mirror to move to
+    if (1 < GetMirrorCount())
+    {
+        Upgrade->WindowLength = Upgrade->Length;
 
+        os_timer_setfn(&ThroughputTimer, (os_timer_func_t *) OnThroughputWindow, 0);
+
+        os_timer_arm(&ThroughputTimer, OTA_THROUGHPUT_WINDOW, 1);
+    }
+
+#ifndef OTA_COAP
     espconn_sent(Upgrade->Connection, request, os_strlen((char*) request));
 
     os_free(request);
+#endif
 }
 
 //======================================================================================================================
@@ -434,7 +2079,7 @@ static void ICACHE_FLASH_ATTR OnDNSFound(const char* name, ip_addr_t* IP, void*
     {
         WriteLine("Cannot connect to the server: ");
 
-        WriteLine(OTA_HOST);
+        WriteLine(GetMirror(Upgrade->Mirror)->Host);
 
         WriteLine("\r\n");
 
@@ -443,6 +2088,43 @@ static void ICACHE_FLASH_ATTR OnDNSFound(const char* name, ip_addr_t* IP, void*
         return;
     }
 
+    GetMirror(Upgrade->Mirror)->IPAddress = *IP;
+
+    SetCachedAddress(GetMirror(Upgrade->Mirror)->Host, IP);
+
+    ConnectToServer(IP);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Connect to the resolved update server.
+//
+// PARAMETERS:          IPAddress* IP - server address
+//
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ConnectToServer(IPAddress* IP)
+{
+#ifdef OTA_COAP
+    // connectionless, the address is all the block requests need
+    Upgrade->IPAddress = *IP;
+    Upgrade->IsConnected = true;
+
+    if (true == Upgrade->IsStarted)
+    {
+        SendRequest();
+    }
+    else
+    {
+        // pre-warmed, drop the resolved server if the update request does not come
+        os_timer_disarm(&Timer);
+
+        os_timer_setfn(&Timer, (os_timer_func_t *) DeactivateOTA, 0);
+
+        os_timer_arm(&Timer, OTA_WARM_TIMEOUT, 0);
+    }
+#else
     // set up connection
     Upgrade->Connection->type = ESPCONN_TCP;
 
@@ -450,7 +2132,7 @@ static void ICACHE_FLASH_ATTR OnDNSFound(const char* name, ip_addr_t* IP, void*
 
     Upgrade->Connection->proto.tcp->local_port = espconn_port();
 
-    Upgrade->Connection->proto.tcp->remote_port = OTA_PORT;
+    Upgrade->Connection->proto.tcp->remote_port = GetMirror(Upgrade->Mirror)->Port;
 
     *(IPAddress*) Upgrade->Connection->proto.tcp->remote_ip = *IP;
 
@@ -468,6 +2150,75 @@ static void ICACHE_FLASH_ATTR OnDNSFound(const char* name, ip_addr_t* IP, void*
     os_timer_setfn(&Timer, (os_timer_func_t *) OnConnectionTimeOut, 0);
 
     os_timer_arm(&Timer, OTA_NETWORK_TIMEOUT, 0);
+#endif
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Activate the staged ROM once the maintenance window has come.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnActivationCheck(void)
+{
+    uint32 activationTime = 0;
+    uint32 now = sntp_get_current_timestamp();
+
+    if ((NO_STAGED_ROM == GetStagedROM(&activationTime)) || (0 == activationTime))
+    {
+        os_timer_disarm(&ActivationTimer);
+        return;
+    }
+
+    // an unsynchronised clock reads 0, the window has not come yet
+    if ((now >= activationTime) && (NULL == Upgrade))
+    {
+        os_timer_disarm(&ActivationTimer);
+        ActivateStagedImage();
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Reboot to the staged ROM on trial, it becomes the current ROM once confirmed.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ActivateStagedImage(void)
+{
+    char message[40];
+
+    os_sprintf(message, "Rebooting to ROM %d...\r\n", GetStagedROM(NULL));
+    WriteLine(message);
+
+    if (false == StartTrialBoot())
+    {
+        WriteLine("Unable to switch ROM...\r\n\r\n");
+        return;
+    }
+
+    SetOTAPhase(OTA_PHASE_ACTIVATE);
+
+    system_restart();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The software on trial was not confirmed in time, restart into the current ROM.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnTrialExpired(void)
+{
+    WriteLine("Software on trial not confirmed, rolling back\r\n");
+
+    system_restart();
 }
 
 //======================================================================================================================
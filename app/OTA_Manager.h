@@ -5,15 +5,65 @@
 // Included files to resolve specific definitions in this file
 //----------------------------------------------------------------------------------------------------------------------
 #include "../drivers/Bootloader.h"
+#include "../drivers/BootTelemetry.h"
+#include "OTA_Bench.h"
 
 //----------------------------------------------------------------------------------------------------------------------
 // Constant data
 //----------------------------------------------------------------------------------------------------------------------
+// system_upgrade_flag values, START while the inactive ROM slot is being written
+#define UPGRADE_FLAG_IDLE       0x00
+
+#define UPGRADE_FLAG_START      0x01
+
+#define UPGRADE_FLAG_FINISH     0x02
+
+// fetch the image with CoAP block-wise transfer (RFC 7959) over UDP instead of HTTP, see OTA_CoAP.h,
+// tools/coap_server.py serves the images
+// #define OTA_COAP
+
 // ota server details
 #define OTA_HOST "192.168.43.1"
+#ifdef OTA_COAP
+#define OTA_PORT 5683
+#else
 #define OTA_PORT 12345
-#define OTA_ROM0 "user_0.bin"
-#define OTA_ROM1 "user_1.bin"
+#endif
+#define OTA_ROM0 "user_0"
+#define OTA_ROM1 "user_1"
+
+// image of every ROM slot with SINGLE_IMAGE, see SINGLE_IMAGE_OFFSET
+#define OTA_ROM "user"
+
+// user_0 is linked for a ROM slot in the lower half of its 1 MB flash block, user_1 for the upper half
+#define OTA_ROM_BLOCK_SIZE  ROM_BLOCK_SIZE
+#define OTA_ROM1_OFFSET     0x80000
+
+// download the sparse images made by tools/sparse_image.py, only their data extents are transferred and
+// programmed, comment out to download the plain images (a bundle marks its sparse parts itself)
+#define OTA_SPARSE_IMAGE
+
+// wrap the image into the hash tree made by tools/hash_tree.py, each chunk is verified as it arrives and
+// only a corrupted chunk is downloaded again, comment out to download the image as it is
+#define OTA_HASH_TREE
+
+// download the bundle made by tools/bundle.py, firmware, certificates and configuration are written to their
+// standby regions and activated together by one boot configuration write, comment out to download the firmware only
+#define OTA_BUNDLE
+
+#if defined(OTA_BUNDLE)
+#define OTA_PAYLOAD_EXTENSION ".bundle"
+#elif defined(OTA_SPARSE_IMAGE)
+#define OTA_PAYLOAD_EXTENSION ".sparse"
+#else
+#define OTA_PAYLOAD_EXTENSION ".bin"
+#endif
+
+#ifdef OTA_HASH_TREE
+#define OTA_IMAGE_EXTENSION OTA_PAYLOAD_EXTENSION ".tree"
+#else
+#define OTA_IMAGE_EXTENSION OTA_PAYLOAD_EXTENSION
+#endif
 
 // general http header
 #define HTTP_HEADER "Connection: keep-alive\r\n\
@@ -25,10 +75,55 @@ Accept: */*\r\n\r\n"
 // timeout for the initial connect and each recv (in ms)
 #define OTA_NETWORK_TIMEOUT  10000
 
+// how long a pre-warmed connection is kept open waiting for the update request (in ms)
+#define OTA_WARM_TIMEOUT  30000
+
+// a connection the server keeps alive stays open after the download for the next one, which skips the DNS lookup,
+// the mirror probing and the handshake (in ms, 0 closes the connection after each download)
+#define OTA_KEEP_ALIVE_TIMEOUT  30000
+
+// a corrupted chunk is requested again on the same connection once the rest of the response is read, if no more
+// than this is left, a longer response is dropped with its connection (in bytes)
+#define OTA_KEEP_ALIVE_MAX_DRAIN  8192
+
+// default rate limits of a background download (in bytes per second), 0 is unlimited
+// flash programming is charged for the written bytes plus SECTOR_SIZE for each erased sector
+#define OTA_BACKGROUND_NETWORK_RATE  4096
+#define OTA_BACKGROUND_FLASH_RATE  16384
+
+// a download slower than this over OTA_THROUGHPUT_WINDOW moves to the next mirror (in bytes per second)
+#define OTA_MIN_THROUGHPUT  2048
+#define OTA_THROUGHPUT_WINDOW  5000
+
+// how often a download may move to another mirror
+#define OTA_MAX_MIRROR_SWITCHES  4
+
+// an activated ROM is booted on trial first, once at a time from the RTC data, and must be confirmed within
+// OTA_TRIAL_DEADLINE (in ms), by connecting to the MQTT broker or the confirm command, to become the current ROM.
+// Otherwise the device restarts into the previous ROM, the staged ROM is dropped after OTA_TRIAL_BOOTS trials.
+// A revert boots the other ROM the same way, a single time.
+#define OTA_TRIAL_DEADLINE  60000
+#define OTA_TRIAL_BOOTS  2
+
+// time server of the scheduled activation and how often the schedule is checked (in ms)
+#define OTA_SNTP_SERVER "pool.ntp.org"
+#define OTA_ACTIVATION_CHECK_INTERVAL  10000
+
+// how often a corrupted chunk is downloaded again from the same mirror before moving to the next one
+#define OTA_MAX_CHUNK_RETRIES  3
+
+// resolved server address is cached in the RTC data area and reused for this long (in s)
+#define OTA_DNS_CACHE_TTL  3600
+
+#define OTA_DNS_CACHE_MAGIC  0x444E5343
+
+// RTC block of the DNS cache, placed after the bootloader RTC data
+#define OTA_DNS_CACHE_RTC_ADDRESS  (RTC_ADDRESS + 0x20)
+
 //----------------------------------------------------------------------------------------------------------------------
 // Exported type
 //----------------------------------------------------------------------------------------------------------------------
-// callback method should take this format
+// callback method should take this format, on success rom_slot is staged and runs once activated
 typedef void (*Callback)(bool result, uint8 rom_slot);
 
 //======================================================================================================================
@@ -36,6 +131,16 @@ typedef void (*Callback)(bool result, uint8 rom_slot);
 //======================================================================================================================
 // function to perform the ota update
 bool ICACHE_FLASH_ATTR ActivateOTA(Callback callback);
+bool ICACHE_FLASH_ATTR WarmUpOTA(void);
+bool ICACHE_FLASH_ATTR ActivateBackgroundOTA(Callback callback);
+bool ICACHE_FLASH_ATTR BenchmarkOTA(BenchStatistics* statistics, uint8* digest, Callback callback);
+void ICACHE_FLASH_ATTR SetOTARateLimit(uint32 networkRate, uint32 flashRate);
+bool ICACHE_FLASH_ATTR SetOTAMirrors(const char* list);
+bool ICACHE_FLASH_ATTR SetOTARoot(const char* root);
+void ICACHE_FLASH_ATTR InitOTAActivation(void);
+bool ICACHE_FLASH_ATTR ScheduleOTAActivation(uint32 activationTime);
+bool ICACHE_FLASH_ATTR ConfirmOTA(void);
+uint32 ICACHE_FLASH_ATTR GetOTATime(void);
 void ICACHE_FLASH_ATTR DeactivateOTA(void);
 
 #endif
@@ -0,0 +1,614 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+#include <espconn.h>
+#include <mem.h>
+#include <osapi.h>
+#include "OTA_Manager.h"
+#include "OTA_Mirrors.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define debug
+
+#ifdef debug
+#define WriteLine UART0_Send
+#else
+#define WriteLine
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local types
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct espconn ESPConnection;
+
+typedef struct
+{
+    ESPConnection* Connection;  // NULL once the probe is over, late callbacks then only clean up
+    uint32 StartTime;
+    uint32 Received;
+    bool IsConnected;
+    bool IsAccepted;            // server answered with 200 or 206
+} Probe;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR OnProbeDNSFound(const char* name, ip_addr_t* IP, void* arg);
+
+static void ICACHE_FLASH_ATTR OnProbeConnected(void* arg);
+
+static void ICACHE_FLASH_ATTR OnProbeData(void* arg, char* data, unsigned short length);
+
+static void ICACHE_FLASH_ATTR OnProbeDisconnect(void* arg);
+
+static void ICACHE_FLASH_ATTR OnProbeError(void* arg, sint8 error);
+
+static void ICACHE_FLASH_ATTR OnProbeTimeOut(void);
+
+static void ICACHE_FLASH_ATTR CompleteProbe(uint8 index);
+
+static void ICACHE_FLASH_ATTR FailProbe(uint8 index);
+
+static void ICACHE_FLASH_ATTR FinishProbing(uint8 winner);
+
+static void ICACHE_FLASH_ATTR FreeConnection(ESPConnection* connection);
+
+static uint8 ICACHE_FLASH_ATTR GetProbeIndex(ESPConnection* connection);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static Mirror Mirrors[OTA_MAX_MIRRORS];
+
+static uint8 MirrorCount;
+
+static Probe Probes[OTA_MAX_MIRRORS];
+
+static ProbeCallback UserCallback;
+
+static char ProbePath[OTA_MAX_HOST_LENGTH];
+
+static os_timer_t ProbeTimer;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Replace the mirror list.
+//
+// PARAMETERS:          const char* list - "host[:port][,host[:port]]...", port defaults to OTA_PORT
+//
+// RETURN VALUE:        bool - false if the list is empty or malformed, the previous list is kept then
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetMirrors(const char* list)
+{
+    Mirror mirrors[OTA_MAX_MIRRORS];
+    uint8 count = 0;
+    uint8 length;
+
+    os_memset(mirrors, 0, sizeof(mirrors));
+
+    while ('\0' != *list)
+    {
+        if (OTA_MAX_MIRRORS == count)
+        {
+            return false;
+        }
+
+        for (length = 0; ('\0' != list[length]) && (',' != list[length]) && (':' != list[length]); length++)
+        {
+            if ((OTA_MAX_HOST_LENGTH - 1) == length)
+            {
+                return false;
+            }
+        }
+
+        if (0 == length)
+        {
+            return false;
+        }
+
+        os_memcpy(mirrors[count].Host, list, length);
+        mirrors[count].Port = OTA_PORT;
+        list += length;
+
+        if (':' == *list)
+        {
+            list++;
+            mirrors[count].Port = atoi(list);
+
+            while (('\0' != *list) && (',' != *list))
+            {
+                list++;
+            }
+        }
+
+        if (',' == *list)
+        {
+            list++;
+        }
+
+        count++;
+    }
+
+    if (0 == count)
+    {
+        return false;
+    }
+
+    os_memcpy(Mirrors, mirrors, sizeof(Mirrors));
+
+    MirrorCount = count;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Number of configured mirrors, OTA_HOST is the only one until SetMirrors is called.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - number of mirrors
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetMirrorCount(void)
+{
+    if (0 == MirrorCount)
+    {
+        os_strcpy(Mirrors[0].Host, OTA_HOST);
+        Mirrors[0].Port = OTA_PORT;
+        MirrorCount = 1;
+    }
+
+    return MirrorCount;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get a mirror
+//
+// PARAMETERS:          uint8 index - index of the mirror
+//
+// RETURN VALUE:        Mirror*
+//
+//======================================================================================================================
+Mirror* ICACHE_FLASH_ATTR GetMirror(uint8 index)
+{
+    GetMirrorCount();
+
+    return &Mirrors[index];
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Mirror to switch to after index, skipping those which failed the probe.
+//
+// PARAMETERS:          uint8 index - current mirror
+//
+// RETURN VALUE:        uint8 - next mirror, NO_MIRROR if there is no other one
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetNextMirror(uint8 index)
+{
+    uint8 next;
+    uint8 count = GetMirrorCount();
+
+    for (next = (index + 1) % count; next != index; next = (next + 1) % count)
+    {
+        if (false == Mirrors[next].IsFailed)
+        {
+            return next;
+        }
+    }
+
+    return NO_MIRROR;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Request the first OTA_PROBE_SIZE bytes of the image from all mirrors in parallel. The first
+//                      mirror to deliver them is reported to the callback, the other probes are dropped.
+//
+// PARAMETERS:          const char* path - image to probe
+//                      ProbeCallback callback - called once with the fastest mirror
+//
+// RETURN VALUE:        bool - false if probing could not be started
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR ProbeMirrors(const char* path, ProbeCallback callback)
+{
+    uint8 index;
+    sint8 result;
+    ESPConnection* connection;
+
+    if (NULL != UserCallback)
+    {
+        WriteLine("Probe in progress\r\n");
+        return false;
+    }
+
+    UserCallback = callback;
+
+    os_strncpy(ProbePath, path, sizeof(ProbePath) - 1);
+
+    for (index = 0; index < GetMirrorCount(); index++)
+    {
+        Mirrors[index].IsFailed = true;
+        Mirrors[index].ProbeTime = 0;
+
+        os_memset(&Probes[index], 0, sizeof(Probe));
+
+        connection = (ESPConnection*) os_zalloc(sizeof(ESPConnection));
+        if (NULL == connection)
+        {
+            continue;
+        }
+
+        connection->proto.tcp = (esp_tcp *) os_zalloc(sizeof(esp_tcp));
+        if (NULL == connection->proto.tcp)
+        {
+            os_free(connection);
+            continue;
+        }
+
+        connection->reverse = &Probes[index];
+
+        Probes[index].Connection = connection;
+        Probes[index].StartTime = system_get_time();
+        Mirrors[index].IsFailed = false;
+
+        result = espconn_gethostbyname(connection, Mirrors[index].Host, &Mirrors[index].IPAddress, OnProbeDNSFound);
+        if (ESPCONN_OK == result)
+        {
+            OnProbeDNSFound(Mirrors[index].Host, &Mirrors[index].IPAddress, connection);
+        }
+        else if (ESPCONN_INPROGRESS != result)
+        {
+            Probes[index].Connection = NULL;
+            Mirrors[index].IsFailed = true;
+            FreeConnection(connection);
+        }
+    }
+
+    // probing may already be over if no mirror could be reached
+    if (NULL != UserCallback)
+    {
+        os_timer_disarm(&ProbeTimer);
+        os_timer_setfn(&ProbeTimer, (os_timer_func_t *) OnProbeTimeOut, 0);
+        os_timer_arm(&ProbeTimer, OTA_PROBE_TIMEOUT, 0);
+
+        for (index = 0; index < GetMirrorCount(); index++)
+        {
+            if (NULL != Probes[index].Connection)
+            {
+                return true;
+            }
+        }
+
+        FinishProbing(NO_MIRROR);
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Mirror resolved, connect to it.
+//
+// PARAMETERS:          const char* name - host name
+//                      ip_addr_t* IP - address, NULL if the lookup failed
+//                      void* arg - probe connection
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeDNSFound(const char* name, ip_addr_t* IP, void* arg)
+{
+    ESPConnection* connection = (ESPConnection*) arg;
+    uint8 index = GetProbeIndex(connection);
+
+    if (NO_MIRROR == index)
+    {
+        FreeConnection(connection);
+        return;
+    }
+
+    if (NULL == IP)
+    {
+        Probes[index].Connection = NULL;
+        FreeConnection(connection);
+        FailProbe(index);
+        return;
+    }
+
+    Mirrors[index].IPAddress = *IP;
+
+    connection->type = ESPCONN_TCP;
+    connection->state = ESPCONN_NONE;
+    connection->proto.tcp->local_port = espconn_port();
+    connection->proto.tcp->remote_port = Mirrors[index].Port;
+    *(ip_addr_t*) connection->proto.tcp->remote_ip = *IP;
+
+    espconn_regist_connectcb(connection, OnProbeConnected);
+    espconn_regist_reconcb(connection, OnProbeError);
+    espconn_regist_disconcb(connection, OnProbeDisconnect);
+
+    espconn_connect(connection);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Connected to a mirror, send the ranged request.
+//
+// PARAMETERS:          void* arg - probe connection
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeConnected(void* arg)
+{
+    ESPConnection* connection = (ESPConnection*) arg;
+    uint8 index = GetProbeIndex(connection);
+    char request[160];
+
+    if (NO_MIRROR == index)
+    {
+        espconn_disconnect(connection);
+        return;
+    }
+
+    Probes[index].IsConnected = true;
+
+    espconn_regist_recvcb(connection, OnProbeData);
+
+    os_sprintf(request, "GET /%s HTTP/1.1\r\nHost: %s\r\nRange: bytes=0-%d\r\nConnection: close\r\n\r\n", ProbePath,
+            Mirrors[index].Host, OTA_PROBE_SIZE - 1);
+
+    espconn_sent(connection, (uint8*) request, os_strlen(request));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Probe data received, the probe is complete once OTA_PROBE_SIZE bytes have arrived.
+//
+// PARAMETERS:          void* arg - probe connection
+//                      char* data - received data
+//                      unsigned short length - length of the data
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeData(void* arg, char* data, unsigned short length)
+{
+    ESPConnection* connection = (ESPConnection*) arg;
+    uint8 index = GetProbeIndex(connection);
+
+    if (NO_MIRROR == index)
+    {
+        return;
+    }
+
+    if (0 == Probes[index].Received)
+    {
+        if ((length < 12) || ((0 != os_strncmp(data + 9, "200", 3)) && (0 != os_strncmp(data + 9, "206", 3))))
+        {
+            Probes[index].Connection = NULL;
+            espconn_disconnect(connection);
+            FailProbe(index);
+            return;
+        }
+
+        Probes[index].IsAccepted = true;
+    }
+
+    // header bytes are counted too, close enough for ranking
+    Probes[index].Received += length;
+
+    if (Probes[index].Received >= OTA_PROBE_SIZE)
+    {
+        CompleteProbe(index);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Probe connection closed, by the mirror after the range was sent or by us.
+//
+// PARAMETERS:          void* arg - probe connection
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeDisconnect(void* arg)
+{
+    ESPConnection* connection = (ESPConnection*) arg;
+    uint8 index = GetProbeIndex(connection);
+
+    FreeConnection(connection);
+
+    if (NO_MIRROR == index)
+    {
+        return;
+    }
+
+    Probes[index].Connection = NULL;
+
+    if (true == Probes[index].IsAccepted)
+    {
+        // image shorter than the probe
+        CompleteProbe(index);
+    }
+    else
+    {
+        FailProbe(index);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Connection to a mirror failed, the connection is already closed.
+//
+// PARAMETERS:          void* arg - probe connection
+//                      sint8 error - type of the error
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeError(void* arg, sint8 error)
+{
+    ESPConnection* connection = (ESPConnection*) arg;
+    uint8 index = GetProbeIndex(connection);
+
+    FreeConnection(connection);
+
+    if (NO_MIRROR != index)
+    {
+        Probes[index].Connection = NULL;
+        FailProbe(index);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         No mirror has delivered the probe in time.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnProbeTimeOut(void)
+{
+    uint8 index;
+
+    for (index = 0; index < MirrorCount; index++)
+    {
+        Mirrors[index].IsFailed = true;
+    }
+
+    WriteLine("No mirror answered the probe!\r\n");
+
+    FinishProbing(NO_MIRROR);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The first mirror to complete the probe wins.
+//
+// PARAMETERS:          uint8 index - mirror
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR CompleteProbe(uint8 index)
+{
+    char message[80];
+
+    Mirrors[index].ProbeTime = system_get_time() - Probes[index].StartTime;
+
+    os_sprintf(message, "Fastest mirror %s:%d (%d ms)\r\n", Mirrors[index].Host, Mirrors[index].Port,
+            Mirrors[index].ProbeTime / 1000);
+    WriteLine(message);
+
+    FinishProbing(index);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Mark the mirror as failed, finish probing when no mirror is left.
+//
+// PARAMETERS:          uint8 index - mirror
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR FailProbe(uint8 index)
+{
+    Mirrors[index].IsFailed = true;
+
+    for (index = 0; index < MirrorCount; index++)
+    {
+        if (NULL != Probes[index].Connection)
+        {
+            return;
+        }
+    }
+
+    FinishProbing(NO_MIRROR);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Drop the remaining probes and report the result.
+//
+// PARAMETERS:          uint8 winner - fastest mirror or NO_MIRROR
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR FinishProbing(uint8 winner)
+{
+    uint8 index;
+    ESPConnection* connection;
+    ProbeCallback callback = UserCallback;
+
+    if (NULL == callback)
+    {
+        return;
+    }
+
+    UserCallback = NULL;
+
+    os_timer_disarm(&ProbeTimer);
+
+    for (index = 0; index < MirrorCount; index++)
+    {
+        connection = Probes[index].Connection;
+        Probes[index].Connection = NULL;
+
+        // connections still resolving or connecting are freed by their pending callback
+        if ((NULL != connection) && (true == Probes[index].IsConnected))
+        {
+            espconn_disconnect(connection);
+        }
+    }
+
+    callback(winner);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Free a probe connection.
+//
+// PARAMETERS:          ESPConnection* connection
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR FreeConnection(ESPConnection* connection)
+{
+    if (NULL != connection->proto.tcp)
+    {
+        os_free(connection->proto.tcp);
+    }
+
+    os_free(connection);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Find the mirror of a probe connection.
+//
+// PARAMETERS:          ESPConnection* connection
+//
+// RETURN VALUE:        uint8 - mirror index, NO_MIRROR if the connection belongs to a finished probe
+//
+//======================================================================================================================
+static uint8 ICACHE_FLASH_ATTR GetProbeIndex(ESPConnection* connection)
+{
+    Probe* probe = (Probe*) connection->reverse;
+    uint8 index = probe - Probes;
+
+    if ((index < MirrorCount) && (Probes[index].Connection == connection))
+    {
+        return index;
+    }
+
+    return NO_MIRROR;
+}
@@ -0,0 +1,49 @@
+#ifndef __OTA_MIRRORS_H__
+#define __OTA_MIRRORS_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+#define OTA_MAX_MIRRORS  4
+
+#define OTA_MAX_HOST_LENGTH  32
+
+// bytes requested from each mirror while probing
+#define OTA_PROBE_SIZE  2048
+
+// time given to the mirrors to answer the probe (in ms)
+#define OTA_PROBE_TIMEOUT  5000
+
+#define NO_MIRROR  0xFF
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct
+{
+    char Host[OTA_MAX_HOST_LENGTH];
+    uint16 Port;
+    ip_addr_t IPAddress;    // 0 until resolved
+    uint32 ProbeTime;       // time to download the probe (in us), 0 if not probed
+    bool IsFailed;          // did not answer the last probe
+} Mirror;
+
+// called with the fastest mirror, or NO_MIRROR if none answered
+typedef void (*ProbeCallback)(uint8 mirror);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetMirrors(const char* list);
+uint8 ICACHE_FLASH_ATTR GetMirrorCount(void);
+Mirror* ICACHE_FLASH_ATTR GetMirror(uint8 index);
+uint8 ICACHE_FLASH_ATTR GetNextMirror(uint8 index);
+bool ICACHE_FLASH_ATTR ProbeMirrors(const char* path, ProbeCallback callback);
+
+#endif
@@ -0,0 +1,349 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+#include <spi_flash.h>
+#include <mem.h>
+#include <osapi.h>
+#include "OTA_Manager.h"
+#include "OTA_Scrub.h"
+#include "MQTT_Wrapper.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define debug
+
+#ifdef debug
+#define WriteLine UART0_Send
+#else
+#define WriteLine
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR ArmPassTimer(void);
+
+static void ICACHE_FLASH_ATTR OnPassTimer(void);
+
+static void ICACHE_FLASH_ATTR OnSlice(void);
+
+static void ICACHE_FLASH_ATTR JudgeSlot(void);
+
+static bool ICACHE_FLASH_ATTR ReadScrubFlash(uint32 address, void* data, uint32 length);
+
+static void ICACHE_FLASH_ATTR FinishScrub(const char* result);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static ScrubStatus* Scrub;
+
+// slot verified without its digest yet, NO_ROM if none
+static uint8 DigestROM = NO_ROM;
+
+static uint32 ReadBuffer[OTA_SCRUB_READ_SIZE / sizeof(uint32)];
+
+static os_timer_t PassTimer;
+
+static os_timer_t SliceTimer;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Scrub the standby ROM slot periodically, the first pass once startup is over.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR InitOTAScrub(void)
+{
+    os_timer_disarm(&PassTimer);
+    os_timer_setfn(&PassTimer, (os_timer_func_t*) OnPassTimer, NULL);
+    os_timer_arm(&PassTimer, OTA_SCRUB_START_DELAY, false);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start a pass over the ROM slot a revert boots. The image is hashed in slices and compared with
+//                      the digest recorded when it was verified, see VerifyImage in app/OTA_Manager.c. A corrupt slot
+//                      is marked bad and no longer used for a revert. A slot just verified goes first, its pass
+//                      records the digest. The result goes to status/scrub.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if a pass or an update is running, or there is no slot to check
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR RunOTAScrub(void)
+{
+    SlotMetadata metadata;
+    uint8 rom;
+    bool isRecord = (NO_ROM != DigestROM);
+
+    if (NULL != Scrub)
+    {
+        WriteLine("Scrub in progress...\r\n");
+        return false;
+    }
+
+    if (UPGRADE_FLAG_START == system_upgrade_flag_check())
+    {
+        WriteLine("Update in progress...\r\n");
+        return false;
+    }
+
+    // the standby slot is only known once the software on trial is confirmed
+    if (true == isRecord)
+    {
+        rom = DigestROM;
+    }
+    else
+    {
+        rom = (true == IsTrialBoot()) ? NO_ROM : GetRevertSlot();
+    }
+
+    if ((NO_ROM == rom) || (false == GetSlotMetadata(rom, &metadata)))
+    {
+        DigestROM = NO_ROM;
+        WriteLine("No standby ROM to scrub\r\n");
+        return false;
+    }
+
+    // a slot flashed by a tool gets verified, and its digest taken, once it runs
+    if ((0 == (metadata.Flags & SLOT_FLAG_VERIFIED))
+            || ((false == isRecord) && (0 == (metadata.Flags & SLOT_FLAG_DIGEST))))
+    {
+        DigestROM = NO_ROM;
+        WriteLine("Standby ROM image has no verified digest\r\n");
+        return false;
+    }
+
+    Scrub = (ScrubStatus*) os_zalloc(sizeof(ScrubStatus));
+
+    if (NULL == Scrub)
+    {
+        return false;
+    }
+
+    os_timer_disarm(&PassTimer);
+
+    if (true == isRecord)
+    {
+        DigestROM = NO_ROM;
+    }
+
+    Scrub->ROM = rom;
+    Scrub->IsRecord = isRecord;
+    Scrub->Metadata = metadata;
+    Scrub->Address = GetROMAddress(rom);
+    Scrub->Left = metadata.Size;
+    Scrub->StartTime = system_get_time();
+
+    SHA256Init(&Scrub->Hash);
+
+    os_timer_disarm(&SliceTimer);
+    os_timer_setfn(&SliceTimer, (os_timer_func_t*) OnSlice, NULL);
+    os_timer_arm(&SliceTimer, OTA_SCRUB_SLICE_INTERVAL, true);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Take the digest of a slot just verified, with the slices of a pass. The slot then gets scrubbed
+//                      against it. Called before the metadata is written, the pass starts once it is.
+//
+// PARAMETERS:          uint8 rom
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR RequestOTADigest(uint8 rom)
+{
+    DigestROM = rom;
+
+    // a pass running already schedules the next one once it finishes
+    if (NULL == Scrub)
+    {
+        ArmPassTimer();
+    }
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Schedule the next pass, soon for a digest to record, a period later otherwise.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ArmPassTimer(void)
+{
+    os_timer_disarm(&PassTimer);
+    os_timer_setfn(&PassTimer, (os_timer_func_t*) OnPassTimer, NULL);
+    os_timer_arm(&PassTimer, (NO_ROM != DigestROM) ? OTA_SCRUB_DIGEST_DELAY : OTA_SCRUB_PERIOD, false);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Periodic pass, tried again later if it cannot start.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnPassTimer(void)
+{
+    if (false == RunOTAScrub())
+    {
+        ArmPassTimer();
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Hash the next slice of the image, within the CPU budget. Gives way to MQTT and stops for an
+//                      update, which may write the slot.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OnSlice(void)
+{
+    uint32 start = system_get_time();
+    uint32 hashed = 0;
+    uint32 length;
+
+    if (UPGRADE_FLAG_START == system_upgrade_flag_check())
+    {
+        FinishScrub("interrupted by an update");
+        return;
+    }
+
+    if (false == QUEUE_IsEmpty(&Get_MQTTClient()->msgQueue))
+    {
+        Scrub->Skipped++;
+        return;
+    }
+
+    Scrub->Slices++;
+
+    do
+    {
+        length = (Scrub->Left < OTA_SCRUB_READ_SIZE) ? Scrub->Left : OTA_SCRUB_READ_SIZE;
+
+        if (false == ReadScrubFlash(Scrub->Address, ReadBuffer, length))
+        {
+            FinishScrub("flash read error");
+            return;
+        }
+
+        SHA256Update(&Scrub->Hash, (uint8*) ReadBuffer, length);
+
+        Scrub->Address += length;
+        Scrub->Left -= length;
+        hashed += length;
+    } while ((0 != Scrub->Left) && (hashed < OTA_SCRUB_SLICE_SIZE)
+            && ((system_get_time() - start) < OTA_SCRUB_SLICE_BUDGET));
+
+    if (0 == Scrub->Left)
+    {
+        JudgeSlot();
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Compare the digest of the pass with the one of the slot metadata, or record it there for a slot
+//                      just verified. A slot that changed during the pass, e.g. emptied for an update, is left alone.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR JudgeSlot(void)
+{
+    SlotMetadata metadata;
+    uint8 digest[SHA256_SIZE];
+
+    SHA256Final(&Scrub->Hash, digest);
+
+    // a digest to record stays valid while the image is, e.g. across its trial boot and confirmation
+    if ((false == GetSlotMetadata(Scrub->ROM, &metadata))
+            || ((false == Scrub->IsRecord) && (0 != os_memcmp(&metadata, &Scrub->Metadata, sizeof(SlotMetadata))))
+            || ((true == Scrub->IsRecord) && ((0 == (metadata.Flags & SLOT_FLAG_VERIFIED))
+                    || (metadata.Size != Scrub->Metadata.Size) || (metadata.CheckSum != Scrub->Metadata.CheckSum))))
+    {
+        FinishScrub("changed during the scrub");
+    }
+    else if (true == Scrub->IsRecord)
+    {
+        os_memcpy(metadata.Digest, digest, SHA256_SIZE);
+        metadata.Flags |= SLOT_FLAG_DIGEST;
+
+        FinishScrub((true == SetSlotMetadata(Scrub->ROM, &metadata)) ? "digest recorded" : "digest not written");
+    }
+    else if (0 == os_memcmp(digest, metadata.Digest, SHA256_SIZE))
+    {
+        FinishScrub("intact");
+    }
+    else
+    {
+        SetSlotState(Scrub->ROM, SLOT_BAD);
+        FinishScrub("corrupt, not used for revert");
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the flash for the pass
+//
+// PARAMETERS:          uint32 address - 4 byte aligned
+//                      void* data - 4 byte aligned
+//                      uint32 length
+//
+// RETURN VALUE:        bool - false on a flash error
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ReadScrubFlash(uint32 address, void* data, uint32 length)
+{
+    return (SPI_FLASH_RESULT_OK == spi_flash_read(address, (uint32*) data, length));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Report the result to UART and MQTT, release the pass and schedule the next one.
+//
+// PARAMETERS:          const char* result
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR FinishScrub(const char* result)
+{
+    char message[120];
+
+    os_timer_disarm(&SliceTimer);
+
+    os_sprintf(message, "ROM %d %s: %d bytes in %d ms, %d slices, %d given way to MQTT", Scrub->ROM, result,
+            Scrub->Metadata.Size - Scrub->Left, (system_get_time() - Scrub->StartTime) / 1000, Scrub->Slices,
+            Scrub->Skipped);
+
+    WriteLine(message);
+    WriteLine("\r\n");
+
+    MQTT_PublishStatus("scrub", message, os_strlen(message));
+
+    os_free(Scrub);
+    Scrub = NULL;
+
+    ArmPassTimer();
+}
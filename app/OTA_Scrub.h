@@ -0,0 +1,54 @@
+#ifndef __OTA_SCRUB_H__
+#define __OTA_SCRUB_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include "../drivers/BootloaderDriver.h"
+#include "SHA256.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// first pass after startup and the pause between passes over the standby ROM slot (in ms)
+#define OTA_SCRUB_START_DELAY  120000
+#define OTA_SCRUB_PERIOD  3600000
+
+// pass that records the digest of a slot just verified, see RequestOTADigest (in ms)
+#define OTA_SCRUB_DIGEST_DELAY  1000
+
+// CPU budget: a slice hashes at most OTA_SCRUB_SLICE_SIZE bytes and stops early after OTA_SCRUB_SLICE_BUDGET us,
+// one slice every OTA_SCRUB_SLICE_INTERVAL ms. A slice is skipped while MQTT has messages to send.
+#define OTA_SCRUB_SLICE_SIZE  2048
+#define OTA_SCRUB_SLICE_BUDGET  2000
+#define OTA_SCRUB_SLICE_INTERVAL  20
+
+// flash read per step of a slice
+#define OTA_SCRUB_READ_SIZE  256
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Pass over the image of a slot
+typedef struct
+{
+    uint8 ROM;
+    bool IsRecord;          // records the digest of the slot instead of comparing with it
+    SlotMetadata Metadata;  // when the pass started, a change meanwhile discards the pass
+    uint32 Address;         // next flash address to hash
+    uint32 Left;            // bytes of the image still to hash
+    SHA256Context Hash;
+    uint32 Slices;
+    uint32 Skipped;         // slices given up to MQTT
+    uint32 StartTime;       // of the pass (in us)
+} ScrubStatus;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void ICACHE_FLASH_ATTR InitOTAScrub(void);
+bool ICACHE_FLASH_ATTR RunOTAScrub(void);
+void ICACHE_FLASH_ATTR RequestOTADigest(uint8 rom);
+
+#endif
@@ -0,0 +1,183 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <osapi.h>
+#include "OTA_Sparse.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR ParseHeader(SparseStatus* sparse);
+
+static bool ICACHE_FLASH_ATTR ParseExtent(SparseStatus* sparse, WriteStatus* status);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Program the next chunk of a sparse image. Extent data is written, holes are only erased.
+//                      Start with a zeroed SparseStatus, headers may be split between chunks.
+//
+// PARAMETERS:          SparseStatus* sparse - parser position
+//                      WriteStatus* status - flash write position of the image
+//                      uint8* data - received chunk
+//                      uint16 length - chunk length
+//
+// RETURN VALUE:        bool - false on a malformed image or a flash error
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR WriteSparse(SparseStatus* sparse, WriteStatus* status, uint8* data, uint16 length)
+{
+    uint16 chunk;
+    uint8 needed;
+
+    while (0 != length)
+    {
+        // inside an extent, pass the data through
+        if (0 != sparse->DataLeft)
+        {
+            chunk = (sparse->DataLeft < length) ? sparse->DataLeft : length;
+
+            if (false == WriteFlash(status, data, chunk))
+            {
+                return false;
+            }
+
+            data += chunk;
+            length -= chunk;
+            sparse->Position += chunk;
+            sparse->DataLeft -= chunk;
+            continue;
+        }
+
+        // data after the last extent
+        if ((true == sparse->IsHeaderParsed) && (0 == sparse->ExtentCount))
+        {
+            return false;
+        }
+
+        // collect the next header
+        needed = (true == sparse->IsHeaderParsed) ? sizeof(SparseExtent) : sizeof(SparseHeader);
+        chunk = needed - sparse->BufferCount;
+        chunk = (chunk < length) ? chunk : length;
+
+        os_memcpy(sparse->Buffer + sparse->BufferCount, data, chunk);
+
+        data += chunk;
+        length -= chunk;
+        sparse->BufferCount += chunk;
+
+        if (needed == sparse->BufferCount)
+        {
+            sparse->BufferCount = 0;
+
+            if (false == ((true == sparse->IsHeaderParsed) ? ParseExtent(sparse, status) : ParseHeader(sparse)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the whole sparse image arrived and erase the hole at its end.
+//
+// PARAMETERS:          SparseStatus* sparse - parser position
+//                      WriteStatus* status - flash write position of the image
+//
+// RETURN VALUE:        bool - true if the image is complete
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR FinishSparse(SparseStatus* sparse, WriteStatus* status)
+{
+    uint32 hole;
+
+    if ((false == sparse->IsHeaderParsed) || (0 != sparse->ExtentCount) || (0 != sparse->DataLeft))
+    {
+        return false;
+    }
+
+    hole = sparse->ImageLength - sparse->Position;
+
+    if ((0 != hole) && (false == SkipFlash(status, hole)))
+    {
+        return false;
+    }
+
+    sparse->SkippedLength += hole;
+    sparse->Position = sparse->ImageLength;
+
+    return true;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Check the image header collected in the buffer.
+//
+// PARAMETERS:          SparseStatus* sparse - parser position
+//
+// RETURN VALUE:        bool - true for a supported sparse image
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ParseHeader(SparseStatus* sparse)
+{
+    SparseHeader header;
+
+    os_memcpy(&header, sparse->Buffer, sizeof(SparseHeader));
+
+    if ((SPARSE_MAGIC != header.MagicNumber) || (SPARSE_VERSION != header.Version)
+            || (header.DataLength > header.ImageLength))
+    {
+        return false;
+    }
+
+    sparse->IsHeaderParsed = true;
+    sparse->ExtentCount = header.ExtentCount;
+    sparse->ImageLength = header.ImageLength;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start the extent collected in the buffer, the hole in front of it is erased.
+//
+// PARAMETERS:          SparseStatus* sparse - parser position
+//                      WriteStatus* status - flash write position of the image
+//
+// RETURN VALUE:        bool - false for an extent out of order or outside the image
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ParseExtent(SparseStatus* sparse, WriteStatus* status)
+{
+    SparseExtent extent;
+    uint32 hole;
+
+    os_memcpy(&extent, sparse->Buffer, sizeof(SparseExtent));
+
+    if ((extent.Offset < sparse->Position) || (extent.Offset > sparse->ImageLength) || (0 != (extent.Offset % 4))
+            || (0 == extent.Length) || (extent.Length > (sparse->ImageLength - extent.Offset)))
+    {
+        return false;
+    }
+
+    hole = extent.Offset - sparse->Position;
+
+    if (false == SkipFlash(status, hole))
+    {
+        return false;
+    }
+
+    sparse->SkippedLength += hole;
+    sparse->Position = extent.Offset;
+    sparse->DataLeft = extent.Length;
+    sparse->ExtentCount--;
+
+    return true;
+}
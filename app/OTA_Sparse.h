@@ -0,0 +1,59 @@
+#ifndef __OTA_SPARSE_H__
+#define __OTA_SPARSE_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include "../drivers/Bootloader.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// "ESPS", sparse images are produced from the ROM images by tools/sparse_image.py
+#define SPARSE_MAGIC  0x53505345
+
+#define SPARSE_VERSION  1
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Sparse image layout, all fields little endian:
+//   SparseHeader, then for each extent a SparseExtent followed by Length bytes of data.
+// Extents are in ascending order, the gaps between them and after the last one up to ImageLength
+// are holes of 0xFF, which are erased but neither transferred nor written.
+typedef struct
+{
+    uint32 MagicNumber;
+    uint16 Version;
+    uint16 ExtentCount;
+    uint32 ImageLength;     // length of the ROM image, holes included
+    uint32 DataLength;      // sum of the extent lengths
+} SparseHeader;
+
+typedef struct
+{
+    uint32 Offset;          // from the start of the image, multiple of 4
+    uint32 Length;          // multiple of 4, except for an extent ending the image
+} SparseExtent;
+
+// Position of the sparse image parser, kept between the received chunks
+typedef struct
+{
+    uint8 Buffer[sizeof(SparseHeader)];  // header or extent split between chunks
+    uint8 BufferCount;
+    bool IsHeaderParsed;
+    uint16 ExtentCount;     // extents still to come
+    uint32 ImageLength;
+    uint32 Position;        // image offset of the next byte
+    uint32 DataLeft;        // data bytes left in the current extent
+    uint32 SkippedLength;   // hole bytes erased only
+} SparseStatus;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR WriteSparse(SparseStatus* sparse, WriteStatus* status, uint8* data, uint16 length);
+bool ICACHE_FLASH_ATTR FinishSparse(SparseStatus* sparse, WriteStatus* status);
+
+#endif
@@ -0,0 +1,196 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <osapi.h>
+#include "SHA256.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+static const uint32 RoundConstants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32 InitialState[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR ProcessBlock(SHA256Context* context);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Start a new hash.
+//
+// PARAMETERS:          SHA256Context* context
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SHA256Init(SHA256Context* context)
+{
+    os_memcpy(context->State, InitialState, sizeof(InitialState));
+
+    context->Length = 0;
+
+    context->BlockCount = 0;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Add data to the hash.
+//
+// PARAMETERS:          SHA256Context* context
+//                      const uint8* data
+//                      uint32 length
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SHA256Update(SHA256Context* context, const uint8* data, uint32 length)
+{
+    uint32 chunk;
+
+    context->Length += length;
+
+    while (0 != length)
+    {
+        chunk = SHA256_BLOCK_SIZE - context->BlockCount;
+        chunk = (chunk < length) ? chunk : length;
+
+        os_memcpy(context->Block + context->BlockCount, data, chunk);
+
+        data += chunk;
+        length -= chunk;
+        context->BlockCount += chunk;
+
+        if (SHA256_BLOCK_SIZE == context->BlockCount)
+        {
+            ProcessBlock(context);
+            context->BlockCount = 0;
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Pad the data and get the hash.
+//
+// PARAMETERS:          SHA256Context* context
+//                      uint8* hash - SHA256_SIZE bytes
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SHA256Final(SHA256Context* context, uint8* hash)
+{
+    uint32 bits = context->Length << 3;
+    uint8 loopIndex;
+
+    context->Block[context->BlockCount++] = 0x80;
+
+    // no room for the length, pad to the next block
+    if (context->BlockCount > (SHA256_BLOCK_SIZE - 8))
+    {
+        os_memset(context->Block + context->BlockCount, 0, SHA256_BLOCK_SIZE - context->BlockCount);
+        ProcessBlock(context);
+        context->BlockCount = 0;
+    }
+
+    os_memset(context->Block + context->BlockCount, 0, SHA256_BLOCK_SIZE - 4 - context->BlockCount);
+
+    // big endian bit length, the upper word is 0
+    context->Block[60] = (uint8) (bits >> 24);
+    context->Block[61] = (uint8) (bits >> 16);
+    context->Block[62] = (uint8) (bits >> 8);
+    context->Block[63] = (uint8) bits;
+    context->Block[59] = (uint8) (context->Length >> 29);
+
+    ProcessBlock(context);
+
+    for (loopIndex = 0; loopIndex < 8; loopIndex++)
+    {
+        hash[(loopIndex * 4) + 0] = (uint8) (context->State[loopIndex] >> 24);
+        hash[(loopIndex * 4) + 1] = (uint8) (context->State[loopIndex] >> 16);
+        hash[(loopIndex * 4) + 2] = (uint8) (context->State[loopIndex] >> 8);
+        hash[(loopIndex * 4) + 3] = (uint8) context->State[loopIndex];
+    }
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Run the compression function over the full block.
+//
+// PARAMETERS:          SHA256Context* context
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ProcessBlock(SHA256Context* context)
+{
+    uint32 schedule[64];
+    uint32 work[8];
+    uint32 temp1;
+    uint32 temp2;
+    uint8 loopIndex;
+
+    for (loopIndex = 0; loopIndex < 16; loopIndex++)
+    {
+        schedule[loopIndex] = ((uint32) context->Block[loopIndex * 4] << 24)
+                | ((uint32) context->Block[(loopIndex * 4) + 1] << 16)
+                | ((uint32) context->Block[(loopIndex * 4) + 2] << 8)
+                | ((uint32) context->Block[(loopIndex * 4) + 3]);
+    }
+
+    for (loopIndex = 16; loopIndex < 64; loopIndex++)
+    {
+        temp1 = ROTR(schedule[loopIndex - 15], 7) ^ ROTR(schedule[loopIndex - 15], 18) ^ (schedule[loopIndex - 15] >> 3);
+        temp2 = ROTR(schedule[loopIndex - 2], 17) ^ ROTR(schedule[loopIndex - 2], 19) ^ (schedule[loopIndex - 2] >> 10);
+        schedule[loopIndex] = schedule[loopIndex - 16] + temp1 + schedule[loopIndex - 7] + temp2;
+    }
+
+    os_memcpy(work, context->State, sizeof(work));
+
+    for (loopIndex = 0; loopIndex < 64; loopIndex++)
+    {
+        temp1 = work[7] + (ROTR(work[4], 6) ^ ROTR(work[4], 11) ^ ROTR(work[4], 25))
+                + ((work[4] & work[5]) ^ (~work[4] & work[6])) + RoundConstants[loopIndex] + schedule[loopIndex];
+        temp2 = (ROTR(work[0], 2) ^ ROTR(work[0], 13) ^ ROTR(work[0], 22))
+                + ((work[0] & work[1]) ^ (work[0] & work[2]) ^ (work[1] & work[2]));
+
+        work[7] = work[6];
+        work[6] = work[5];
+        work[5] = work[4];
+        work[4] = work[3] + temp1;
+        work[3] = work[2];
+        work[2] = work[1];
+        work[1] = work[0];
+        work[0] = temp1 + temp2;
+    }
+
+    for (loopIndex = 0; loopIndex < 8; loopIndex++)
+    {
+        context->State[loopIndex] += work[loopIndex];
+    }
+}
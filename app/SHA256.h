@@ -0,0 +1,34 @@
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+#define SHA256_SIZE  32
+
+#define SHA256_BLOCK_SIZE  64
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32 State[8];
+    uint32 Length;          // hashed bytes, images are far below 512 MB
+    uint8 Block[SHA256_BLOCK_SIZE];
+    uint8 BlockCount;
+} SHA256Context;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SHA256Init(SHA256Context* context);
+void ICACHE_FLASH_ATTR SHA256Update(SHA256Context* context, const uint8* data, uint32 length);
+void ICACHE_FLASH_ATTR SHA256Final(SHA256Context* context, uint8* hash);
+
+#endif
@@ -147,6 +147,7 @@ static void ICACHE_FLASH_ATTR RetryConnection(void)
 
     if (status == STATION_GOT_IP && false == IsConnected)
     {
+        SetBootPhase(BOOT_PHASE_WIFI);
         MQTT_WiFiConnectCallback(status);
         IsConnected = true;
     }
@@ -7,6 +7,9 @@
 #include "OTA_Manager.h"
 #include "../drivers/UART_APP.h"
 #include "MQTT_Wrapper.h"
+#include "OTA_Jobs.h"
+#include "OTA_Bench.h"
+#include "OTA_Scrub.h"
 
 //----------------------------------------------------------------------------------------------------------------------
 // Local macros
@@ -25,11 +28,24 @@
 //----------------------------------------------------------------------------------------------------------------------
 static void ICACHE_FLASH_ATTR PrintSystemInfo();
 
+static const char* ICACHE_FLASH_ATTR GetSlotStateName(uint8 state);
+
+static void ICACHE_FLASH_ATTR PrintLastBoot(void);
+
 static void ICACHE_FLASH_ATTR SwitchROM();
 
 static void ICACHE_FLASH_ATTR OTA_UpdateCallBack(bool result, uint8 ROM);
 
 static void ICACHE_FLASH_ATTR OTA_InvokeUpdate();
+
+static void ICACHE_FLASH_ATTR OTA_StagedCallBack(bool result, uint8 ROM);
+
+static void ICACHE_FLASH_ATTR OTA_InvokeBackgroundUpdate();
+
+static void ICACHE_FLASH_ATTR OTA_ScheduleActivation(char* arguments);
+
+static void ICACHE_FLASH_ATTR OTA_SetRateLimit(char* arguments);
+
 //======================================================================================================================
 // EXPORTED FUNCTIONS
 //======================================================================================================================
@@ -46,10 +62,15 @@ void ICACHE_FLASH_ATTR user_init(void)
 {
     char message[50];
     UART_Init(BIT_RATE_74880, BIT_RATE_74880);
+    LoadConfiguration();
+    InitBootTelemetry(GetRunningROM());
     WriteLine("\r\n\r\n================Firmware Over the Air================\r\n");
-    os_sprintf(message, "\r\n====================Loading rom %d====================\r\n", GetCurrentROM());
+    os_sprintf(message, "\r\n====================Loading rom %d====================\r\n", GetRunningROM());
     WriteLine(message);
     PrintSystemInfo();
+    PrintLastBoot();
+    InitOTAActivation();
+    InitOTAScrub();
 
 #ifdef MQTT
     WiFi_Connect();
@@ -140,6 +161,17 @@ void ICACHE_FLASH_ATTR ParseCommand(char* command)
         WriteLine("  restart   - restarts the device\r\n");
         WriteLine("  revert    - runs the other ROM image\r\n");
         WriteLine("  fota      - perform ota update, switch rom and reboot\r\n");
+        WriteLine("  warmup    - connect to the update server ahead of fota\r\n");
+        WriteLine("  fotabg    - rate limited ota update in the background, no reboot\r\n");
+        WriteLine("  fota-bench - download without writing, then erase and program the inactive rom\r\n");
+        WriteLine("  scrub     - check the image of the standby rom against its digest\r\n");
+        WriteLine("  job J;V[;L]   - update job J to firmware version V from mirrors L, skipped if done already\r\n");
+        WriteLine("  jobbg J;V[;L] - update job in the background, no reboot\r\n");
+        WriteLine("  activate [T|+N] - switch to the staged rom and reboot, now, at unix time T or in N seconds\r\n");
+        WriteLine("  rate N[,M]- background download rate N and flash rate M in bytes/s, 0 is unlimited\r\n");
+        WriteLine("  mirrors L - update servers to probe, L is host[:port],host[:port],...\r\n");
+        WriteLine("  root H    - published image root of the next update, 64 hex digits\r\n");
+        WriteLine("  confirm   - keep the software on trial after an update\r\n");
         WriteLine("  info      - show device information\r\n");
         WriteLine("\r\n");
     }
@@ -164,6 +196,76 @@ void ICACHE_FLASH_ATTR ParseCommand(char* command)
     {
         OTA_InvokeUpdate();
     }
+    else if (0 == strcmp(command, "warmup"))
+    {
+        if (WarmUpOTA())
+        {
+            WriteLine("Connecting to the update server...\r\n");
+        }
+    }
+    else if (0 == strncmp(command, "job ", 4))
+    {
+        SubmitOTAJob(command + 4, false);
+    }
+    else if (0 == strncmp(command, "jobbg ", 6))
+    {
+        SubmitOTAJob(command + 6, true);
+    }
+    else if (0 == strcmp(command, "fotabg"))
+    {
+        OTA_InvokeBackgroundUpdate();
+    }
+    else if (0 == strcmp(command, "fota-bench"))
+    {
+        if (RunOTABench())
+        {
+            WriteLine("Benchmarking...\r\n");
+        }
+    }
+    else if (0 == strcmp(command, "scrub"))
+    {
+        if (RunOTAScrub())
+        {
+            WriteLine("Scrubbing...\r\n");
+        }
+    }
+    else if (0 == strncmp(command, "activate", 8))
+    {
+        OTA_ScheduleActivation(command + 8);
+    }
+    else if (0 == strncmp(command, "rate ", 5))
+    {
+        OTA_SetRateLimit(command + 5);
+    }
+    else if (0 == strncmp(command, "root", 4))
+    {
+        if (SetOTARoot((' ' == command[4]) ? command + 5 : command + 4))
+        {
+            WriteLine("Image root set\r\n");
+        }
+        else
+        {
+            WriteLine("Cannot set the image root\r\n");
+        }
+    }
+    else if (0 == strncmp(command, "mirrors ", 8))
+    {
+        if (SetOTAMirrors(command + 8))
+        {
+            WriteLine("Update mirrors set\r\n");
+        }
+        else
+        {
+            WriteLine("Cannot set the update mirrors\r\n");
+        }
+    }
+    else if (0 == strcmp(command, "confirm"))
+    {
+        if (false == ConfirmOTA())
+        {
+            WriteLine("No software on trial\r\n");
+        }
+    }
     else if (0 == strcmp(command, "info"))
     {
         PrintSystemInfo();
@@ -184,7 +286,10 @@ void ICACHE_FLASH_ATTR ParseCommand(char* command)
 //======================================================================================================================
 static void ICACHE_FLASH_ATTR PrintSystemInfo()
 {
-    char message[50];
+    char message[90];
+    ConfigurationStatistics statistics;
+    SlotMetadata metadata;
+    uint8 rom;
 
     os_sprintf(message, "System Chip ID:      0x%x\r\n", system_get_chip_id());
     WriteLine(message);
@@ -203,6 +308,81 @@ static void ICACHE_FLASH_ATTR PrintSystemInfo()
 
     os_sprintf(message, "Current ROM:         %d\r\n", GetCurrentROM());
     WriteLine(message);
+
+    for (rom = 0; rom < GetROMCount(); rom++)
+    {
+        os_sprintf(message, "ROM %d address:       0x%x\r\n", rom, GetROMAddress(rom));
+        WriteLine(message);
+
+        if (true == GetSlotMetadata(rom, &metadata))
+        {
+            os_sprintf(message, "ROM %d image:         %s, version %d, %d bytes, build %08x\r\n", rom,
+                    GetSlotStateName(metadata.State), metadata.Version, metadata.Size, metadata.BuildID);
+            WriteLine(message);
+        }
+    }
+
+    GetConfigurationStatistics(&statistics);
+
+    os_sprintf(message, "Boot config reads:   %d cached, %d loads, %d flash reads\r\n", statistics.Hits,
+            statistics.Loads, statistics.FlashReads);
+    WriteLine(message);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Name of a ROM slot state for the system information.
+//
+// PARAMETERS:          uint8 state - SLOT_EMPTY, SLOT_STAGED, SLOT_CONFIRMED or SLOT_BAD
+//
+// RETURN VALUE:        const char* - state name
+//
+//======================================================================================================================
+static const char* ICACHE_FLASH_ATTR GetSlotStateName(uint8 state)
+{
+    switch (state)
+    {
+        case SLOT_STAGED:
+        {
+            return "staged";
+        }
+        case SLOT_CONFIRMED:
+        {
+            return "confirmed";
+        }
+        case SLOT_BAD:
+        {
+            return "bad";
+        }
+        default:
+        {
+            return "empty";
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Show how the run before the last reset ended, from the boot telemetry.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR PrintLastBoot(void)
+{
+    BootTelemetry telemetry;
+    char message[TELEMETRY_REPORT_LENGTH];
+
+    if (false == GetBootTelemetry(&telemetry, true))
+    {
+        return;
+    }
+
+    FormatBootTelemetry(&telemetry, message);
+
+    WriteLine("Last boot: ");
+    WriteLine(message);
+    WriteLine("\r\n");
 }
 
 //======================================================================================================================
@@ -218,15 +398,40 @@ static void ICACHE_FLASH_ATTR SwitchROM()
     char message[50];
     MQTT_Client* Client = Get_MQTTClient();
     uint8 currentRom = GetCurrentROM();
-    os_sprintf(message, "Switch ROM %d to ROM %d\r\n", currentRom, !currentRom);
+    uint8 revertRom;
+
+    // software on trial, the current ROM boots again once the trial is dropped
+    if (true == IsTrialBoot())
+    {
+        os_sprintf(message, "Switch ROM %d to ROM %d\r\n", GetRunningROM(), currentRom);
+        WriteLine(message);
+
+        CancelTrialBoot();
+
+        system_restart();
+        return;
+    }
+
+    // the newest confirmed software in another slot, from the slot metadata
+    revertRom = GetRevertSlot();
+
+    if (NO_ROM == revertRom)
+    {
+        WriteLine("No other software to revert to\r\n");
+        return;
+    }
+
+    os_sprintf(message, "Switch ROM %d to ROM %d\r\n", currentRom, revertRom);
     WriteLine(message);
 
-    if (false == SetCurrentROM(!currentRom))
+    // booted from the RTC data, the boot configuration is written once the reverted ROM is confirmed
+    if (false == StartRevertBoot(revertRom))
     {
         WriteLine("Unable to switch ROM...\r\n\r\n");
+        return;
     }
 
-    MQTT_PublishTopic("esp/revertdone", "Revert is completed", 19);
+    system_restart();
 }
 
 //======================================================================================================================
@@ -241,12 +446,8 @@ static void ICACHE_FLASH_ATTR OTA_UpdateCallBack(bool result, uint8 ROM)
 {
     if (true == result)
     {
-        char message[50];
-        os_sprintf(message, "Software has been updated\r\nRebooting to ROM %d...\r\n", ROM);
-        WriteLine(message);
-        SetCurrentROM(ROM);
-        DeactivateOTA();
-        system_restart();
+        WriteLine("Software has been updated\r\n");
+        ScheduleOTAActivation(0);
 
     }
     else
@@ -274,3 +475,121 @@ static void ICACHE_FLASH_ATTR OTA_InvokeUpdate()
         WriteLine("Update has failed!\r\n\r\n");
     }
 }
+
+//======================================================================================================================
+// DESCRIPTION:         Background update has finished, keep running the current ROM until activated.
+//
+// PARAMETERS:          bool result - true if the image was downloaded
+//                      uint8 ROM - slot holding the new image
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OTA_StagedCallBack(bool result, uint8 ROM)
+{
+    char message[50];
+
+    if (true == result)
+    {
+        os_sprintf(message, "Software staged in ROM %d\r\n", ROM);
+        WriteLine(message);
+        MQTT_PublishStatus("staged", message, os_strlen(message));
+    }
+    else
+    {
+        WriteLine("Background software update has failed!\r\n");
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start a rate limited update in the background.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OTA_InvokeBackgroundUpdate()
+{
+    if (ActivateBackgroundOTA((Callback) OTA_StagedCallBack))
+    {
+        WriteLine("Updating in the background...\r\n");
+    }
+    else
+    {
+        WriteLine("Update has failed!\r\n\r\n");
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Switch to the staged ROM and reboot, now or at a maintenance window.
+//
+// PARAMETERS:          char* arguments - "" for now, " T" for unix time T or " +N" for N seconds from now
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OTA_ScheduleActivation(char* arguments)
+{
+    char message[50];
+    uint32 activationTime;
+
+    while (' ' == *arguments)
+    {
+        arguments++;
+    }
+
+    if ('\0' == *arguments)
+    {
+        ScheduleOTAActivation(0);
+        return;
+    }
+
+    if ('+' == *arguments)
+    {
+        if (0 == GetOTATime())
+        {
+            WriteLine("Clock is not synchronised yet\r\n");
+            return;
+        }
+
+        activationTime = GetOTATime() + atoi(arguments + 1);
+    }
+    else
+    {
+        activationTime = atoi(arguments);
+    }
+
+    if ((0 != activationTime) && ScheduleOTAActivation(activationTime))
+    {
+        os_sprintf(message, "Activation scheduled at %u\r\n", activationTime);
+        WriteLine(message);
+        MQTT_PublishStatus("scheduled", message, os_strlen(message));
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Set the background download rate limits.
+//
+// PARAMETERS:          char* arguments - "N" or "N,M", network rate N and flash rate M in bytes per second
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR OTA_SetRateLimit(char* arguments)
+{
+    char message[60];
+    uint32 networkRate = atoi(arguments);
+    uint32 flashRate = OTA_BACKGROUND_FLASH_RATE;
+    char* separator = (char*) os_strstr(arguments, ",");
+
+    if (NULL != separator)
+    {
+        flashRate = atoi(separator + 1);
+    }
+
+    SetOTARateLimit(networkRate, flashRate);
+
+    os_sprintf(message, "Rate limit: network %d B/s, flash %d B/s\r\n", networkRate, flashRate);
+    WriteLine(message);
+}
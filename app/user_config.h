@@ -10,17 +10,54 @@
 #define MQTT_KEEPALIVE          20
 #define MQTT_CLEAN_SESSION      1
 
+// Prefix of the client ID, the chip ID is appended to make it unique per device
 #define MQTT_CLIENT_ID          "ESP"
 #define MQTT_USER               "kraykov"
 #define MQTT_PASS               "qwerty123"
 
 #define MQTT_RECONNECT_TIMEOUT  5
 
-#define UpdateTopic        "esp/update"
-#define RevertTopic        "esp/revert"
+// Version of this firmware, update jobs name the version they install. Increase it for every release.
+#define FIRMWARE_VERSION        1
+
+// Build of this firmware, kept in the metadata of its ROM slot. The Makefile passes the abbreviated git commit.
+#ifndef BUILD_ID
+#define BUILD_ID                0
+#endif
+
+// Topic layout:
+//   esp/<command>                    - broadcast to every device
+//   esp/group/<tag>/<command>        - every device carrying the group tag
+//   esp/<chip id>/<command>          - a single device
+//   esp/<chip id>/status/<name>      - status published by a single device
+#define TopicRoot          "esp"
+#define UpdateTopic        TopicRoot "/update"
+#define RevertTopic        TopicRoot "/revert"
+#define GroupTopicRoot     TopicRoot "/group"
+#define StatusTopic        "status"
+
+#define UpdateCommand      "update"    // payload "job;version[;mirrors]" is an update job, see OTA_Jobs.h
+#define RevertCommand      "revert"
+#define PrepareCommand     "prepare"   // update announcement, pre-warms the connection to the update server
+#define StageCommand       "stage"     // rate limited background update, no reboot, payload as for update
+#define ActivateCommand    "activate"  // switch to the staged ROM and reboot, payload "T" or "+N" schedules it
+#define RateCommand        "rate"      // payload "N" or "N,M", background network and flash rate in bytes/s
+#define RootCommand        "root"      // payload is the image root printed by tools/hash_tree.py
+#define BenchCommand       "bench"     // network and flash throughput of an update, results in status/bench
+#define ScrubCommand       "scrub"     // check the standby ROM slot now, result in status/scrub
+
+// Comma separated list of group tags this device belongs to
+#define DeviceGroups       "default"
+
+#define MAX_TOPIC_LENGTH   64
+
+// longest command line built from an MQTT payload, fits a full mirror list
+#define MAX_COMMAND_LENGTH 160
 
 #define DEFAULT_SECURITY        0
 #define QUEUE_BUFFER_SIZE       2048
+// queued packets waiting together go out in one TCP segment of up to this many bytes, the MSS of the SDK
+#define MQTT_SEGMENT_SIZE       1460
 
 #define PROTOCOL_NAMEv31
 
@@ -0,0 +1,316 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootSelect.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static uint8 GetCheckSum(uint8 const *start, uint8 const * const end);
+
+static bool IsInOrder(const uint8* order, uint8 count, uint8 rom);
+
+static bool IsRecordIntact(const BootConfigRecord* record);
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Calculate checksum for block of data from start up to (but excluding) end
+//
+// PARAMETERS:          uint8 const *start - from here to end
+//                      uint8 const * const end - from start up to (but excluding) end
+//
+// RETURN VALUE:        Calculated checksum
+//
+//======================================================================================================================
+static uint8 GetCheckSum(uint8 const *start, uint8 const * const end)
+{
+    uint8 chksum = DEFAULT_CHECKSUM;
+    while (start < end)
+    {
+        chksum ^= *start;
+        start++;
+    }
+    return chksum;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check if a ROM is in the boot order already
+//
+// PARAMETERS:          const uint8* order
+//                      uint8 count - ROMs in the order
+//                      uint8 rom
+//
+// RETURN VALUE:        bool - true if it is
+//
+//======================================================================================================================
+static bool IsInOrder(const uint8* order, uint8 count, uint8 rom)
+{
+    uint8 index;
+
+    for (index = 0; index < count; index++)
+    {
+        if (rom == order[index])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check a record of a configuration sector
+//
+// PARAMETERS:          const BootConfigRecord* record
+//
+// RETURN VALUE:        bool - true if it is committed, its checksum matches and its configuration is valid
+//
+//======================================================================================================================
+static bool IsRecordIntact(const BootConfigRecord* record)
+{
+    return ((BOOT_LOG_COMMIT == record->Commit)
+            && (record->CheckSum == GetCheckSum((uint8*) &record->Configuration, (uint8*) &record->CheckSum))
+            && (true == IsConfigurationValid(&record->Configuration)));
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Check a configuration before booting from it
+//
+// PARAMETERS:          const BootConfiguration* configuration
+//
+// RETURN VALUE:        bool - false if it is missing, of another version or its ROMs are out of range
+//
+//======================================================================================================================
+bool IsConfigurationValid(const BootConfiguration* configuration)
+{
+    return ((BOOT_CONFIG_MAGIC == configuration->MagicNumber) && (BOOT_CONFIG_VERSION == configuration->Version)
+            && (0 != configuration->Count) && (MAX_ROMS >= configuration->Count)
+            && (configuration->CurrentROM < configuration->Count));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Choose the configuration to boot from, see BOOT_CONFIG_COPY_SECTOR. A write torn by a power
+//                      failure only ever hits the sector not in use, the other one is intact.
+//
+// PARAMETERS:          const BootConfigRecord* first - read from the configuration sector
+//                      const BootConfigRecord* second - read from its copy
+//
+// RETURN VALUE:        const BootConfiguration* - of the intact record with the higher Sequence, else the one of the
+//                                                 configuration sector if it is valid without a record, else NULL
+//
+//======================================================================================================================
+const BootConfiguration* SelectConfiguration(const BootConfigRecord* first, const BootConfigRecord* second)
+{
+    bool isFirst = IsRecordIntact(first);
+
+    if ((true == IsRecordIntact(second))
+            && ((false == isFirst) || (second->Configuration.Sequence > first->Configuration.Sequence)))
+    {
+        return &second->Configuration;
+    }
+
+    if ((true == isFirst) || (true == IsConfigurationValid(&first->Configuration)))
+    {
+        return &first->Configuration;
+    }
+
+    return NULL;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Carry the configuration log forward into a configuration about to be rewritten. The application
+//                      appends the changes the bootloader does not read to the log, see drivers/Bootloader.c, and only
+//                      takes the newest record if it is newer than the configuration sectors. The fields of the newest
+//                      intact record are kept and its Sequence is taken, the next write is then newer than the log.
+//
+// PARAMETERS:          BootConfiguration* configuration - updated with the fields of a newer record, its Sequence
+//                                                         with the newest of both, an erased one counts as 0
+//                      FlashReader read - reads the log, no flash access of its own
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void CarryConfigLog(BootConfiguration* configuration, FlashReader read)
+{
+    // the newest record so far and the one read, swapped without a copy, the bootloader has no memcpy
+    BootConfigRecord records[2];
+    const BootConfigRecord* newest = NULL;
+    BootConfigRecord* record = &records[0];
+    uint32 sequence = (0xFFFFFFFF == configuration->Sequence) ? 0 : configuration->Sequence;
+    uint32 sector;
+    uint32 slot;
+
+    for (sector = 0; sector < BOOT_LOG_SECTORS; sector++)
+    {
+        for (slot = 0; slot < BOOT_LOG_RECORDS; slot++)
+        {
+            // records are only appended, a flash error or the first erased record ends the sector
+            if ((false == read(((BOOT_LOG_SECTOR + sector) * SECTOR_SIZE) + (slot * sizeof(BootConfigRecord)), record,
+                    sizeof(BootConfigRecord)))
+                    || ((0xFFFFFFFF == record->Configuration.MagicNumber) && (0xFFFFFFFF == record->Commit)))
+            {
+                break;
+            }
+
+            if ((true == IsRecordIntact(record)) && (record->Configuration.Sequence > sequence))
+            {
+                newest = record;
+                sequence = record->Configuration.Sequence;
+                record = (&records[0] == record) ? &records[1] : &records[0];
+            }
+        }
+    }
+
+    if (NULL != newest)
+    {
+        configuration->StagedROM = newest->Configuration.StagedROM;
+        configuration->ActivationTime = newest->Configuration.ActivationTime;
+        configuration->LastJobID = newest->Configuration.LastJobID;
+        configuration->LastJobVersion = newest->Configuration.LastJobVersion;
+        configuration->ActiveParts = newest->Configuration.ActiveParts;
+        configuration->StagedParts = newest->Configuration.StagedParts;
+    }
+
+    configuration->Sequence = sequence;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Configuration of a blank device. Parts of at least 4 MB get a factory, an A and a B slot,
+//                      smaller ones a slot in each half of the flash. No image is known yet.
+//
+// PARAMETERS:          BootConfiguration* configuration - populated with the defaults
+//                      uint32 flashSize - in bytes
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void GetDefaultConfiguration(BootConfiguration* configuration, uint32 flashSize)
+{
+    uint8* data = (uint8*) configuration;
+    uint32 index;
+
+    for (index = 0; index < sizeof(BootConfiguration); index++)
+    {
+        data[index] = 0;
+    }
+
+    configuration->MagicNumber = BOOT_CONFIG_MAGIC;
+    configuration->Version = BOOT_CONFIG_VERSION;
+    configuration->StagedROM = NO_STAGED_ROM;
+    configuration->LastJobID = NO_JOB;
+
+    configuration->ROMS[0] = BOOT_DEFAULT_ROM0;
+
+    if (BOOT_BIG_FLASH_SIZE <= flashSize)
+    {
+        configuration->Count = 3;
+        configuration->ROMS[1] = BOOT_DEFAULT_ROM1;
+        configuration->ROMS[2] = BOOT_DEFAULT_ROM2;
+    }
+    else
+    {
+        configuration->Count = 2;
+        configuration->ROMS[1] = (flashSize / 2) + BOOT_DEFAULT_ROM0;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the RTC data left by the application or the last boot
+//
+// PARAMETERS:          const RTCData* rtc
+//
+// RETURN VALUE:        bool - false after power on
+//
+//======================================================================================================================
+bool IsRTCDataValid(const RTCData* rtc)
+{
+    return ((RTC_MAGIC == rtc->MagicNumber) && (rtc->CheckSum == GetCheckSum((uint8*) rtc, (uint8*) &rtc->CheckSum)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Order the ROMs to try booting, from the configuration and the slot metadata only. A ROM
+//                      requested once through the RTC data goes first, then the current ROM, then the other
+//                      confirmed ROMs with the newest image first and the factory ROM last. Empty and bad slots
+//                      are left out, apart from the ROMs the configuration or the RTC data ask for.
+//
+// PARAMETERS:          const BootConfiguration* configuration - valid, see IsConfigurationValid
+//                      const RTCData* rtc - valid RTC data or NULL
+//                      uint8* order - populated with up to MAX_ROMS ROMs
+//                      bool* isTemp - set if the first ROM is booted once from the RTC data
+//
+// RETURN VALUE:        uint8 - ROMs in the order
+//
+//======================================================================================================================
+uint8 GetBootOrder(const BootConfiguration* configuration, const RTCData* rtc, uint8* order, bool* isTemp)
+{
+    const SlotMetadata* slots = configuration->Slots;
+    uint8 count = 0;
+    uint8 best;
+    uint8 rom;
+
+    *isTemp = false;
+
+    if ((NULL != rtc) && (0 != (rtc->NextMode & MODE_TEMP_ROM)) && (rtc->TempROM < configuration->Count))
+    {
+        order[count++] = rtc->TempROM;
+        *isTemp = true;
+    }
+
+    if (false == IsInOrder(order, count, configuration->CurrentROM))
+    {
+        order[count++] = configuration->CurrentROM;
+    }
+
+    // the confirmed ROMs, newest image first
+    do
+    {
+        best = NO_ROM;
+
+        for (rom = 0; rom < configuration->Count; rom++)
+        {
+            if ((SLOT_CONFIRMED == slots[rom].State) && (false == IsInOrder(order, count, rom))
+                    && ((configuration->Count <= 2) || (FACTORY_ROM != rom))
+                    && ((NO_ROM == best) || (slots[rom].Version > slots[best].Version)))
+            {
+                best = rom;
+            }
+        }
+
+        if (NO_ROM != best)
+        {
+            order[count++] = best;
+        }
+    } while (NO_ROM != best);
+
+    // the last resort, flashed in production before any metadata was recorded
+    if ((configuration->Count > 2) && (SLOT_BAD != slots[FACTORY_ROM].State)
+            && (false == IsInOrder(order, count, FACTORY_ROM)))
+    {
+        order[count++] = FACTORY_ROM;
+    }
+
+    return count;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Decide if an image may boot without reading it whole. Its checksum was verified once it was
+//                      written and recorded in the slot metadata, the headers must still describe that image.
+//
+// PARAMETERS:          const SlotMetadata* metadata
+//                      const ImageInfo* info - from the headers of the image in the slot, see GetImageInfo
+//
+// RETURN VALUE:        bool - false if the image needs a full check
+//
+//======================================================================================================================
+bool IsFastBoot(const SlotMetadata* metadata, const ImageInfo* info)
+{
+    return ((0 != (metadata->Flags & SLOT_FLAG_VERIFIED)) && (SLOT_BAD != metadata->State)
+            && (metadata->Size == info->Length) && (metadata->CheckSum == info->CheckSum));
+}
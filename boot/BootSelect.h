@@ -0,0 +1,40 @@
+#ifndef __BOOT_SELECT_H__
+#define __BOOT_SELECT_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "../drivers/BootloaderDriver.h"
+#include "../drivers/BootImage.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// default layout of parts of at least 4 MB: factory, A and B, see MAX_ROMS
+#define BOOT_BIG_FLASH_SIZE  0x400000
+
+#define BOOT_DEFAULT_ROM0    0x002000
+
+#ifdef SINGLE_IMAGE
+// each slot SINGLE_IMAGE_OFFSET into its own block, the third block holds the bundle regions and the configuration log
+#define BOOT_DEFAULT_ROM1    0x102000
+#define BOOT_DEFAULT_ROM2    0x302000
+#else
+#define BOOT_DEFAULT_ROM1    0x082000
+#define BOOT_DEFAULT_ROM2    0x102000
+#endif
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//
+// Boot decisions without flash or hardware access of their own, they also compile for the host with BOOT_HOST.
+//======================================================================================================================
+bool IsConfigurationValid(const BootConfiguration* configuration);
+const BootConfiguration* SelectConfiguration(const BootConfigRecord* first, const BootConfigRecord* second);
+void CarryConfigLog(BootConfiguration* configuration, FlashReader read);
+void GetDefaultConfiguration(BootConfiguration* configuration, uint32 flashSize);
+bool IsRTCDataValid(const RTCData* rtc);
+uint8 GetBootOrder(const BootConfiguration* configuration, const RTCData* rtc, uint8* order, bool* isTemp);
+bool IsFastBoot(const SlotMetadata* metadata, const ImageInfo* info);
+
+#endif
@@ -0,0 +1,83 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootStage2a.h"
+#include "../drivers/BootImage.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define NOINLINE __attribute__ ((noinline))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+extern uint32 SPIRead(uint32 address, void* data, uint32 length);
+
+static UserCode* NOINLINE LoadROM(uint32 position);
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Copy the sections of an image to RAM
+//
+// PARAMETERS:          uint32 position - flash address of the ImageHeader, see ImageInfo.LoadAddress
+//
+// RETURN VALUE:        UserCode* - entry point of the image
+//
+//======================================================================================================================
+static UserCode* NOINLINE LoadROM(uint32 position)
+{
+    ImageHeader header;
+    SectionHeader section;
+    uint8* destination;
+    uint32 remaining;
+    uint32 length;
+    uint8 count;
+
+    SPIRead(position, &header, sizeof(ImageHeader));
+    position += sizeof(ImageHeader);
+
+    for (count = header.Count; 0 != count; count--)
+    {
+        SPIRead(position, &section, sizeof(SectionHeader));
+        position += sizeof(SectionHeader);
+
+        destination = (uint8*) section.Address;
+        remaining = section.Length;
+
+        while (0 != remaining)
+        {
+            length = (remaining < STAGE2A_READ_SIZE) ? remaining : STAGE2A_READ_SIZE;
+
+            SPIRead(position, destination, length);
+
+            position += length;
+            destination += length;
+            remaining -= length;
+        }
+    }
+
+    return (UserCode*) header.Entry;
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Load the image chosen by the bootloader and run it
+//
+// PARAMETERS:          uint32 position - flash address of the ImageHeader, see ImageInfo.LoadAddress
+//
+// RETURN VALUE:        void - does not return
+//
+//======================================================================================================================
+void call_user_start(uint32 position)
+{
+    UserCode* user = LoadROM(position);
+
+    user();
+}
@@ -0,0 +1,28 @@
+#ifndef __BOOT_STAGE2A_H__
+#define __BOOT_STAGE2A_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// flash read per step of the copy
+#define STAGE2A_READ_SIZE  0x1000
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+typedef void UserCode(void);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//
+// Runs at the top of IRAM, see ld/boot_stage2a.ld, and is copied there by the bootloader, whose own code is
+// overwritten by the sections of the image. No ROM function but SPIRead and no static data may be used.
+//======================================================================================================================
+void call_user_start(uint32 position);
+
+#endif
@@ -0,0 +1,328 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootloaderDriver.h"
+// generated by esptool2 -header from boot/BootStage2a.c, see the Makefile
+#include "BootStage2aImage.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local macros
+//----------------------------------------------------------------------------------------------------------------------
+#define NOINLINE __attribute__ ((noinline))
+
+// called from the assembly of call_user_start only
+#define USED __attribute__ ((used))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+extern uint32 SPIRead(uint32 address, void* data, uint32 length);
+extern uint32 SPIWrite(uint32 address, const void* data, uint32 length);
+extern uint32 SPIEraseSector(int sector);
+extern void ets_printf(const char* format, ...);
+extern void* ets_memcpy(void* destination, const void* source, uint32 length);
+
+static uint8 GetCheckSum(uint8 const *start, uint8 const * const end);
+
+static bool ReadFlash(uint32 address, void* data, uint32 length);
+
+static bool WriteConfiguration(BootConfiguration* configuration, bool* isCopy);
+
+static uint32 GetFlashSize(void);
+
+static bool GetRTCData(RTCData* rtc);
+
+static void SetRTCData(RTCData* rtc);
+
+static uint32 NOINLINE USED FindImage(void);
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Calculate checksum for block of data from start up to (but excluding) end
+//
+// PARAMETERS:          uint8 const *start - from here to end
+//                      uint8 const * const end - from start up to (but excluding) end
+//
+// RETURN VALUE:        Calculated checksum
+//
+//======================================================================================================================
+static uint8 GetCheckSum(uint8 const *start, uint8 const * const end)
+{
+    uint8 chksum = DEFAULT_CHECKSUM;
+    while (start < end)
+    {
+        chksum ^= *start;
+        start++;
+    }
+    return chksum;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the flash through the ROM code, see FlashReader
+//
+// PARAMETERS:          uint32 address - 4 byte aligned
+//                      void* data - 4 byte aligned
+//                      uint32 length
+//
+// RETURN VALUE:        bool - false on a flash error
+//
+//======================================================================================================================
+static bool ReadFlash(uint32 address, void* data, uint32 length)
+{
+    return (0 == SPIRead(address, data, length));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write the configuration to the configuration sector not in use, as a record with the next
+//                      Sequence, see BOOT_CONFIG_COPY_SECTOR. The newer records of the configuration log are carried
+//                      forward, see CarryConfigLog, else the application would take the rewrite for newer than them.
+//
+// PARAMETERS:          BootConfiguration* configuration - its Sequence is set past the log, updated from the log
+//                      bool* isCopy - set if the configuration in use is the one of the copy, updated
+//
+// RETURN VALUE:        bool - false on a flash error
+//
+//======================================================================================================================
+static bool WriteConfiguration(BootConfiguration* configuration, bool* isCopy)
+{
+    BootConfigRecord record;
+    uint32 sector = (true == *isCopy) ? BOOT_CONFIG_SECTOR : BOOT_CONFIG_COPY_SECTOR;
+    uint32 address = sector * SECTOR_SIZE;
+
+    CarryConfigLog(configuration, ReadFlash);
+
+    configuration->Sequence++;
+
+    ets_memcpy(&record.Configuration, configuration, sizeof(BootConfiguration));
+    record.CheckSum = GetCheckSum((uint8*) &record.Configuration, (uint8*) &record.CheckSum);
+    record.Reserved[0] = 0xFF;
+    record.Reserved[1] = 0xFF;
+    record.Reserved[2] = 0xFF;
+    record.Commit = BOOT_LOG_COMMIT;
+
+    // the commit goes last, a record cut short by a power failure is never taken for valid
+    if ((0 != SPIEraseSector(sector)) || (0 != SPIWrite(address, &record, sizeof(BootConfigRecord) - sizeof(uint32)))
+            || (0 != SPIWrite(address + sizeof(BootConfigRecord) - sizeof(uint32), &record.Commit, sizeof(uint32))))
+    {
+        return false;
+    }
+
+    *isCopy = (BOOT_CONFIG_COPY_SECTOR == sector);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Flash size from the header of the bootloader, as set by the flash tool
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32 - in bytes
+//
+//======================================================================================================================
+static uint32 GetFlashSize(void)
+{
+    ImageHeader header;
+
+    if (false == ReadFlash(0, &header, sizeof(ImageHeader)))
+    {
+        return BOOT_BIG_FLASH_SIZE;
+    }
+
+    switch (header.Flags2 >> BOOT_FLASH_SIZE_SHIFT)
+    {
+        case 0:
+            return 0x80000;
+
+        case 1:
+            return 0x40000;
+
+        case 2:
+            return 0x100000;
+
+        case 3:
+            return 0x200000;
+
+        default:
+            return BOOT_BIG_FLASH_SIZE;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the RTC data, see GetRTCData in drivers/Bootloader.c
+//
+// PARAMETERS:          RTCData* rtc - populated with the data
+//
+// RETURN VALUE:        bool - false after power on
+//
+//======================================================================================================================
+static bool GetRTCData(RTCData* rtc)
+{
+    volatile uint32* memory = (volatile uint32*) (BOOT_RTC_MEMORY + (RTC_ADDRESS * 4));
+    uint32* data = (uint32*) rtc;
+    uint32 index;
+
+    for (index = 0; index < (sizeof(RTCData) / sizeof(uint32)); index++)
+    {
+        data[index] = memory[index];
+    }
+
+    return IsRTCDataValid(rtc);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write the RTC data with its checksum
+//
+// PARAMETERS:          RTCData* rtc
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void SetRTCData(RTCData* rtc)
+{
+    volatile uint32* memory = (volatile uint32*) (BOOT_RTC_MEMORY + (RTC_ADDRESS * 4));
+    uint32* data = (uint32*) rtc;
+    uint32 index;
+
+    rtc->CheckSum = GetCheckSum((uint8*) rtc, (uint8*) &rtc->CheckSum);
+
+    for (index = 0; index < (sizeof(RTCData) / sizeof(uint32)); index++)
+    {
+        memory[index] = data[index];
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Choose the ROM to boot and copy the loader. An image verified once it was written boots from
+//                      its headers, see IsFastBoot, any other is checked in full. A ROM that fails is skipped for the
+//                      next one of the boot order, the configuration then gets it as its current ROM.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32 - flash address of the ImageHeader to load, 0 if no ROM boots
+//
+//======================================================================================================================
+static uint32 NOINLINE USED FindImage(void)
+{
+    BootConfiguration configuration;
+    BootConfigRecord records[2];
+    const BootConfiguration* selected = NULL;
+    RTCData rtc;
+    ImageInfo info;
+    uint8 order[MAX_ROMS];
+    uint8 count;
+    uint8 index;
+    uint8 rom = NO_ROM;
+    bool isRTCValid;
+    bool isTemp;
+    bool isFast = false;
+    bool isCopy;
+
+    ets_printf("\r\nBootloader\r\n");
+
+    if ((true == ReadFlash(BOOT_CONFIG_SECTOR * SECTOR_SIZE, &records[0], sizeof(BootConfigRecord)))
+            && (true == ReadFlash(BOOT_CONFIG_COPY_SECTOR * SECTOR_SIZE, &records[1], sizeof(BootConfigRecord))))
+    {
+        selected = SelectConfiguration(&records[0], &records[1]);
+    }
+
+    if (NULL == selected)
+    {
+        ets_printf("Writing the default configuration\r\n");
+
+        // goes to the configuration sector
+        isCopy = true;
+
+        GetDefaultConfiguration(&configuration, GetFlashSize());
+        WriteConfiguration(&configuration, &isCopy);
+    }
+    else
+    {
+        isCopy = (selected == &records[1].Configuration);
+
+        ets_memcpy(&configuration, selected, sizeof(BootConfiguration));
+    }
+
+    isRTCValid = GetRTCData(&rtc);
+
+    count = GetBootOrder(&configuration, (true == isRTCValid) ? &rtc : NULL, order, &isTemp);
+
+    for (index = 0; index < count; index++)
+    {
+        rom = order[index];
+
+        if ((true == GetImageInfo(configuration.ROMS[rom], ReadFlash, &info))
+                && (true == IsFastBoot(&configuration.Slots[rom], &info)))
+        {
+            isFast = true;
+            break;
+        }
+
+        if (true == CheckImage(configuration.ROMS[rom], ReadFlash, &info))
+        {
+            break;
+        }
+
+        ets_printf("ROM %d is not valid\r\n", rom);
+    }
+
+    if (index == count)
+    {
+        ets_printf("No ROM to boot\r\n");
+        return 0;
+    }
+
+    // a standard boot fell back to another ROM, make it current. The temp ROM does not change the configuration.
+    if (((false == isTemp) || (0 != index)) && (rom != configuration.CurrentROM))
+    {
+        configuration.CurrentROM = rom;
+        WriteConfiguration(&configuration, &isCopy);
+    }
+
+    if (false == isRTCValid)
+    {
+        rtc.MagicNumber = RTC_MAGIC;
+        rtc.TempROM = 0;
+    }
+
+    rtc.LastMode = ((true == isTemp) && (0 == index)) ? MODE_TEMP_ROM : MODE_STANDARD;
+    rtc.LastROM = rom;
+    rtc.NextMode = MODE_STANDARD;
+    SetRTCData(&rtc);
+
+    ets_printf("Booting ROM %d at 0x%x, %s\r\n", rom, configuration.ROMS[rom], (true == isFast) ? "verified" : "checked");
+
+    ets_memcpy((void*) _text_addr, _text_data, _text_len);
+
+    return info.LoadAddress;
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Entry of the bootloader, jumps to the loader with the image found, in a2
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void - returns to the ROM code only if no ROM boots
+//
+//======================================================================================================================
+void call_user_start(void)
+{
+    __asm volatile (
+        "mov a15, a0\n"             // keep the return address
+        "call0 FindImage\n"
+        "mov a0, a15\n"
+        "bnez a2, 1f\n"
+        "ret\n"
+        "1:\n"
+        "movi a3, entry_addr\n"     // the loader, copied by FindImage
+        "l32i a3, a3, 0\n"
+        "jx a3\n"
+    );
+}
@@ -0,0 +1,26 @@
+#ifndef __BOOT_LOADER_H__
+#define __BOOT_LOADER_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootSelect.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// RTC user memory as the ROM code sees it, a block is 4 bytes, see RTC_ADDRESS
+#define BOOT_RTC_MEMORY      0x60001100
+
+// flash size nibble of the header of the bootloader itself, at address 0
+#define BOOT_FLASH_SIZE_SHIFT 4
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//
+// Entry of the bootloader, see ld/boot.ld. It chooses a ROM, copies the loader of boot/BootStage2a.c to the top of
+// IRAM and jumps to it with the flash address of the image.
+//======================================================================================================================
+void call_user_start(void);
+
+#endif
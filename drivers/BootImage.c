@@ -0,0 +1,174 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootImage.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR AddCheckSum(FlashReader read, uint32 address, uint32 length, uint8* checksum);
+
+static bool ICACHE_FLASH_ATTR WalkImage(uint32 address, FlashReader read, ImageInfo* info, bool isChecked);
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Add a section of the image to its checksum
+//
+// PARAMETERS:          FlashReader read
+//                      uint32 address - section data, word aligned
+//                      uint32 length - section length, multiple of 4
+//                      uint8* checksum - running checksum
+//
+// RETURN VALUE:        bool - false on a flash error
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR AddCheckSum(FlashReader read, uint32 address, uint32 length, uint8* checksum)
+{
+    uint32 buffer[IMAGE_READ_SIZE / sizeof(uint32)];
+    uint8* data = (uint8*) buffer;
+    uint32 chunk;
+    uint32 index;
+
+    while (0 != length)
+    {
+        chunk = (length < IMAGE_READ_SIZE) ? length : IMAGE_READ_SIZE;
+
+        if (false == read(address, buffer, chunk))
+        {
+            return false;
+        }
+
+        for (index = 0; index < chunk; index++)
+        {
+            *checksum ^= data[index];
+        }
+
+        address += chunk;
+        length -= chunk;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Follow the headers of an image, optionally checksumming its sections on the way
+//
+// PARAMETERS:          uint32 address - flash address of the image
+//                      FlashReader read
+//                      ImageInfo* info - populated with the image layout
+//                      bool isChecked - read the section data and compare the checksum
+//
+// RETURN VALUE:        bool - false if the headers are malformed, the checksum differs or on a flash error
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR WalkImage(uint32 address, FlashReader read, ImageInfo* info, bool isChecked)
+{
+    ImageHeaderNew header;
+    SectionHeader section;
+    uint32 block[IMAGE_ALIGN / sizeof(uint32)];
+    uint32 position = address;
+    uint8 checksum = DEFAULT_CHECKSUM;
+    uint8 count;
+
+    if (false == read(position, &header, sizeof(ImageHeaderNew)))
+    {
+        return false;
+    }
+
+    // the irom0 section comes first, ahead of the usual header
+    if ((IMAGE_MAGIC_NEW1 == header.Magic) && (IMAGE_MAGIC_NEW2 == header.Count))
+    {
+        position += sizeof(ImageHeaderNew);
+
+        if ((IMAGE_MAX_LENGTH < header.Length)
+                || ((true == isChecked) && (false == AddCheckSum(read, position, header.Length, &checksum))))
+        {
+            return false;
+        }
+
+        position += header.Length;
+
+        if (false == read(position, &header, sizeof(ImageHeader)))
+        {
+            return false;
+        }
+    }
+
+    if ((IMAGE_MAGIC != header.Magic) || (IMAGE_MAX_SECTIONS < header.Count))
+    {
+        return false;
+    }
+
+    info->Entry = header.Entry;
+    info->LoadAddress = position;
+
+    position += sizeof(ImageHeader);
+
+    for (count = header.Count; 0 != count; count--)
+    {
+        if (false == read(position, &section, sizeof(SectionHeader)))
+        {
+            return false;
+        }
+
+        position += sizeof(SectionHeader);
+
+        if ((IMAGE_MAX_LENGTH < section.Length)
+                || ((true == isChecked) && (false == AddCheckSum(read, position, section.Length, &checksum))))
+        {
+            return false;
+        }
+
+        position += section.Length;
+    }
+
+    // last byte of the 16 byte block, read whole to keep the flash access aligned
+    position |= (IMAGE_ALIGN - 1);
+
+    if (false == read(position - (IMAGE_ALIGN - 1), block, IMAGE_ALIGN))
+    {
+        return false;
+    }
+
+    info->CheckSum = ((uint8*) block)[IMAGE_ALIGN - 1];
+    info->Length = position + 1 - address;
+
+    return ((false == isChecked) || (checksum == info->CheckSum));
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Get the layout of an image from its headers, the section data is not read
+//
+// PARAMETERS:          uint32 address - flash address of the image
+//                      FlashReader read
+//                      ImageInfo* info - populated with the image layout
+//
+// RETURN VALUE:        bool - false if the headers are malformed or on a flash error
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR GetImageInfo(uint32 address, FlashReader read, ImageInfo* info)
+{
+    return WalkImage(address, read, info, false);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check an image against its checksum, every section is read
+//
+// PARAMETERS:          uint32 address - flash address of the image
+//                      FlashReader read
+//                      ImageInfo* info - populated with the image layout
+//
+// RETURN VALUE:        bool - true if the image is intact
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR CheckImage(uint32 address, FlashReader read, ImageInfo* info)
+{
+    return WalkImage(address, read, info, true);
+}
@@ -0,0 +1,75 @@
+#ifndef __BOOT_IMAGE_H__
+#define __BOOT_IMAGE_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootloaderDriver.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// Image layout made by esptool2 -boot2 -iromchksum, see the Makefile:
+//   ImageHeaderNew followed by the irom0 section, then ImageHeader followed by Count sections, each a SectionHeader
+//   and its data. The checksum is the last byte of the 16 byte block after the last section, it covers the data of
+//   all sections, irom0 included.
+#define IMAGE_MAGIC         0xE9
+#define IMAGE_MAGIC_NEW1    0xEA
+#define IMAGE_MAGIC_NEW2    0x04
+
+#define IMAGE_ALIGN         16
+
+// sanity limits of a header read from flash, a slot never holds more
+#define IMAGE_MAX_SECTIONS  16
+#define IMAGE_MAX_LENGTH    0x100000
+
+// flash read per step of the checksum
+#define IMAGE_READ_SIZE     256
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint8 Magic;
+    uint8 Count;
+    uint8 Flags1;
+    uint8 Flags2;
+    uint32 Entry;
+} ImageHeader;
+
+typedef struct
+{
+    uint8 Magic;
+    uint8 Count;
+    uint8 Flags1;
+    uint8 Flags2;
+    uint32 Entry;
+    uint32 Address;         // irom0 section, mapped from flash
+    uint32 Length;
+} ImageHeaderNew;
+
+typedef struct
+{
+    uint32 Address;
+    uint32 Length;
+} SectionHeader;
+
+typedef struct
+{
+    uint32 Entry;
+    uint32 LoadAddress;     // flash address of the ImageHeader of the sections loaded to RAM
+    uint32 Length;          // from the start of the image up to and including the checksum
+    uint8 CheckSum;         // stored in the image
+} ImageInfo;
+
+// reads flash for the image functions, returns false on a flash error
+typedef bool (*FlashReader)(uint32 address, void* data, uint32 length);
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR GetImageInfo(uint32 address, FlashReader read, ImageInfo* info);
+bool ICACHE_FLASH_ATTR CheckImage(uint32 address, FlashReader read, ImageInfo* info);
+
+#endif
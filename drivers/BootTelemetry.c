@@ -0,0 +1,214 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+#include <osapi.h>
+#include "BootTelemetry.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static uint32 ICACHE_FLASH_ATTR GetCRC(const uint8* data, uint32 length);
+
+static bool ICACHE_FLASH_ATTR ReadTelemetry(BootTelemetry* telemetry);
+
+static void ICACHE_FLASH_ATTR WriteTelemetry(void);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static BootTelemetry Current;
+
+static BootTelemetry Previous;
+
+static bool IsPreviousValid;
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         CRC-32 (IEEE 802.3) of a block of data
+//
+// PARAMETERS:          const uint8* data
+//                      uint32 length
+//
+// RETURN VALUE:        uint32 - CRC
+//
+//======================================================================================================================
+static uint32 ICACHE_FLASH_ATTR GetCRC(const uint8* data, uint32 length)
+{
+    uint32 crc = 0xFFFFFFFF;
+    uint8 bit;
+
+    while (0 != length--)
+    {
+        crc ^= *data++;
+
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the record from the RTC memory
+//
+// PARAMETERS:          BootTelemetry* telemetry - populated with the record
+//
+// RETURN VALUE:        bool - false after power on, or for a record of another version
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ReadTelemetry(BootTelemetry* telemetry)
+{
+    if (!system_rtc_mem_read(TELEMETRY_RTC_ADDRESS, telemetry, sizeof(BootTelemetry)))
+    {
+        return false;
+    }
+
+    return ((TELEMETRY_MAGIC == telemetry->MagicNumber) && (TELEMETRY_VERSION == telemetry->Version)
+            && (telemetry->CRC == GetCRC((uint8*) telemetry, sizeof(BootTelemetry) - sizeof(uint32))));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write the record of this boot to the RTC memory
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR WriteTelemetry(void)
+{
+    Current.CRC = GetCRC((uint8*) &Current, sizeof(BootTelemetry) - sizeof(uint32));
+
+    system_rtc_mem_write(TELEMETRY_RTC_ADDRESS, &Current, sizeof(BootTelemetry));
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Keep the record of the boot before and start the one of this boot. Call first thing at startup.
+//
+// PARAMETERS:          uint8 rom - ROM booted
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR InitBootTelemetry(uint8 rom)
+{
+    struct rst_info* reset = system_get_rst_info();
+
+    IsPreviousValid = ReadTelemetry(&Previous);
+
+    os_memset(&Current, 0, sizeof(BootTelemetry));
+
+    Current.MagicNumber = TELEMETRY_MAGIC;
+    Current.Version = TELEMETRY_VERSION;
+    Current.ResetReason = reset->reason;
+    Current.ROM = rom;
+    Current.Attempts = 1;
+
+    if ((true == IsPreviousValid) && (0 == Previous.PhaseTime[BOOT_PHASE_MQTT]) && (0xFF != Previous.Attempts))
+    {
+        Current.Attempts = Previous.Attempts + 1;
+    }
+
+    if ((REASON_EXCEPTION_RST == reset->reason) || (REASON_SOFT_WDT_RST == reset->reason)
+            || (REASON_WDT_RST == reset->reason))
+    {
+        Current.ExceptionCause = reset->exccause;
+        Current.ExceptionAddress = reset->epc1;
+    }
+
+    Current.PhaseTime[BOOT_PHASE_INIT] = system_get_time();
+
+    WriteTelemetry();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Stamp a startup phase with the time since the reset, only the first time it is reached
+//
+// PARAMETERS:          uint8 phase - BOOT_PHASE_...
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SetBootPhase(uint8 phase)
+{
+    if ((phase >= BOOT_PHASES) || (0 != Current.PhaseTime[phase]))
+    {
+        return;
+    }
+
+    Current.PhaseTime[phase] = system_get_time();
+
+    WriteTelemetry();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Keep the OTA phase reached, for the report after the next reset
+//
+// PARAMETERS:          uint8 phase - OTA_PHASE_...
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR SetOTAPhase(uint8 phase)
+{
+    if (phase == Current.OTAPhase)
+    {
+        return;
+    }
+
+    Current.OTAPhase = phase;
+
+    WriteTelemetry();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the record of this boot or of the boot before
+//
+// PARAMETERS:          BootTelemetry* telemetry - populated with the record
+//                      bool isPrevious - the record of the boot before
+//
+// RETURN VALUE:        bool - false if there is no record of the boot before, e.g. after power on
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR GetBootTelemetry(BootTelemetry* telemetry, bool isPrevious)
+{
+    if (false == isPrevious)
+    {
+        *telemetry = Current;
+        return true;
+    }
+
+    *telemetry = Previous;
+
+    return IsPreviousValid;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Describe a record in one line, the phases in ms since the reset
+//
+// PARAMETERS:          const BootTelemetry* telemetry
+//                      char* buffer - at least TELEMETRY_REPORT_LENGTH bytes
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR FormatBootTelemetry(const BootTelemetry* telemetry, char* buffer)
+{
+    os_sprintf(buffer, "reset %d, exception %d at 0x%x, ROM %d, attempt %d, init %d ms, wifi %d ms, mqtt %d ms, "
+            "confirmed %d ms, ota phase %d", telemetry->ResetReason, telemetry->ExceptionCause,
+            telemetry->ExceptionAddress, telemetry->ROM, telemetry->Attempts,
+            telemetry->PhaseTime[BOOT_PHASE_INIT] / 1000, telemetry->PhaseTime[BOOT_PHASE_WIFI] / 1000,
+            telemetry->PhaseTime[BOOT_PHASE_MQTT] / 1000, telemetry->PhaseTime[BOOT_PHASE_CONFIRMED] / 1000,
+            telemetry->OTAPhase);
+}
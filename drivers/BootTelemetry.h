@@ -0,0 +1,83 @@
+#ifndef __BOOT_TELEMETRY_H__
+#define __BOOT_TELEMETRY_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootloaderDriver.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+#define TELEMETRY_MAGIC 0x544C4D59
+
+// layout of BootTelemetry, a record of another version is discarded
+#define TELEMETRY_VERSION 0x01
+
+// startup phases, each stamped once per boot
+#define BOOT_PHASE_INIT 0           // user_init
+
+#define BOOT_PHASE_WIFI 1           // IP address received
+
+#define BOOT_PHASE_MQTT 2           // MQTT broker reached, the boot counts as successful
+
+#define BOOT_PHASE_CONFIRMED 3      // software on trial confirmed
+
+#define BOOT_PHASES 4
+
+// OTA phases, the last one reached is kept
+#define OTA_PHASE_NONE 0
+
+#define OTA_PHASE_DOWNLOAD 1        // update started
+
+#define OTA_PHASE_VERIFY 2          // image received, checked before staging
+
+#define OTA_PHASE_STAGED 3
+
+#define OTA_PHASE_FAILED 4          // update ended without a staged image
+
+#define OTA_PHASE_ACTIVATE 5        // restart to the staged ROM
+
+#define OTA_PHASE_TRIAL 6           // staged ROM running on trial
+
+#define OTA_PHASE_CONFIRMED 7
+
+#define OTA_PHASE_ROLLBACK 8        // trial not confirmed, previous ROM kept
+
+// longest line of FormatBootTelemetry
+#define TELEMETRY_REPORT_LENGTH 160
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Record of a boot in the RTC memory, see TELEMETRY_RTC_ADDRESS. It survives soft resets, the one of the boot before
+// is read back at startup, so why and where the last run ended is known without a flash write.
+typedef struct
+{
+    uint32 MagicNumber;         // TELEMETRY_MAGIC
+    uint8 Version;              // TELEMETRY_VERSION
+    uint8 ResetReason;          // rst_info reason that started this boot, REASON_DEFAULT_RST after power on
+    uint8 ROM;                  // ROM booted
+    uint8 Attempts;             // boots since the last one that reached BOOT_PHASE_MQTT, this one included
+    uint32 ExceptionCause;      // rst_info of an exception reset
+    uint32 ExceptionAddress;
+    uint32 PhaseTime[BOOT_PHASES];  // time since the reset each phase was reached (in us), 0 if not reached
+    uint8 OTAPhase;             // last OTA phase reached
+    uint8 Reserved[3];
+    uint32 CRC;                 // CRC-32 of the record up to here
+} BootTelemetry;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void ICACHE_FLASH_ATTR InitBootTelemetry(uint8 rom);
+
+void ICACHE_FLASH_ATTR SetBootPhase(uint8 phase);
+
+void ICACHE_FLASH_ATTR SetOTAPhase(uint8 phase);
+
+bool ICACHE_FLASH_ATTR GetBootTelemetry(BootTelemetry* telemetry, bool isPrevious);
+
+void ICACHE_FLASH_ATTR FormatBootTelemetry(const BootTelemetry* telemetry, char* buffer);
+
+#endif
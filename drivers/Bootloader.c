@@ -4,15 +4,96 @@
 #include <string.h>
 #include <c_types.h>
 #include <spi_flash.h>
+#include <user_interface.h>
 #include <mem.h>
 #include "Bootloader.h"
 
+//----------------------------------------------------------------------------------------------------------------------
+// Local types
+//----------------------------------------------------------------------------------------------------------------------
+// Boot configuration as last loaded or written, the flash is read again only after a failed write
+typedef struct
+{
+    BootConfiguration Configuration;    // returned by GetConfiguration
+    BootConfiguration Sector;           // content of the newer configuration sector
+    uint8 SectorCopy;                   // 1 if it is the one of BOOT_CONFIG_COPY_SECTOR
+    uint8 LogSector;                    // where the next log record goes
+    uint16 LogSlots;
+    bool IsLoaded;
+} ConfigurationCache;
+
+// Boot configuration of version 1, before the slot metadata, converted once by MigrateConfiguration
+typedef struct
+{
+    uint32 MagicNumber;
+    uint8 Version;
+    uint8 CurrentROM;
+    uint8 Count;
+    uint32 ROMS[2];
+    uint8 StagedROM;
+    uint32 ActivationTime;
+    uint32 LastJobID;
+    uint32 LastJobVersion;
+    uint8 ActiveParts;
+    uint8 StagedParts;
+    uint32 Sequence;
+} BootConfigurationV1;
+
+typedef struct
+{
+    BootConfigurationV1 Configuration;
+    uint8 CheckSum;
+    uint8 Reserved[3];
+    uint32 Commit;
+} BootConfigRecordV1;
+
 //----------------------------------------------------------------------------------------------------------------------
 // Local function prototypes
 //----------------------------------------------------------------------------------------------------------------------
 
 static uint8 GetCheckSum(uint8 const *start, uint8 const * const end);
 
+static void ICACHE_FLASH_ATTR ReadFlash(uint32 address, void *data, uint32 length);
+
+static uint32 ICACHE_FLASH_ATTR GetSequence(const BootConfiguration *configuration);
+
+static bool ICACHE_FLASH_ATTR IsBootChanged(const BootConfiguration *first, const BootConfiguration *second);
+
+static bool ICACHE_FLASH_ATTR ReadConfigRecord(uint32 address, BootConfigRecord *record);
+
+static bool ICACHE_FLASH_ATTR ReadRecord(uint8 sector, uint16 slot, BootConfigRecord *record);
+
+static bool ICACHE_FLASH_ATTR IsSlotErased(uint8 sector, uint16 slot);
+
+static uint16 ICACHE_FLASH_ATTR GetUsedSlots(uint8 sector);
+
+static bool ICACHE_FLASH_ATTR FindNewestRecord(BootConfigRecord *newest, uint8 *sector, uint16 *usedSlots);
+
+static bool ICACHE_FLASH_ATTR AppendRecord(BootConfiguration *configuration, uint8 *sector, uint16 *slot);
+
+static void ICACHE_FLASH_ATTR ReadConfigSectors(void);
+
+static bool ICACHE_FLASH_ATTR WriteConfigSector(BootConfiguration *configuration);
+
+static void ICACHE_FLASH_ATTR MigrateConfiguration(void);
+
+static bool ICACHE_FLASH_ATTR IsUpdateSlot(const BootConfiguration *configuration, uint8 rom, uint8 running);
+
+static bool ICACHE_FLASH_ATTR GetTrialData(TrialData *trial);
+
+static bool ICACHE_FLASH_ATTR SetTrialData(TrialData *trial);
+
+static void ICACHE_FLASH_ATTR ClearTrialData(void);
+
+static bool ICACHE_FLASH_ATTR GetRunningTrial(TrialData *trial);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static ConfigurationCache Cache;
+
+static ConfigurationStatistics Statistics;
+
 //======================================================================================================================
 // LOCAL FUNCTIONS
 //======================================================================================================================
@@ -38,95 +119,1021 @@ static uint8 GetCheckSum(uint8 const *start, uint8 const * const end)
 }
 
 //======================================================================================================================
-// EXPORTED FUNCTIONS
+// DESCRIPTION:         Read configuration data from flash, counted in the statistics
+//
+// PARAMETERS:          uint32 address - flash address, word aligned
+//                      void *data - word aligned buffer
+//                      uint32 length - multiple of 4
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ReadFlash(uint32 address, void *data, uint32 length)
+{
+    Statistics.FlashReads++;
+
+    spi_flash_read(address, (uint32*) data, length);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Sequence number of a configuration, the configuration of erased flash is the oldest
+//
+// PARAMETERS:          const BootConfiguration *configuration
+//
+// RETURN VALUE:        uint32 - sequence number
+//
+//======================================================================================================================
+static uint32 ICACHE_FLASH_ATTR GetSequence(const BootConfiguration *configuration)
+{
+    return (0xFFFFFFFF == configuration->Sequence) ? 0 : configuration->Sequence;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Compare the fields the bootloader reads from the configuration sector, the slot metadata
+//                      included
+//
+// PARAMETERS:          const BootConfiguration *first
+//                      const BootConfiguration *second
+//
+// RETURN VALUE:        bool - true if any of them differs
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR IsBootChanged(const BootConfiguration *first, const BootConfiguration *second)
+{
+    return ((first->MagicNumber != second->MagicNumber) || (first->Version != second->Version)
+            || (first->CurrentROM != second->CurrentROM) || (first->Count != second->Count)
+            || (0 != memcmp(first->ROMS, second->ROMS, sizeof(first->ROMS)))
+            || (0 != memcmp(first->Slots, second->Slots, sizeof(first->Slots))));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read a configuration record, of the log or of a configuration sector
+//
+// PARAMETERS:          uint32 address - flash address of the record
+//                      BootConfigRecord *record - populated with the record
+//
+// RETURN VALUE:        bool - true if the record is committed and intact
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ReadConfigRecord(uint32 address, BootConfigRecord *record)
+{
+    ReadFlash(address, record, sizeof(BootConfigRecord));
+
+    // a record of an older configuration version is never taken for a current one
+    return ((BOOT_LOG_COMMIT == record->Commit) && (BOOT_CONFIG_MAGIC == record->Configuration.MagicNumber)
+            && (BOOT_CONFIG_VERSION == record->Configuration.Version)
+            && (record->CheckSum == GetCheckSum((uint8*) &record->Configuration, (uint8*) &record->CheckSum)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read a record of the configuration log
+//
+// PARAMETERS:          uint8 sector - log sector, 0 to BOOT_LOG_SECTORS - 1
+//                      uint16 slot - record in the sector
+//                      BootConfigRecord *record - populated with the record
+//
+// RETURN VALUE:        bool - true if the record is committed and intact
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR ReadRecord(uint8 sector, uint16 slot, BootConfigRecord *record)
+{
+    return ReadConfigRecord(((BOOT_LOG_SECTOR + sector) * SECTOR_SIZE) + (slot * sizeof(BootConfigRecord)), record);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check if a record of the configuration log was never written, even partially
+//
+// PARAMETERS:          uint8 sector - log sector, 0 to BOOT_LOG_SECTORS - 1
+//                      uint16 slot - record in the sector
+//
+// RETURN VALUE:        bool - true if the whole record is erased flash
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR IsSlotErased(uint8 sector, uint16 slot)
+{
+    BootConfigRecord record;
+    uint32* word = (uint32*) ((void*) &record);
+    uint8 index;
+
+    ReadRecord(sector, slot, &record);
+
+    for (index = 0; index < (sizeof(BootConfigRecord) / sizeof(uint32)); index++)
+    {
+        if (0xFFFFFFFF != word[index])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Count the written records of a log sector. Records are only appended, so the written ones
+//                      come first and a binary search finds their end.
+//
+// PARAMETERS:          uint8 sector - log sector, 0 to BOOT_LOG_SECTORS - 1
+//
+// RETURN VALUE:        uint16 - written records, committed or not
+//
+//======================================================================================================================
+static uint16 ICACHE_FLASH_ATTR GetUsedSlots(uint8 sector)
+{
+    uint16 low = 0;
+    uint16 high = BOOT_LOG_RECORDS;
+    uint16 middle;
+
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+
+        if (true == IsSlotErased(sector, middle))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return low;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Find the newest intact record of the configuration log and where the next one goes
+//
+// PARAMETERS:          BootConfigRecord *newest - populated with the newest record
+//                      uint8 *sector - populated with the log sector to append to
+//                      uint16 *usedSlots - populated with the written records of that sector
+//
+// RETURN VALUE:        bool - false if the log holds no intact record
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR FindNewestRecord(BootConfigRecord *newest, uint8 *sector, uint16 *usedSlots)
+{
+    BootConfigRecord record;
+    bool isFound = false;
+    uint16 used;
+    uint16 slot;
+    uint8 index;
+
+    *sector = 0;
+    *usedSlots = GetUsedSlots(0);
+
+    for (index = 0; index < BOOT_LOG_SECTORS; index++)
+    {
+        used = (0 == index) ? *usedSlots : GetUsedSlots(index);
+
+        // the last intact record of the sector, a torn one is skipped
+        for (slot = used; 0 != slot; slot--)
+        {
+            if (true == ReadRecord(index, slot - 1, &record))
+            {
+                break;
+            }
+        }
+
+        if ((0 != slot) && ((false == isFound) || (record.Configuration.Sequence > newest->Configuration.Sequence)))
+        {
+            *newest = record;
+            *sector = index;
+            *usedSlots = used;
+            isFound = true;
+        }
+    }
+
+    return isFound;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Append a configuration to the log. A full sector continues in the next one, which is erased
+//                      first, the records left behind are all older. At most one sector is erased per call, so the
+//                      sector holding the newest record is never erased before a newer one is committed elsewhere.
+//
+// PARAMETERS:          BootConfiguration *configuration - with its Sequence set
+//                      uint8 *sector - log sector to append to, see FindNewestRecord, updated for the next record
+//                      uint16 *slot - first free record of the sector, updated for the next record
+//
+// RETURN VALUE:        bool - true if the record was written and reads back intact
+//
 //======================================================================================================================
+static bool ICACHE_FLASH_ATTR AppendRecord(BootConfiguration *configuration, uint8 *sector, uint16 *slot)
+{
+    BootConfigRecord record;
+    BootConfigRecord check;
+    uint32 commit = BOOT_LOG_COMMIT;
+    uint32 address;
+    uint8 attempt;
+    bool isErased = false;
+
+    memset(&record, 0xFF, sizeof(BootConfigRecord));
+
+    memcpy(&record.Configuration, configuration, sizeof(BootConfiguration));
+    record.CheckSum = GetCheckSum((uint8*) &record.Configuration, (uint8*) &record.CheckSum);
+
+    // a slot that does not read back, e.g. a sector torn while being erased, moves on to a fresh sector, or to the
+    // next slot of the sector just erased, going back would erase the newest records
+    for (attempt = 0; attempt < 2; attempt++)
+    {
+        if ((false == isErased) && ((0 != attempt) || (BOOT_LOG_RECORDS <= *slot)))
+        {
+            *sector = (*sector + 1) % BOOT_LOG_SECTORS;
+            *slot = 0;
+            isErased = true;
+
+            if (SPI_FLASH_RESULT_OK != spi_flash_erase_sector(BOOT_LOG_SECTOR + *sector))
+            {
+                return false;
+            }
+        }
+
+        address = ((BOOT_LOG_SECTOR + *sector) * SECTOR_SIZE) + (*slot * sizeof(BootConfigRecord));
+
+        // the slot is used from now on, even if the write fails
+        (*slot)++;
+
+        // the commit goes last, a record cut short by a power failure is never taken for valid
+        if ((SPI_FLASH_RESULT_OK == spi_flash_write(address, (uint32*) ((void*) &record),
+                sizeof(BootConfigRecord) - sizeof(uint32)))
+                && (SPI_FLASH_RESULT_OK == spi_flash_write(address + sizeof(BootConfigRecord) - sizeof(uint32),
+                        &commit, sizeof(uint32)))
+                && (true == ReadRecord(*sector, *slot - 1, &check))
+                && (0 == memcmp(&check.Configuration, configuration, sizeof(BootConfiguration))))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
 
 //======================================================================================================================
-// DESCRIPTION:         Gets the configuration written in FLASH
+// DESCRIPTION:         Read the newer intact record of the configuration sector and its copy into the cache. Without
+//                      one, the configuration sector is taken as it is, written before the records or of version 1.
 //
 // PARAMETERS:          void
 //
-// RETURN VALUE:        BootConfiguration - the configuration written in FLASH
+// RETURN VALUE:        void
 //
 //======================================================================================================================
-BootConfiguration ICACHE_FLASH_ATTR GetConfiguration(void)
+static void ICACHE_FLASH_ATTR ReadConfigSectors(void)
+{
+    BootConfigRecord first;
+    BootConfigRecord second;
+    bool isFirst = ReadConfigRecord(BOOT_CONFIG_SECTOR * SECTOR_SIZE, &first);
+
+    if ((true == ReadConfigRecord(BOOT_CONFIG_COPY_SECTOR * SECTOR_SIZE, &second))
+            && ((false == isFirst) || (second.Configuration.Sequence > first.Configuration.Sequence)))
+    {
+        Cache.Sector = second.Configuration;
+        Cache.SectorCopy = 1;
+    }
+    else
+    {
+        Cache.Sector = first.Configuration;
+        Cache.SectorCopy = 0;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write the configuration the bootloader reads to the configuration sector not in use, the one in
+//                      use stays intact until the new record is committed
+//
+// PARAMETERS:          BootConfiguration *configuration - with its Sequence set
+//
+// RETURN VALUE:        bool - true if the record was written and reads back intact
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR WriteConfigSector(BootConfiguration *configuration)
+{
+    BootConfigRecord record;
+    BootConfigRecord check;
+    uint32 commit = BOOT_LOG_COMMIT;
+    uint16 sector = (0 == Cache.SectorCopy) ? BOOT_CONFIG_COPY_SECTOR : BOOT_CONFIG_SECTOR;
+    uint32 address = sector * SECTOR_SIZE;
+
+    memset(&record, 0xFF, sizeof(BootConfigRecord));
+
+    memcpy(&record.Configuration, configuration, sizeof(BootConfiguration));
+    record.CheckSum = GetCheckSum((uint8*) &record.Configuration, (uint8*) &record.CheckSum);
+
+    // the commit goes last, as for the log
+    if ((SPI_FLASH_RESULT_OK != spi_flash_erase_sector(sector))
+            || (SPI_FLASH_RESULT_OK != spi_flash_write(address, (uint32*) ((void*) &record),
+                    sizeof(BootConfigRecord) - sizeof(uint32)))
+            || (SPI_FLASH_RESULT_OK != spi_flash_write(address + sizeof(BootConfigRecord) - sizeof(uint32), &commit,
+                    sizeof(uint32)))
+            || (false == ReadConfigRecord(address, &check))
+            || (0 != memcmp(&check.Configuration, configuration, sizeof(BootConfiguration))))
+    {
+        return false;
+    }
+
+    Cache.SectorCopy = (BOOT_CONFIG_COPY_SECTOR == sector) ? 1 : 0;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Convert a configuration of version 1 in the cache, with the newest record of its log, and
+//                      write it to the copy of the configuration sector. Its ROMs are known to boot, except the staged
+//                      one.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR MigrateConfiguration(void)
 {
+    BootConfigurationV1 sector;
+    BootConfigurationV1 newest;
+    BootConfigRecordV1 record;
     BootConfiguration configuration;
+    uint16 slot;
+    uint8 index;
+    uint8 rom;
+
+    memcpy(&sector, &Cache.Sector, sizeof(BootConfigurationV1));
+
+    newest = sector;
+    newest.Sequence = (0xFFFFFFFF == sector.Sequence) ? 0 : sector.Sequence;
+
+    // records of version 1 are smaller, the whole log is read once
+    for (index = 0; index < BOOT_LOG_SECTORS; index++)
+    {
+        for (slot = 0; slot < (SECTOR_SIZE / sizeof(BootConfigRecordV1)); slot++)
+        {
+            ReadFlash(((BOOT_LOG_SECTOR + index) * SECTOR_SIZE) + (slot * sizeof(BootConfigRecordV1)), &record,
+                    sizeof(BootConfigRecordV1));
+
+            if ((BOOT_LOG_COMMIT == record.Commit)
+                    && (record.CheckSum == GetCheckSum((uint8*) &record.Configuration, (uint8*) &record.CheckSum))
+                    && (record.Configuration.Sequence > newest.Sequence))
+            {
+                newest = record.Configuration;
+            }
+        }
+    }
+
+    memset(&configuration, 0, sizeof(BootConfiguration));
+
+    configuration.MagicNumber = BOOT_CONFIG_MAGIC;
+    configuration.Version = BOOT_CONFIG_VERSION;
+    configuration.CurrentROM = sector.CurrentROM;
+    configuration.Count = (sector.Count > 2) ? 2 : sector.Count;
+    memcpy(configuration.ROMS, sector.ROMS, sizeof(sector.ROMS));
+    configuration.StagedROM = newest.StagedROM;
+    configuration.ActivationTime = newest.ActivationTime;
+    configuration.LastJobID = newest.LastJobID;
+    configuration.LastJobVersion = newest.LastJobVersion;
+    configuration.ActiveParts = newest.ActiveParts;
+    configuration.StagedParts = newest.StagedParts;
+    configuration.Sequence = newest.Sequence + 1;
+
+    for (rom = 0; rom < configuration.Count; rom++)
+    {
+        configuration.Slots[rom].State = (rom == configuration.StagedROM) ? SLOT_STAGED : SLOT_CONFIRMED;
+    }
+
+    // if the write fails, the sector of version 1 is still there and migrated again on the next load
+    WriteConfigSector(&configuration);
+
+    Cache.Sector = configuration;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check if a ROM slot may be written by an update
+//
+// PARAMETERS:          const BootConfiguration *configuration
+//                      uint8 rom - ROM slot
+//                      uint8 running - ROM the software runs from
+//
+// RETURN VALUE:        bool - false for the running, the current and the factory ROM, and with SINGLE_IMAGE for a
+//                             slot the single image cannot run from
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR IsUpdateSlot(const BootConfiguration *configuration, uint8 rom, uint8 running)
+{
+#ifdef SINGLE_IMAGE
+    if (SINGLE_IMAGE_OFFSET != (configuration->ROMS[rom] % ROM_BLOCK_SIZE))
+    {
+        return false;
+    }
+#endif
+
+    return ((rom != running) && (rom != configuration->CurrentROM)
+            && ((configuration->Count <= 2) || (FACTORY_ROM != rom)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the trial boot data from the RTC data area
+//
+// PARAMETERS:          TrialData *trial - populated with the trial
+//
+// RETURN VALUE:        bool - true if a trial is recorded
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR GetTrialData(TrialData *trial)
+{
+    if (system_rtc_mem_read(TRIAL_RTC_ADDRESS, trial, sizeof(TrialData)))
+    {
+        return ((TRIAL_MAGIC == trial->MagicNumber)
+                && (trial->CheckSum == GetCheckSum((uint8*) trial, (uint8*) &trial->CheckSum)));
+    }
+
+    return false;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Set the trial boot data in the RTC data area
+//
+// PARAMETERS:          TrialData *trial
+//
+// RETURN VALUE:        bool - true on success
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR SetTrialData(TrialData *trial)
+{
+    trial->MagicNumber = TRIAL_MAGIC;
+    trial->CheckSum = GetCheckSum((uint8*) trial, (uint8*) &trial->CheckSum);
+
+    return system_rtc_mem_write(TRIAL_RTC_ADDRESS, trial, sizeof(TrialData));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Forget the trial boot
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ICACHE_FLASH_ATTR ClearTrialData(void)
+{
+    TrialData trial;
+
+    memset(&trial, 0, sizeof(TrialData));
+
+    system_rtc_mem_write(TRIAL_RTC_ADDRESS, &trial, sizeof(TrialData));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the trial the running software is booted for
+//
+// PARAMETERS:          TrialData *trial - populated with the trial
+//
+// RETURN VALUE:        bool - true if the running software is on trial
+//
+//======================================================================================================================
+static bool ICACHE_FLASH_ATTR GetRunningTrial(TrialData *trial)
+{
+    uint8 mode;
+    uint8 rom;
+
+    return ((true == GetTrialData(trial))
+            && ((0 != (trial->Flags & TRIAL_FLAG_REVERT)) || (trial->ROM == GetStagedROM(NULL)))
+            && (true == GetLastBootMode(&mode)) && (0 != (mode & MODE_TEMP_ROM)) && (true == GetLastBootROM(&rom))
+            && (rom == trial->ROM));
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Read the configuration from FLASH into the cache. The newest log record is used if it is newer
+//                      than the configuration sectors, the fields the bootloader reads always come from the sectors.
+//                      Call once at startup, GetConfiguration loads it on first use otherwise.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR LoadConfiguration(void)
+{
+    BootConfigRecord newest;
+
+    Statistics.Loads++;
+
+    ReadConfigSectors();
+
+    if ((BOOT_CONFIG_MAGIC == Cache.Sector.MagicNumber) && (BOOT_CONFIG_VERSION > Cache.Sector.Version))
+    {
+        MigrateConfiguration();
+    }
+
+    Cache.Configuration = Cache.Sector;
+    Cache.Configuration.Sequence = GetSequence(&Cache.Sector);
+
+    if ((true == FindNewestRecord(&newest, &Cache.LogSector, &Cache.LogSlots))
+            && (newest.Configuration.Sequence > Cache.Configuration.Sequence))
+    {
+        Cache.Configuration = newest.Configuration;
+
+        Cache.Configuration.MagicNumber = Cache.Sector.MagicNumber;
+        Cache.Configuration.Version = Cache.Sector.Version;
+        Cache.Configuration.CurrentROM = Cache.Sector.CurrentROM;
+        Cache.Configuration.Count = Cache.Sector.Count;
+        memcpy(Cache.Configuration.ROMS, Cache.Sector.ROMS, sizeof(Cache.Sector.ROMS));
+        memcpy(Cache.Configuration.Slots, Cache.Sector.Slots, sizeof(Cache.Sector.Slots));
+    }
+
+    Cache.IsLoaded = true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Gets the configuration written in FLASH, from the cache
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        BootConfiguration - the configuration written in FLASH
+//
+//======================================================================================================================
+BootConfiguration ICACHE_FLASH_ATTR GetConfiguration(void)
+{
+    if (false == Cache.IsLoaded)
+    {
+        LoadConfiguration();
+    }
+    else
+    {
+        Statistics.Hits++;
+    }
+
+    return Cache.Configuration;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write the boot configuration, the cache is updated with it. A change the bootloader does not
+//                      see is appended to the configuration log, only a change of the ROMs or of their metadata
+//                      rewrites a configuration sector, the one not in use.
+//
+// PARAMETERS:          BootConfiguration - the configuration to be written in FLASH, its Sequence is set
+//
+// RETURN VALUE:        bool - true if writing is successfull
+//                             false if writing is not successfull
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetConfiguration(BootConfiguration* configuration)
+{
+    bool isOK;
+
+    if (false == Cache.IsLoaded)
+    {
+        LoadConfiguration();
+    }
+
+    configuration->Sequence = Cache.Configuration.Sequence + 1;
+
+    if (true == IsBootChanged(&Cache.Sector, configuration))
+    {
+        isOK = WriteConfigSector(configuration);
+
+        if (true == isOK)
+        {
+            Cache.Sector = *configuration;
+        }
+    }
+    else
+    {
+        isOK = AppendRecord(configuration, &Cache.LogSector, &Cache.LogSlots);
+    }
+
+    if (true == isOK)
+    {
+        Cache.Configuration = *configuration;
+    }
+    else
+    {
+        // the write may or may not have reached the flash, read it again
+        Cache.IsLoaded = false;
+    }
+
+    return isOK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Number of ROM slots, from the cache
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - quantity of ROMs available to boot
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetROMCount(void)
+{
+    return GetConfiguration().Count;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Flash address of a ROM slot, from the cache
+//
+// PARAMETERS:          uint8 rom - ROM slot
+//
+// RETURN VALUE:        uint32 - flash address, 0 for an unknown slot
+//
+//======================================================================================================================
+uint32 ICACHE_FLASH_ATTR GetROMAddress(uint8 rom)
+{
+    BootConfiguration configuration = GetConfiguration();
+
+    if ((rom >= configuration.Count) || (rom >= MAX_ROMS))
+    {
+        return 0;
+    }
+
+    return configuration.ROMS[rom];
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the metadata of a ROM slot, from the cache
+//
+// PARAMETERS:          uint8 rom - ROM slot
+//                      SlotMetadata *metadata - populated with the metadata
+//
+// RETURN VALUE:        bool - false for an unknown slot
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR GetSlotMetadata(uint8 rom, SlotMetadata *metadata)
+{
+    BootConfiguration configuration = GetConfiguration();
+
+    if ((rom >= configuration.Count) || (rom >= MAX_ROMS))
+    {
+        return false;
+    }
+
+    *metadata = configuration.Slots[rom];
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Record the metadata of a ROM slot
+//
+// PARAMETERS:          uint8 rom - ROM slot
+//                      const SlotMetadata *metadata
+//
+// RETURN VALUE:        bool - true if modification was successfull
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetSlotMetadata(uint8 rom, const SlotMetadata *metadata)
+{
+    BootConfiguration configuration = GetConfiguration();
+
+    if ((rom >= configuration.Count) || (rom >= MAX_ROMS))
+    {
+        return false;
+    }
+
+    configuration.Slots[rom] = *metadata;
+
+    return SetConfiguration(&configuration);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Change the state of a ROM slot, an emptied slot forgets its image
+//
+// PARAMETERS:          uint8 rom - ROM slot
+//                      uint8 state - SLOT_EMPTY, SLOT_STAGED, SLOT_CONFIRMED or SLOT_BAD
+//
+// RETURN VALUE:        bool - true if modification was successfull
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetSlotState(uint8 rom, uint8 state)
+{
+    SlotMetadata metadata;
+
+    if (false == GetSlotMetadata(rom, &metadata))
+    {
+        return false;
+    }
+
+    if (SLOT_EMPTY == state)
+    {
+        memset(&metadata, 0, sizeof(SlotMetadata));
+    }
+
+    metadata.State = state;
+
+    return SetSlotMetadata(rom, &metadata);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Choose the ROM slot an update writes, from the slot metadata. An empty or bad slot goes
+//                      first, then a staged one, then the confirmed one with the oldest image. The running, the
+//                      current and the factory ROM are never chosen.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - ROM slot, NO_ROM if there is none
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetUpdateSlot(void)
+{
+    BootConfiguration configuration = GetConfiguration();
+    uint8 running = GetRunningROM();
+    uint8 best = NO_ROM;
+    uint8 bestRank = 0;
+    uint8 rank;
+    uint8 rom;
+
+    for (rom = 0; (rom < configuration.Count) && (rom < MAX_ROMS); rom++)
+    {
+        if (false == IsUpdateSlot(&configuration, rom, running))
+        {
+            continue;
+        }
+
+        switch (configuration.Slots[rom].State)
+        {
+            case SLOT_STAGED:
+            {
+                rank = 1;
+                break;
+            }
+            case SLOT_CONFIRMED:
+            {
+                rank = 2;
+                break;
+            }
+            default:
+            {
+                rank = 0;
+                break;
+            }
+        }
+
+        if ((NO_ROM == best) || (rank < bestRank) || ((rank == bestRank)
+                && (configuration.Slots[rom].Version < configuration.Slots[best].Version)))
+        {
+            best = rom;
+            bestRank = rank;
+        }
+    }
+
+    return best;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Choose the ROM slot a revert boots, from the slot metadata: the confirmed one with the newest
+//                      image other than the current ROM
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - ROM slot, NO_ROM if there is none
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetRevertSlot(void)
+{
+    BootConfiguration configuration = GetConfiguration();
+    uint8 best = NO_ROM;
+    uint8 rom;
+
+    for (rom = 0; (rom < configuration.Count) && (rom < MAX_ROMS); rom++)
+    {
+        if ((rom != configuration.CurrentROM) && (SLOT_CONFIRMED == configuration.Slots[rom].State)
+                && ((NO_ROM == best) || (configuration.Slots[rom].Version > configuration.Slots[best].Version)))
+        {
+            best = rom;
+        }
+    }
+
+    return best;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Configuration reads served by the cache and by FLASH since startup
+//
+// PARAMETERS:          ConfigurationStatistics *statistics - populated with the counters
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ICACHE_FLASH_ATTR GetConfigurationStatistics(ConfigurationStatistics *statistics)
+{
+    *statistics = Statistics;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get current boot rom
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - number of currently used ROM
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetCurrentROM(void)
+{
+    BootConfiguration configuration;
+
+    configuration = GetConfiguration();
+
+    return configuration.CurrentROM;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         uint8 rom - ROM to be used
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true if modification was successfull
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetCurrentROM(uint8 rom)
+{
+    BootConfiguration configuration;
+
+    configuration = GetConfiguration();
+
+    if (rom >= configuration.Count)
+    {
+        return false;
+    }
+
+    configuration.CurrentROM = rom;
+
+    return SetConfiguration(&configuration);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the ROM downloaded ahead of its activation
+//
+// PARAMETERS:          uint32 *activationTime - Unix time of a scheduled activation or 0, may be NULL
+//
+// RETURN VALUE:        uint8 - staged ROM, NO_STAGED_ROM if there is none
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetStagedROM(uint32 *activationTime)
+{
+    BootConfiguration configuration;
+
+    configuration = GetConfiguration();
+
+    if (configuration.StagedROM >= configuration.Count)
+    {
+        return NO_STAGED_ROM;
+    }
+
+    if (NULL != activationTime)
+    {
+        *activationTime = configuration.ActivationTime;
+    }
+
+    return configuration.StagedROM;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Record a downloaded ROM, the current ROM keeps running until it is activated
+//
+// PARAMETERS:          uint8 rom - ROM holding the new image, NO_STAGED_ROM to forget it
+//                      uint32 activationTime - Unix time to activate at, 0 waits for the activate command
+//
+// RETURN VALUE:        bool - true if modification was successfull
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetStagedROM(uint8 rom, uint32 activationTime)
+{
+    BootConfiguration configuration;
+
+    configuration = GetConfiguration();
+
+    if ((NO_STAGED_ROM != rom) && (rom >= configuration.Count))
+    {
+        return false;
+    }
+
+    configuration.StagedROM = rom;
+    configuration.StagedParts = configuration.ActiveParts;
+    configuration.ActivationTime = (NO_STAGED_ROM == rom) ? 0 : activationTime;
+
+    return SetConfiguration(&configuration);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Record a downloaded bundle, its ROM and the regions of its other parts are switched to
+//                      together on activation
+//
+// PARAMETERS:          uint8 rom - ROM to boot after activation, may be the current one
+//                      uint8 parts - ActiveParts after activation
+//
+// RETURN VALUE:        bool - true if modification was successfull
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetStagedBundle(uint8 rom, uint8 parts)
+{
+    BootConfiguration configuration;
+
+    configuration = GetConfiguration();
+
+    if (rom >= configuration.Count)
+    {
+        return false;
+    }
+
+    configuration.StagedROM = rom;
+    configuration.StagedParts = parts;
+    configuration.ActivationTime = 0;
+
+    return SetConfiguration(&configuration);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Schedule the activation of the staged ROM
+//
+// PARAMETERS:          uint32 activationTime - Unix time to activate at, 0 waits for the activate command
+//
+// RETURN VALUE:        bool - false if there is no staged ROM or the modification failed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetActivationTime(uint32 activationTime)
+{
+    BootConfiguration configuration;
+
+    configuration = GetConfiguration();
+
+    if (configuration.StagedROM >= configuration.Count)
+    {
+        return false;
+    }
 
-    spi_flash_read(BOOT_CONFIG_SECTOR * SECTOR_SIZE, (uint32*) &configuration, sizeof(BootConfiguration));
+    configuration.ActivationTime = activationTime;
 
-    return configuration;
+    return SetConfiguration(&configuration);
 }
 
 //======================================================================================================================
-// DESCRIPTION:         Write the boot configuration.
+// DESCRIPTION:         Make the staged ROM and bundle parts the ones used for the next boot, in a single configuration
+//                      write, so an update is either applied completely or not at all. The staged ROM booted on
+//                      trial, its slot is confirmed.
 //
-// PARAMETERS:          BootConfiguration - the configuration to be written in FLASH
+// PARAMETERS:          void
 //
-// RETURN VALUE:        bool - true if writing is successfull
-//                             false if writing is not successfull
+// RETURN VALUE:        bool - false if there is no staged ROM or the modification failed
 //
 //======================================================================================================================
-bool ICACHE_FLASH_ATTR SetConfiguration(BootConfiguration* configuration)
+bool ICACHE_FLASH_ATTR ActivateStagedROM(void)
 {
-    uint8* buffer = (uint8*) os_malloc(SECTOR_SIZE);
+    BootConfiguration configuration;
 
-    if (!buffer)
+    configuration = GetConfiguration();
+
+    if (configuration.StagedROM >= configuration.Count)
     {
-        // Not enough RAM memory available
         return false;
     }
 
-    spi_flash_read(BOOT_CONFIG_SECTOR * SECTOR_SIZE, (uint32*) ((void*) buffer), SECTOR_SIZE);
-
-    memcpy(buffer, configuration, sizeof(BootConfiguration));
-
-    spi_flash_erase_sector(BOOT_CONFIG_SECTOR);
-
-    spi_flash_write(BOOT_CONFIG_SECTOR * SECTOR_SIZE, (uint32*) ((void*) buffer), SECTOR_SIZE);
-
-    os_free(buffer);
+    configuration.CurrentROM = configuration.StagedROM;
+    configuration.Slots[configuration.CurrentROM].State = SLOT_CONFIRMED;
+    configuration.ActiveParts = configuration.StagedParts;
+    configuration.StagedROM = NO_STAGED_ROM;
+    configuration.ActivationTime = 0;
 
-    return true;
+    return SetConfiguration(&configuration);
 }
 
 //======================================================================================================================
-// DESCRIPTION:         Get current boot rom
+// DESCRIPTION:         Get the last completed update job
 //
-// PARAMETERS:          void
+// PARAMETERS:          uint32 *version - firmware version installed by the job, may be NULL
 //
-// RETURN VALUE:        uint8 - number of currently used ROM
+// RETURN VALUE:        uint32 - job ID, NO_JOB if there is none
 //
 //======================================================================================================================
-uint8 ICACHE_FLASH_ATTR GetCurrentROM(void)
+uint32 ICACHE_FLASH_ATTR GetLastJob(uint32 *version)
 {
     BootConfiguration configuration;
 
     configuration = GetConfiguration();
 
-    return configuration.CurrentROM;
+    if (NULL != version)
+    {
+        *version = configuration.LastJobVersion;
+    }
+
+    return configuration.LastJobID;
 }
 
 //======================================================================================================================
-// DESCRIPTION:         uint8 rom - ROM to be used
+// DESCRIPTION:         Record a completed update job, so a repeated request is not done again
 //
-// PARAMETERS:          void
+// PARAMETERS:          uint32 id - job ID
+//                      uint32 version - firmware version installed by the job
 //
 // RETURN VALUE:        bool - true if modification was successfull
 //
 //======================================================================================================================
-bool ICACHE_FLASH_ATTR SetCurrentROM(uint8 rom)
+bool ICACHE_FLASH_ATTR SetLastJob(uint32 id, uint32 version)
 {
     BootConfiguration configuration;
 
     configuration = GetConfiguration();
 
-    if (rom >= configuration.Count)
-    {
-        return false;
-    }
-
-    configuration.CurrentROM = rom;
+    configuration.LastJobID = id;
+    configuration.LastJobVersion = version;
 
     return SetConfiguration(&configuration);
 }
@@ -250,6 +1257,44 @@ bool ICACHE_FLASH_ATTR WriteFlash(WriteStatus *status, uint8* data, uint16 lengt
     return isOK;
 }
 
+//======================================================================================================================
+// DESCRIPTION:         Leave a region of erased flash, the sectors it covers are erased but nothing is written.
+//                      The region must start on a word boundary, so no bytes of the previous write can be pending.
+//
+// PARAMETERS:          WriteStatus *status - Pointer to structure defining the write status
+//                      uint32 length - Quantity of bytes to leave erased
+//
+// RETURN VALUE:        bool - false if bytes of the previous write are still pending
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SkipFlash(WriteStatus *status, uint32 length)
+{
+    int32 lastSector;
+
+    if (0 != status->ExtraCount)
+    {
+        return false;
+    }
+
+    if (0 == length)
+    {
+        return true;
+    }
+
+    // erase any additional sectors covered by the hole
+    lastSector = ((status->StartAddress + length) - 1) / SECTOR_SIZE;
+
+    while (lastSector > status->LastErasedSector)
+    {
+        status->LastErasedSector++;
+        spi_flash_erase_sector(status->LastErasedSector);
+    }
+
+    status->StartAddress += length;
+
+    return true;
+}
+
 //======================================================================================================================
 // DESCRIPTION:         Get boot status/control data from RTC data area
 //
@@ -283,3 +1328,320 @@ bool ICACHE_FLASH_ATTR SetRTCData(RTCData* rtc)
 
     return system_rtc_mem_write(RTC_ADDRESS, rtc, sizeof(RTCData));
 }
+
+//======================================================================================================================
+// DESCRIPTION:         Boot a ROM once at the next reset, the one after boots the current ROM again. Only the RTC
+//                      data is written, the boot configuration stays as it is.
+//
+// PARAMETERS:          uint8 rom - ROM to boot once
+//
+// RETURN VALUE:        bool - true on success
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR SetTempROM(uint8 rom)
+{
+    RTCData rtc;
+
+    if (rom >= GetROMCount())
+    {
+        return false;
+    }
+
+    // first use since power on
+    if (false == GetRTCData(&rtc))
+    {
+        memset(&rtc, 0, sizeof(RTCData));
+        rtc.MagicNumber = RTC_MAGIC;
+    }
+
+    rtc.NextMode = MODE_TEMP_ROM;
+    rtc.TempROM = rom;
+
+    return SetRTCData(&rtc);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the ROM the bootloader booted last
+//
+// PARAMETERS:          uint8 *rom - populated with the ROM
+//
+// RETURN VALUE:        bool - false if the bootloader left no RTC data
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR GetLastBootROM(uint8 *rom)
+{
+    RTCData rtc;
+
+    if (false == GetRTCData(&rtc))
+    {
+        return false;
+    }
+
+    *rom = rtc.LastROM;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the mode of the last boot
+//
+// PARAMETERS:          uint8 *mode - populated with MODE_STANDARD, MODE_GPIO_ROM or MODE_TEMP_ROM
+//
+// RETURN VALUE:        bool - false if the bootloader left no RTC data
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR GetLastBootMode(uint8 *mode)
+{
+    RTCData rtc;
+
+    if (false == GetRTCData(&rtc))
+    {
+        return false;
+    }
+
+    *mode = rtc.LastMode;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check if the running software is the staged ROM or a reverted ROM on a trial boot
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true until the trial is confirmed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR IsTrialBoot(void)
+{
+    TrialData trial;
+
+    return GetRunningTrial(&trial);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check if the running software is a reverted ROM on a trial boot
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - true until the revert is confirmed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR IsRevertBoot(void)
+{
+    TrialData trial;
+
+    return ((true == GetRunningTrial(&trial)) && (0 != (trial.Flags & TRIAL_FLAG_REVERT)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the ROM the software runs from, the current ROM or the ROM on trial
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - running ROM
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetRunningROM(void)
+{
+    TrialData trial;
+
+    return (true == GetRunningTrial(&trial)) ? trial.ROM : GetCurrentROM();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the bundle parts the running software uses, the staged ones on a trial boot of the staged
+//                      ROM. A reverted ROM runs with the active parts.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - bit per bundle part, see BootConfiguration.ActiveParts
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR GetBootParts(void)
+{
+    BootConfiguration configuration = GetConfiguration();
+    TrialData trial;
+
+    return ((true == GetRunningTrial(&trial)) && (0 == (trial.Flags & TRIAL_FLAG_REVERT))) ?
+            configuration.StagedParts : configuration.ActiveParts;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Find out at startup how a trial of the staged ROM went. A trial boot that was not confirmed
+//                      ends with the next reset, which boots the current ROM again. It is tried again until
+//                      maxBoots trial boots were started, then the staged ROM is dropped and its slot is bad. A
+//                      reverted ROM gets a single trial boot. It booted before, a missed confirmation only ends the
+//                      revert and its slot keeps its state.
+//
+// PARAMETERS:          uint8 maxBoots - trial boots of a staged ROM
+//
+// RETURN VALUE:        uint8 - TRIAL_NONE if no trial runs
+//                              TRIAL_RUNNING if this boot is a trial, confirm it with ConfirmTrialBoot
+//                              TRIAL_RETRY if the trial boot failed, start the next one with StartTrialBoot
+//                              TRIAL_ROLLBACK if the last trial boot failed and the staged ROM was dropped
+//                              TRIAL_REVERT_FAILED if the reverted ROM failed, the current ROM runs on
+//
+//======================================================================================================================
+uint8 ICACHE_FLASH_ATTR CheckTrialBoot(uint8 maxBoots)
+{
+    BootConfiguration configuration;
+    TrialData trial;
+
+    // staged again or dropped since
+    if ((false == GetTrialData(&trial))
+            || ((0 == (trial.Flags & TRIAL_FLAG_REVERT)) && (trial.ROM != GetStagedROM(NULL))))
+    {
+        ClearTrialData();
+        return TRIAL_NONE;
+    }
+
+    if (true == IsTrialBoot())
+    {
+        return TRIAL_RUNNING;
+    }
+
+    if (0 != (trial.Flags & TRIAL_FLAG_REVERT))
+    {
+        ClearTrialData();
+
+        return TRIAL_REVERT_FAILED;
+    }
+
+    if (trial.Boots < maxBoots)
+    {
+        return TRIAL_RETRY;
+    }
+
+    ClearTrialData();
+
+    configuration = GetConfiguration();
+
+    configuration.Slots[trial.ROM].State = SLOT_BAD;
+    configuration.StagedROM = NO_STAGED_ROM;
+    configuration.StagedParts = configuration.ActiveParts;
+    configuration.ActivationTime = 0;
+
+    SetConfiguration(&configuration);
+
+    return TRIAL_ROLLBACK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Boot the staged ROM on trial at the next reset, it is not written to the boot configuration
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if there is no staged ROM or the RTC data cannot be written
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR StartTrialBoot(void)
+{
+    TrialData trial;
+    uint8 rom = GetStagedROM(NULL);
+
+    if (NO_STAGED_ROM == rom)
+    {
+        return false;
+    }
+
+    // a trial of another staged ROM starts over
+    if ((false == GetTrialData(&trial)) || (trial.ROM != rom) || (0 != (trial.Flags & TRIAL_FLAG_REVERT)))
+    {
+        memset(&trial, 0, sizeof(TrialData));
+        trial.ROM = rom;
+    }
+
+    trial.Boots++;
+
+    return ((true == SetTrialData(&trial)) && (true == SetTempROM(rom)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Boot another ROM on trial at the next reset, to revert to it without a flash write. The boot
+//                      configuration is only written once the ROM is confirmed.
+//
+// PARAMETERS:          uint8 rom - ROM to revert to
+//
+// RETURN VALUE:        bool - false if the ROM is the current one or the RTC data cannot be written
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR StartRevertBoot(uint8 rom)
+{
+    TrialData trial;
+
+    if ((rom >= GetROMCount()) || (rom == GetCurrentROM()))
+    {
+        return false;
+    }
+
+    memset(&trial, 0, sizeof(TrialData));
+
+    trial.ROM = rom;
+    trial.Boots = 1;
+    trial.Flags = TRIAL_FLAG_REVERT;
+
+    return ((true == SetTrialData(&trial)) && (true == SetTempROM(rom)));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The ROM on trial works, make it the current ROM
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if no trial runs or the modification failed
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR ConfirmTrialBoot(void)
+{
+    TrialData trial;
+
+    if (false == GetRunningTrial(&trial))
+    {
+        return false;
+    }
+
+    if (0 != (trial.Flags & TRIAL_FLAG_REVERT))
+    {
+        if (false == SetCurrentROM(trial.ROM))
+        {
+            return false;
+        }
+    }
+    else if (false == ActivateStagedROM())
+    {
+        return false;
+    }
+
+    ClearTrialData();
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Reject the software on trial, the next reset boots the current ROM. A staged ROM on trial is
+//                      dropped.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if no trial runs
+//
+//======================================================================================================================
+bool ICACHE_FLASH_ATTR CancelTrialBoot(void)
+{
+    TrialData trial;
+
+    if (false == GetRunningTrial(&trial))
+    {
+        return false;
+    }
+
+    ClearTrialData();
+
+    if (0 == (trial.Flags & TRIAL_FLAG_REVERT))
+    {
+        SetStagedROM(NO_STAGED_ROM, 0);
+    }
+
+    return true;
+}
@@ -19,24 +19,65 @@ typedef struct
     uint8 ExtraBytes[4];
 } WriteStatus;
 
+typedef struct
+{
+    uint32 Hits;        // GetConfiguration calls served by the cache
+    uint32 Loads;       // configuration loads from flash
+    uint32 FlashReads;  // flash reads of the configuration sectors and log, including those of writes
+} ConfigurationStatistics;
+
 //======================================================================================================================
 // EXPORTED FUNCTIONS
 //======================================================================================================================
 
+void ICACHE_FLASH_ATTR LoadConfiguration(void);
+
 BootConfiguration ICACHE_FLASH_ATTR GetConfiguration(void);
 
 bool ICACHE_FLASH_ATTR SetConfiguration(BootConfiguration *conf);
 
+uint8 ICACHE_FLASH_ATTR GetROMCount(void);
+
+uint32 ICACHE_FLASH_ATTR GetROMAddress(uint8 rom);
+
+bool ICACHE_FLASH_ATTR GetSlotMetadata(uint8 rom, SlotMetadata *metadata);
+
+bool ICACHE_FLASH_ATTR SetSlotMetadata(uint8 rom, const SlotMetadata *metadata);
+
+bool ICACHE_FLASH_ATTR SetSlotState(uint8 rom, uint8 state);
+
+uint8 ICACHE_FLASH_ATTR GetUpdateSlot(void);
+
+uint8 ICACHE_FLASH_ATTR GetRevertSlot(void);
+
+void ICACHE_FLASH_ATTR GetConfigurationStatistics(ConfigurationStatistics *statistics);
+
 uint8 ICACHE_FLASH_ATTR GetCurrentROM(void);
 
 bool ICACHE_FLASH_ATTR SetCurrentROM(uint8 rom);
 
+uint8 ICACHE_FLASH_ATTR GetStagedROM(uint32 *activationTime);
+
+bool ICACHE_FLASH_ATTR SetStagedROM(uint8 rom, uint32 activationTime);
+
+bool ICACHE_FLASH_ATTR SetStagedBundle(uint8 rom, uint8 parts);
+
+bool ICACHE_FLASH_ATTR SetActivationTime(uint32 activationTime);
+
+bool ICACHE_FLASH_ATTR ActivateStagedROM(void);
+
+uint32 ICACHE_FLASH_ATTR GetLastJob(uint32 *version);
+
+bool ICACHE_FLASH_ATTR SetLastJob(uint32 id, uint32 version);
+
 WriteStatus ICACHE_FLASH_ATTR WriteStatusInit(uint32 start_addr);
 
 bool ICACHE_FLASH_ATTR WriteRemainingBytes(WriteStatus *status);
 
 bool ICACHE_FLASH_ATTR WriteFlash(WriteStatus *status, uint8 *data, uint16 len);
 
+bool ICACHE_FLASH_ATTR SkipFlash(WriteStatus *status, uint32 len);
+
 bool ICACHE_FLASH_ATTR GetRTCData(RTCData *rtc);
 
 bool ICACHE_FLASH_ATTR SetRTCData(RTCData *rtc);
@@ -47,4 +88,22 @@ bool ICACHE_FLASH_ATTR GetLastBootROM(uint8 *rom);
 
 bool ICACHE_FLASH_ATTR GetLastBootMode(uint8 *mode);
 
+bool ICACHE_FLASH_ATTR IsTrialBoot(void);
+
+bool ICACHE_FLASH_ATTR IsRevertBoot(void);
+
+uint8 ICACHE_FLASH_ATTR GetRunningROM(void);
+
+uint8 ICACHE_FLASH_ATTR GetBootParts(void);
+
+uint8 ICACHE_FLASH_ATTR CheckTrialBoot(uint8 maxBoots);
+
+bool ICACHE_FLASH_ATTR StartTrialBoot(void);
+
+bool ICACHE_FLASH_ATTR StartRevertBoot(uint8 rom);
+
+bool ICACHE_FLASH_ATTR ConfirmTrialBoot(void);
+
+bool ICACHE_FLASH_ATTR CancelTrialBoot(void);
+
 #endif
@@ -4,7 +4,21 @@
 //----------------------------------------------------------------------------------------------------------------------
 // Included files to resolve specific definitions in this file
 //----------------------------------------------------------------------------------------------------------------------
+// shared with the bootloader in boot/, whose boot decisions also compile for the host with BOOT_HOST
+#ifdef BOOT_HOST
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int32_t int32;
+
+#define ICACHE_FLASH_ATTR
+#else
 #include <c_types.h>
+#endif
 
 //----------------------------------------------------------------------------------------------------------------------
 // Constant data
@@ -15,18 +29,114 @@
 
 #define BOOT_CONFIG_SECTOR 1
 
+// The configuration sector and its copy, after the configuration log, are rewritten in turn, each holds a
+// BootConfigRecord and the intact one with the higher Sequence is used. A power failure during a rewrite leaves the
+// other one. Before its first record the configuration sector holds a bare BootConfiguration.
+#define BOOT_CONFIG_COPY_SECTOR 0x214
+
 #define BOOT_CONFIG_MAGIC 0xA5EAF1C3
 
-#define BOOT_CONFIG_VERSION 0x01
+#define BOOT_CONFIG_VERSION 0x02
 
 #define RTC_ADDRESS 0x40
 
-#define MAX_ROMS 2
+#define RTC_MAGIC 0x2334AE68
+
+// boot modes of the RTC data
+#define MODE_STANDARD 0x00
+
+#define MODE_GPIO_ROM 0x01
+
+#define MODE_TEMP_ROM 0x02
+
+// RTC block of the trial boot, after the bootloader RTC data
+#define TRIAL_RTC_ADDRESS (RTC_ADDRESS + 0x10)
+
+#define TRIAL_MAGIC 0x54524941
+
+// startup state of a trial boot, see CheckTrialBoot
+#define TRIAL_NONE 0
+
+#define TRIAL_RUNNING 1
+
+#define TRIAL_RETRY 2
+
+#define TRIAL_ROLLBACK 3
+
+#define TRIAL_REVERT_FAILED 4
+
+// the ROM on trial is the target of a revert, not the staged ROM
+#define TRIAL_FLAG_REVERT 0x01
+
+// RTC block of the boot telemetry, after the DNS cache of the application, see drivers/BootTelemetry.h
+#define TELEMETRY_RTC_ADDRESS (RTC_ADDRESS + 0x30)
+
+// ROM slots, e.g. factory at 0x002000, A at 0x082000 and B at 0x102000 on 4 MB parts, or A at 0x102000 and B at
+// 0x302000 with SINGLE_IMAGE. The bootloader maps the 1 MB block of a slot, the image of a slot is linked for its
+// offset in the block, see GetImageName in OTA_Manager.c
+#define MAX_ROMS 3
+
+// with more than two slots this one is never updated, the last fallback
+#define FACTORY_ROM 0
+
+// the flash cache maps one 1 MB block, the one of the ROM booted, see drivers/FlashMapping.c
+#define ROM_BLOCK_SIZE 0x100000
+
+// With SINGLE_IMAGE (SINGLE_IMAGE=1 of the Makefile) every ROM slot sits this far into its own 1 MB block, so the one
+// image linked for it, ld/user.ld, runs from any slot. Needs at least 2 MB of flash.
+#define SINGLE_IMAGE_OFFSET 0x2000
+
+#define NO_ROM 0xFF
+
+#define NO_STAGED_ROM NO_ROM
+
+// slot states of the metadata table
+#define SLOT_EMPTY 0x00
+
+#define SLOT_STAGED 0x01
+
+#define SLOT_CONFIRMED 0x02
+
+#define SLOT_BAD 0x03
+
+#define SLOT_DIGEST_SIZE 32
+
+// the image of the slot passed its checksum after it was written, Size and CheckSum describe it
+#define SLOT_FLAG_VERIFIED 0x01
+
+// Digest holds the digest of the image, taken in slices by the scrub of app/OTA_Scrub.c right after the image was
+// verified, and compared by its later passes
+#define SLOT_FLAG_DIGEST 0x02
+
+#define NO_JOB 0xFFFFFFFF
+
+// log of configuration records, after the bundle regions, its sectors are written in turn
+#define BOOT_LOG_SECTOR 0x212
+
+#define BOOT_LOG_SECTORS 2
+
+#define BOOT_LOG_RECORDS (SECTOR_SIZE / sizeof(BootConfigRecord))
+
+#define BOOT_LOG_COMMIT 0x474F4C43
 
 //----------------------------------------------------------------------------------------------------------------------
 // Exported type
 //----------------------------------------------------------------------------------------------------------------------
 
+// Metadata of a ROM slot, kept with the boot configuration so update, revert and boot choose a slot without
+// reading its image
+typedef struct
+{
+    uint32 Version;         // FIRMWARE_VERSION of the image, 0 if unknown
+    uint32 Size;            // Length of the image in flash, from its headers
+    uint32 BuildID;         // BUILD_ID of the image, 0 if unknown
+    uint8 Digest[SLOT_DIGEST_SIZE]; // SHA256 of the Size bytes of the image in flash, with SLOT_FLAG_DIGEST
+    uint8 State;            // SLOT_EMPTY, SLOT_STAGED, SLOT_CONFIRMED or SLOT_BAD
+    uint8 Flags;            // SLOT_FLAG_VERIFIED, SLOT_FLAG_DIGEST
+    uint8 CheckSum;         // Checksum stored in the image, see drivers/BootImage.h
+    uint8 Reserved;
+} SlotMetadata;
+
 // Structure containing boot configuration
 // ROM addresses must be multiples of 0x1000 (flash sector aligned).
 typedef struct
@@ -36,15 +146,49 @@ typedef struct
     uint8 CurrentROM;        // Currently selected ROM (will be used for next standard boot)
     uint8 Count;            // Quantity of ROMs available to boot
     uint32 ROMS[MAX_ROMS];  // Flash addresses of each ROM
+    uint8 StagedROM;        // Downloaded ROM waiting for activation, NO_STAGED_ROM if none (erased flash)
+    uint32 ActivationTime;  // Unix time to activate the staged ROM at, 0 waits for the activate command
+    uint32 LastJobID;       // Last completed update job, NO_JOB if none (erased flash)
+    uint32 LastJobVersion;  // Firmware version installed by the last completed update job
+    uint8 ActiveParts;      // Bit per bundle part, selects which of its two flash regions is in use
+    uint8 StagedParts;      // ActiveParts once the staged ROM is activated
+    uint32 Sequence;        // Number of the write, the newer of sector and log is used (erased flash before the first)
+    SlotMetadata Slots[MAX_ROMS];   // Metadata of each ROM
 } BootConfiguration;
 
+// Record of the configuration log and of the configuration sectors. A write torn by a power failure lacks the commit
+// and is skipped, the previous record stays in use.
+typedef struct
+{
+    BootConfiguration Configuration;
+    uint8 CheckSum;         // Checksum of Configuration
+    uint8 Reserved[3];
+    uint32 Commit;          // BOOT_LOG_COMMIT, written after the rest of the record
+} BootConfigRecord;
+
 // Structure containing rBoot status/control data.
 // This structure is used to, communicate between bootloader and
 // the user app. It is stored in the ESP RTC data area.
 typedef struct
 {
-    uint32 MagicNumber;      // Magic, identifies rBoot RTC data - should be RBOOT_RTC_MAGIC
+    uint32 MagicNumber;      // Magic, identifies rBoot RTC data - should be RTC_MAGIC
+    uint8 NextMode;         // Boot mode for the next boot, MODE_TEMP_ROM boots TempROM once
+    uint8 LastMode;         // Boot mode of the last boot, set by the bootloader
+    uint8 LastROM;          // ROM booted last, set by the bootloader
+    uint8 TempROM;          // ROM to boot in MODE_TEMP_ROM
     uint8 CheckSum;         // Checksum of this structure this will be updated for you passed to the API
 } RTCData;
 
+// Trial boots of the staged ROM or of the ROM a revert goes back to. It is booted once at a time from the RTC data,
+// without a flash write, and only becomes the current ROM once confirmed. Lost on power off, the ROM is then not on
+// trial anymore.
+typedef struct
+{
+    uint32 MagicNumber;     // TRIAL_MAGIC
+    uint8 ROM;              // ROM on trial
+    uint8 Boots;            // Trial boots started
+    uint8 Flags;            // TRIAL_FLAG_REVERT
+    uint8 CheckSum;
+} TrialData;
+
 #endif
@@ -0,0 +1,130 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "FlashMapping.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+extern uint32 SPIRead(uint32 address, void* data, uint32 length);
+extern void Cache_Read_Enable(uint8 odd_even, uint8 mb_count, uint8 no_idea);
+
+static bool ReadConfiguration(uint32 sector, BootConfigRecord* record);
+
+static uint8 GetBootBlock(void);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+// found on the first call, the SDK calls again after each flash access
+static uint8 BootBlock = 0xFF;
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Read the record of a configuration sector, see BOOT_CONFIG_COPY_SECTOR
+//
+// PARAMETERS:          uint32 sector
+//                      BootConfigRecord* record - populated with the record
+//
+// RETURN VALUE:        bool - true if it is committed and intact
+//
+//======================================================================================================================
+static bool ReadConfiguration(uint32 sector, BootConfigRecord* record)
+{
+    uint8* byte = (uint8*) &record->Configuration;
+    uint8 checksum = DEFAULT_CHECKSUM;
+    uint32 index;
+
+    if (0 != SPIRead(sector * SECTOR_SIZE, record, sizeof(BootConfigRecord)))
+    {
+        return false;
+    }
+
+    for (index = 0; byte + index < &record->CheckSum; index++)
+    {
+        checksum ^= byte[index];
+    }
+
+    return ((BOOT_LOG_COMMIT == record->Commit) && (checksum == record->CheckSum));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Find the 1 MB block of the ROM booted, from the RTC data left by the bootloader and the
+//                      configuration sectors. Runs before the SDK is up, the flash is read through the ROM code.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8 - block of the flash, the first one if the bootloader left no RTC data
+//
+//======================================================================================================================
+static uint8 GetBootBlock(void)
+{
+    volatile uint32* memory = (volatile uint32*) (FLASH_MAPPING_RTC + (RTC_ADDRESS * 4));
+    BootConfigRecord first;
+    BootConfigRecord second;
+    BootConfiguration* configuration = &first.Configuration;
+    RTCData rtc;
+    uint32* data = (uint32*) &rtc;
+    uint8* byte = (uint8*) &rtc;
+    uint8 checksum = DEFAULT_CHECKSUM;
+    uint32 index;
+    bool isFirst;
+
+    for (index = 0; index < (sizeof(RTCData) / sizeof(uint32)); index++)
+    {
+        data[index] = memory[index];
+    }
+
+    for (index = 0; byte + index < &rtc.CheckSum; index++)
+    {
+        checksum ^= byte[index];
+    }
+
+    if ((RTC_MAGIC != rtc.MagicNumber) || (checksum != rtc.CheckSum))
+    {
+        return 0;
+    }
+
+    // the newer intact record, as the bootloader chose, the configuration sector as it is without one
+    first.Configuration.MagicNumber = 0;
+    isFirst = ReadConfiguration(BOOT_CONFIG_SECTOR, &first);
+
+    if ((true == ReadConfiguration(BOOT_CONFIG_COPY_SECTOR, &second))
+            && ((false == isFirst) || (second.Configuration.Sequence > first.Configuration.Sequence)))
+    {
+        configuration = &second.Configuration;
+    }
+
+    if ((BOOT_CONFIG_MAGIC != configuration->MagicNumber) || (rtc.LastROM >= configuration->Count)
+            || (MAX_ROMS < configuration->Count))
+    {
+        return 0;
+    }
+
+    return (configuration->ROMS[rtc.LastROM] / FLASH_MAPPING_BLOCK);
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Map the block of the ROM booted to the flash cache
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void Cache_Read_Enable_New(void)
+{
+    if (0xFF == BootBlock)
+    {
+        BootBlock = GetBootBlock();
+    }
+
+    Cache_Read_Enable(BootBlock & 1, BootBlock >> 1, 1);
+}
@@ -0,0 +1,26 @@
+#ifndef __FLASH_MAPPING_H__
+#define __FLASH_MAPPING_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "BootloaderDriver.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// the cache maps one 1 MB block of the flash at 0x40200000
+#define FLASH_MAPPING_BLOCK ROM_BLOCK_SIZE
+
+// RTC user memory as seen before the SDK is up, see RTC_ADDRESS
+#define FLASH_MAPPING_RTC   0x60001100
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//
+// Replaces the one of libmain, see libmain2 in the Makefile. Called by the SDK at startup, from IRAM, to map the
+// block of the ROM the bootloader booted instead of always the first one.
+//======================================================================================================================
+void Cache_Read_Enable_New(void);
+
+#endif
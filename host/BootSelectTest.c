@@ -0,0 +1,328 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "BootSelectTest.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void Check(bool isOK, const char* name);
+
+static void CheckOrder(const BootConfiguration* configuration, const RTCData* rtc, const uint8* expected,
+        uint8 count, bool isTemp, const char* name);
+
+static void PrepareConfiguration(BootConfiguration* configuration, uint8 count, uint8 current);
+
+static void PrepareRTCData(RTCData* rtc, uint8 mode, uint8 rom);
+
+static void TestBootOrder(void);
+
+static void TestTempBootOrder(void);
+
+static void TestTwoSlotBootOrder(void);
+
+static void TestFastBoot(void);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static uint32 Checks;
+
+static uint32 Failures;
+
+//======================================================================================================================
+// DESCRIPTION:         Run the boot decisions of boot/BootSelect.c, built for the host with BOOT_HOST
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        int - 0 if all checks passed
+//
+//======================================================================================================================
+int main(void)
+{
+    TestBootOrder();
+    TestTempBootOrder();
+    TestTwoSlotBootOrder();
+    TestFastBoot();
+
+    printf("BootSelectTest: %u checks, %u failed\n", Checks, Failures);
+
+    return (0 == Failures) ? 0 : 1;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Account a check, a failed one is printed
+//
+// PARAMETERS:          bool isOK
+//                      const char* name
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void Check(bool isOK, const char* name)
+{
+    Checks++;
+
+    if (false == isOK)
+    {
+        Failures++;
+        printf("BootSelectTest failed: %s\n", name);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the boot order of a configuration, a wrong one is printed
+//
+// PARAMETERS:          const BootConfiguration* configuration
+//                      const RTCData* rtc - or NULL
+//                      const uint8* expected - ROMs in the expected order
+//                      uint8 count - of expected ROMs
+//                      bool isTemp - first ROM booted once from the RTC data
+//                      const char* name
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void CheckOrder(const BootConfiguration* configuration, const RTCData* rtc, const uint8* expected,
+        uint8 count, bool isTemp, const char* name)
+{
+    uint8 order[MAX_ROMS];
+    uint8 found;
+    uint8 index;
+    bool isFoundTemp;
+
+    memset(order, NO_ROM, sizeof(order));
+
+    found = GetBootOrder(configuration, rtc, order, &isFoundTemp);
+
+    Check((found == count) && (0 == memcmp(order, expected, count)) && (isFoundTemp == isTemp), name);
+
+    if ((found != count) || (0 != memcmp(order, expected, count)))
+    {
+        printf("  order:");
+
+        for (index = 0; index < found; index++)
+        {
+            printf(" %u", order[index]);
+        }
+
+        printf(", expected:");
+
+        for (index = 0; index < count; index++)
+        {
+            printf(" %u", expected[index]);
+        }
+
+        printf("\n");
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Configuration with every slot empty
+//
+// PARAMETERS:          BootConfiguration* configuration - populated
+//                      uint8 count - ROM slots
+//                      uint8 current - current ROM
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrepareConfiguration(BootConfiguration* configuration, uint8 count, uint8 current)
+{
+    GetDefaultConfiguration(configuration, (3 == count) ? BOOT_BIG_FLASH_SIZE : (BOOT_BIG_FLASH_SIZE / 2));
+
+    configuration->CurrentROM = current;
+
+    Check(true == IsConfigurationValid(configuration), "default configuration valid");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         RTC data as the application leaves it for the bootloader
+//
+// PARAMETERS:          RTCData* rtc - populated
+//                      uint8 mode - NextMode
+//                      uint8 rom - TempROM
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrepareRTCData(RTCData* rtc, uint8 mode, uint8 rom)
+{
+    memset(rtc, 0, sizeof(RTCData));
+
+    rtc->MagicNumber = RTC_MAGIC;
+    rtc->NextMode = mode;
+    rtc->TempROM = rom;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Standard boots of three slots: the current ROM, the other confirmed ROMs newest first, the
+//                      factory ROM last. Empty and bad slots are left out unless the configuration asks for them.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestBootOrder(void)
+{
+    BootConfiguration configuration;
+    static const uint8 currentOnly[] = { 1, 0 };
+    static const uint8 newest[] = { 1, 2, 0 };
+    static const uint8 older[] = { 0, 2, 1 };
+    static const uint8 badCurrent[] = { 2, 0 };
+    static const uint8 badFactory[] = { 1, 2 };
+
+    PrepareConfiguration(&configuration, 3, 1);
+
+    CheckOrder(&configuration, NULL, currentOnly, sizeof(currentOnly), false, "empty slots left out");
+
+    configuration.Slots[0].State = SLOT_CONFIRMED;
+    configuration.Slots[1].State = SLOT_CONFIRMED;
+    configuration.Slots[2].State = SLOT_CONFIRMED;
+    configuration.Slots[0].Version = 9;
+    configuration.Slots[1].Version = 3;
+    configuration.Slots[2].Version = 2;
+
+    CheckOrder(&configuration, NULL, newest, sizeof(newest), false, "factory ROM last");
+
+    configuration.CurrentROM = 0;
+    configuration.Slots[1].Version = 1;
+
+    CheckOrder(&configuration, NULL, older, sizeof(older), false, "confirmed ROMs newest first");
+
+    configuration.CurrentROM = 2;
+    configuration.Slots[2].State = SLOT_BAD;
+    configuration.Slots[1].State = SLOT_STAGED;
+
+    CheckOrder(&configuration, NULL, badCurrent, sizeof(badCurrent), false, "bad current ROM kept, staged left out");
+
+    configuration.CurrentROM = 1;
+    configuration.Slots[0].State = SLOT_BAD;
+    configuration.Slots[1].State = SLOT_CONFIRMED;
+    configuration.Slots[2].State = SLOT_CONFIRMED;
+
+    CheckOrder(&configuration, NULL, badFactory, sizeof(badFactory), false, "bad factory ROM left out");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Boots of a ROM requested once through the RTC data
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestTempBootOrder(void)
+{
+    BootConfiguration configuration;
+    RTCData rtc;
+    static const uint8 temp[] = { 2, 1, 0 };
+    static const uint8 tempCurrent[] = { 1, 2, 0 };
+    static const uint8 standard[] = { 1, 2, 0 };
+
+    PrepareConfiguration(&configuration, 3, 1);
+
+    configuration.Slots[1].State = SLOT_CONFIRMED;
+    configuration.Slots[2].State = SLOT_STAGED;
+
+    PrepareRTCData(&rtc, MODE_TEMP_ROM, 2);
+
+    CheckOrder(&configuration, &rtc, temp, sizeof(temp), true, "temp ROM first, staged or not");
+
+    PrepareRTCData(&rtc, MODE_TEMP_ROM, 1);
+    configuration.Slots[2].State = SLOT_CONFIRMED;
+
+    CheckOrder(&configuration, &rtc, tempCurrent, sizeof(tempCurrent), true, "temp ROM is the current ROM");
+
+    PrepareRTCData(&rtc, MODE_STANDARD, 2);
+
+    CheckOrder(&configuration, &rtc, standard, sizeof(standard), false, "standard mode ignores the temp ROM");
+
+    PrepareRTCData(&rtc, MODE_TEMP_ROM, MAX_ROMS);
+
+    CheckOrder(&configuration, &rtc, standard, sizeof(standard), false, "temp ROM beyond the ROM count ignored");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Two slots have no factory ROM, either one is a fallback once confirmed
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestTwoSlotBootOrder(void)
+{
+    BootConfiguration configuration;
+    static const uint8 both[] = { 1, 0 };
+    static const uint8 current[] = { 1 };
+
+    PrepareConfiguration(&configuration, 2, 1);
+
+    CheckOrder(&configuration, NULL, current, sizeof(current), false, "two slots, the other one empty");
+
+    configuration.Slots[0].State = SLOT_CONFIRMED;
+
+    CheckOrder(&configuration, NULL, both, sizeof(both), false, "two slots, slot 0 is no factory ROM");
+
+    configuration.Slots[0].State = SLOT_BAD;
+
+    CheckOrder(&configuration, NULL, current, sizeof(current), false, "two slots, the other one bad");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A verified image boots from its headers only while they still describe it
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestFastBoot(void)
+{
+    SlotMetadata metadata;
+    ImageInfo info;
+
+    memset(&metadata, 0, sizeof(SlotMetadata));
+    memset(&info, 0, sizeof(ImageInfo));
+
+    metadata.State = SLOT_CONFIRMED;
+    metadata.Flags = SLOT_FLAG_VERIFIED;
+    metadata.Size = SELECT_TEST_SIZE;
+    metadata.CheckSum = SELECT_TEST_CHECKSUM;
+
+    info.Length = SELECT_TEST_SIZE;
+    info.CheckSum = SELECT_TEST_CHECKSUM;
+
+    Check(true == IsFastBoot(&metadata, &info), "verified image boots fast");
+
+    metadata.State = SLOT_STAGED;
+
+    Check(true == IsFastBoot(&metadata, &info), "verified staged image boots fast");
+
+    info.CheckSum = SELECT_TEST_CHECKSUM ^ 0x01;
+
+    Check(false == IsFastBoot(&metadata, &info), "stale checksum needs a full check");
+
+    info.CheckSum = SELECT_TEST_CHECKSUM;
+    info.Length = SELECT_TEST_SIZE + IMAGE_ALIGN;
+
+    Check(false == IsFastBoot(&metadata, &info), "stale length needs a full check");
+
+    info.Length = SELECT_TEST_SIZE;
+    metadata.Flags = 0;
+
+    Check(false == IsFastBoot(&metadata, &info), "unverified image needs a full check");
+
+    metadata.Flags = SLOT_FLAG_VERIFIED;
+    metadata.State = SLOT_BAD;
+
+    Check(false == IsFastBoot(&metadata, &info), "bad slot needs a full check");
+}
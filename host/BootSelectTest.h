@@ -0,0 +1,16 @@
+#ifndef __BOOT_SELECT_TEST_H__
+#define __BOOT_SELECT_TEST_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include "../boot/BootSelect.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// image of a verified slot, see IsFastBoot
+#define SELECT_TEST_SIZE  0x4A3F0
+#define SELECT_TEST_CHECKSUM  0x5C
+
+#endif
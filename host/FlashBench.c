@@ -0,0 +1,519 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FlashBench.h"
+#include "FlashEmulator.h"
+#include "HostSystem.h"
+#include "../drivers/Bootloader.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void PrepareFlash(void);
+
+static void RecordCall(CallStatistics* statistics, uint32 start, bool isOK);
+
+static void PrintCalls(const char* name, const CallStatistics* statistics);
+
+static void PrintFlash(const char* name);
+
+static void PrintWear(uint16 first, uint16 count, const char* name);
+
+static bool CheckReadBack(const char* name, uint32 writes);
+
+static bool BenchConfiguration(void);
+
+static void BenchWriteFlash(void);
+
+static bool RunUpdate(uint8 rom);
+
+static uint8 CheckPowerCut(uint8 rom);
+
+static uint32 BenchPowerCuts(void);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static uint8 Image[FLASH_BENCH_IMAGE_LENGTH];
+
+static const char* CutOutcomes[CUT_OUTCOMES] = { "old ROM", "new ROM", "configuration lost", "inconsistent" };
+
+//======================================================================================================================
+// DESCRIPTION:         Run the configuration and OTA flash paths of drivers/Bootloader.c on the emulated flash, report
+//                      modelled latency, wear and the outcome of a power cut at each flash operation of an update.
+//
+// PARAMETERS:          int argc
+//                      char* argv[] - [-strict] [flash image]
+//
+// RETURN VALUE:        int - 0 if no power cut lost the configuration or left the flash inconsistent, and configuration
+//                            writes read nothing but their read-back
+//
+//======================================================================================================================
+int main(int argc, char* argv[])
+{
+    const char* path = NULL;
+    uint32 failures;
+    bool isReadBack;
+    uint32 index;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (0 == strcmp(argv[arg], "-strict"))
+        {
+            SetFlashStrict(true);
+        }
+        else
+        {
+            path = argv[arg];
+        }
+    }
+
+    if (false == InitFlashEmulator(path, FLASH_EMULATOR_SIZE))
+    {
+        fprintf(stderr, "Cannot open the flash %s\n", (NULL == path) ? "in memory" : path);
+        return 2;
+    }
+
+    for (index = 0; index < FLASH_BENCH_IMAGE_LENGTH; index++)
+    {
+        Image[index] = (uint8) ((index * 7) ^ (index >> 8));
+    }
+
+    isReadBack = BenchConfiguration();
+    BenchWriteFlash();
+    failures = BenchPowerCuts();
+
+    CloseFlashEmulator();
+
+    return ((0 == failures) && (true == isReadBack)) ? 0 : 1;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Erase the flash and write the configuration of a module running ROM 0 of two slots, each at
+//                      SINGLE_IMAGE_OFFSET into its 1 MB block so the layout suits either image mode
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrepareFlash(void)
+{
+    BootConfiguration configuration;
+
+    memset(GetFlashMemory(), 0xFF, FLASH_EMULATOR_SIZE);
+
+    memset(&configuration, 0xFF, sizeof(BootConfiguration));
+    memset(configuration.Slots, 0, sizeof(configuration.Slots));
+
+    configuration.MagicNumber = BOOT_CONFIG_MAGIC;
+    configuration.Version = BOOT_CONFIG_VERSION;
+    configuration.CurrentROM = 0;
+    configuration.Count = 2;
+    configuration.ROMS[0] = 0x002000;
+    configuration.ROMS[1] = 0x102000;
+    configuration.ActiveParts = 0;
+    configuration.StagedParts = 0;
+    configuration.Slots[0].State = SLOT_CONFIRMED;
+    configuration.Slots[0].Version = 1;
+
+    memcpy(GetFlashMemory() + (BOOT_CONFIG_SECTOR * SECTOR_SIZE), &configuration, sizeof(BootConfiguration));
+
+    PowerOnHost();
+    LoadConfiguration();
+    ResetFlashStatistics();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Account a call, from the host clock the flash operations advance
+//
+// PARAMETERS:          CallStatistics* statistics
+//                      uint32 start - system_get_time before the call
+//                      bool isOK - result of the call
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void RecordCall(CallStatistics* statistics, uint32 start, bool isOK)
+{
+    uint32 time = system_get_time() - start;
+
+    statistics->Count++;
+    statistics->Time += time;
+
+    if (time > statistics->MaxTime)
+    {
+        statistics->MaxTime = time;
+    }
+
+    if (false == isOK)
+    {
+        statistics->Failures++;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Print the latency of the calls of a scenario
+//
+// PARAMETERS:          const char* name
+//                      const CallStatistics* statistics
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrintCalls(const char* name, const CallStatistics* statistics)
+{
+    printf("%s: %u calls, %u failed, average %llu us, max %u us\n", name, statistics->Count, statistics->Failures,
+            (0 == statistics->Count) ? 0ULL : (unsigned long long) (statistics->Time / statistics->Count),
+            statistics->MaxTime);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Print the flash operations since the statistics were reset
+//
+// PARAMETERS:          const char* name
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrintFlash(const char* name)
+{
+    FlashStatistics statistics;
+    const FlashOperationStatistics* operations = statistics.Operations;
+
+    GetFlashStatistics(&statistics);
+
+    printf("%s flash: %u reads (%llu B), %u writes (%llu B), %u erases, %llu ms, %u program violations, "
+            "%u alignment errors\n", name, operations[FLASH_OPERATION_READ].Count,
+            (unsigned long long) operations[FLASH_OPERATION_READ].Bytes, operations[FLASH_OPERATION_WRITE].Count,
+            (unsigned long long) operations[FLASH_OPERATION_WRITE].Bytes, operations[FLASH_OPERATION_ERASE].Count,
+            (unsigned long long) ((operations[FLASH_OPERATION_READ].Time + operations[FLASH_OPERATION_WRITE].Time
+                    + operations[FLASH_OPERATION_ERASE].Time) / 1000), statistics.ProgramViolations,
+            statistics.AlignmentErrors);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Print the erases of a range of sectors since the flash was opened
+//
+// PARAMETERS:          uint16 first - sector
+//                      uint16 count - of sectors
+//                      const char* name
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrintWear(uint16 first, uint16 count, const char* name)
+{
+    uint32 total = 0;
+    uint32 most = 0;
+    uint32 erases;
+    uint16 sector;
+
+    for (sector = first; sector < (first + count); sector++)
+    {
+        erases = GetSectorEraseCount(sector);
+
+        total += erases;
+
+        if (erases > most)
+        {
+            most = erases;
+        }
+    }
+
+    printf("%s wear: sectors 0x%03X-0x%03X, %u erases, at most %u per sector\n", name, first, first + count - 1,
+            total, most);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check that configuration writes since the statistics were reset read the flash only to read
+//                      back the record each one wrote, the cache replaces any read before the write
+//
+// PARAMETERS:          const char* name
+//                      uint32 writes - configuration writes
+//
+// RETURN VALUE:        bool - false if they read more
+//
+//======================================================================================================================
+static bool CheckReadBack(const char* name, uint32 writes)
+{
+    FlashStatistics statistics;
+    uint64 bytes;
+
+    GetFlashStatistics(&statistics);
+
+    bytes = statistics.Operations[FLASH_OPERATION_READ].Bytes;
+
+    if (bytes > ((uint64) writes * sizeof(BootConfigRecord)))
+    {
+        printf("%s: %llu B read, more than the read-back of %u records\n", name, (unsigned long long) bytes, writes);
+        return false;
+    }
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Configuration writes that go to the log, and those that rewrite a configuration sector
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if a write read more than its read-back, see CheckReadBack
+//
+//======================================================================================================================
+static bool BenchConfiguration(void)
+{
+    CallStatistics calls;
+    SlotMetadata metadata;
+    uint32 start;
+    uint32 index;
+    bool isReadBack;
+
+    PrepareFlash();
+
+    memset(&calls, 0, sizeof(CallStatistics));
+
+    for (index = 0; index < FLASH_BENCH_JOBS; index++)
+    {
+        start = system_get_time();
+        RecordCall(&calls, start, (true == SetLastJob(index, FLASH_BENCH_VERSION)) && (index == GetLastJob(NULL)));
+    }
+
+    PrintCalls("SetConfiguration log", &calls);
+    PrintFlash("SetConfiguration log");
+    PrintWear(BOOT_LOG_SECTOR, BOOT_LOG_SECTORS, "SetConfiguration log");
+
+    isReadBack = CheckReadBack("SetConfiguration log", calls.Count);
+
+    ResetFlashStatistics();
+    memset(&calls, 0, sizeof(CallStatistics));
+    memset(&metadata, 0, sizeof(SlotMetadata));
+
+    for (index = 0; index < FLASH_BENCH_SECTOR_WRITES; index++)
+    {
+        metadata.Version = index;
+
+        start = system_get_time();
+        RecordCall(&calls, start, SetSlotMetadata(1, &metadata));
+    }
+
+    PrintCalls("SetConfiguration sector", &calls);
+    PrintFlash("SetConfiguration sector");
+    PrintWear(BOOT_CONFIG_SECTOR, 1, "SetConfiguration sector");
+    PrintWear(BOOT_CONFIG_COPY_SECTOR, 1, "SetConfiguration sector copy");
+
+    return (true == CheckReadBack("SetConfiguration sector", calls.Count)) && (true == isReadBack);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write an image to the update slot as a download does, and read it back
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void BenchWriteFlash(void)
+{
+    CallStatistics calls;
+    WriteStatus status;
+    uint32 address;
+    uint32 offset;
+    uint32 length;
+    uint32 start;
+    uint8 rom;
+
+    PrepareFlash();
+
+    rom = GetUpdateSlot();
+    address = GetROMAddress(rom);
+
+    memset(&calls, 0, sizeof(CallStatistics));
+
+    status = WriteStatusInit(address);
+
+    for (offset = 0; offset < FLASH_BENCH_IMAGE_LENGTH; offset += length)
+    {
+        length = FLASH_BENCH_IMAGE_LENGTH - offset;
+        length = (length < FLASH_BENCH_CHUNK) ? length : FLASH_BENCH_CHUNK;
+
+        start = system_get_time();
+        RecordCall(&calls, start, WriteFlash(&status, &Image[offset], length));
+    }
+
+    WriteRemainingBytes(&status);
+
+    PrintCalls("WriteFlash", &calls);
+    printf("WriteFlash: %u B in %llu ms, %llu B/s, image %s\n", FLASH_BENCH_IMAGE_LENGTH,
+            (unsigned long long) (calls.Time / 1000),
+            (0 == calls.Time) ? 0ULL : (unsigned long long) ((FLASH_BENCH_IMAGE_LENGTH * 1000000ULL) / calls.Time),
+            (0 == memcmp(GetFlashMemory() + address, Image, FLASH_BENCH_IMAGE_LENGTH)) ? "intact" : "corrupt");
+    PrintFlash("WriteFlash");
+    PrintWear(address / SECTOR_SIZE, FLASH_BENCH_IMAGE_LENGTH / SECTOR_SIZE, "WriteFlash");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Download, stage and activate an image as app/OTA_Manager.c does, stop at the first failure
+//
+// PARAMETERS:          uint8 rom - update slot
+//
+// RETURN VALUE:        bool - false if a step failed
+//
+//======================================================================================================================
+static bool RunUpdate(uint8 rom)
+{
+    WriteStatus status = WriteStatusInit(GetROMAddress(rom));
+    SlotMetadata metadata;
+    uint32 offset;
+    uint32 length;
+
+    for (offset = 0; offset < FLASH_BENCH_IMAGE_LENGTH; offset += length)
+    {
+        length = FLASH_BENCH_IMAGE_LENGTH - offset;
+        length = (length < FLASH_BENCH_CHUNK) ? length : FLASH_BENCH_CHUNK;
+
+        if (false == WriteFlash(&status, &Image[offset], length))
+        {
+            return false;
+        }
+    }
+
+    if (false == WriteRemainingBytes(&status))
+    {
+        return false;
+    }
+
+    memset(&metadata, 0, sizeof(SlotMetadata));
+
+    metadata.Version = FLASH_BENCH_VERSION;
+    metadata.Size = FLASH_BENCH_IMAGE_LENGTH;
+    metadata.State = SLOT_STAGED;
+    metadata.Flags = SLOT_FLAG_VERIFIED;
+
+    return (true == SetSlotMetadata(rom, &metadata)) && (true == SetStagedROM(rom, 0))
+            && (true == SetLastJob(FLASH_BENCH_JOB_ID, FLASH_BENCH_VERSION)) && (true == ActivateStagedROM());
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Judge the flash after a power cut during RunUpdate, from the configuration read at power on.
+//                      The new ROM may only be booted once its image is complete.
+//
+// PARAMETERS:          uint8 rom - update slot
+//
+// RETURN VALUE:        uint8 - CUT_...
+//
+//======================================================================================================================
+static uint8 CheckPowerCut(uint8 rom)
+{
+    BootConfiguration configuration;
+    uint32 job;
+
+    LoadConfiguration();
+
+    configuration = GetConfiguration();
+    job = GetLastJob(NULL);
+
+    if ((BOOT_CONFIG_MAGIC != configuration.MagicNumber) || (BOOT_CONFIG_VERSION != configuration.Version))
+    {
+        return CUT_CONFIGURATION_LOST;
+    }
+
+    if ((2 != configuration.Count) || ((NO_JOB != job) && (FLASH_BENCH_JOB_ID != job)))
+    {
+        return CUT_INCONSISTENT;
+    }
+
+    if (0 == configuration.CurrentROM)
+    {
+        return CUT_OLD_ROM;
+    }
+
+    if ((rom == configuration.CurrentROM) && (SLOT_CONFIRMED == configuration.Slots[rom].State)
+            && (0 == memcmp(GetFlashMemory() + GetROMAddress(rom), Image, FLASH_BENCH_IMAGE_LENGTH)))
+    {
+        return CUT_NEW_ROM;
+    }
+
+    return CUT_INCONSISTENT;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Cut the power at each flash operation of an update in turn, then power on and check the flash.
+//                      A configuration write must also succeed after every cut.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32 - cuts that lost the configuration or left the flash inconsistent
+//
+//======================================================================================================================
+static uint32 BenchPowerCuts(void)
+{
+    CallStatistics calls;
+    uint32 outcomes[CUT_OUTCOMES] = { 0 };
+    uint32 operations;
+    uint32 start;
+    uint32 cut;
+    uint8 outcome;
+    uint8 rom;
+
+    PrepareFlash();
+
+    rom = GetUpdateSlot();
+
+    memset(&calls, 0, sizeof(CallStatistics));
+
+    start = system_get_time();
+    RecordCall(&calls, start, RunUpdate(rom));
+
+    operations = GetFlashOperationCount();
+
+    PrintCalls("OTA update", &calls);
+    PrintFlash("OTA update");
+
+    for (cut = 0; cut < operations; cut++)
+    {
+        PrepareFlash();
+
+        SetPowerCut(cut);
+
+        // the step cut fails, the cut is seen on the flash only
+        RunUpdate(rom);
+
+        if (false == IsPowerCut())
+        {
+            printf("OTA power cut at operation %u: not reached\n", cut);
+            continue;
+        }
+
+        PowerOnHost();
+
+        outcome = CheckPowerCut(rom);
+
+        if ((CUT_CONFIGURATION_LOST != outcome) && (false == SetLastJob(FLASH_BENCH_JOB_ID + 1, FLASH_BENCH_VERSION)))
+        {
+            outcome = CUT_INCONSISTENT;
+        }
+
+        if ((CUT_CONFIGURATION_LOST == outcome) || (CUT_INCONSISTENT == outcome))
+        {
+            printf("OTA power cut at operation %u: %s\n", cut, CutOutcomes[outcome]);
+        }
+
+        outcomes[outcome]++;
+    }
+
+    printf("OTA power cuts: %u, %s %u, %s %u, %s %u, %s %u\n", operations, CutOutcomes[CUT_OLD_ROM],
+            outcomes[CUT_OLD_ROM], CutOutcomes[CUT_NEW_ROM], outcomes[CUT_NEW_ROM],
+            CutOutcomes[CUT_CONFIGURATION_LOST], outcomes[CUT_CONFIGURATION_LOST], CutOutcomes[CUT_INCONSISTENT],
+            outcomes[CUT_INCONSISTENT]);
+
+    return outcomes[CUT_CONFIGURATION_LOST] + outcomes[CUT_INCONSISTENT];
+}
@@ -0,0 +1,43 @@
+#ifndef __FLASH_BENCH_H__
+#define __FLASH_BENCH_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// configuration writes: log records and rewrites of the configuration sector
+#define FLASH_BENCH_JOBS  1000
+#define FLASH_BENCH_SECTOR_WRITES  50
+
+// image written to the update slot, in chunks of a received TCP segment as app/OTA_Bench.c does on the module
+#define FLASH_BENCH_IMAGE_LENGTH  0x40000
+#define FLASH_BENCH_CHUNK  1460
+
+#define FLASH_BENCH_JOB_ID  0x1000
+#define FLASH_BENCH_VERSION  2
+
+// outcomes of a power cut during the update, see CheckPowerCut
+#define CUT_OLD_ROM  0
+#define CUT_NEW_ROM  1
+#define CUT_CONFIGURATION_LOST  2      // the bootloader falls back to its default configuration
+#define CUT_INCONSISTENT  3
+
+#define CUT_OUTCOMES  4
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Modelled latency of the calls of a scenario
+typedef struct
+{
+    uint32 Count;
+    uint64 Time;        // in us
+    uint32 MaxTime;
+    uint32 Failures;
+} CallStatistics;
+
+#endif
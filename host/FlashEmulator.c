@@ -0,0 +1,557 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "FlashEmulator.h"
+#include "HostSystem.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static uint32 GetRandom(void);
+
+static bool StartOperation(uint8 operation, uint32 address, const void* data, uint32 length, bool* isCut);
+
+static void EndOperation(uint8 operation, uint32 length, uint32 time);
+
+static void CutPower(void);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static uint8* Flash;
+
+static uint32 FlashSize;
+
+static int FlashFile = -1;
+
+static uint32* EraseCounts;
+
+static FlashTiming Timing =
+{
+    FLASH_READ_SETUP_TIME, FLASH_READ_TIME_PER_KB, FLASH_WRITE_SETUP_TIME, FLASH_PAGE_PROGRAM_TIME, FLASH_ERASE_TIME
+};
+
+static FlashStatistics Statistics;
+
+static bool IsStrict;
+
+// operations since the last ResetFlashStatistics, the power is cut during operation CutOperation
+static uint32 OperationCount;
+
+static uint32 CutOperation = NO_POWER_CUT;
+
+static bool IsPowerOff;
+
+static uint32 RandomState;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Open the emulated flash. A file keeps the flash between runs and can be flashed to a module or
+//                      dumped from one, the part of it not there yet is erased.
+//
+// PARAMETERS:          const char* path - flash image, NULL for a flash in memory only
+//                      uint32 size - of the flash, a multiple of SPI_FLASH_SEC_SIZE
+//
+// RETURN VALUE:        bool - false if the image cannot be opened or mapped
+//
+//======================================================================================================================
+bool InitFlashEmulator(const char* path, uint32 size)
+{
+    struct stat status;
+    uint32 erased = 0;
+
+    if ((NULL != Flash) || (0 == size) || (0 != (size % SPI_FLASH_SEC_SIZE)))
+    {
+        return false;
+    }
+
+    if (NULL == path)
+    {
+        Flash = (uint8*) malloc(size);
+    }
+    else
+    {
+        FlashFile = open(path, O_RDWR | O_CREAT, 0644);
+
+        if ((FlashFile < 0) || (0 != fstat(FlashFile, &status)))
+        {
+            CloseFlashEmulator();
+            return false;
+        }
+
+        erased = (status.st_size < size) ? (uint32) status.st_size : size;
+
+        if ((status.st_size < size) && (0 != ftruncate(FlashFile, size)))
+        {
+            CloseFlashEmulator();
+            return false;
+        }
+
+        Flash = (uint8*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, FlashFile, 0);
+
+        if (MAP_FAILED == Flash)
+        {
+            Flash = NULL;
+        }
+    }
+
+    EraseCounts = (uint32*) calloc(size / SPI_FLASH_SEC_SIZE, sizeof(uint32));
+
+    if ((NULL == Flash) || (NULL == EraseCounts))
+    {
+        CloseFlashEmulator();
+        return false;
+    }
+
+    FlashSize = size;
+
+    memset(Flash + erased, 0xFF, size - erased);
+
+    IsStrict = false;
+    RandomState = 0x2545F491;
+
+    PowerOnFlash();
+    ResetFlashStatistics();
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Close the emulated flash, a flash image is written back
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void CloseFlashEmulator(void)
+{
+    if ((NULL != Flash) && (FlashFile >= 0))
+    {
+        munmap(Flash, FlashSize);
+    }
+    else
+    {
+        free(Flash);
+    }
+
+    if (FlashFile >= 0)
+    {
+        close(FlashFile);
+    }
+
+    free(EraseCounts);
+
+    Flash = NULL;
+    FlashSize = 0;
+    FlashFile = -1;
+    EraseCounts = NULL;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Content of the emulated flash, to prepare or check it without counting operations
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint8* - FLASH_EMULATOR_SIZE bytes, or the size given to InitFlashEmulator
+//
+//======================================================================================================================
+uint8* GetFlashMemory(void)
+{
+    return Flash;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Replace the latency model
+//
+// PARAMETERS:          const FlashTiming* timing
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void SetFlashTiming(const FlashTiming* timing)
+{
+    Timing = *timing;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         In strict mode a write over bits not erased fails and leaves the flash alone, otherwise it
+//                      clears bits only, as the part does. Either way it is counted as a program violation.
+//
+// PARAMETERS:          bool isStrict
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void SetFlashStrict(bool isStrict)
+{
+    IsStrict = isStrict;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Cut the power during a later operation. A write is applied in part, an erase leaves the sector
+//                      in between, and every operation fails until PowerOnFlash.
+//
+// PARAMETERS:          uint32 operation - operations to let through before, NO_POWER_CUT to cancel
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void SetPowerCut(uint32 operation)
+{
+    CutOperation = (NO_POWER_CUT == operation) ? NO_POWER_CUT : (OperationCount + operation);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Whether the power is off after a cut
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool
+//
+//======================================================================================================================
+bool IsPowerCut(void)
+{
+    return IsPowerOff;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Power the flash again after a cut, the content stays as the cut left it
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void PowerOnFlash(void)
+{
+    IsPowerOff = false;
+    CutOperation = NO_POWER_CUT;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Operations since the statistics were reset, e.g. to place a power cut at each of them
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32
+//
+//======================================================================================================================
+uint32 GetFlashOperationCount(void)
+{
+    return OperationCount;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Get the statistics since the last reset
+//
+// PARAMETERS:          FlashStatistics* statistics - populated with the statistics
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void GetFlashStatistics(FlashStatistics* statistics)
+{
+    *statistics = Statistics;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Erases of a sector since the flash was opened, kept across ResetFlashStatistics
+//
+// PARAMETERS:          uint16 sector
+//
+// RETURN VALUE:        uint32
+//
+//======================================================================================================================
+uint32 GetSectorEraseCount(uint16 sector)
+{
+    if ((NULL == EraseCounts) || (sector >= (FlashSize / SPI_FLASH_SEC_SIZE)))
+    {
+        return 0;
+    }
+
+    return EraseCounts[sector];
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Start the statistics and the operation count again
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void ResetFlashStatistics(void)
+{
+    memset(&Statistics, 0, sizeof(FlashStatistics));
+
+    OperationCount = 0;
+    CutOperation = NO_POWER_CUT;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the flash, see the SDK
+//
+// PARAMETERS:          uint32 src_addr - 4 byte aligned
+//                      uint32 *des_addr - 4 byte aligned
+//                      uint32 size - multiple of 4
+//
+// RETURN VALUE:        SpiFlashOpResult
+//
+//======================================================================================================================
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size)
+{
+    bool isCut;
+
+    if (false == StartOperation(FLASH_OPERATION_READ, src_addr, des_addr, size, &isCut))
+    {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    if (true == isCut)
+    {
+        CutPower();
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    memcpy(des_addr, Flash + src_addr, size);
+
+    EndOperation(FLASH_OPERATION_READ, size, Timing.ReadSetup + (((size * Timing.ReadPerKB) + 1023) / 1024));
+
+    return SPI_FLASH_RESULT_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Program the flash, see the SDK. Only bits erased to 1 can be programmed to 0.
+//
+// PARAMETERS:          uint32 des_addr - 4 byte aligned
+//                      uint32 *src_addr - 4 byte aligned
+//                      uint32 size - multiple of 4
+//
+// RETURN VALUE:        SpiFlashOpResult
+//
+//======================================================================================================================
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size)
+{
+    const uint8* data = (const uint8*) src_addr;
+    uint8* flash;
+    uint32 pages;
+    uint32 written;
+    uint32 index;
+    bool isCut;
+
+    if (false == StartOperation(FLASH_OPERATION_WRITE, des_addr, src_addr, size, &isCut))
+    {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    flash = Flash + des_addr;
+
+    for (index = 0; index < size; index++)
+    {
+        if (0 != (data[index] & ~flash[index]))
+        {
+            Statistics.ProgramViolations++;
+
+            if (true == IsStrict)
+            {
+                fprintf(stderr, "flash: write at 0x%06X over bits not erased\n", des_addr + index);
+
+                Statistics.FailedOperations++;
+                return SPI_FLASH_RESULT_ERR;
+            }
+
+            break;
+        }
+    }
+
+    pages = (((des_addr + size + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE) - (des_addr / FLASH_PAGE_SIZE));
+
+    if (true == isCut)
+    {
+        // words before the cut are programmed, the word at the cut only in part
+        written = (GetRandom() % ((size / 4) + 1)) * 4;
+
+        for (index = 0; index < written; index++)
+        {
+            flash[index] &= data[index];
+        }
+
+        for (; (index < size) && (index < (written + 4)); index++)
+        {
+            flash[index] &= (data[index] | (uint8) GetRandom());
+        }
+
+        CutPower();
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    for (index = 0; index < size; index++)
+    {
+        flash[index] &= data[index];
+    }
+
+    EndOperation(FLASH_OPERATION_WRITE, size, Timing.WriteSetup + (pages * Timing.PageProgram));
+
+    return SPI_FLASH_RESULT_OK;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Erase a sector of the flash to 0xFF, see the SDK
+//
+// PARAMETERS:          uint16 sec - sector number
+//
+// RETURN VALUE:        SpiFlashOpResult
+//
+//======================================================================================================================
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec)
+{
+    uint8* flash;
+    uint32 index;
+    bool isCut;
+
+    if (false == StartOperation(FLASH_OPERATION_ERASE, sec * SPI_FLASH_SEC_SIZE, NULL, SPI_FLASH_SEC_SIZE, &isCut))
+    {
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    flash = Flash + (sec * SPI_FLASH_SEC_SIZE);
+
+    EraseCounts[sec]++;
+
+    if (true == isCut)
+    {
+        // an interrupted erase leaves any bit between programmed and erased
+        for (index = 0; index < SPI_FLASH_SEC_SIZE; index++)
+        {
+            flash[index] |= (uint8) GetRandom();
+        }
+
+        CutPower();
+        return SPI_FLASH_RESULT_ERR;
+    }
+
+    memset(flash, 0xFF, SPI_FLASH_SEC_SIZE);
+
+    EndOperation(FLASH_OPERATION_ERASE, SPI_FLASH_SEC_SIZE, Timing.Erase);
+
+    return SPI_FLASH_RESULT_OK;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Pseudo random numbers of the power cuts, the same sequence every run
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32
+//
+//======================================================================================================================
+static uint32 GetRandom(void)
+{
+    RandomState ^= RandomState << 13;
+    RandomState ^= RandomState >> 17;
+    RandomState ^= RandomState << 5;
+
+    return RandomState;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check an operation and count it, the SDK requires 4 byte alignment of all of its arguments
+//
+// PARAMETERS:          uint8 operation - FLASH_OPERATION_...
+//                      uint32 address
+//                      const void* data - NULL for an erase
+//                      uint32 length
+//                      bool* isCut - set if the power is cut during the operation
+//
+// RETURN VALUE:        bool - false if the operation is refused
+//
+//======================================================================================================================
+static bool StartOperation(uint8 operation, uint32 address, const void* data, uint32 length, bool* isCut)
+{
+    if ((NULL == Flash) || (true == IsPowerOff))
+    {
+        Statistics.FailedOperations++;
+        return false;
+    }
+
+    if ((0 != (address % 4)) || (0 != (length % 4)) || (0 != (((uintptr_t) data) % 4)))
+    {
+        fprintf(stderr, "flash: %s at 0x%06X of %u bytes not aligned\n",
+                (FLASH_OPERATION_READ == operation) ? "read" : "write", address, length);
+
+        Statistics.AlignmentErrors++;
+        Statistics.FailedOperations++;
+        return false;
+    }
+
+    if ((address > FlashSize) || (length > (FlashSize - address)))
+    {
+        Statistics.RangeErrors++;
+        Statistics.FailedOperations++;
+        return false;
+    }
+
+    *isCut = (OperationCount == CutOperation);
+
+    OperationCount++;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Account a completed operation, its time goes to the host clock
+//
+// PARAMETERS:          uint8 operation - FLASH_OPERATION_...
+//                      uint32 length
+//                      uint32 time - modelled (in us)
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void EndOperation(uint8 operation, uint32 length, uint32 time)
+{
+    FlashOperationStatistics* statistics = &Statistics.Operations[operation];
+
+    statistics->Count++;
+    statistics->Bytes += length;
+    statistics->Time += time;
+
+    if (time > statistics->MaxTime)
+    {
+        statistics->MaxTime = time;
+    }
+
+    AddHostTime(time);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Power off until PowerOnFlash
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void CutPower(void)
+{
+    IsPowerOff = true;
+    CutOperation = NO_POWER_CUT;
+
+    Statistics.PowerCuts++;
+    Statistics.FailedOperations++;
+}
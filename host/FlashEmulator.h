@@ -0,0 +1,91 @@
+#ifndef __FLASH_EMULATOR_H__
+#define __FLASH_EMULATOR_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <spi_flash.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+#define FLASH_EMULATOR_SIZE  0x400000
+
+#define FLASH_PAGE_SIZE  256
+
+// typical figures of the 4 MB parts on the modules (in us), a page program covers up to FLASH_PAGE_SIZE bytes
+#define FLASH_READ_SETUP_TIME  2
+#define FLASH_READ_TIME_PER_KB  25
+#define FLASH_WRITE_SETUP_TIME  5
+#define FLASH_PAGE_PROGRAM_TIME  700
+#define FLASH_ERASE_TIME  45000
+
+// operations of the emulated flash
+#define FLASH_OPERATION_READ  0
+#define FLASH_OPERATION_WRITE  1
+#define FLASH_OPERATION_ERASE  2
+
+#define FLASH_OPERATIONS  3
+
+#define NO_POWER_CUT  0xFFFFFFFF
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Latency model, the time of an operation is added to the clock of host/HostSystem.c
+typedef struct
+{
+    uint32 ReadSetup;
+    uint32 ReadPerKB;
+    uint32 WriteSetup;
+    uint32 PageProgram;
+    uint32 Erase;
+} FlashTiming;
+
+typedef struct
+{
+    uint32 Count;
+    uint64 Bytes;
+    uint64 Time;            // modelled time of the operations (in us)
+    uint32 MaxTime;
+} FlashOperationStatistics;
+
+typedef struct
+{
+    FlashOperationStatistics Operations[FLASH_OPERATIONS];
+    uint32 AlignmentErrors;     // address, length or buffer not 4 byte aligned, the operation failed
+    uint32 RangeErrors;         // beyond the end of the flash, the operation failed
+    uint32 ProgramViolations;   // writes that needed a 0 bit back to 1, i.e. an erase first
+    uint32 PowerCuts;
+    uint32 FailedOperations;    // refused, including those while the power is off
+} FlashStatistics;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+bool InitFlashEmulator(const char* path, uint32 size);
+
+void CloseFlashEmulator(void);
+
+uint8* GetFlashMemory(void);
+
+void SetFlashTiming(const FlashTiming* timing);
+
+void SetFlashStrict(bool isStrict);
+
+void SetPowerCut(uint32 operation);
+
+bool IsPowerCut(void);
+
+void PowerOnFlash(void);
+
+uint32 GetFlashOperationCount(void);
+
+void GetFlashStatistics(FlashStatistics* statistics);
+
+uint32 GetSectorEraseCount(uint16 sector);
+
+void ResetFlashStatistics(void);
+
+#endif
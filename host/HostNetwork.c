@@ -0,0 +1,629 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+#include <osapi.h>
+#include "HostNetwork.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void Connected(void* arg);
+
+static void Disconnected(void* arg);
+
+static void Acknowledged(void* arg);
+
+static void ReceivePackets(const uint8* data, uint16 length);
+
+static void Respond(uint8 type, const uint8* packet, uint32 position);
+
+static void ServeRequest(const uint8* data, uint16 length);
+
+static void Stream(void* arg);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+// the connection to the broker stand-in or the image server, one at a time
+static struct espconn* Connection;
+
+static ETSTimer ConnectTimer;
+
+static ETSTimer DisconnectTimer;
+
+static ETSTimer SentTimer;
+
+// send waiting for its acknowledgement, and a copy to tell whether the caller kept its data until the sent callback
+static const uint8* SentData;
+
+static uint16 SentLength;
+
+static uint8 SentCopy[HOST_LINK_BUFFER_SIZE];
+
+// responses of the broker to the send, each delivered to the receive callback on its own
+static uint8 Responses[HOST_BROKER_RESPONSES][HOST_BROKER_RESPONSE_SIZE];
+
+static uint8 ResponseLengths[HOST_BROKER_RESPONSES];
+
+static uint8 ResponseCount;
+
+// image served over HTTP instead of the broker, see SetHostImage
+static const uint8* Image;
+
+static uint32 ImageLength;
+
+// response being streamed: the header, then ServeLeft bytes of the image from ServePosition
+static char ServeHeader[128];
+
+static uint32 HeaderLength;
+
+static uint32 HeaderPosition;
+
+static uint32 ServePosition;
+
+static uint32 ServeLeft;
+
+static bool IsHeld;
+
+static ETSTimer StreamTimer;
+
+// received segment, terminated for the string functions of the client
+static uint8 Segment[HOST_LINK_MSS + 1];
+
+static NetworkStatistics Statistics;
+
+static uint32 LocalPort = 49152;
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         The broker accepted the connection
+//
+//======================================================================================================================
+static void Connected(void* arg)
+{
+    Connection->state = ESPCONN_CONNECT;
+
+    if (NULL != Connection->proto.tcp->connect_callback)
+    {
+        Connection->proto.tcp->connect_callback(Connection);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The connection is closed
+//
+//======================================================================================================================
+static void Disconnected(void* arg)
+{
+    struct espconn* connection = Connection;
+
+    os_timer_disarm(&SentTimer);
+    os_timer_disarm(&StreamTimer);
+    SentData = NULL;
+    ServeLeft = 0;
+    IsHeld = false;
+
+    // the connection is gone, the callback may connect it again
+    Connection = NULL;
+
+    connection->state = ESPCONN_CLOSE;
+
+    if (NULL != connection->proto.tcp->disconnect_callback)
+    {
+        connection->proto.tcp->disconnect_callback(connection);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         The broker acknowledged the send. It takes the packets in, the sent callback is called and the
+//                      responses go to the receive callback. The image server starts streaming its response instead.
+//
+//======================================================================================================================
+static void Acknowledged(void* arg)
+{
+    uint8 response;
+
+    ResponseCount = 0;
+
+    if (NULL != Image)
+    {
+        // HTTP requests are sent with espconn_sent and freed right away, as the SDK copies them
+        ServeRequest(SentCopy, SentLength);
+    }
+    else
+    {
+        if (0 != memcmp(SentData, SentCopy, SentLength))
+        {
+            Statistics.Errors++;
+        }
+
+        ReceivePackets(SentCopy, SentLength);
+    }
+
+    SentData = NULL;
+
+    if (NULL != Connection->sent_callback)
+    {
+        Connection->sent_callback(Connection);
+    }
+
+    for (response = 0; (response < ResponseCount) && (NULL != Connection); response++)
+    {
+        Connection->recv_callback(Connection, (char*) Responses[response], ResponseLengths[response]);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Broker stand-in, take in the MQTT packets of a send
+//
+// PARAMETERS:          const uint8* data
+//                      uint16 length
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ReceivePackets(const uint8* data, uint16 length)
+{
+    uint32 position = 0;
+    uint32 remaining;
+    uint32 header;
+    uint8 shift;
+
+    while (position < length)
+    {
+        remaining = 0;
+        shift = 0;
+
+        for (header = 1; (position + header < length) && (shift < 28); header++, shift += 7)
+        {
+            remaining |= (data[position + header] & 0x7F) << shift;
+
+            if (0 == (data[position + header] & 0x80))
+            {
+                break;
+            }
+        }
+
+        header++;
+
+        if (position + header + remaining > length)
+        {
+            Statistics.Errors++;
+            return;
+        }
+
+        Statistics.Packets++;
+
+        Respond(data[position] >> 4, data + position, header);
+
+        position += header + remaining;
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Queue the response of the broker to a packet
+//
+// PARAMETERS:          uint8 type - of the packet, MQTT_MSG_TYPE_...
+//                      const uint8* packet
+//                      uint32 position - of the variable header
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void Respond(uint8 type, const uint8* packet, uint32 position)
+{
+    uint8* response;
+    uint32 topicLength;
+    uint8 qos = (packet[0] >> 1) & 3;
+
+    if (ResponseCount >= HOST_BROKER_RESPONSES)
+    {
+        Statistics.Errors++;
+        return;
+    }
+
+    response = Responses[ResponseCount];
+
+    switch (type)
+    {
+        case 1:     // CONNECT, accepted
+        {
+            response[0] = 0x20;
+            response[1] = 2;
+            response[2] = 0;
+            response[3] = 0;
+            ResponseLengths[ResponseCount++] = 4;
+            break;
+        }
+        case 3:     // PUBLISH, acknowledged from QoS 1 on
+        {
+            Statistics.Publishes++;
+
+            if (0 != qos)
+            {
+                topicLength = (packet[position] << 8) | packet[position + 1];
+
+                response[0] = (1 == qos) ? 0x40 : 0x50;
+                response[1] = 2;
+                response[2] = packet[position + 2 + topicLength];
+                response[3] = packet[position + 2 + topicLength + 1];
+                ResponseLengths[ResponseCount++] = 4;
+            }
+            break;
+        }
+        case 6:     // PUBREL
+        {
+            response[0] = 0x70;
+            response[1] = 2;
+            response[2] = packet[position];
+            response[3] = packet[position + 1];
+            ResponseLengths[ResponseCount++] = 4;
+            break;
+        }
+        case 8:     // SUBSCRIBE, granted at QoS 0
+        {
+            response[0] = 0x90;
+            response[1] = 3;
+            response[2] = packet[position];
+            response[3] = packet[position + 1];
+            response[4] = 0;
+            ResponseLengths[ResponseCount++] = 5;
+            break;
+        }
+        case 12:    // PINGREQ
+        {
+            response[0] = 0xD0;
+            response[1] = 0;
+            ResponseLengths[ResponseCount++] = 2;
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Image server, answer a GET of the image, from the offset of a Range header if there is one.
+//                      Any path is the image.
+//
+// PARAMETERS:          const uint8* data
+//                      uint16 length
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ServeRequest(const uint8* data, uint16 length)
+{
+    char request[HOST_LINK_BUFFER_SIZE + 1];
+    const char* range;
+    uint32 start = 0;
+
+    memcpy(request, data, length);
+    request[length] = '\0';
+
+    Statistics.Requests++;
+
+    // unanswered, the client times out
+    if ((0 != strncmp(request, "GET /", 5)) || (0 != ServeLeft))
+    {
+        Statistics.Errors++;
+        return;
+    }
+
+    range = strstr(request, "Range: bytes=");
+    if (NULL != range)
+    {
+        start = strtoul(range + 13, NULL, 10);
+    }
+
+    if (start >= ImageLength)
+    {
+        Statistics.Errors++;
+        return;
+    }
+
+    HeaderLength = sprintf(ServeHeader, "HTTP/1.1 %s\r\nContent-Length: %u\r\n\r\n",
+            (NULL == range) ? "200 OK" : "206 Partial Content", ImageLength - start);
+    HeaderPosition = 0;
+    ServePosition = start;
+    ServeLeft = ImageLength - start;
+
+    os_timer_setfn(&StreamTimer, Stream, NULL);
+
+    if (false == IsHeld)
+    {
+        os_timer_arm_us(&StreamTimer, (HOST_LINK_MSS + HOST_LINK_SEGMENT_HEADER) * HOST_LINK_BYTE_TIME, false);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Deliver the next segment of the response to the receive callback, the next one follows after
+//                      the time of a full segment on the link unless the client holds the receive window closed
+//
+//======================================================================================================================
+static void Stream(void* arg)
+{
+    uint32 length = 0;
+    uint32 part;
+
+    if (HeaderPosition < HeaderLength)
+    {
+        length = ((HeaderLength - HeaderPosition) < HOST_LINK_MSS) ? (HeaderLength - HeaderPosition) : HOST_LINK_MSS;
+
+        memcpy(Segment, ServeHeader + HeaderPosition, length);
+        HeaderPosition += length;
+    }
+
+    part = (ServeLeft < (HOST_LINK_MSS - length)) ? ServeLeft : (HOST_LINK_MSS - length);
+
+    memcpy(Segment + length, Image + ServePosition, part);
+    Segment[length + part] = '\0';
+
+    ServePosition += part;
+    ServeLeft -= part;
+    length += part;
+
+    Statistics.Segments++;
+    Statistics.Served += part;
+
+    if (0 != ServeLeft)
+    {
+        os_timer_arm_us(&StreamTimer, (HOST_LINK_MSS + HOST_LINK_SEGMENT_HEADER) * HOST_LINK_BYTE_TIME, false);
+    }
+
+    Connection->state = ESPCONN_READ;
+
+    if (NULL != Connection->recv_callback)
+    {
+        Connection->recv_callback(Connection, (char*) Segment, length);
+    }
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Serve an image over HTTP instead of the broker stand-in, to the connections opened from now on
+//
+// PARAMETERS:          const uint8* image - kept by the caller, NULL goes back to the broker
+//                      uint32 length
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void SetHostImage(const uint8* image, uint32 length)
+{
+    Image = image;
+    ImageLength = length;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Counts of the link and the broker
+//
+// PARAMETERS:          NetworkStatistics* statistics - populated with the counts
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void GetNetworkStatistics(NetworkStatistics* statistics)
+{
+    *statistics = Statistics;
+}
+
+void ResetNetworkStatistics(void)
+{
+    memset(&Statistics, 0, sizeof(Statistics));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         espconn API of the SDK, see there. TCP clients of the broker stand-in only.
+//
+//======================================================================================================================
+sint8 espconn_connect(struct espconn *espconn)
+{
+    if ((NULL != Connection) && (espconn != Connection))
+    {
+        return ESPCONN_ISCONN;
+    }
+
+    Connection = espconn;
+    Connection->state = ESPCONN_WAIT;
+
+    os_timer_setfn(&ConnectTimer, Connected, NULL);
+    os_timer_arm_us(&ConnectTimer, HOST_LINK_ROUND_TRIP, false);
+
+    return ESPCONN_OK;
+}
+
+sint8 espconn_disconnect(struct espconn *espconn)
+{
+    if (espconn != Connection)
+    {
+        return ESPCONN_ARG;
+    }
+
+    os_timer_setfn(&DisconnectTimer, Disconnected, NULL);
+    os_timer_arm_us(&DisconnectTimer, 0, false);
+
+    return ESPCONN_OK;
+}
+
+sint8 espconn_abort(struct espconn *espconn)
+{
+    return espconn_delete(espconn);
+}
+
+sint8 espconn_delete(struct espconn *espconn)
+{
+    if (espconn != Connection)
+    {
+        return ESPCONN_ARG;
+    }
+
+    os_timer_disarm(&ConnectTimer);
+    os_timer_disarm(&DisconnectTimer);
+    os_timer_disarm(&SentTimer);
+    os_timer_disarm(&StreamTimer);
+
+    SentData = NULL;
+    ServeLeft = 0;
+    IsHeld = false;
+    Connection = NULL;
+
+    return ESPCONN_OK;
+}
+
+sint8 espconn_send(struct espconn *espconn, uint8 *psent, uint16 length)
+{
+    uint32 segments;
+
+    if ((espconn != Connection) || ((ESPCONN_CONNECT != espconn->state) && (ESPCONN_READ != espconn->state))
+            || (length > HOST_LINK_BUFFER_SIZE))
+    {
+        return ESPCONN_ARG;
+    }
+
+    if (NULL != SentData)
+    {
+        Statistics.Rejected++;
+        return ESPCONN_MAXNUM;
+    }
+
+    SentData = psent;
+    SentLength = length;
+    memcpy(SentCopy, psent, length);
+
+    segments = (length + HOST_LINK_MSS - 1) / HOST_LINK_MSS;
+
+    Statistics.Sends++;
+    Statistics.Segments += segments;
+    Statistics.Bytes += length;
+
+    os_timer_setfn(&SentTimer, Acknowledged, NULL);
+    os_timer_arm_us(&SentTimer, HOST_LINK_ROUND_TRIP
+            + ((length + (segments * HOST_LINK_SEGMENT_HEADER)) * HOST_LINK_BYTE_TIME), false);
+
+    return ESPCONN_OK;
+}
+
+sint8 espconn_sent(struct espconn *espconn, uint8 *psent, uint16 length)
+{
+    return espconn_send(espconn, psent, length);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Close and reopen the receive window, see the SDK. The image server stops streaming meanwhile.
+//
+//======================================================================================================================
+sint8 espconn_recv_hold(struct espconn *pespconn)
+{
+    if (pespconn != Connection)
+    {
+        return ESPCONN_ARG;
+    }
+
+    IsHeld = true;
+    os_timer_disarm(&StreamTimer);
+
+    return ESPCONN_OK;
+}
+
+sint8 espconn_recv_unhold(struct espconn *pespconn)
+{
+    if (pespconn != Connection)
+    {
+        return ESPCONN_ARG;
+    }
+
+    IsHeld = false;
+
+    if (0 != ServeLeft)
+    {
+        os_timer_arm_us(&StreamTimer, (HOST_LINK_MSS + HOST_LINK_SEGMENT_HEADER) * HOST_LINK_BYTE_TIME, false);
+    }
+
+    return ESPCONN_OK;
+}
+
+uint32 espconn_port(void)
+{
+    return LocalPort++;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         No DNS on the host, an address string is taken as it is
+//
+//======================================================================================================================
+err_t espconn_gethostbyname(struct espconn *pespconn, const char *hostname, ip_addr_t *addr, dns_found_callback found)
+{
+    unsigned int bytes[4];
+    char end;
+
+    if ((4 != sscanf(hostname, "%u.%u.%u.%u%c", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &end))
+            || (bytes[0] > 255) || (bytes[1] > 255) || (bytes[2] > 255) || (bytes[3] > 255))
+    {
+        return ESPCONN_ARG;
+    }
+
+    addr->addr = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_connectcb(struct espconn *espconn, espconn_connect_callback connect_cb)
+{
+    espconn->proto.tcp->connect_callback = connect_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_reconcb(struct espconn *espconn, espconn_reconnect_callback recon_cb)
+{
+    espconn->proto.tcp->reconnect_callback = recon_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_disconcb(struct espconn *espconn, espconn_connect_callback discon_cb)
+{
+    espconn->proto.tcp->disconnect_callback = discon_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_recvcb(struct espconn *espconn, espconn_recv_callback recv_cb)
+{
+    espconn->recv_callback = recv_cb;
+    return ESPCONN_OK;
+}
+
+sint8 espconn_regist_sentcb(struct espconn *espconn, espconn_sent_callback sent_cb)
+{
+    espconn->sent_callback = sent_cb;
+    return ESPCONN_OK;
+}
+
+bool espconn_secure_set_size(uint8 level, uint16 size)
+{
+    return false;
+}
+
+sint8 espconn_secure_connect(struct espconn *espconn)
+{
+    return ESPCONN_ARG;
+}
+
+sint8 espconn_secure_disconnect(struct espconn *espconn)
+{
+    return ESPCONN_ARG;
+}
+
+sint8 espconn_secure_send(struct espconn *espconn, uint8 *psent, uint16 length)
+{
+    return ESPCONN_ARG;
+}
@@ -0,0 +1,51 @@
+#ifndef __HOST_NETWORK_H__
+#define __HOST_NETWORK_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <espconn.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// local broker or image server over WiFi: a segment is acknowledged, and its sent callback called, a round trip after
+// the send. The image server streams its response a full segment at a time, see SetHostImage.
+#define HOST_LINK_ROUND_TRIP  5000      // in us
+#define HOST_LINK_BYTE_TIME  1          // in us, about 8 Mbit/s
+#define HOST_LINK_MSS  1460
+#define HOST_LINK_SEGMENT_HEADER  54    // Ethernet, IP and TCP headers of each segment
+
+// data of one send, and responses of the broker to one send
+#define HOST_LINK_BUFFER_SIZE  4096
+#define HOST_BROKER_RESPONSES  64
+#define HOST_BROKER_RESPONSE_SIZE  5
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32 Sends;           // espconn_send calls accepted
+    uint32 Segments;        // TCP segments sent, a send longer than HOST_LINK_MSS takes several, and streamed by the
+                            // image server
+    uint64 Bytes;           // MQTT bytes, without the headers of the segments
+    uint32 Packets;         // MQTT packets received by the broker
+    uint32 Publishes;
+    uint32 Rejected;        // sends while the one before was not acknowledged, refused as by the SDK
+    uint32 Errors;          // malformed packets or requests, or data changed before the sent callback
+    uint32 Requests;        // HTTP requests of the image server
+    uint64 Served;          // image bytes sent by the image server
+} NetworkStatistics;
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void GetNetworkStatistics(NetworkStatistics* statistics);
+
+void ResetNetworkStatistics(void);
+
+void SetHostImage(const uint8* image, uint32 length);
+
+#endif
@@ -0,0 +1,227 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sntp.h>
+#include "HostSystem.h"
+#include "FlashEmulator.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static uint32 RTCMemory[HOST_RTC_BLOCKS];
+
+// time since power on (in us), advanced by the modelled flash operations and the timers of host/HostTasks.c
+static uint32 Time;
+
+// os_printf of the code under test
+static bool IsLog;
+
+static uint8 UpgradeFlag;
+
+// every start is a power on
+static struct rst_info ResetInfo = { REASON_DEFAULT_RST };
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Power on after a power cut, the RTC memory is lost and the clock starts again
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void PowerOnHost(void)
+{
+    memset(RTCMemory, 0, sizeof(RTCMemory));
+
+    Time = 0;
+    UpgradeFlag = 0;
+
+    PowerOnFlash();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Advance the clock of system_get_time
+//
+// PARAMETERS:          uint32 time - in us
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void AddHostTime(uint32 time)
+{
+    Time += time;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Let os_printf of the code under test through to stdout, off by default
+//
+// PARAMETERS:          bool isLog
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void SetHostLog(bool isLog)
+{
+    IsLog = isLog;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         os_printf, see the SDK
+//
+// PARAMETERS:          const char* format
+//
+// RETURN VALUE:        int - characters printed
+//
+//======================================================================================================================
+int HostPrintf(const char* format, ...)
+{
+    va_list arguments;
+    int length;
+
+    if (false == IsLog)
+    {
+        return 0;
+    }
+
+    va_start(arguments, format);
+    length = vprintf(format, arguments);
+    va_end(arguments);
+
+    return length;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the RTC user memory, see the SDK
+//
+// PARAMETERS:          uint8 src_addr - block, from HOST_RTC_USER_BLOCK
+//                      void *des_addr - 4 byte aligned
+//                      uint16 load_size
+//
+// RETURN VALUE:        bool - false beyond the user memory
+//
+//======================================================================================================================
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size)
+{
+    if ((src_addr < HOST_RTC_USER_BLOCK) || (load_size > ((HOST_RTC_BLOCKS - src_addr) * sizeof(uint32))))
+    {
+        return false;
+    }
+
+    memcpy(des_addr, &RTCMemory[src_addr], load_size);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Write the RTC user memory, see the SDK
+//
+// PARAMETERS:          uint8 des_addr - block, from HOST_RTC_USER_BLOCK
+//                      const void *src_addr - 4 byte aligned
+//                      uint16 save_size
+//
+// RETURN VALUE:        bool - false beyond the user memory
+//
+//======================================================================================================================
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr, uint16 save_size)
+{
+    if ((des_addr < HOST_RTC_USER_BLOCK) || (save_size > ((HOST_RTC_BLOCKS - des_addr) * sizeof(uint32))))
+    {
+        return false;
+    }
+
+    memcpy(&RTCMemory[des_addr], src_addr, save_size);
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Time since power on, see the SDK
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        uint32 - in us
+//
+//======================================================================================================================
+uint32 system_get_time(void)
+{
+    return Time;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         RTC counter and its period, see the SDK. The counter runs off the clock of system_get_time, one
+//                      tick per us.
+//
+//======================================================================================================================
+uint32 system_get_rtc_time(void)
+{
+    return Time;
+}
+
+uint32 system_rtc_clock_cali_proc(void)
+{
+    // period in us, 12 bits of fraction
+    return 1 << 12;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Reason of the last reset, see the SDK
+//
+//======================================================================================================================
+struct rst_info* system_get_rst_info(void)
+{
+    return &ResetInfo;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Upgrade flag, see the SDK. Cleared at power on.
+//
+//======================================================================================================================
+void system_upgrade_flag_set(uint8 flag)
+{
+    UpgradeFlag = flag;
+}
+
+uint8 system_upgrade_flag_check(void)
+{
+    return UpgradeFlag;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Watchdog and restart, see the SDK. There is no watchdog on the host, and the code under test
+//                      cannot be restarted, a restart ends the run.
+//
+//======================================================================================================================
+void system_soft_wdt_feed(void)
+{
+}
+
+void system_restart(void)
+{
+    fprintf(stderr, "system_restart at %u us\n", Time);
+    exit(3);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         SNTP client, see the SDK. The host has no time server, the timestamp stays 0.
+//
+//======================================================================================================================
+void sntp_setservername(unsigned char idx, char *server)
+{
+}
+
+void sntp_init(void)
+{
+}
+
+uint32 sntp_get_current_timestamp(void)
+{
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef __HOST_SYSTEM_H__
+#define __HOST_SYSTEM_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <user_interface.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// RTC memory of the chip in 4 byte blocks, blocks from 64 on are the user memory of the SDK
+#define HOST_RTC_BLOCKS  192
+
+#define HOST_RTC_USER_BLOCK  64
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void PowerOnHost(void);
+
+void AddHostTime(uint32 time);
+
+void SetHostLog(bool isLog);
+
+#endif
@@ -0,0 +1,290 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <user_interface.h>
+#include <osapi.h>
+#include "HostTasks.h"
+#include "HostSystem.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local type
+//----------------------------------------------------------------------------------------------------------------------
+// Task of the SDK, events are posted to the queue given by the task
+typedef struct
+{
+    os_task_t Task;
+    os_event_t* Queue;
+    uint8 Length;
+    uint8 First;
+    uint8 Count;
+} HostTask;
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static bool RunTask(void);
+
+static void RemoveTimer(ETSTimer* timer);
+
+static void InsertTimer(ETSTimer* timer);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static HostTask Tasks[HOST_TASK_PRIOS];
+
+// armed timers, the one expiring first in front
+static ETSTimer* Timers;
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Run the oldest event of the task with the highest priority
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        bool - false if no event is waiting
+//
+//======================================================================================================================
+static bool RunTask(void)
+{
+    HostTask* task;
+    os_event_t event;
+    sint8 prio;
+
+    for (prio = HOST_TASK_PRIOS - 1; prio >= 0; prio--)
+    {
+        task = &Tasks[prio];
+
+        if (0 != task->Count)
+        {
+            event = task->Queue[task->First];
+
+            task->First = (task->First + 1) % task->Length;
+            task->Count--;
+
+            task->Task(&event);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Take a timer out of the armed ones, if it is armed
+//
+// PARAMETERS:          ETSTimer* timer
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void RemoveTimer(ETSTimer* timer)
+{
+    ETSTimer** next;
+
+    for (next = &Timers; NULL != *next; next = &(*next)->timer_next)
+    {
+        if (timer == *next)
+        {
+            *next = timer->timer_next;
+            timer->timer_next = NULL;
+            return;
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Add a timer to the armed ones in the order they expire, after those expiring at the same time
+//
+// PARAMETERS:          ETSTimer* timer
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void InsertTimer(ETSTimer* timer)
+{
+    ETSTimer** next = &Timers;
+
+    while ((NULL != *next) && ((sint32) ((*next)->timer_expire - timer->timer_expire) <= 0))
+    {
+        next = &(*next)->timer_next;
+    }
+
+    timer->timer_next = *next;
+    *next = timer;
+}
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Run the tasks and timers for a while, the events waiting run first, then the clock advances to
+//                      the next timer
+//
+// PARAMETERS:          uint32 duration - in us
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void RunHost(uint32 duration)
+{
+    uint32 end = system_get_time() + duration;
+    ETSTimer* timer;
+
+    while (true)
+    {
+        while (true == RunTask())
+        {
+        }
+
+        timer = Timers;
+
+        if ((NULL == timer) || ((sint32) (timer->timer_expire - end) > 0))
+        {
+            break;
+        }
+
+        if ((sint32) (timer->timer_expire - system_get_time()) > 0)
+        {
+            AddHostTime(timer->timer_expire - system_get_time());
+        }
+
+        RemoveTimer(timer);
+
+        if (0 != timer->timer_period)
+        {
+            timer->timer_expire += timer->timer_period;
+            InsertTimer(timer);
+        }
+
+        timer->timer_func(timer->timer_arg);
+    }
+
+    AddHostTime(end - system_get_time());
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Register a task, see the SDK
+//
+// PARAMETERS:          os_task_t task
+//                      uint8 prio - 0 to HOST_TASK_PRIOS - 1
+//                      os_event_t *queue
+//                      uint8 qlen - events the queue holds
+//
+// RETURN VALUE:        bool - false for a priority out of range
+//
+//======================================================================================================================
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen)
+{
+    if ((prio >= HOST_TASK_PRIOS) || (0 == qlen))
+    {
+        return false;
+    }
+
+    Tasks[prio].Task = task;
+    Tasks[prio].Queue = queue;
+    Tasks[prio].Length = qlen;
+    Tasks[prio].First = 0;
+    Tasks[prio].Count = 0;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Post an event to a task, see the SDK
+//
+// PARAMETERS:          uint8 prio
+//                      os_signal_t sig
+//                      os_param_t par
+//
+// RETURN VALUE:        bool - false if the queue of the task is full, the event is lost as on the module
+//
+//======================================================================================================================
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par)
+{
+    HostTask* task;
+
+    if ((prio >= HOST_TASK_PRIOS) || (NULL == Tasks[prio].Task) || (Tasks[prio].Count == Tasks[prio].Length))
+    {
+        return false;
+    }
+
+    task = &Tasks[prio];
+
+    task->Queue[(task->First + task->Count) % task->Length].sig = sig;
+    task->Queue[(task->First + task->Count) % task->Length].par = par;
+    task->Count++;
+
+    return true;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Set the function of a timer, see the SDK
+//
+// PARAMETERS:          ETSTimer *ptimer
+//                      ETSTimerFunc *pfunction
+//                      void *parg
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void os_timer_setfn(ETSTimer *ptimer, ETSTimerFunc *pfunction, void *parg)
+{
+    RemoveTimer(ptimer);
+
+    ptimer->timer_func = pfunction;
+    ptimer->timer_arg = parg;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Arm a timer, see the SDK
+//
+// PARAMETERS:          ETSTimer *ptimer
+//                      uint32 milliseconds
+//                      bool repeat_flag
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void os_timer_arm(ETSTimer *ptimer, uint32 milliseconds, bool repeat_flag)
+{
+    os_timer_arm_us(ptimer, milliseconds * 1000, repeat_flag);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Arm a timer in us, see the SDK
+//
+// PARAMETERS:          ETSTimer *ptimer
+//                      uint32 microseconds
+//                      bool repeat_flag
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void os_timer_arm_us(ETSTimer *ptimer, uint32 microseconds, bool repeat_flag)
+{
+    RemoveTimer(ptimer);
+
+    ptimer->timer_expire = system_get_time() + microseconds;
+    ptimer->timer_period = (true == repeat_flag) ? microseconds : 0;
+
+    InsertTimer(ptimer);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Disarm a timer, see the SDK
+//
+// PARAMETERS:          ETSTimer *ptimer
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+void os_timer_disarm(ETSTimer *ptimer)
+{
+    RemoveTimer(ptimer);
+}
@@ -0,0 +1,21 @@
+#ifndef __HOST_TASKS_H__
+#define __HOST_TASKS_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <os_type.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// task priorities of the SDK, 0 to 2
+#define HOST_TASK_PRIOS  3
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+void RunHost(uint32 duration);
+
+#endif
@@ -0,0 +1,183 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "MQTTBench.h"
+#include "HostNetwork.h"
+#include "HostSystem.h"
+#include "HostTasks.h"
+#include "../mqtt/mqtt.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void Connected(uint32_t* args);
+
+static void Published(uint32_t* args);
+
+static void RunPublish(int segmentSize, int qos, PublishStatistics* statistics);
+
+static void PrintPublish(const char* name, const PublishStatistics* statistics);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static MQTT_Client Client;
+
+static bool IsConnected;
+
+static uint32 PublishedCalls;
+
+//======================================================================================================================
+// DESCRIPTION:         Publish throughput of mqtt/mqtt.c against a local broker stand-in, on the host: one packet per
+//                      TCP segment against the queued packets coalesced into segments of up to MQTT_SEGMENT_SIZE.
+//                      -v prints the log of the MQTT client.
+//
+// PARAMETERS:          int argc
+//                      char* argv[]
+//
+// RETURN VALUE:        int - 0 if the broker got every publish intact and publishedCb came once for each
+//
+//======================================================================================================================
+int main(int argc, char* argv[])
+{
+    PublishStatistics single;
+    PublishStatistics coalesced;
+    uint32 errors = 0;
+    int qos;
+
+    SetHostLog((argc > 1) && (0 == strcmp(argv[1], "-v")));
+
+    MQTT_InitConnection(&Client, (uint8_t*) MQTT_BENCH_HOST, MQTT_BENCH_PORT, 0);
+    MQTT_InitClient(&Client, (uint8_t*) "bench", NULL, NULL, MQTT_KEEPALIVE, 1);
+    MQTT_OnConnected(&Client, Connected);
+    MQTT_OnPublished(&Client, Published);
+    MQTT_Connect(&Client);
+
+    while ((false == IsConnected) && (system_get_time() < MQTT_BENCH_TIMEOUT))
+    {
+        RunHost(MQTT_BENCH_STEP);
+    }
+
+    if (false == IsConnected)
+    {
+        printf("no connection to the broker stand-in\n");
+        return 1;
+    }
+
+    for (qos = 0; qos < 2; qos++)
+    {
+        RunPublish(0, qos, &single);
+        RunPublish(MQTT_SEGMENT_SIZE, qos, &coalesced);
+
+        printf("QoS %d, %u publishes, round trip %u us:\n", qos, MQTT_BENCH_PUBLISHES, HOST_LINK_ROUND_TRIP);
+        PrintPublish("one per segment", &single);
+        PrintPublish("coalesced", &coalesced);
+
+        errors += single.Errors + coalesced.Errors;
+    }
+
+    return (0 == errors) ? 0 : 1;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+static void Connected(uint32_t* args)
+{
+    IsConnected = true;
+}
+
+static void Published(uint32_t* args)
+{
+    PublishedCalls++;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Publish a burst of status payloads, topping the outbound queue up every step as an application
+//                      publishing as fast as the client takes them would, until the broker has them all
+//
+// PARAMETERS:          int segmentSize - segment buffer of the client, 0 sends one packet per segment
+//                      int qos
+//                      PublishStatistics* statistics - populated with the results
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void RunPublish(int segmentSize, int qos, PublishStatistics* statistics)
+{
+    NetworkStatistics network;
+    char payload[96];
+    uint32 published = 0;
+    uint32 start;
+    int length;
+
+    memset(statistics, 0, sizeof(PublishStatistics));
+
+    // the queue and the link are idle, the acknowledgements of the burst before are in
+    RunHost(HOST_LINK_ROUND_TRIP * 4);
+
+    Client.mqtt_state.segment_buffer_length = segmentSize;
+    Client.sentSegments = 0;
+    Client.sentPackets = 0;
+    PublishedCalls = 0;
+    ResetNetworkStatistics();
+
+    start = system_get_time();
+
+    do
+    {
+        while (published < MQTT_BENCH_PUBLISHES)
+        {
+            length = sprintf(payload, "{\"seq\":%u,\"rom\":%u,\"heap\":%u,\"rssi\":-%u}", published, published % 3,
+                    30000 + (published % 997), 40 + (published % 50));
+
+            if (NULL == QUEUE_Reserve(&Client.msgQueue, MQTT_MSG_PUBLISH_LENGTH(sizeof(MQTT_BENCH_TOPIC) - 1, length)))
+            {
+                break;
+            }
+
+            if (FALSE == MQTT_Publish(&Client, MQTT_BENCH_TOPIC, payload, length, qos, 0))
+            {
+                statistics->Errors++;
+            }
+
+            published++;
+        }
+
+        RunHost(MQTT_BENCH_STEP);
+
+        GetNetworkStatistics(&network);
+    }
+    while ((network.Publishes < MQTT_BENCH_PUBLISHES) && (system_get_time() - start < MQTT_BENCH_TIMEOUT));
+
+    statistics->Time = system_get_time() - start;
+    statistics->Publishes = network.Publishes;
+    statistics->Segments = Client.sentSegments;
+    statistics->Packets = Client.sentPackets;
+    statistics->Callbacks = PublishedCalls;
+    statistics->Rejected = network.Rejected;
+    statistics->Errors += network.Errors + (MQTT_BENCH_PUBLISHES - network.Publishes)
+            + ((PublishedCalls == MQTT_BENCH_PUBLISHES) ? 0 : 1);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Print the results of a burst
+//
+// PARAMETERS:          const char* name
+//                      const PublishStatistics* statistics
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrintPublish(const char* name, const PublishStatistics* statistics)
+{
+    uint32 perSegment = (0 == statistics->Segments) ? 0 : (statistics->Packets * 100) / statistics->Segments;
+
+    printf("  %s: %u publishes in %u ms, %u publishes/s, %u.%02u packets per segment, %u published callbacks, "
+            "%u sends refused, %u errors\n", name, statistics->Publishes, statistics->Time / 1000,
+            (0 == statistics->Time) ? 0 : (uint32) ((statistics->Publishes * 1000000ULL) / statistics->Time),
+            perSegment / 100, perSegment % 100, statistics->Callbacks, statistics->Rejected, statistics->Errors);
+}
@@ -0,0 +1,35 @@
+#ifndef __MQTT_BENCH_H__
+#define __MQTT_BENCH_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// burst of status publishes, the producer tops the outbound queue up every step as far as it goes
+#define MQTT_BENCH_PUBLISHES  2000
+#define MQTT_BENCH_STEP  1000           // in us
+#define MQTT_BENCH_TIMEOUT  120000000   // in us
+
+#define MQTT_BENCH_HOST  "127.0.0.1"
+#define MQTT_BENCH_PORT  1883
+#define MQTT_BENCH_TOPIC  "esp/1a2b3c/status/bench"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+typedef struct
+{
+    uint32 Time;            // emulated time from the first publish until the broker has them all (in us)
+    uint32 Publishes;       // received by the broker
+    uint32 Segments;        // sent by the client, see sentSegments of MQTT_Client
+    uint32 Packets;
+    uint32 Callbacks;       // publishedCb calls, one per publish sent
+    uint32 Rejected;
+    uint32 Errors;
+} PublishStatistics;
+
+#endif
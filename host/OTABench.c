@@ -0,0 +1,202 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <osapi.h>
+#include "OTABench.h"
+#include "FlashEmulator.h"
+#include "HostNetwork.h"
+#include "HostSystem.h"
+#include "HostTasks.h"
+#include "../app/OTA_Bench.h"
+#include "../app/MQTT_Wrapper.h"
+#include "../drivers/Bootloader.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void PrepareFlash(void);
+
+static bool CheckReports(const uint8* digest);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static uint8 Image[OTA_HOST_BENCH_IMAGE_LENGTH];
+
+static char Reports[OTA_HOST_BENCH_REPORTS][OTA_HOST_BENCH_REPORT_LENGTH];
+
+static uint8 ReportCount;
+
+static MQTT_Client Client;
+
+//======================================================================================================================
+// DESCRIPTION:         Run the network and flash passes of app/OTA_Bench.c on the host, the download against the image
+//                      server of host/HostNetwork.c and the flash pass on the emulated flash. -v prints the log of the
+//                      code under test.
+//
+// PARAMETERS:          int argc
+//                      char* argv[]
+//
+// RETURN VALUE:        int - 0 if both passes reported, with the digest of the served image and no link errors
+//
+//======================================================================================================================
+int main(int argc, char* argv[])
+{
+    NetworkStatistics network;
+    SHA256Context context;
+    uint8 digest[SHA256_SIZE];
+    uint8 report;
+    uint32 index;
+    bool isOK;
+
+    SetHostLog((argc > 1) && (0 == strcmp(argv[1], "-v")));
+
+    if (false == InitFlashEmulator(NULL, FLASH_EMULATOR_SIZE))
+    {
+        fprintf(stderr, "Cannot open the flash in memory\n");
+        return 2;
+    }
+
+    for (index = 0; index < OTA_HOST_BENCH_IMAGE_LENGTH; index++)
+    {
+        Image[index] = (uint8) ((index * 7) ^ (index >> 8));
+    }
+
+    SHA256Init(&context);
+    SHA256Update(&context, Image, OTA_HOST_BENCH_IMAGE_LENGTH);
+    SHA256Final(&context, digest);
+
+    PrepareFlash();
+    SetHostImage(Image, OTA_HOST_BENCH_IMAGE_LENGTH);
+    ResetNetworkStatistics();
+
+    if (false == RunOTABench())
+    {
+        printf("the benchmark did not start\n");
+        return 1;
+    }
+
+    while ((ReportCount < OTA_HOST_BENCH_REPORTS) && (system_get_time() < OTA_HOST_BENCH_TIMEOUT))
+    {
+        RunHost(OTA_HOST_BENCH_STEP);
+    }
+
+    GetNetworkStatistics(&network);
+
+    printf("OTA benchmark, image of %u B, round trip %u us, %u requests, %u B served in %u segments:\n",
+            OTA_HOST_BENCH_IMAGE_LENGTH, HOST_LINK_ROUND_TRIP, network.Requests, (uint32) network.Served,
+            network.Segments);
+
+    for (report = 0; report < ReportCount; report++)
+    {
+        printf("  %s\n", Reports[report]);
+    }
+
+    isOK = CheckReports(digest) && (0 == network.Errors) && (OTA_HOST_BENCH_IMAGE_LENGTH == network.Served);
+
+    CloseFlashEmulator();
+
+    return (true == isOK) ? 0 : 1;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Stand-ins for the UART and MQTT glue of the application, the reports are kept for main
+//
+//======================================================================================================================
+void UART0_Send(const char* buffer)
+{
+    os_printf("%s", buffer);
+}
+
+void MQTT_PublishStatus(const char* name, const char* data, int data_length)
+{
+    if (ReportCount < OTA_HOST_BENCH_REPORTS)
+    {
+        snprintf(Reports[ReportCount++], OTA_HOST_BENCH_REPORT_LENGTH, "%.*s", data_length, data);
+    }
+}
+
+MQTT_Client* Get_MQTTClient(void)
+{
+    return &Client;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Erase the flash and write the configuration of a module running ROM 0 of two slots, ROM 1 is
+//                      the slot of the flash pass
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrepareFlash(void)
+{
+    BootConfiguration configuration;
+
+    memset(GetFlashMemory(), 0xFF, FLASH_EMULATOR_SIZE);
+
+    memset(&configuration, 0xFF, sizeof(BootConfiguration));
+    memset(configuration.Slots, 0, sizeof(configuration.Slots));
+
+    configuration.MagicNumber = BOOT_CONFIG_MAGIC;
+    configuration.Version = BOOT_CONFIG_VERSION;
+    configuration.CurrentROM = 0;
+    configuration.Count = 2;
+    configuration.ROMS[0] = 0x002000;
+    configuration.ROMS[1] = 0x102000;
+    configuration.ActiveParts = 0;
+    configuration.StagedParts = 0;
+    configuration.Slots[0].State = SLOT_CONFIRMED;
+    configuration.Slots[0].Version = 1;
+
+    memcpy(GetFlashMemory() + (BOOT_CONFIG_SECTOR * SECTOR_SIZE), &configuration, sizeof(BootConfiguration));
+
+    PowerOnHost();
+    LoadConfiguration();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Check the reports: the network pass hashed the whole served image and the flash pass ran
+//
+// PARAMETERS:          const uint8* digest - SHA256 of the served image
+//
+// RETURN VALUE:        bool - true if both passes succeeded
+//
+//======================================================================================================================
+static bool CheckReports(const uint8* digest)
+{
+    char expected[(2 * SHA256_SIZE) + 1];
+    uint8 index;
+
+    if (OTA_HOST_BENCH_REPORTS != ReportCount)
+    {
+        printf("  %u of %u reports\n", ReportCount, OTA_HOST_BENCH_REPORTS);
+        return false;
+    }
+
+    for (index = 0; index < SHA256_SIZE; index++)
+    {
+        sprintf(expected + (2 * index), "%02x", digest[index]);
+    }
+
+    if ((0 != strncmp(Reports[0], "network: ", 9)) || (NULL == strstr(Reports[0], expected)))
+    {
+        printf("  the network pass did not get the served image, sha256 %s\n", expected);
+        return false;
+    }
+
+    if ((0 != strncmp(Reports[1], "flash: ", 7)) || (NULL == strstr(Reports[1], " B/s")))
+    {
+        printf("  the flash pass did not run\n");
+        return false;
+    }
+
+    return true;
+}
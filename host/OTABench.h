@@ -0,0 +1,29 @@
+#ifndef __OTA_HOST_BENCH_H__
+#define __OTA_HOST_BENCH_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// image served by the image server of host/HostNetwork.c for the network pass of app/OTA_Bench.c
+#define OTA_HOST_BENCH_IMAGE_LENGTH  0x40000
+
+#define OTA_HOST_BENCH_STEP  1000           // in us
+#define OTA_HOST_BENCH_TIMEOUT  60000000    // in us
+
+// results of app/OTA_Bench.c published to <device topic>/status/bench, network and flash pass
+#define OTA_HOST_BENCH_REPORTS  2
+#define OTA_HOST_BENCH_REPORT_LENGTH  256
+
+//======================================================================================================================
+// EXPORTED FUNCTIONS
+//======================================================================================================================
+// drivers/UART_APP.h, the application calls it without the header, which needs the registers of the module, and with
+// constant strings too. The OTABench rule of the Makefile includes this file in every source.
+void UART0_Send(const char* buffer);
+
+#endif
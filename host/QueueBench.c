@@ -0,0 +1,436 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "QueueBench.h"
+#include "../mqtt/queue.h"
+#include "../mqtt/proto.h"
+#include "../mqtt/ringbuf.h"
+#include "../mqtt/mqtt_msg.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static uint16 MakePacket(uint8 payload, uint32 index, uint8* packet);
+
+static int32 PutEscaped(const uint8* packet, uint16 length);
+
+static int32 GetEscaped(uint8* packet, uint16* length);
+
+static int32 PutRecord(const uint8* packet, uint16 length);
+
+static int32 GetRecord(uint8* packet, uint16* length);
+
+static int32 PutCopied(const uint8* payload, uint16 length);
+
+static int32 SendCopied(const uint8* expected, uint16 length);
+
+static int32 PutInPlace(const uint8* payload, uint16 length);
+
+static int32 SendInPlace(const uint8* expected, uint16 length);
+
+static void RunQueue(uint8 payload, QueuePut put, QueueGet get, QueueStatistics* statistics);
+
+static void RunPublish(PublishPut put, PublishSend send, QueueStatistics* statistics);
+
+static void PrintQueue(const char* name, const QueueStatistics* statistics);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+// queue before the length-prefixed records, escaped framing over a byte ring buffer
+static RINGBUF EscapedQueue;
+
+static uint8 EscapedBuffer[QUEUE_BENCH_BUFFER_SIZE];
+
+static QUEUE RecordQueue;
+
+// state of the MQTT client, the encoders build in OutBuffer or in the room reserved in the queue
+static mqtt_connection_t Connection;
+
+static uint8 OutBuffer[QUEUE_BENCH_PACKET_SIZE];
+
+static const char* PayloadNames[PAYLOADS] = { "text", "binary", "framing bytes" };
+
+static uint32 RandomState = 0x2545F491;
+
+//======================================================================================================================
+// DESCRIPTION:         Compare the outbound queue of mqtt/queue.c with the escaped framing it replaced, on the host:
+//                      time per packet added and taken out, and packets a full queue holds. Then the publish path
+//                      of mqtt/mqtt.c, built in a buffer and copied in and out of the queue against built in place.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        int - 0 if every packet came out as it went in
+//
+//======================================================================================================================
+int main(void)
+{
+    QueueStatistics escaped;
+    QueueStatistics record;
+    QueueStatistics copied;
+    QueueStatistics inPlace;
+    uint32 errors = 0;
+    uint8 payload;
+
+    QUEUE_Init(&RecordQueue, QUEUE_BENCH_BUFFER_SIZE);
+
+    for (payload = 0; payload < PAYLOADS; payload++)
+    {
+        RINGBUF_Init(&EscapedQueue, EscapedBuffer, QUEUE_BENCH_BUFFER_SIZE);
+
+        RunQueue(payload, PutEscaped, GetEscaped, &escaped);
+        RunQueue(payload, PutRecord, GetRecord, &record);
+
+        printf("%s:\n", PayloadNames[payload]);
+        PrintQueue("escaped", &escaped);
+        PrintQueue("length-prefixed", &record);
+
+        errors += escaped.Errors + record.Errors;
+    }
+
+    RunPublish(PutCopied, SendCopied, &copied);
+    RunPublish(PutInPlace, SendInPlace, &inPlace);
+
+    printf("publish, %s:\n", PayloadNames[PAYLOAD_TEXT]);
+    PrintQueue("copied", &copied);
+    PrintQueue("in place", &inPlace);
+
+    errors += copied.Errors + inPlace.Errors;
+
+    return (0 == errors) ? 0 : 1;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Build a packet as the MQTT client queues it
+//
+// PARAMETERS:          uint8 payload - PAYLOAD_...
+//                      uint32 index - of the packet, varies the length and the content
+//                      uint8* packet - at least QUEUE_BENCH_PACKET_SIZE bytes
+//
+// RETURN VALUE:        uint16 - length of the packet
+//
+//======================================================================================================================
+static uint16 MakePacket(uint8 payload, uint32 index, uint8* packet)
+{
+    uint16 length;
+    uint16 position;
+
+    switch (payload)
+    {
+        case PAYLOAD_TEXT:
+        {
+            length = sprintf((char*) packet + 2, "%c%cstatus/scrub{\"rom\":%u,\"result\":\"intact\",\"bytes\":%u,"
+                    "\"ms\":%u}", 0, 12, index % 3, 400000 + index, index % 9000);
+            packet[0] = 0x30;
+            packet[1] = length;
+            return length + 2;
+        }
+        case PAYLOAD_BINARY:
+        {
+            length = 64 + ((index * 37) % 256);
+
+            for (position = 0; position < length; position++)
+            {
+                RandomState ^= RandomState << 13;
+                RandomState ^= RandomState >> 17;
+                RandomState ^= RandomState << 5;
+
+                packet[position] = (uint8) RandomState;
+            }
+
+            return length;
+        }
+        default:
+        {
+            length = 64 + ((index * 37) % 256);
+
+            for (position = 0; position < length; position++)
+            {
+                packet[position] = 0x7D + (position % 3);
+            }
+
+            return length;
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Old queue, see PROTO_AddRb and PROTO_ParseRb
+//
+//======================================================================================================================
+static int32 PutEscaped(const uint8* packet, uint16 length)
+{
+    RINGBUF saved = EscapedQueue;
+
+    // a packet that does not fit leaves part of its framing, taken back so the queue stays usable
+    if (-1 == PROTO_AddRb(&EscapedQueue, packet, length))
+    {
+        EscapedQueue = saved;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int32 GetEscaped(uint8* packet, uint16* length)
+{
+    return PROTO_ParseRb(&EscapedQueue, packet, length, QUEUE_BENCH_PACKET_SIZE);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Queue of length-prefixed records, see mqtt/queue.c
+//
+//======================================================================================================================
+static int32 PutRecord(const uint8* packet, uint16 length)
+{
+    return (-1 == QUEUE_Puts(&RecordQueue, (uint8_t*) packet, length)) ? -1 : 0;
+}
+
+static int32 GetRecord(uint8* packet, uint16* length)
+{
+    return QUEUE_Gets(&RecordQueue, packet, length, QUEUE_BENCH_PACKET_SIZE);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Publish path before the reservation: built in the output buffer, copied into the queue, copied
+//                      out to a buffer on the stack and sent from there
+//
+//======================================================================================================================
+static int32 PutCopied(const uint8* payload, uint16 length)
+{
+    mqtt_message_t* message;
+    uint16 id;
+
+    mqtt_msg_set_buffer(&Connection, OutBuffer, QUEUE_BENCH_PACKET_SIZE);
+    message = mqtt_msg_publish(&Connection, QUEUE_BENCH_TOPIC, (const char*) payload, length, 0, 0, &id);
+
+    return ((0 == message->length) || (-1 == QUEUE_Puts(&RecordQueue, message->data, message->length))) ? -1 : 0;
+}
+
+static int32 SendCopied(const uint8* expected, uint16 length)
+{
+    uint8 packet[QUEUE_BENCH_PACKET_SIZE];
+    uint16 packetLength;
+
+    if (-1 == QUEUE_Gets(&RecordQueue, packet, &packetLength, QUEUE_BENCH_PACKET_SIZE))
+    {
+        return -1;
+    }
+
+    return ((packetLength == length) && (0 == memcmp(packet, expected, length))) ? 0 : -1;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Publish path of mqtt/mqtt.c: built in the room reserved in the queue and sent from there
+//
+//======================================================================================================================
+static int32 PutInPlace(const uint8* payload, uint16 length)
+{
+    mqtt_message_t* message;
+    uint16 maxLength = MQTT_MSG_PUBLISH_LENGTH(sizeof(QUEUE_BENCH_TOPIC) - 1, length);
+    uint8* buffer;
+    uint16 id;
+
+    buffer = QUEUE_Reserve(&RecordQueue, maxLength);
+
+    if (NULL == buffer)
+    {
+        return -1;
+    }
+
+    mqtt_msg_set_buffer(&Connection, buffer, maxLength);
+    message = mqtt_msg_publish(&Connection, QUEUE_BENCH_TOPIC, (const char*) payload, length, 0, 0, &id);
+
+    return ((0 == message->length) || (-1 == QUEUE_Commit(&RecordQueue, message->data, message->length))) ? -1 : 0;
+}
+
+static int32 SendInPlace(const uint8* expected, uint16 length)
+{
+    uint8* packet;
+    uint16 packetLength;
+    int32 result;
+
+    packet = QUEUE_Front(&RecordQueue, &packetLength);
+
+    if (NULL == packet)
+    {
+        return -1;
+    }
+
+    result = ((packetLength == length) && (0 == memcmp(packet, expected, length))) ? 0 : -1;
+
+    QUEUE_Drop(&RecordQueue);
+
+    return result;
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Fill the queue as far as it goes and drain it, round after round, so the records wrap at every
+//                      position of the buffer. Packets are made before the timed part.
+//
+// PARAMETERS:          uint8 payload - PAYLOAD_...
+//                      QueuePut put
+//                      QueueGet get
+//                      QueueStatistics* statistics - populated with the results
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void RunQueue(uint8 payload, QueuePut put, QueueGet get, QueueStatistics* statistics)
+{
+    static uint8 packets[QUEUE_BENCH_PACKETS][QUEUE_BENCH_PACKET_SIZE];
+    static uint16 lengths[QUEUE_BENCH_PACKETS];
+    uint8 received[QUEUE_BENCH_PACKET_SIZE];
+    struct timespec start;
+    struct timespec end;
+    uint16 length;
+    uint32 round;
+    uint32 count;
+    uint32 next;
+    uint32 index;
+
+    memset(statistics, 0, sizeof(QueueStatistics));
+
+    for (index = 0; index < QUEUE_BENCH_PACKETS; index++)
+    {
+        lengths[index] = MakePacket(payload, index, packets[index]);
+    }
+
+    for (round = 0; round < QUEUE_BENCH_ROUNDS; round++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (count = 0; count < QUEUE_BENCH_PACKETS; count++)
+        {
+            index = (round + count) % QUEUE_BENCH_PACKETS;
+
+            if (0 != put(packets[index], lengths[index]))
+            {
+                break;
+            }
+        }
+
+        for (next = 0; next < count; next++)
+        {
+            index = (round + next) % QUEUE_BENCH_PACKETS;
+
+            if ((0 != get(received, &length)) || (length != lengths[index])
+                    || (0 != memcmp(received, packets[index], length)))
+            {
+                statistics->Errors++;
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        statistics->Time += ((end.tv_sec - start.tv_sec) * 1000000000ULL) + end.tv_nsec - start.tv_nsec;
+        statistics->Packets += count;
+
+        if (count > statistics->PacketsPerQueue)
+        {
+            statistics->PacketsPerQueue = count;
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Publish status payloads until the queue is full and send them all, round after round. The
+//                      packets expected are built beforehand, sending compares the packet with them.
+//
+// PARAMETERS:          PublishPut put
+//                      PublishSend send
+//                      QueueStatistics* statistics - populated with the results
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void RunPublish(PublishPut put, PublishSend send, QueueStatistics* statistics)
+{
+    static uint8 payloads[QUEUE_BENCH_PACKETS][QUEUE_BENCH_PACKET_SIZE];
+    static uint8 expected[QUEUE_BENCH_PACKETS][QUEUE_BENCH_PACKET_SIZE];
+    static uint16 payloadLengths[QUEUE_BENCH_PACKETS];
+    static uint16 expectedLengths[QUEUE_BENCH_PACKETS];
+    mqtt_message_t* message;
+    struct timespec start;
+    struct timespec end;
+    uint32 round;
+    uint32 count;
+    uint32 next;
+    uint32 index;
+    uint16 id;
+
+    memset(statistics, 0, sizeof(QueueStatistics));
+
+    QUEUE_Init(&RecordQueue, QUEUE_BENCH_BUFFER_SIZE);
+    mqtt_msg_init(&Connection, OutBuffer, QUEUE_BENCH_PACKET_SIZE);
+
+    for (index = 0; index < QUEUE_BENCH_PACKETS; index++)
+    {
+        // the status JSON of the text payload, without the publish header MakePacket puts in front
+        payloadLengths[index] = MakePacket(PAYLOAD_TEXT, index, payloads[index]) - 16;
+        memmove(payloads[index], payloads[index] + 16, payloadLengths[index]);
+
+        message = mqtt_msg_publish(&Connection, QUEUE_BENCH_TOPIC, (const char*) payloads[index],
+                payloadLengths[index], 0, 0, &id);
+        memcpy(expected[index], message->data, message->length);
+        expectedLengths[index] = message->length;
+    }
+
+    for (round = 0; round < QUEUE_BENCH_ROUNDS; round++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (count = 0; count < QUEUE_BENCH_PACKETS; count++)
+        {
+            index = (round + count) % QUEUE_BENCH_PACKETS;
+
+            if (0 != put(payloads[index], payloadLengths[index]))
+            {
+                break;
+            }
+        }
+
+        for (next = 0; next < count; next++)
+        {
+            index = (round + next) % QUEUE_BENCH_PACKETS;
+
+            if (0 != send(expected[index], expectedLengths[index]))
+            {
+                statistics->Errors++;
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        statistics->Time += ((end.tv_sec - start.tv_sec) * 1000000000ULL) + end.tv_nsec - start.tv_nsec;
+        statistics->Packets += count;
+
+        if (count > statistics->PacketsPerQueue)
+        {
+            statistics->PacketsPerQueue = count;
+        }
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Print the results of a queue
+//
+// PARAMETERS:          const char* name
+//                      const QueueStatistics* statistics
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrintQueue(const char* name, const QueueStatistics* statistics)
+{
+    printf("  %s: %llu ns per packet, up to %u packets in %u bytes, %u errors\n", name,
+            (0 == statistics->Packets) ? 0ULL : (unsigned long long) (statistics->Time / statistics->Packets),
+            statistics->PacketsPerQueue, QUEUE_BENCH_BUFFER_SIZE, statistics->Errors);
+}
@@ -0,0 +1,49 @@
+#ifndef __QUEUE_BENCH_H__
+#define __QUEUE_BENCH_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// outbound queue of the MQTT client, see QUEUE_BUFFER_SIZE and MQTT_BUF_SIZE of app/user_config.h
+#define QUEUE_BENCH_BUFFER_SIZE  2048
+#define QUEUE_BENCH_PACKET_SIZE  1024
+
+// each round fills the queue as far as it goes and drains it, from a pool of packets made beforehand
+#define QUEUE_BENCH_ROUNDS  20000
+#define QUEUE_BENCH_PACKETS  64
+
+// payloads of the packets
+#define PAYLOAD_TEXT  0         // status publish, JSON
+#define PAYLOAD_BINARY  1       // random bytes, 3 in 256 escaped by the old queue
+#define PAYLOAD_FRAMING  2      // only bytes the old queue escapes
+
+#define PAYLOADS  3
+
+// topic of the publishes built by the MQTT encoders, QoS 0
+#define QUEUE_BENCH_TOPIC  "esp/1a2b3c/status/scrub"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Exported type
+//----------------------------------------------------------------------------------------------------------------------
+// Queue under test, adds a packet or takes the oldest one out, -1 if full or empty
+typedef int32 (*QueuePut)(const uint8* packet, uint16 length);
+typedef int32 (*QueueGet)(uint8* packet, uint16* length);
+
+// Publish path under test, builds and queues a publish or sends the oldest one, -1 if full or empty
+typedef int32 (*PublishPut)(const uint8* payload, uint16 length);
+typedef int32 (*PublishSend)(const uint8* expected, uint16 length);
+
+typedef struct
+{
+    uint64 Time;            // host time of the rounds (in ns)
+    uint64 Packets;
+    uint32 PacketsPerQueue; // packets a full queue holds
+    uint32 Errors;          // packets taken out different from what was added
+} QueueStatistics;
+
+#endif
@@ -0,0 +1,518 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "TrialBootTest.h"
+#include "FlashEmulator.h"
+#include "HostSystem.h"
+#include "../drivers/Bootloader.h"
+#include "../boot/BootSelect.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local function prototypes
+//----------------------------------------------------------------------------------------------------------------------
+static void Check(bool isOK, const char* name);
+
+static void PrepareFlash(void);
+
+static void BootDevice(void);
+
+static bool ReadFlash(uint32 address, void* data, uint32 length);
+
+static void FallBack(uint8 rom);
+
+static void StageUpdate(void);
+
+static void ConfirmUpdate(void);
+
+static void TestTempROM(void);
+
+static void TestConfirm(void);
+
+static void TestRetryRollback(void);
+
+static void TestPowerOff(void);
+
+static void TestRevert(void);
+
+static void TestRevertFailed(void);
+
+static void TestFallBack(void);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Local data
+//----------------------------------------------------------------------------------------------------------------------
+static uint32 Checks;
+
+static uint32 Failures;
+
+//======================================================================================================================
+// DESCRIPTION:         Run the trial boots of drivers/Bootloader.c over the RTC memory of host/HostSystem.c and the
+//                      emulated flash, with a reset between the steps
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        int - 0 if all checks passed
+//
+//======================================================================================================================
+int main(void)
+{
+    if (false == InitFlashEmulator(NULL, FLASH_EMULATOR_SIZE))
+    {
+        fprintf(stderr, "Cannot open the flash in memory\n");
+        return 2;
+    }
+
+    TestTempROM();
+    TestConfirm();
+    TestRetryRollback();
+    TestPowerOff();
+    TestRevert();
+    TestRevertFailed();
+    TestFallBack();
+
+    CloseFlashEmulator();
+
+    printf("TrialBootTest: %u checks, %u failed\n", Checks, Failures);
+
+    return (0 == Failures) ? 0 : 1;
+}
+
+//======================================================================================================================
+// LOCAL FUNCTIONS
+//======================================================================================================================
+
+//======================================================================================================================
+// DESCRIPTION:         Account a check, a failed one is printed
+//
+// PARAMETERS:          bool isOK
+//                      const char* name
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void Check(bool isOK, const char* name)
+{
+    Checks++;
+
+    if (false == isOK)
+    {
+        Failures++;
+        printf("TrialBootTest failed: %s\n", name);
+    }
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Power on a module running its confirmed current ROM, with an empty update slot
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void PrepareFlash(void)
+{
+    BootConfiguration configuration;
+
+    memset(GetFlashMemory(), 0xFF, FLASH_EMULATOR_SIZE);
+
+    memset(&configuration, 0xFF, sizeof(BootConfiguration));
+    memset(configuration.Slots, 0, sizeof(configuration.Slots));
+
+    configuration.MagicNumber = BOOT_CONFIG_MAGIC;
+    configuration.Version = BOOT_CONFIG_VERSION;
+    configuration.CurrentROM = TRIAL_TEST_CURRENT;
+    configuration.Count = 2;
+    configuration.ROMS[0] = 0x002000;
+    configuration.ROMS[1] = 0x102000;
+    configuration.ActiveParts = 0;
+    configuration.StagedParts = 0;
+    configuration.Slots[TRIAL_TEST_CURRENT].State = SLOT_CONFIRMED;
+    configuration.Slots[TRIAL_TEST_CURRENT].Version = 1;
+
+    memcpy(GetFlashMemory() + (BOOT_CONFIG_SECTOR * SECTOR_SIZE), &configuration, sizeof(BootConfiguration));
+
+    PowerOnHost();
+    BootDevice();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Reset the module. The RTC memory survives, the bootloader boots the temp ROM once if the RTC
+//                      data asks for it and the current ROM otherwise, as boot/BootloaderDriver.c does for valid
+//                      images. The application then loads the configuration.
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void BootDevice(void)
+{
+    RTCData rtc;
+
+    LoadConfiguration();
+
+    if (false == GetRTCData(&rtc))
+    {
+        memset(&rtc, 0, sizeof(RTCData));
+        rtc.MagicNumber = RTC_MAGIC;
+    }
+
+    if ((0 != (rtc.NextMode & MODE_TEMP_ROM)) && (rtc.TempROM < GetROMCount()))
+    {
+        rtc.LastMode = MODE_TEMP_ROM;
+        rtc.LastROM = rtc.TempROM;
+    }
+    else
+    {
+        rtc.LastMode = MODE_STANDARD;
+        rtc.LastROM = GetCurrentROM();
+    }
+
+    rtc.NextMode = MODE_STANDARD;
+    SetRTCData(&rtc);
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Read the emulated flash, the FlashReader of the bootloader
+//
+// PARAMETERS:          uint32 address
+//                      void* data
+//                      uint32 length
+//
+// RETURN VALUE:        bool - false on a flash error
+//
+//======================================================================================================================
+static bool ReadFlash(uint32 address, void* data, uint32 length)
+{
+    return (SPI_FLASH_RESULT_OK == spi_flash_read(address, (uint32*) data, length));
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Reset the module with a current ROM that does not boot. The bootloader falls back to another
+//                      ROM and rewrites the configuration with it, as WriteConfiguration of boot/BootloaderDriver.c
+//                      does, then the application loads the configuration.
+//
+// PARAMETERS:          uint8 rom - booted instead of the current ROM
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void FallBack(uint8 rom)
+{
+    BootConfigRecord records[2];
+    BootConfigRecord record;
+    const BootConfiguration* selected;
+    uint32 commit = BOOT_LOG_COMMIT;
+    uint16 sector;
+    uint32 address;
+    uint32 index;
+
+    ReadFlash(BOOT_CONFIG_SECTOR * SECTOR_SIZE, &records[0], sizeof(BootConfigRecord));
+    ReadFlash(BOOT_CONFIG_COPY_SECTOR * SECTOR_SIZE, &records[1], sizeof(BootConfigRecord));
+
+    selected = SelectConfiguration(&records[0], &records[1]);
+
+    Check(NULL != selected, "bootloader finds the configuration");
+
+    if (NULL == selected)
+    {
+        return;
+    }
+
+    sector = (selected == &records[1].Configuration) ? BOOT_CONFIG_SECTOR : BOOT_CONFIG_COPY_SECTOR;
+    address = sector * SECTOR_SIZE;
+
+    memset(&record, 0xFF, sizeof(BootConfigRecord));
+    memcpy(&record.Configuration, selected, sizeof(BootConfiguration));
+
+    record.Configuration.CurrentROM = rom;
+
+    CarryConfigLog(&record.Configuration, ReadFlash);
+
+    record.Configuration.Sequence++;
+    record.CheckSum = DEFAULT_CHECKSUM;
+
+    for (index = 0; index < sizeof(BootConfiguration); index++)
+    {
+        record.CheckSum ^= ((uint8*) &record.Configuration)[index];
+    }
+
+    Check((SPI_FLASH_RESULT_OK == spi_flash_erase_sector(sector))
+            && (SPI_FLASH_RESULT_OK == spi_flash_write(address, (uint32*) ((void*) &record),
+                    sizeof(BootConfigRecord) - sizeof(uint32)))
+            && (SPI_FLASH_RESULT_OK == spi_flash_write(address + sizeof(BootConfigRecord) - sizeof(uint32), &commit,
+                    sizeof(uint32))), "bootloader rewrites the configuration");
+
+    BootDevice();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Stage a downloaded image in the update slot, as app/OTA_Manager.c does once it is verified
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void StageUpdate(void)
+{
+    Check((true == SetSlotState(TRIAL_TEST_UPDATE, SLOT_STAGED)) && (true == SetStagedROM(TRIAL_TEST_UPDATE, 0)),
+            "stage the update slot");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Stage an update and confirm its trial boot, the ROM it replaced stays confirmed for a revert
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void ConfirmUpdate(void)
+{
+    StageUpdate();
+
+    Check(true == StartTrialBoot(), "trial started");
+
+    BootDevice();
+
+    Check(true == ConfirmTrialBoot(), "trial confirmed");
+
+    BootDevice();
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A temp ROM boots once, the next reset boots the current ROM again
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestTempROM(void)
+{
+    uint8 rom = NO_ROM;
+    uint8 mode = MODE_STANDARD;
+
+    PrepareFlash();
+
+    Check(false == SetTempROM(2), "temp ROM beyond the ROM count refused");
+    Check(true == SetTempROM(TRIAL_TEST_UPDATE), "temp ROM set");
+
+    BootDevice();
+
+    Check((true == GetLastBootROM(&rom)) && (TRIAL_TEST_UPDATE == rom), "temp ROM booted");
+    Check((true == GetLastBootMode(&mode)) && (MODE_TEMP_ROM == mode), "temp boot mode");
+    Check(false == IsTrialBoot(), "temp ROM without a trial is no trial boot");
+    Check(TRIAL_TEST_CURRENT == GetCurrentROM(), "temp ROM keeps the current ROM");
+
+    BootDevice();
+
+    Check((true == GetLastBootROM(&rom)) && (TRIAL_TEST_CURRENT == rom), "current ROM booted after the temp ROM");
+    Check((true == GetLastBootMode(&mode)) && (MODE_STANDARD == mode), "standard boot mode after the temp ROM");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A staged ROM on trial becomes the current ROM once confirmed
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestConfirm(void)
+{
+    SlotMetadata metadata;
+
+    PrepareFlash();
+
+    Check(false == StartTrialBoot(), "no trial without a staged ROM");
+
+    StageUpdate();
+
+    Check(true == StartTrialBoot(), "trial started");
+    Check(TRIAL_TEST_CURRENT == GetCurrentROM(), "trial start keeps the current ROM");
+
+    BootDevice();
+
+    Check(TRIAL_RUNNING == CheckTrialBoot(TRIAL_TEST_BOOTS), "trial running");
+    Check((true == IsTrialBoot()) && (false == IsRevertBoot()), "trial boot of the staged ROM");
+    Check(TRIAL_TEST_UPDATE == GetRunningROM(), "staged ROM runs");
+    Check(true == ConfirmTrialBoot(), "trial confirmed");
+    Check(TRIAL_TEST_UPDATE == GetCurrentROM(), "confirmed ROM is current");
+    Check(NO_STAGED_ROM == GetStagedROM(NULL), "confirmed ROM is not staged anymore");
+    Check((true == GetSlotMetadata(TRIAL_TEST_UPDATE, &metadata)) && (SLOT_CONFIRMED == metadata.State),
+            "confirmed slot state");
+
+    BootDevice();
+
+    Check(TRIAL_NONE == CheckTrialBoot(TRIAL_TEST_BOOTS), "no trial after the confirmation");
+    Check(TRIAL_TEST_UPDATE == GetRunningROM(), "confirmed ROM boots");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A trial boot that is not confirmed is retried, then the staged ROM is rolled back
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestRetryRollback(void)
+{
+    SlotMetadata metadata;
+    uint8 boot;
+
+    PrepareFlash();
+    StageUpdate();
+
+    for (boot = 1; boot <= TRIAL_TEST_BOOTS; boot++)
+    {
+        Check(true == StartTrialBoot(), "trial started");
+
+        BootDevice();
+
+        Check(TRIAL_RUNNING == CheckTrialBoot(TRIAL_TEST_BOOTS), "trial running");
+
+        // reset before the confirmation, the current ROM boots again
+        BootDevice();
+
+        Check(TRIAL_TEST_CURRENT == GetRunningROM(), "current ROM boots after a failed trial");
+
+        if (boot < TRIAL_TEST_BOOTS)
+        {
+            Check(TRIAL_RETRY == CheckTrialBoot(TRIAL_TEST_BOOTS), "failed trial retried");
+            Check(TRIAL_TEST_UPDATE == GetStagedROM(NULL), "staged ROM kept for the retry");
+        }
+    }
+
+    Check(TRIAL_ROLLBACK == CheckTrialBoot(TRIAL_TEST_BOOTS), "last failed trial rolled back");
+    Check(NO_STAGED_ROM == GetStagedROM(NULL), "staged ROM dropped");
+    Check(TRIAL_TEST_CURRENT == GetCurrentROM(), "rollback keeps the current ROM");
+    Check((true == GetSlotMetadata(TRIAL_TEST_UPDATE, &metadata)) && (SLOT_BAD == metadata.State),
+            "rolled back slot is bad");
+    Check(TRIAL_NONE == CheckTrialBoot(TRIAL_TEST_BOOTS), "no trial after the rollback");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         Power off loses the trial, the staged ROM waits for the next activation
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestPowerOff(void)
+{
+    PrepareFlash();
+    StageUpdate();
+
+    Check(true == StartTrialBoot(), "trial started");
+
+    PowerOnHost();
+    BootDevice();
+
+    Check(TRIAL_NONE == CheckTrialBoot(TRIAL_TEST_BOOTS), "no trial after power off");
+    Check(TRIAL_TEST_CURRENT == GetRunningROM(), "current ROM boots after power off");
+    Check(TRIAL_TEST_UPDATE == GetStagedROM(NULL), "staged ROM kept after power off");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A revert boots the previous ROM on trial and makes it current once confirmed
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestRevert(void)
+{
+    PrepareFlash();
+    ConfirmUpdate();
+
+    Check(false == StartRevertBoot(TRIAL_TEST_UPDATE), "no revert to the current ROM");
+    Check(true == StartRevertBoot(TRIAL_TEST_CURRENT), "revert started");
+    Check(TRIAL_TEST_UPDATE == GetCurrentROM(), "revert start keeps the current ROM");
+
+    BootDevice();
+
+    Check(TRIAL_RUNNING == CheckTrialBoot(TRIAL_TEST_BOOTS), "revert running");
+    Check(true == IsRevertBoot(), "revert boot");
+    Check(TRIAL_TEST_CURRENT == GetRunningROM(), "reverted ROM runs");
+    Check(true == ConfirmTrialBoot(), "revert confirmed");
+    Check(TRIAL_TEST_CURRENT == GetCurrentROM(), "reverted ROM is current");
+
+    BootDevice();
+
+    Check(TRIAL_NONE == CheckTrialBoot(TRIAL_TEST_BOOTS), "no trial after the revert");
+    Check(TRIAL_TEST_CURRENT == GetRunningROM(), "reverted ROM boots");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A revert that is not confirmed ends after one boot, the slot reverted to stays confirmed
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestRevertFailed(void)
+{
+    SlotMetadata metadata;
+
+    PrepareFlash();
+    ConfirmUpdate();
+
+    Check(true == StartRevertBoot(TRIAL_TEST_CURRENT), "revert started");
+
+    BootDevice();
+
+    Check(true == IsRevertBoot(), "revert boot");
+
+    // reset before the confirmation
+    BootDevice();
+
+    Check(TRIAL_REVERT_FAILED == CheckTrialBoot(TRIAL_TEST_BOOTS), "revert failed");
+    Check(TRIAL_TEST_UPDATE == GetCurrentROM(), "failed revert keeps the current ROM");
+    Check(TRIAL_TEST_UPDATE == GetRunningROM(), "current ROM boots after a failed revert");
+    Check((true == GetSlotMetadata(TRIAL_TEST_CURRENT, &metadata)) && (SLOT_CONFIRMED == metadata.State),
+            "slot reverted to stays confirmed");
+    Check((true == GetSlotMetadata(TRIAL_TEST_UPDATE, &metadata)) && (SLOT_CONFIRMED == metadata.State),
+            "current slot stays confirmed");
+    Check(TRIAL_NONE == CheckTrialBoot(TRIAL_TEST_BOOTS), "no trial after the failed revert");
+}
+
+//======================================================================================================================
+// DESCRIPTION:         A fall back of the bootloader rewrites the configuration sector, the changes the application
+//                      appended to the configuration log since survive it
+//
+// PARAMETERS:          void
+//
+// RETURN VALUE:        void
+//
+//======================================================================================================================
+static void TestFallBack(void)
+{
+    uint32 version = 0;
+
+    PrepareFlash();
+    ConfirmUpdate();
+
+    // appended to the log, newer than the configuration sector
+    Check(true == SetLastJob(TRIAL_TEST_JOB, 2), "job recorded");
+
+    FallBack(TRIAL_TEST_CURRENT);
+
+    Check(TRIAL_TEST_CURRENT == GetCurrentROM(), "fall back ROM is current");
+    Check((TRIAL_TEST_JOB == GetLastJob(&version)) && (2 == version), "job kept by the fall back");
+
+    // the log continues past the rewrite
+    Check(true == SetLastJob(TRIAL_TEST_JOB + 1, 3), "next job recorded");
+
+    BootDevice();
+
+    Check((TRIAL_TEST_JOB + 1 == GetLastJob(&version)) && (3 == version), "next job kept after the fall back");
+    Check(TRIAL_TEST_CURRENT == GetCurrentROM(), "fall back ROM stays current");
+}
@@ -0,0 +1,22 @@
+#ifndef __TRIAL_BOOT_TEST_H__
+#define __TRIAL_BOOT_TEST_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Included files to resolve specific definitions in this file
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+// Constant data
+//----------------------------------------------------------------------------------------------------------------------
+// trial boots of a staged ROM before it is rolled back, OTA_TRIAL_BOOTS of app/OTA_Manager.h
+#define TRIAL_TEST_BOOTS  2
+
+// ROM slots of the module: the current ROM and the update slot
+#define TRIAL_TEST_CURRENT  0
+#define TRIAL_TEST_UPDATE  1
+
+// update job recorded before the bootloader falls back to another ROM
+#define TRIAL_TEST_JOB  0x1234
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header, see host/FlashEmulator.h
+//----------------------------------------------------------------------------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef int8_t int8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef int16_t int16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+typedef int32_t int32;
+typedef uint64_t uint64;
+typedef int64_t sint64;
+
+typedef unsigned char BOOL;
+
+#define TRUE 1
+#define FALSE 0
+
+#define LOCAL static
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define IRAM_ATTR
+
+#endif
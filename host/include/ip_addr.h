@@ -0,0 +1,14 @@
+#ifndef __IP_ADDR_H__
+#define __IP_ADDR_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the lwIP header of the SDK
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+typedef struct ip_addr
+{
+    uint32 addr;
+} ip_addr_t;
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __MEM_H__
+#define __MEM_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header
+//----------------------------------------------------------------------------------------------------------------------
+#include <stdlib.h>
+
+#define os_malloc(s) malloc(s)
+#define os_zalloc(s) calloc(1, (s))
+#define os_free(p) free(p)
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _OS_TYPE_H_
+#define _OS_TYPE_H_
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header, tasks and timers are implemented by host/HostTasks.c
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+typedef uint32 os_signal_t;
+typedef uintptr_t os_param_t;     // uint32 on the module, holds a pointer on a 64 bit host too
+
+typedef struct ETSEventTag
+{
+    os_signal_t sig;
+    os_param_t par;
+} os_event_t;
+
+typedef void (*os_task_t)(os_event_t *e);
+
+typedef void ETSTimerFunc(void *timer_arg);
+
+typedef struct _ETSTIMER_
+{
+    struct _ETSTIMER_ *timer_next;
+    uint32 timer_expire;
+    uint32 timer_period;
+    ETSTimerFunc *timer_func;
+    void *timer_arg;
+} ETSTimer;
+
+#define os_timer_t ETSTimer
+#define os_timer_func_t ETSTimerFunc
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _OSAPI_H_
+#define _OSAPI_H_
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header
+//----------------------------------------------------------------------------------------------------------------------
+#include <string.h>
+#include <stdio.h>
+#include <os_type.h>
+
+#define os_memcmp memcmp
+#define os_memcpy memcpy
+#define os_memset memset
+#define os_strlen strlen
+#define os_sprintf sprintf
+#define os_strcpy strcpy
+#define os_strncpy strncpy
+#define os_strcat strcat
+#define os_strncmp strncmp
+#define os_strstr strstr
+#define os_printf HostPrintf
+
+// host/HostSystem.c, quiet unless SetHostLog turns it on
+int HostPrintf(const char* format, ...);
+
+// host/HostTasks.c
+void os_timer_setfn(ETSTimer *ptimer, ETSTimerFunc *pfunction, void *parg);
+void os_timer_arm(ETSTimer *ptimer, uint32 milliseconds, bool repeat_flag);
+void os_timer_arm_us(ETSTimer *ptimer, uint32 microseconds, bool repeat_flag);
+void os_timer_disarm(ETSTimer *ptimer);
+
+#endif
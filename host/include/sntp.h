@@ -0,0 +1,13 @@
+#ifndef __SNTP_H__
+#define __SNTP_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header, implemented by host/HostSystem.c. The host is never synchronized.
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+void sntp_setservername(unsigned char idx, char *server);
+void sntp_init(void);
+uint32 sntp_get_current_timestamp(void);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _SPI_FLASH_H_
+#define _SPI_FLASH_H_
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header, implemented by host/FlashEmulator.c
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+
+typedef enum
+{
+    SPI_FLASH_RESULT_OK,
+    SPI_FLASH_RESULT_ERR,
+    SPI_FLASH_RESULT_TIMEOUT
+} SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec);
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size);
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __USER_INTERFACE_H__
+#define __USER_INTERFACE_H__
+
+//----------------------------------------------------------------------------------------------------------------------
+// Host stand-in for the SDK header, implemented by host/HostSystem.c and host/HostTasks.c
+//----------------------------------------------------------------------------------------------------------------------
+#include <c_types.h>
+#include <os_type.h>
+#include <ip_addr.h>
+
+enum rst_reason
+{
+    REASON_DEFAULT_RST = 0,
+    REASON_WDT_RST = 1,
+    REASON_EXCEPTION_RST = 2,
+    REASON_SOFT_WDT_RST = 3,
+    REASON_SOFT_RESTART = 4,
+    REASON_DEEP_SLEEP_AWAKE = 5,
+    REASON_EXT_SYS_RST = 6
+};
+
+struct rst_info
+{
+    uint32 reason;
+    uint32 exccause;
+    uint32 epc1;
+    uint32 epc2;
+    uint32 epc3;
+    uint32 excvaddr;
+    uint32 depc;
+};
+
+struct rst_info* system_get_rst_info(void);
+
+bool system_rtc_mem_read(uint8 src_addr, void *des_addr, uint16 load_size);
+bool system_rtc_mem_write(uint8 des_addr, const void *src_addr, uint16 save_size);
+
+uint32 system_get_time(void);
+uint32 system_get_rtc_time(void);
+uint32 system_rtc_clock_cali_proc(void);
+
+void system_upgrade_flag_set(uint8 flag);
+uint8 system_upgrade_flag_check(void);
+
+void system_soft_wdt_feed(void);
+void system_restart(void);
+
+bool system_os_task(os_task_t task, uint8 prio, os_event_t *queue, uint8 qlen);
+bool system_os_post(uint8 prio, os_signal_t sig, os_param_t par);
+
+#endif
@@ -39,6 +39,7 @@
 #include "../app/user_config.h"
 #include "mqtt.h"
 #include "queue.h"
+#include "utils.h"
 
 #define MQTT_TASK_PRIO            2
 #define MQTT_TASK_QUEUE_SIZE      1
@@ -52,6 +53,10 @@
 #define QUEUE_BUFFER_SIZE     2048
 #endif
 
+#ifndef MQTT_SEGMENT_SIZE
+#define MQTT_SEGMENT_SIZE     1460
+#endif
+
 unsigned char *default_certificate;
 unsigned int default_certificate_len = 0;
 unsigned char *default_private_key;
@@ -122,6 +127,102 @@ deliver_publish(MQTT_Client* client, uint8_t* message, int length)
 
 }
 
+/**
+  * @brief  Drop the oldest packet of the outbound queue
+  * @param  client: MQTT_Client reference
+  * @retval 0 if successfull, -1 if the queue is empty
+  */
+LOCAL int32_t ICACHE_FLASH_ATTR
+mqtt_queue_drop(MQTT_Client* client)
+{
+  client->queueSending = FALSE;
+  return QUEUE_Drop(&client->msgQueue);
+}
+
+/**
+  * @brief  Reserve room in the outbound queue and point the encoders at it, the packet is built in place
+  * @param  client: MQTT_Client reference
+  * @param  length: longest packet the encoder may build
+  * @param  evict: drop the oldest packets until there is room
+  * @retval TRUE if there is room
+  */
+LOCAL BOOL ICACHE_FLASH_ATTR
+mqtt_queue_reserve(MQTT_Client* client, int length, BOOL evict)
+{
+  uint8_t* buffer;
+
+  if (length > MQTT_BUF_SIZE)
+    return FALSE;
+
+  while ((buffer = QUEUE_Reserve(&client->msgQueue, length)) == NULL) {
+    MQTT_INFO("MQTT: Queue full\r\n");
+    if (!evict)
+      return FALSE;
+    // the oldest packet stays until the stack is done sending it from the queue
+    if (client->queueSending && client->sendTimeout != 0)
+      return FALSE;
+    if (mqtt_queue_drop(client) == -1) {
+      MQTT_INFO("MQTT: Serious buffer error\r\n");
+      return FALSE;
+    }
+  }
+
+  mqtt_msg_set_buffer(&client->mqtt_state.mqtt_connection, buffer, length);
+  return TRUE;
+}
+
+/**
+  * @brief  Add the packet built in the room of mqtt_queue_reserve to the outbound queue
+  * @param  client: MQTT_Client reference
+  * @retval TRUE if the packet was built and queued
+  */
+LOCAL BOOL ICACHE_FLASH_ATTR
+mqtt_queue_commit(MQTT_Client* client)
+{
+  mqtt_message_t* message = client->mqtt_state.outbound_message;
+  BOOL result = FALSE;
+
+  if (message->length != 0 && QUEUE_Commit(&client->msgQueue, message->data, message->length) != -1)
+    result = TRUE;
+
+  // the packets sent directly, connect and keepalive, are built in the output buffer
+  mqtt_msg_set_buffer(&client->mqtt_state.mqtt_connection, client->mqtt_state.out_buffer, client->mqtt_state.out_buffer_length);
+  return result;
+}
+
+/**
+  * @brief  Copy as many of the oldest queued packets as fit into the segment buffer, back to back. They leave the
+  *         queue. The pending type and id are those of the last one, the publishes are counted for publishedCb.
+  * @param  client: MQTT_Client reference
+  * @param  length: bytes copied
+  * @retval packets copied
+  */
+LOCAL int ICACHE_FLASH_ATTR
+mqtt_queue_gather(MQTT_Client* client, uint16_t* length)
+{
+  uint8_t* data;
+  uint16_t dataLen;
+  int count = 0;
+
+  *length = 0;
+  client->mqtt_state.pending_publishes = 0;
+
+  while ((data = QUEUE_Front(&client->msgQueue, &dataLen)) != NULL
+         && *length + dataLen <= client->mqtt_state.segment_buffer_length) {
+    os_memcpy(client->mqtt_state.segment_buffer + *length, data, dataLen);
+    client->mqtt_state.pending_msg_type = mqtt_get_type(data);
+    client->mqtt_state.pending_msg_id = mqtt_get_id(data, dataLen);
+    if (client->mqtt_state.pending_msg_type == MQTT_MSG_TYPE_PUBLISH)
+      client->mqtt_state.pending_publishes++;
+
+    *length += dataLen;
+    count++;
+    mqtt_queue_drop(client);
+  }
+
+  return count;
+}
+
 void ICACHE_FLASH_ATTR
 mqtt_send_keepalive(MQTT_Client *client)
 {
@@ -130,6 +231,7 @@ mqtt_send_keepalive(MQTT_Client *client)
   client->mqtt_state.pending_msg_type = MQTT_MSG_TYPE_PINGREQ;
   client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.outbound_message->data);
   client->mqtt_state.pending_msg_id = mqtt_get_id(client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length);
+  client->mqtt_state.pending_publishes = 0;
 
 
   client->sendTimeout = MQTT_SEND_TIMOUT;
@@ -217,6 +319,11 @@ mqtt_client_delete(MQTT_Client *mqttClient)
     mqttClient->mqtt_state.out_buffer = NULL;
   }
 
+  if (mqttClient->mqtt_state.segment_buffer != NULL) {
+    os_free(mqttClient->mqtt_state.segment_buffer);
+    mqttClient->mqtt_state.segment_buffer = NULL;
+  }
+
   if (mqttClient->mqtt_state.outbound_message != NULL) {
     if (mqttClient->mqtt_state.outbound_message->data != NULL)
     {
@@ -372,14 +479,14 @@ READPACKET:
               MQTT_INFO("MQTT: UnSubscribe successful\r\n");
             break;
           case MQTT_MSG_TYPE_PUBLISH:
-            if (msg_qos == 1)
-              client->mqtt_state.outbound_message = mqtt_msg_puback(&client->mqtt_state.mqtt_connection, msg_id);
-            else if (msg_qos == 2)
-              client->mqtt_state.outbound_message = mqtt_msg_pubrec(&client->mqtt_state.mqtt_connection, msg_id);
             if (msg_qos == 1 || msg_qos == 2) {
               MQTT_INFO("MQTT: Queue response QoS: %d\r\n", msg_qos);
-              if (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-                MQTT_INFO("MQTT: Queue full\r\n");
+              if (mqtt_queue_reserve(client, MQTT_MSG_ACK_LENGTH, FALSE)) {
+                if (msg_qos == 1)
+                  client->mqtt_state.outbound_message = mqtt_msg_puback(&client->mqtt_state.mqtt_connection, msg_id);
+                else
+                  client->mqtt_state.outbound_message = mqtt_msg_pubrec(&client->mqtt_state.mqtt_connection, msg_id);
+                mqtt_queue_commit(client);
               }
             }
 
@@ -392,15 +499,15 @@ READPACKET:
 
             break;
           case MQTT_MSG_TYPE_PUBREC:
-            client->mqtt_state.outbound_message = mqtt_msg_pubrel(&client->mqtt_state.mqtt_connection, msg_id);
-            if (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-              MQTT_INFO("MQTT: Queue full\r\n");
+            if (mqtt_queue_reserve(client, MQTT_MSG_ACK_LENGTH, FALSE)) {
+              client->mqtt_state.outbound_message = mqtt_msg_pubrel(&client->mqtt_state.mqtt_connection, msg_id);
+              mqtt_queue_commit(client);
             }
             break;
           case MQTT_MSG_TYPE_PUBREL:
-            client->mqtt_state.outbound_message = mqtt_msg_pubcomp(&client->mqtt_state.mqtt_connection, msg_id);
-            if (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-              MQTT_INFO("MQTT: Queue full\r\n");
+            if (mqtt_queue_reserve(client, MQTT_MSG_ACK_LENGTH, FALSE)) {
+              client->mqtt_state.outbound_message = mqtt_msg_pubcomp(&client->mqtt_state.mqtt_connection, msg_id);
+              mqtt_queue_commit(client);
             }
             break;
           case MQTT_MSG_TYPE_PUBCOMP:
@@ -409,9 +516,9 @@ READPACKET:
             }
             break;
           case MQTT_MSG_TYPE_PINGREQ:
-            client->mqtt_state.outbound_message = mqtt_msg_pingresp(&client->mqtt_state.mqtt_connection);
-            if (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-              MQTT_INFO("MQTT: Queue full\r\n");
+            if (mqtt_queue_reserve(client, MQTT_MSG_ACK_LENGTH, FALSE)) {
+              client->mqtt_state.outbound_message = mqtt_msg_pingresp(&client->mqtt_state.mqtt_connection);
+              mqtt_queue_commit(client);
             }
             break;
           case MQTT_MSG_TYPE_PINGRESP:
@@ -459,10 +566,12 @@ mqtt_tcpclient_sent_cb(void *arg)
   client->sendTimeout = 0;
   client->keepAliveTick = 0;
 
-  if ((client->connState == MQTT_DATA || client->connState == MQTT_KEEPALIVE_SEND)
-      && client->mqtt_state.pending_msg_type == MQTT_MSG_TYPE_PUBLISH) {
-    if (client->publishedCb)
-      client->publishedCb((uint32_t*)client);
+  // once per publish of the segment, a coalesced one may hold several
+  if (client->connState == MQTT_DATA || client->connState == MQTT_KEEPALIVE_SEND) {
+    for (; client->mqtt_state.pending_publishes > 0; client->mqtt_state.pending_publishes--) {
+      if (client->publishedCb)
+        client->publishedCb((uint32_t*)client);
+    }
   }
   system_os_post(MQTT_TASK_PRIO, 0, (os_param_t)client);
 }
@@ -536,6 +645,7 @@ mqtt_tcpclient_connect_cb(void *arg)
   client->mqtt_state.outbound_message = mqtt_msg_connect(&client->mqtt_state.mqtt_connection, client->mqtt_state.connect_info);
   client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.outbound_message->data);
   client->mqtt_state.pending_msg_id = mqtt_get_id(client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length);
+  client->mqtt_state.pending_publishes = 0;
 
 
   client->sendTimeout = MQTT_SEND_TIMOUT;
@@ -588,24 +698,21 @@ mqtt_tcpclient_recon_cb(void *arg, sint8 errType)
 BOOL ICACHE_FLASH_ATTR
 MQTT_Publish(MQTT_Client *client, const char* topic, const char* data, int data_length, int qos, int retain)
 {
-  uint8_t dataBuffer[MQTT_BUF_SIZE];
-  uint16_t dataLen;
+  int topic_length = (topic != NULL) ? os_strlen(topic) : 0;
+
+  if (!mqtt_queue_reserve(client, MQTT_MSG_PUBLISH_LENGTH(topic_length, data_length), TRUE)) {
+    MQTT_INFO("MQTT: Queuing publish failed\r\n");
+    return FALSE;
+  }
   client->mqtt_state.outbound_message = mqtt_msg_publish(&client->mqtt_state.mqtt_connection,
                                         topic, data, data_length,
                                         qos, retain,
                                         &client->mqtt_state.pending_msg_id);
-  if (client->mqtt_state.outbound_message->length == 0) {
+  if (!mqtt_queue_commit(client)) {
     MQTT_INFO("MQTT: Queuing publish failed\r\n");
     return FALSE;
   }
-  MQTT_INFO("MQTT: queuing publish, length: %d, queue size(%d/%d)\r\n", client->mqtt_state.outbound_message->length, client->msgQueue.rb.fill_cnt, client->msgQueue.rb.size);
-  while (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-    MQTT_INFO("MQTT: Queue full\r\n");
-    if (QUEUE_Gets(&client->msgQueue, dataBuffer, &dataLen, MQTT_BUF_SIZE) == -1) {
-      MQTT_INFO("MQTT: Serious buffer error\r\n");
-      return FALSE;
-    }
-  }
+  MQTT_INFO("MQTT: queuing publish, length: %d, queue size(%d/%d)\r\n", client->mqtt_state.outbound_message->length, client->msgQueue.fill, client->msgQueue.size);
   system_os_post(MQTT_TASK_PRIO, 0, (os_param_t)client);
   return TRUE;
 }
@@ -620,20 +727,14 @@ MQTT_Publish(MQTT_Client *client, const char* topic, const char* data, int data_
 BOOL ICACHE_FLASH_ATTR
 MQTT_Subscribe(MQTT_Client *client, char* topic, uint8_t qos)
 {
-  uint8_t dataBuffer[MQTT_BUF_SIZE];
-  uint16_t dataLen;
-
+  if (!mqtt_queue_reserve(client, MQTT_MSG_SUBSCRIBE_LENGTH((topic != NULL) ? os_strlen(topic) : 0), TRUE))
+    return FALSE;
   client->mqtt_state.outbound_message = mqtt_msg_subscribe(&client->mqtt_state.mqtt_connection,
                                         topic, qos,
                                         &client->mqtt_state.pending_msg_id);
   MQTT_INFO("MQTT: queue subscribe, topic\"%s\", id: %d\r\n", topic, client->mqtt_state.pending_msg_id);
-  while (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-    MQTT_INFO("MQTT: Queue full\r\n");
-    if (QUEUE_Gets(&client->msgQueue, dataBuffer, &dataLen, MQTT_BUF_SIZE) == -1) {
-      MQTT_INFO("MQTT: Serious buffer error\r\n");
-      return FALSE;
-    }
-  }
+  if (!mqtt_queue_commit(client))
+    return FALSE;
   system_os_post(MQTT_TASK_PRIO, 0, (os_param_t)client);
 
   return TRUE;
@@ -648,19 +749,14 @@ MQTT_Subscribe(MQTT_Client *client, char* topic, uint8_t qos)
 BOOL ICACHE_FLASH_ATTR
 MQTT_UnSubscribe(MQTT_Client *client, char* topic)
 {
-  uint8_t dataBuffer[MQTT_BUF_SIZE];
-  uint16_t dataLen;
+  if (!mqtt_queue_reserve(client, MQTT_MSG_SUBSCRIBE_LENGTH((topic != NULL) ? os_strlen(topic) : 0), TRUE))
+    return FALSE;
   client->mqtt_state.outbound_message = mqtt_msg_unsubscribe(&client->mqtt_state.mqtt_connection,
                                         topic,
                                         &client->mqtt_state.pending_msg_id);
   MQTT_INFO("MQTT: queue un-subscribe, topic\"%s\", id: %d\r\n", topic, client->mqtt_state.pending_msg_id);
-  while (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-    MQTT_INFO("MQTT: Queue full\r\n");
-    if (QUEUE_Gets(&client->msgQueue, dataBuffer, &dataLen, MQTT_BUF_SIZE) == -1) {
-      MQTT_INFO("MQTT: Serious buffer error\r\n");
-      return FALSE;
-    }
-  }
+  if (!mqtt_queue_commit(client))
+    return FALSE;
   system_os_post(MQTT_TASK_PRIO, 0, (os_param_t)client);
   return TRUE;
 }
@@ -673,21 +769,16 @@ MQTT_UnSubscribe(MQTT_Client *client, char* topic)
 BOOL ICACHE_FLASH_ATTR
 MQTT_Ping(MQTT_Client *client)
 {
-  uint8_t dataBuffer[MQTT_BUF_SIZE];
-  uint16_t dataLen;
-  client->mqtt_state.outbound_message = mqtt_msg_pingreq(&client->mqtt_state.mqtt_connection);
-  if (client->mqtt_state.outbound_message->length == 0) {
+  if (!mqtt_queue_reserve(client, MQTT_MSG_ACK_LENGTH, TRUE)) {
     MQTT_INFO("MQTT: Queuing publish failed\r\n");
     return FALSE;
   }
-  MQTT_INFO("MQTT: queuing publish, length: %d, queue size(%d/%d)\r\n", client->mqtt_state.outbound_message->length, client->msgQueue.rb.fill_cnt, client->msgQueue.rb.size);
-  while (QUEUE_Puts(&client->msgQueue, client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == -1) {
-    MQTT_INFO("MQTT: Queue full\r\n");
-    if (QUEUE_Gets(&client->msgQueue, dataBuffer, &dataLen, MQTT_BUF_SIZE) == -1) {
-      MQTT_INFO("MQTT: Serious buffer error\r\n");
-      return FALSE;
-    }
+  client->mqtt_state.outbound_message = mqtt_msg_pingreq(&client->mqtt_state.mqtt_connection);
+  if (!mqtt_queue_commit(client)) {
+    MQTT_INFO("MQTT: Queuing publish failed\r\n");
+    return FALSE;
   }
+  MQTT_INFO("MQTT: queuing publish, length: %d, queue size(%d/%d)\r\n", client->mqtt_state.outbound_message->length, client->msgQueue.fill, client->msgQueue.size);
   system_os_post(MQTT_TASK_PRIO, 0, (os_param_t)client);
   return TRUE;
 }
@@ -696,8 +787,9 @@ void ICACHE_FLASH_ATTR
 MQTT_Task(os_event_t *e)
 {
   MQTT_Client* client = (MQTT_Client*)e->par;
-  uint8_t dataBuffer[MQTT_BUF_SIZE];
+  uint8_t* data;
   uint16_t dataLen;
+  int count;
   if (e->par == 0)
     return;
   switch (client->connState) {
@@ -736,25 +828,44 @@ MQTT_Task(os_event_t *e)
       mqtt_send_keepalive(client);
       break;
     case MQTT_DATA:
-      if (QUEUE_IsEmpty(&client->msgQueue) || client->sendTimeout != 0) {
+      if (client->sendTimeout != 0) {
         break;
       }
-      if (QUEUE_Gets(&client->msgQueue, dataBuffer, &dataLen, MQTT_BUF_SIZE) == 0) {
-        client->mqtt_state.pending_msg_type = mqtt_get_type(dataBuffer);
-        client->mqtt_state.pending_msg_id = mqtt_get_id(dataBuffer, dataLen);
-
+      // the packet sent from the queue last time is done with, sent or timed out
+      if (client->queueSending)
+        mqtt_queue_drop(client);
+      // several packets waiting share a segment, a single one is sent from the queue
+      count = 0;
+      if (client->msgQueue.records > 1 && (count = mqtt_queue_gather(client, &dataLen)) > 0) {
+        data = client->mqtt_state.segment_buffer;
+      }
+      else if ((data = QUEUE_Front(&client->msgQueue, &dataLen)) != NULL) {
+        client->mqtt_state.pending_msg_type = mqtt_get_type(data);
+        client->mqtt_state.pending_msg_id = mqtt_get_id(data, dataLen);
+        client->mqtt_state.pending_publishes = (client->mqtt_state.pending_msg_type == MQTT_MSG_TYPE_PUBLISH) ? 1 : 0;
+
+        // sent from where it was built, it stays in the queue until the stack is done with it
+        client->queueSending = TRUE;
+        count = 1;
+      }
+      if (count > 0) {
+        client->sentSegments++;
+        client->sentPackets += count;
 
         client->sendTimeout = MQTT_SEND_TIMOUT;
-        MQTT_INFO("MQTT: Sending, type: %d, id: %04X\r\n", client->mqtt_state.pending_msg_type, client->mqtt_state.pending_msg_id);
+        MQTT_INFO("MQTT: Sending %d packet(s), %d bytes, %d.%02d packets per segment, last type: %d, id: %04X\r\n",
+                  count, dataLen, client->sentPackets / client->sentSegments,
+                  (client->sentPackets * 100 / client->sentSegments) % 100,
+                  client->mqtt_state.pending_msg_type, client->mqtt_state.pending_msg_id);
         if (client->security) {
 #ifdef MQTT_SSL_ENABLE
-          espconn_secure_send(client->pCon, dataBuffer, dataLen);
+          espconn_secure_send(client->pCon, data, dataLen);
 #else
           MQTT_INFO("TCP: Do not support SSL\r\n");
 #endif
         }
         else {
-          espconn_send(client->pCon, dataBuffer, dataLen);
+          espconn_send(client->pCon, data, dataLen);
         }
 
         client->mqtt_state.outbound_message = NULL;
@@ -856,6 +967,8 @@ MQTT_InitClient(MQTT_Client *mqttClient, uint8_t* client_id, uint8_t* client_use
   mqttClient->mqtt_state.in_buffer_length = MQTT_BUF_SIZE;
   mqttClient->mqtt_state.out_buffer =  (uint8_t *)os_zalloc(MQTT_BUF_SIZE);
   mqttClient->mqtt_state.out_buffer_length = MQTT_BUF_SIZE;
+  mqttClient->mqtt_state.segment_buffer = (uint8_t *)os_zalloc(MQTT_SEGMENT_SIZE);
+  mqttClient->mqtt_state.segment_buffer_length = (mqttClient->mqtt_state.segment_buffer != NULL) ? MQTT_SEGMENT_SIZE : 0;
   mqttClient->mqtt_state.connect_info = &mqttClient->connect_info;
 
   mqtt_msg_init(&mqttClient->mqtt_state.mqtt_connection, mqttClient->mqtt_state.out_buffer, mqttClient->mqtt_state.out_buffer_length);
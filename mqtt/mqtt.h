@@ -51,14 +51,17 @@ typedef struct mqtt_state_t
   mqtt_connect_info_t* connect_info;
   uint8_t* in_buffer;
   uint8_t* out_buffer;
+  uint8_t* segment_buffer;
   int in_buffer_length;
   int out_buffer_length;
+  int segment_buffer_length;
   uint16_t message_length;
   uint16_t message_length_read;
   mqtt_message_t* outbound_message;
   mqtt_connection_t mqtt_connection;
   uint16_t pending_msg_id;
   int pending_msg_type;
+  int pending_publishes;
   int pending_publish_qos;
 } mqtt_state_t;
 
@@ -110,6 +113,9 @@ typedef struct  {
   uint32_t sendTimeout;
   tConnState connState;
   QUEUE msgQueue;
+  BOOL queueSending;
+  uint32_t sentSegments;
+  uint32_t sentPackets;
   void* user_data;
 } MQTT_Client;
 
@@ -32,7 +32,6 @@
 #include <string.h>
 #include "mqtt_msg.h"
 #include "../app/user_config.h"
-#define MQTT_MAX_FIXED_HEADER_SIZE 3
 
 enum mqtt_connect_flag
 {
@@ -132,6 +131,12 @@ void ICACHE_FLASH_ATTR mqtt_msg_init(mqtt_connection_t* connection, uint8_t* buf
   connection->buffer_length = buffer_length;
 }
 
+void ICACHE_FLASH_ATTR mqtt_msg_set_buffer(mqtt_connection_t* connection, uint8_t* buffer, uint16_t buffer_length)
+{
+  connection->buffer = buffer;
+  connection->buffer_length = buffer_length;
+}
+
 int ICACHE_FLASH_ATTR mqtt_get_total_length(uint8_t* buffer, uint16_t length)
 {
   int i;
@@ -47,6 +47,14 @@ extern "C" {
 /*|      --- Message Type----     |  DUP Flag |    QoS Level    | Retain  |
 /*                    Remaining Length                 */
 
+/* The encoders leave room for the longest fixed header, a packet with a short remaining length starts 1 byte
+   into the buffer */
+#define MQTT_MAX_FIXED_HEADER_SIZE 3
+
+/* Buffer an encoder needs for a packet, at most */
+#define MQTT_MSG_PUBLISH_LENGTH(topic_length, data_length) (MQTT_MAX_FIXED_HEADER_SIZE + 2 + (topic_length) + 2 + (data_length))
+#define MQTT_MSG_SUBSCRIBE_LENGTH(topic_length) (MQTT_MAX_FIXED_HEADER_SIZE + 2 + 2 + (topic_length) + 1)
+#define MQTT_MSG_ACK_LENGTH (MQTT_MAX_FIXED_HEADER_SIZE + 2)
 
 enum mqtt_message_type
 {
@@ -115,6 +123,7 @@ static inline int ICACHE_FLASH_ATTR mqtt_get_qos(uint8_t* buffer) { return (buff
 static inline int ICACHE_FLASH_ATTR mqtt_get_retain(uint8_t* buffer) { return (buffer[0] & 0x01); }
 
 void ICACHE_FLASH_ATTR mqtt_msg_init(mqtt_connection_t* connection, uint8_t* buffer, uint16_t buffer_length);
+void ICACHE_FLASH_ATTR mqtt_msg_set_buffer(mqtt_connection_t* connection, uint8_t* buffer, uint16_t buffer_length);
 int ICACHE_FLASH_ATTR mqtt_get_total_length(uint8_t* buffer, uint16_t length);
 const char* ICACHE_FLASH_ATTR mqtt_get_publish_topic(uint8_t* buffer, uint16_t* length);
 const char* ICACHE_FLASH_ATTR mqtt_get_publish_data(uint8_t* buffer, uint16_t* length);
@@ -33,25 +33,210 @@
 #include "osapi.h"
 #include "os_type.h"
 #include "mem.h"
-#include "proto.h"
+
+static uint16_t ICACHE_FLASH_ATTR QUEUE_RecordLength(uint8_t* record);
+static int32_t ICACHE_FLASH_ATTR QUEUE_RecordOffset(uint8_t* record);
+
 void ICACHE_FLASH_ATTR QUEUE_Init(QUEUE *queue, int bufferSize)
 {
   queue->buf = (uint8_t*)os_zalloc(bufferSize);
-  RINGBUF_Init(&queue->rb, queue->buf, bufferSize);
+  queue->size = (queue->buf != NULL) ? bufferSize : 0;
+  queue->head = 0;
+  queue->fill = 0;
+  queue->records = 0;
+  queue->reserved = -1;
+  queue->reservedLen = 0;
+}
+
+/**
+* \brief reserve room for a record in one piece, to build it in place and add it with QUEUE_Commit.
+*        The queue is unchanged until then, a reservation not committed is simply forgotten.
+* \param maxLen longest record that may be committed, including the bytes skipped in front of it
+* \return where to build the record, NULL if there is not enough room
+*/
+uint8_t* ICACHE_FLASH_ATTR QUEUE_Reserve(QUEUE *queue, uint16_t maxLen)
+{
+  int32_t needed = maxLen + QUEUE_RECORD_HEADER;
+  int32_t tail;
+
+  queue->reserved = -1;
+
+  if (maxLen > QUEUE_MAX_RECORD)
+    return NULL;
+
+  /* an empty queue starts over, the whole buffer is in one piece */
+  if (queue->fill <= 0)
+    queue->head = 0;
+
+  tail = queue->head + queue->fill;
+
+  if (tail < queue->size) {
+    /* free from the tail to the end of the buffer, then from the start to the head */
+    if (queue->size - tail >= needed)
+      queue->reserved = tail;
+    else if (queue->head >= needed)
+      queue->reserved = 0;
+  }
+  else if (queue->head - (tail - queue->size) >= needed) {
+    queue->reserved = tail - queue->size;
+  }
+
+  if (queue->reserved < 0)
+    return NULL;
+
+  queue->reservedLen = maxLen;
+
+  return queue->buf + queue->reserved + QUEUE_RECORD_HEADER;
 }
+
+/**
+* \brief add the record built in the room of QUEUE_Reserve
+* \param data start of the record, up to QUEUE_MAX_OFFSET bytes into the room
+* \return bytes used, -1 if nothing is reserved or the record is outside the room
+*/
+int32_t ICACHE_FLASH_ATTR QUEUE_Commit(QUEUE *queue, uint8_t* data, uint16_t len)
+{
+  uint8_t* record;
+  int32_t offset;
+  int32_t tail;
+
+  if (queue->reserved < 0)
+    return -1;
+
+  record = queue->buf + queue->reserved;
+  offset = data - (record + QUEUE_RECORD_HEADER);
+  queue->reserved = -1;
+
+  if (offset < 0 || offset > QUEUE_MAX_OFFSET || offset + len > queue->reservedLen)
+    return -1;
+
+  /* a record that did not fit before the end of the buffer went to the start, the end is left unused */
+  tail = (queue->head + queue->fill) % queue->size;
+  if (record != queue->buf + tail) {
+    if (queue->size - tail >= QUEUE_RECORD_HEADER) {
+      queue->buf[tail] = QUEUE_RECORD_WRAP & 0xFF;
+      queue->buf[tail + 1] = QUEUE_RECORD_WRAP >> 8;
+    }
+    queue->fill += queue->size - tail;
+  }
+
+  record[0] = len & 0xFF;
+  record[1] = (len >> 8) | (offset << (QUEUE_RECORD_OFFSET_SHIFT - 8));
+
+  queue->fill += QUEUE_RECORD_HEADER + offset + len;
+  queue->records++;
+
+  return QUEUE_RECORD_HEADER + offset + len;
+}
+
+/**
+* \brief the oldest record where it is in the queue, valid until it is dropped
+* \return NULL if the queue is empty
+*/
+uint8_t* ICACHE_FLASH_ATTR QUEUE_Front(QUEUE *queue, uint16_t* len)
+{
+  uint8_t* record;
+
+  if (queue->fill <= 0)
+    return NULL;
+
+  record = queue->buf + queue->head;
+  *len = QUEUE_RecordLength(record);
+
+  return record + QUEUE_RECORD_HEADER + QUEUE_RecordOffset(record);
+}
+
+/**
+* \brief add a record, all of it or nothing
+* \return bytes used, -1 if there is not enough room
+*/
 int32_t ICACHE_FLASH_ATTR QUEUE_Puts(QUEUE *queue, uint8_t* buffer, uint16_t len)
 {
-  return PROTO_AddRb(&queue->rb, buffer, len);
+  uint8_t* data = QUEUE_Reserve(queue, len);
+
+  if (data == NULL)
+    return -1;
+
+  os_memcpy(data, buffer, len);
+
+  return QUEUE_Commit(queue, data, len);
 }
+
+/**
+* \brief take the oldest record out, see QUEUE_Peek
+*/
 int32_t ICACHE_FLASH_ATTR QUEUE_Gets(QUEUE *queue, uint8_t* buffer, uint16_t* len, uint16_t maxLen)
 {
+  if (QUEUE_Peek(queue, buffer, len, maxLen) == -1)
+    return -1;
+
+  return QUEUE_Drop(queue);
+}
+
+/**
+* \brief copy the oldest record and leave it in the queue, one longer than maxLen is cut to maxLen
+* \return 0 if successfull, -1 if the queue is empty
+*/
+int32_t ICACHE_FLASH_ATTR QUEUE_Peek(QUEUE *queue, uint8_t* buffer, uint16_t* len, uint16_t maxLen)
+{
+  uint8_t* data;
+  uint16_t recordLen;
+
+  data = QUEUE_Front(queue, &recordLen);
+  if (data == NULL)
+    return -1;
+
+  *len = (recordLen < maxLen) ? recordLen : maxLen;
+  os_memcpy(buffer, data, *len);
+
+  return 0;
+}
+
+/**
+* \brief remove the oldest record without copying it
+* \return 0 if successfull, -1 if the queue is empty
+*/
+int32_t ICACHE_FLASH_ATTR QUEUE_Drop(QUEUE *queue)
+{
+  uint8_t* record;
+  int32_t recordSize;
+
+  if (queue->fill <= 0)
+    return -1;
+
+  record = queue->buf + queue->head;
+  recordSize = QUEUE_RECORD_HEADER + QUEUE_RecordOffset(record) + QUEUE_RecordLength(record);
+
+  queue->head += recordSize;
+  queue->fill -= recordSize;
+  queue->records--;
 
-  return PROTO_ParseRb(&queue->rb, buffer, len, maxLen);
+  /* skip the unused end of the buffer, the next record is at the start */
+  if (queue->fill > 0 && (queue->size - queue->head < QUEUE_RECORD_HEADER
+      || (queue->buf[queue->head] | (queue->buf[queue->head + 1] << 8)) == QUEUE_RECORD_WRAP)) {
+    queue->fill -= queue->size - queue->head;
+    queue->head = 0;
+  }
+  else if (queue->head >= queue->size) {
+    queue->head = 0;
+  }
+
+  return 0;
 }
 
 BOOL ICACHE_FLASH_ATTR QUEUE_IsEmpty(QUEUE *queue)
 {
-  if (queue->rb.fill_cnt <= 0)
+  if (queue->fill <= 0)
     return TRUE;
   return FALSE;
 }
+
+static uint16_t ICACHE_FLASH_ATTR QUEUE_RecordLength(uint8_t* record)
+{
+  return (record[0] | (record[1] << 8)) & QUEUE_RECORD_LENGTH_MASK;
+}
+
+static int32_t ICACHE_FLASH_ATTR QUEUE_RecordOffset(uint8_t* record)
+{
+  return record[1] >> (QUEUE_RECORD_OFFSET_SHIFT - 8);
+}
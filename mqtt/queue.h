@@ -31,14 +31,36 @@
 #ifndef USER_QUEUE_H_
 #define USER_QUEUE_H_
 #include "os_type.h"
-#include "ringbuf.h"
+
+/* Bytes in front of each record: its length in the low 12 bits and, in the high 4 bits, the bytes
+   skipped between the header and the packet (little endian) */
+#define QUEUE_RECORD_HEADER 2
+#define QUEUE_RECORD_LENGTH_MASK 0x0FFF
+#define QUEUE_RECORD_OFFSET_SHIFT 12
+#define QUEUE_MAX_OFFSET 15
+#define QUEUE_MAX_RECORD 0x0FFE
+
+/* Header of the unused end of the buffer, the next record is at the start */
+#define QUEUE_RECORD_WRAP 0xFFFF
+
+/* Each record is in one piece, so a packet can be built in place and sent from the queue */
 typedef struct {
   uint8_t *buf;
-  RINGBUF rb;
+  int32_t size;       /**< Buffer size */
+  int32_t head;       /**< Offset of the oldest record */
+  int32_t fill;       /**< Bytes in use, records, their headers and the unused end of the buffer */
+  int32_t records;    /**< Records in the queue */
+  int32_t reserved;   /**< Offset of the record reserved by QUEUE_Reserve, -1 if none */
+  int32_t reservedLen;
 } QUEUE;
 
 void ICACHE_FLASH_ATTR QUEUE_Init(QUEUE *queue, int bufferSize);
+uint8_t* ICACHE_FLASH_ATTR QUEUE_Reserve(QUEUE *queue, uint16_t maxLen);
+int32_t ICACHE_FLASH_ATTR QUEUE_Commit(QUEUE *queue, uint8_t* data, uint16_t len);
+uint8_t* ICACHE_FLASH_ATTR QUEUE_Front(QUEUE *queue, uint16_t* len);
 int32_t ICACHE_FLASH_ATTR QUEUE_Puts(QUEUE *queue, uint8_t* buffer, uint16_t len);
 int32_t ICACHE_FLASH_ATTR QUEUE_Gets(QUEUE *queue, uint8_t* buffer, uint16_t* len, uint16_t maxLen);
+int32_t ICACHE_FLASH_ATTR QUEUE_Peek(QUEUE *queue, uint8_t* buffer, uint16_t* len, uint16_t maxLen);
+int32_t ICACHE_FLASH_ATTR QUEUE_Drop(QUEUE *queue);
 BOOL ICACHE_FLASH_ATTR QUEUE_IsEmpty(QUEUE *queue);
 #endif /* USER_QUEUE_H_ */
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Pack firmware, certificates and configuration into an update bundle.
+
+The device writes every part into its standby region and switches all of
+them together with one boot configuration write when the bundle is activated,
+so an update never leaves new firmware with old certificates or the other way
+round. Layout (little endian), matching app/OTA_Bundle.h:
+
+    header  uint32 magic "ESPB", uint16 version, uint16 part count
+    parts   uint8 type, uint8 flags, uint16 reserved, uint32 length,
+            SHA256 of the data (32 bytes), then the data
+
+Part types are 0 firmware, 1 certificates, 2 configuration. A sparse
+firmware image (tools/sparse_image.py) is recognised by its magic and gets
+the sparse flag. Each part is optional, at least one is needed.
+
+    python3 tools/bundle.py bin/user_0.bundle --firmware bin/user_0.sparse \\
+        --certificates certs.der --configuration config.bin
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+BUNDLE_MAGIC = 0x42505345
+BUNDLE_VERSION = 1
+BUNDLE_FLAG_SPARSE = 0x01
+SPARSE_MAGIC = 0x53505345
+HEADER = struct.Struct("<IHH")
+PART = struct.Struct("<BBHI32s")
+
+# type, largest part the device takes (firmware is bounded by the ROM slot)
+PARTS = {
+    "firmware": (0, None),
+    "certificates": (1, 0x8000),
+    "configuration": (2, 0x1000),
+}
+
+
+def build_bundle(parts):
+    """parts is a list of (type, data), returns the bundle."""
+    body = []
+    for part_type, data in parts:
+        flags = BUNDLE_FLAG_SPARSE if part_type == 0 and data[:4] == struct.pack("<I", SPARSE_MAGIC) else 0
+        body.append(PART.pack(part_type, flags, 0, len(data), hashlib.sha256(data).digest()))
+        body.append(data)
+    return HEADER.pack(BUNDLE_MAGIC, BUNDLE_VERSION, len(parts)) + b"".join(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="bundle")
+    for name in PARTS:
+        parser.add_argument("--" + name, metavar="FILE", help="%s part" % name)
+    args = parser.parse_args()
+
+    parts = []
+    for name, (part_type, limit) in PARTS.items():
+        path = getattr(args, name)
+        if path is None:
+            continue
+        with open(path, "rb") as source:
+            data = source.read()
+        if limit is not None and len(data) > limit:
+            parser.error("%s is %d bytes, the region holds %d" % (name, len(data), limit))
+        parts.append((part_type, data))
+
+    if not parts:
+        parser.error("no parts given")
+
+    bundle = build_bundle(parts)
+
+    with open(args.output, "wb") as target:
+        target.write(bundle)
+
+    print("%s: %d parts, %d bytes" % (args.output, len(parts), len(bundle)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
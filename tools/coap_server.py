@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""Stand-in CoAP server for the OTA CoAP transport (app/OTA_CoAP.c).
+
+Serves the files of a directory with block-wise GET (RFC 7959). The server
+keeps no transfer state, every block is requested by the device, which also
+retransmits lost requests and responses. Latency and loss can be injected to
+try the transfer under cellular-like conditions:
+
+    python3 tools/coap_server.py bin --loss 0.1 --delay 300 --jitter 200
+
+Only what the device uses is implemented: confirmable GET with Uri-Path,
+Block2 and Size2, answered piggybacked, or with --separate as an empty ACK
+followed by a confirmable response.
+"""
+
+import argparse
+import os
+import random
+import socket
+import struct
+import sys
+import threading
+
+COAP_VERSION = 1
+CON, NON, ACK, RST = range(4)
+GET = 0x01
+CONTENT = 0x45
+NOT_FOUND = 0x84
+BAD_OPTION = 0x82
+URI_PATH = 11
+BLOCK2 = 23
+SIZE2 = 28
+
+
+def parse(message):
+    if len(message) < 4 or message[0] >> 6 != COAP_VERSION:
+        raise ValueError("not a CoAP message")
+    kind = (message[0] >> 4) & 3
+    token_length = message[0] & 0x0F
+    code = message[1]
+    message_id = struct.unpack(">H", message[2:4])[0]
+    token = message[4:4 + token_length]
+    position = 4 + token_length
+    options = []
+    number = 0
+    while position < len(message) and message[position] != 0xFF:
+        delta, length = message[position] >> 4, message[position] & 0x0F
+        position += 1
+        values = []
+        for nibble in (delta, length):
+            if nibble == 13:
+                nibble = 13 + message[position]
+                position += 1
+            elif nibble == 14:
+                nibble = 269 + struct.unpack(">H", message[position:position + 2])[0]
+                position += 2
+            elif nibble == 15:
+                raise ValueError("reserved option nibble")
+            values.append(nibble)
+        number += values[0]
+        options.append((number, message[position:position + values[1]]))
+        position += values[1]
+    return kind, code, message_id, token, options
+
+
+def uint(value):
+    return value.to_bytes((value.bit_length() + 7) // 8, "big")
+
+
+def encode_option(delta, value):
+    def nibble(n):
+        if n < 13:
+            return n, b""
+        if n < 269:
+            return 13, bytes([n - 13])
+        return 14, struct.pack(">H", n - 269)
+    delta_nibble, delta_extra = nibble(delta)
+    length_nibble, length_extra = nibble(len(value))
+    return bytes([delta_nibble << 4 | length_nibble]) + delta_extra + length_extra + value
+
+
+def build(kind, code, message_id, token, options=(), payload=b""):
+    message = bytearray([COAP_VERSION << 6 | kind << 4 | len(token), code]) + struct.pack(">H", message_id) + token
+    number = 0
+    for option, value in sorted(options):
+        message += encode_option(option - number, value)
+        number = option
+    if payload:
+        message += b"\xff" + payload
+    return bytes(message)
+
+
+class Server:
+    def __init__(self, args):
+        self.args = args
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.socket.bind((args.bind, args.port))
+        self.message_id = random.randrange(0x10000)
+        self.lock = threading.Lock()
+        self.sent = self.dropped = 0
+
+    def lost(self):
+        return random.random() < self.args.loss
+
+    def send(self, message, address):
+        """Send after the injected latency, unless the message is lost."""
+        if self.lost():
+            self.dropped += 1
+            return
+        delay = max(0.0, self.args.delay + random.uniform(-self.args.jitter, self.args.jitter)) / 1000
+        self.sent += 1
+        threading.Timer(delay, self.socket.sendto, (message, address)).start()
+
+    def next_message_id(self):
+        with self.lock:
+            self.message_id = (self.message_id + 1) & 0xFFFF
+            return self.message_id
+
+    def respond(self, options, token):
+        """Response code, options and payload of a GET."""
+        path = "/".join(value.decode() for number, value in options if number == URI_PATH)
+        file_name = os.path.realpath(os.path.join(self.args.root, path))
+        if not file_name.startswith(os.path.realpath(self.args.root) + os.sep) or not os.path.isfile(file_name):
+            return NOT_FOUND, [], b""
+
+        with open(file_name, "rb") as source:
+            data = source.read()
+
+        szx = self.args.max_szx
+        number = 0
+        for option, value in options:
+            if option == BLOCK2:
+                block = int.from_bytes(value, "big")
+                szx = min(szx, block & 7)
+                number = (block >> 4) * (16 << (block & 7)) // (16 << szx)
+        size = 16 << szx
+        start = number * size
+        if start > len(data) or (start == len(data) and start != 0):
+            return BAD_OPTION, [], b""
+        more = start + size < len(data)
+        response = [(BLOCK2, uint(number << 4 | more << 3 | szx))]
+        if any(option == SIZE2 for option, value in options) or number == 0:
+            response.append((SIZE2, uint(len(data))))
+        print("%s block %d (%d bytes)%s" % (path, number, size, "" if more else ", last"))
+        return CONTENT, response, data[start:start + size]
+
+    def serve(self):
+        print("Serving %s on udp %s:%d, loss %.0f%%, delay %d+-%d ms"
+              % (self.args.root, self.args.bind, self.args.port, self.args.loss * 100, self.args.delay,
+                 self.args.jitter))
+        while True:
+            message, address = self.socket.recvfrom(2048)
+            if self.lost():
+                self.dropped += 1
+                continue
+            try:
+                kind, code, message_id, token, options = parse(message)
+            except (ValueError, IndexError, struct.error):
+                continue
+            if kind != CON or code != GET:
+                continue
+            code, response, payload = self.respond(options, token)
+            if self.args.separate:
+                self.send(build(ACK, 0, message_id, b""), address)
+                self.send(build(CON, code, self.next_message_id(), token, response, payload), address)
+            else:
+                self.send(build(ACK, code, message_id, token, response, payload), address)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("root", help="directory holding the images")
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--max-szx", type=int, default=6, choices=range(7),
+                        help="largest block size exponent, blocks are 16 << SZX bytes (default 6)")
+    parser.add_argument("--loss", type=float, default=0.0, help="probability a datagram is lost, each way")
+    parser.add_argument("--delay", type=int, default=0, help="one way latency of the responses (in ms)")
+    parser.add_argument("--jitter", type=int, default=0, help="latency variation (in ms)")
+    parser.add_argument("--separate", action="store_true", help="acknowledge first, respond separately")
+    args = parser.parse_args()
+
+    try:
+        Server(args).serve()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Wrap an image into the hash tree image downloaded by the OTA manager.
+
+Every chunk of the image is verified on the device as it arrives, a corrupted
+chunk is downloaded again by range. Layout (little endian), matching
+app/OTA_HashTree.h:
+
+    header  uint32 magic "ESPT", uint16 version, uint16 reserved,
+            uint32 chunk size, uint32 payload length, tree root (32 bytes)
+    tree    pre-order, an inner node is its left and right child hashes,
+            a leaf is the chunk itself
+
+    leaf = SHA256(0x00 | chunk), node = SHA256(0x01 | left | right)
+
+A node over n chunks has the largest power of 2 below n in its left subtree.
+The image root SHA256(0x02 | header) is printed, publish it to the devices
+(MQTT 'root' command) so the header is checked as well.
+
+    python3 tools/hash_tree.py bin/user_0.sparse bin/user_0.sparse.tree
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+TREE_MAGIC = 0x54505345
+TREE_VERSION = 1
+TREE_MAX_CHUNK_SIZE = 4096
+TREE_MAX_DEPTH = 10
+HEADER = struct.Struct("<IHHII32s")
+
+
+def sha256(prefix, data):
+    return hashlib.sha256(bytes([prefix]) + data).digest()
+
+
+def split(count):
+    """Chunks in the left subtree of a node over count chunks."""
+    left = 1
+    while left << 1 < count:
+        left <<= 1
+    return left
+
+
+def tree_hash(chunks):
+    if len(chunks) == 1:
+        return sha256(0x00, chunks[0])
+    left = split(len(chunks))
+    return sha256(0x01, tree_hash(chunks[:left]) + tree_hash(chunks[left:]))
+
+
+def serialize(chunks, output):
+    """Pre-order tree, returns the subtree hash."""
+    if len(chunks) == 1:
+        output.append(chunks[0])
+        return sha256(0x00, chunks[0])
+    left = split(len(chunks))
+    record = len(output)
+    output.append(None)
+    left_hash = serialize(chunks[:left], output)
+    right_hash = serialize(chunks[left:], output)
+    output[record] = left_hash + right_hash
+    return sha256(0x01, left_hash + right_hash)
+
+
+def build_tree(payload, chunk_size):
+    chunks = [payload[offset:offset + chunk_size] for offset in range(0, len(payload), chunk_size)]
+    if len(chunks) > 1 << (TREE_MAX_DEPTH - 1):
+        raise ValueError("%d chunks, the device takes at most %d" % (len(chunks), 1 << (TREE_MAX_DEPTH - 1)))
+    body = []
+    root = serialize(chunks, body) if chunks else b"\0" * 32
+    header = HEADER.pack(TREE_MAGIC, TREE_VERSION, 0, chunk_size, len(payload), root)
+    return header + b"".join(body), sha256(0x02, header), len(chunks)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="image to wrap, .bin or .sparse")
+    parser.add_argument("output", help="hash tree image")
+    parser.add_argument("--chunk-size", type=int, default=TREE_MAX_CHUNK_SIZE,
+                        help="bytes per verified chunk (default %d)" % TREE_MAX_CHUNK_SIZE)
+    args = parser.parse_args()
+
+    if not 0 < args.chunk_size <= TREE_MAX_CHUNK_SIZE:
+        parser.error("--chunk-size must be between 1 and %d" % TREE_MAX_CHUNK_SIZE)
+
+    with open(args.input, "rb") as source:
+        payload = source.read()
+
+    try:
+        image, image_root, chunks = build_tree(payload, args.chunk_size)
+    except ValueError as error:
+        parser.error(str(error))
+
+    with open(args.output, "wb") as target:
+        target.write(image)
+
+    print("%s: %d chunks, %d bytes of tree, image root %s"
+          % (args.output, chunks, len(image) - len(payload), image_root.hex()))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
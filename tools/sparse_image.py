@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Convert a ROM image into the sparse image downloaded by the OTA manager.
+
+The sparse image lists the data extents of the ROM image, runs of 0xFF between
+them are holes that the device only erases. Layout (little endian), matching
+app/OTA_Sparse.h:
+
+    header  uint32 magic "ESPS", uint16 version, uint16 extent count,
+            uint32 image length, uint32 data length
+    extent  uint32 offset, uint32 length, followed by length bytes of data
+
+The input is either the .bin made by esptool2 (bin/user_0.bin) or the linked
+.elf (obj/user_0.elf), which is laid out the same way as esptool2 -boot2 does.
+
+    python3 tools/sparse_image.py obj/user_0.elf bin/user_0.sparse
+"""
+
+import argparse
+import struct
+import sys
+
+SPARSE_MAGIC = 0x53505345
+SPARSE_VERSION = 1
+HEADER = struct.Struct("<IHHII")
+EXTENT = struct.Struct("<II")
+
+ELF_MAGIC = b"\x7fELF"
+IROM_SECTION = ".irom0.text"
+RAM_SECTIONS = (".text", ".data", ".rodata")
+ROM_MAGIC_BOOT2 = 0xEA
+ROM_MAGIC = 0xE9
+CHECKSUM_SEED = 0xEF
+
+
+def read_sections(data):
+    """Return {name: (address, bytes)} of the sections of a 32 bit little endian ELF."""
+    shoff, = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+    headers = [struct.unpack_from("<IIIIII", data, shoff + i * shentsize) for i in range(shnum)]
+    strtab = headers[shstrndx][4]
+    sections = {}
+    for name, _, _, address, offset, size in headers:
+        end = data.index(b"\0", strtab + name)
+        sections[data[strtab + name:end].decode()] = (address, data[offset:offset + size])
+    return sections
+
+
+def pad(data, boundary, fill=b"\0"):
+    return data + fill * (-len(data) % boundary)
+
+
+def build_rom(elf, flash_mode, flash_size_freq):
+    """Lay out the ELF sections as the boot2 ROM image made by esptool2."""
+    sections = read_sections(elf)
+    entry, = struct.unpack_from("<I", elf, 0x18)
+
+    irom = pad(sections[IROM_SECTION][1], 4)
+    rom = struct.pack("<BBBBIII", ROM_MAGIC_BOOT2, 4, flash_mode, flash_size_freq, entry, 0, len(irom)) + irom
+
+    ram = [(sections[name][0], pad(sections[name][1], 4)) for name in RAM_SECTIONS if name in sections]
+    rom += struct.pack("<BBBBI", ROM_MAGIC, len(ram), flash_mode, flash_size_freq, entry)
+    checksum = CHECKSUM_SEED
+    for address, body in ram:
+        rom += struct.pack("<II", address, len(body)) + body
+        for byte in body:
+            checksum ^= byte
+
+    # checksum is the last byte of the 16 byte aligned image
+    rom += b"\0" * (15 - len(rom) % 16) + bytes([checksum])
+    return rom
+
+
+def find_extents(rom, min_hole):
+    """Word aligned data extents of rom, separated by 0xFF holes of at least min_hole bytes."""
+    extents = []
+    start = None
+    position = 0
+    while position < len(rom):
+        word = rom[position:position + 4]
+        if word == b"\xff" * len(word):
+            end = position
+            while end < len(rom) and rom[end:end + 4] == b"\xff" * len(rom[end:end + 4]):
+                end += 4
+            end = min(end, len(rom))
+            if end - position >= min_hole or end == len(rom):
+                if start is not None:
+                    extents.append((start, position - start))
+                    start = None
+                position = end
+                continue
+        if start is None:
+            start = position
+        position += 4
+    if start is not None:
+        extents.append((start, min(position, len(rom)) - start))
+    return extents
+
+
+def build_sparse(rom, min_hole):
+    extents = find_extents(rom, min_hole)
+    data_length = sum(length for _, length in extents)
+    sparse = HEADER.pack(SPARSE_MAGIC, SPARSE_VERSION, len(extents), len(rom), data_length)
+    for offset, length in extents:
+        sparse += EXTENT.pack(offset, length) + rom[offset:offset + length]
+    return sparse, extents
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="ROM image (.bin) or linked firmware (.elf)")
+    parser.add_argument("output", nargs="?", help="sparse image, only the statistics are printed if omitted")
+    parser.add_argument("--min-hole", type=int, default=64,
+                        help="shortest 0xFF run turned into a hole, in bytes (default 64)")
+    parser.add_argument("--pad-to", type=lambda value: int(value, 0), default=0,
+                        help="pad the image with 0xFF to this length first, e.g. the ROM slot size")
+    parser.add_argument("--flash-mode", type=int, default=0, help="esptool2 flash mode of an .elf input")
+    parser.add_argument("--flash-size-freq", type=int, default=0, help="esptool2 size/frequency byte of an .elf input")
+    args = parser.parse_args()
+
+    if args.min_hole < EXTENT.size or args.min_hole % 4:
+        parser.error("--min-hole must be a multiple of 4 and at least %d" % EXTENT.size)
+
+    with open(args.input, "rb") as source:
+        rom = source.read()
+    if rom.startswith(ELF_MAGIC):
+        rom = build_rom(rom, args.flash_mode, args.flash_size_freq)
+    if args.pad_to > len(rom):
+        rom += b"\xff" * (args.pad_to - len(rom))
+
+    sparse, extents = build_sparse(rom, args.min_hole)
+
+    if args.output:
+        with open(args.output, "wb") as target:
+            target.write(sparse)
+
+    saved = len(rom) - len(sparse)
+    print("%s: image %d bytes, sparse %d bytes in %d extents, %d bytes saved (%.1f%%)"
+          % (args.input, len(rom), len(sparse), len(extents), saved, 100.0 * saved / len(rom)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())